@@ -51,6 +51,27 @@ SFB::Audio::BufferList::BufferList(UInt32 channelsPerFrame, UInt32 bytesPerFrame
 		throw std::bad_alloc();
 }
 
+SFB::Audio::BufferList::BufferList(BufferList&& rhs)
+	: mBufferList(std::move(rhs.mBufferList)), mBytesPerFrame(rhs.mBytesPerFrame), mCapacityFrames(rhs.mCapacityFrames)
+{
+	rhs.mCapacityFrames = 0;
+	rhs.mBytesPerFrame = 0;
+}
+
+SFB::Audio::BufferList& SFB::Audio::BufferList::operator=(BufferList&& rhs)
+{
+	if(this != &rhs) {
+		mBufferList = std::move(rhs.mBufferList);
+		mCapacityFrames = rhs.mCapacityFrames;
+		mBytesPerFrame = rhs.mBytesPerFrame;
+
+		rhs.mCapacityFrames = 0;
+		rhs.mBytesPerFrame = 0;
+	}
+
+	return *this;
+}
+
 bool SFB::Audio::BufferList::Allocate(const AudioStreamBasicDescription& format, UInt32 capacityFrames)
 {
 	return Allocate(format.mChannelsPerFrame, format.mBytesPerFrame, !(kAudioFormatFlagIsNonInterleaved & format.mFormatFlags), capacityFrames);
@@ -79,6 +79,12 @@ namespace SFB {
 			BufferList& operator=(const BufferList& rhs) = delete;
 
 			/*! @endcond */
+
+			/*! @brief Create a new \c BufferList by taking ownership of the buffers of another */
+			BufferList(BufferList&& rhs);
+
+			/*! @brief Replace this object's buffers with those of another */
+			BufferList& operator=(BufferList&& rhs);
 			//@}
 
 			// ========================================
@@ -0,0 +1,289 @@
+/*
+ *  Copyright (C) 2013 Stephen F. Booth <me@sbooth.org>
+ *  All Rights Reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    - Neither the name of Stephen F. Booth nor the names of its 
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Measures the throughput of each SampleConversion kernel using every implementation available on this processor,
+// and checks that each implementation produces the same output as the scalar one
+//
+// Build from the top-level directory with:
+//   clang++ -std=c++11 -O3 -I. Benchmarks/SampleConversionBenchmark.cpp SampleConversion.cpp -o SampleConversionBenchmark
+//
+// Usage: SampleConversionBenchmark [frames [iterations]]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <vector>
+
+#include "SampleConversion.h"
+
+namespace {
+
+	namespace SampleConversion = SFB::Audio::SampleConversion;
+
+	const SampleConversion::Implementation sImplementations [] = {
+		SampleConversion::Implementation::Scalar,
+		SampleConversion::Implementation::SSE2,
+		SampleConversion::Implementation::AVX2,
+		SampleConversion::Implementation::NEON
+	};
+
+	// The channel counts measured; the interleaved SIMD paths are specialized for stereo
+	const unsigned sChannelCounts [] = { 2, 6 };
+
+	// Source and destination buffers for one channel count
+	// The integer samples are 8-bit values so every kernel's shift produces in-range output
+	struct Buffers
+	{
+		Buffers(unsigned channels, size_t frames)
+			: mChannels(channels), mFrames(frames), mSamples(channels * frames),
+			  mFloatInterleaved(mSamples), mInt32Interleaved(mSamples),
+			  mFloatPlanar(channels, std::vector<float>(frames)), mInt32Planar(channels, std::vector<int32_t>(frames)),
+			  mFloatPlanarOutput(channels, std::vector<float>(frames)), mInt32PlanarOutput(channels, std::vector<int32_t>(frames)),
+			  mFloatOutput(mSamples), mInt32Output(mSamples), mInt16Output(mSamples), mInt8Output(mSamples), mPackedInt24Output(3 * mSamples)
+		{
+			std::mt19937 generator(12345);
+			std::uniform_real_distribution<float> floatDistribution(-1.25f, 1.25f);
+			std::uniform_int_distribution<int32_t> int32Distribution(INT8_MIN, INT8_MAX);
+
+			for(size_t i = 0; i < mSamples; ++i) {
+				mFloatInterleaved[i] = floatDistribution(generator);
+				mInt32Interleaved[i] = int32Distribution(generator);
+			}
+
+			for(unsigned channel = 0; channel < channels; ++channel) {
+				for(size_t frame = 0; frame < frames; ++frame) {
+					mFloatPlanar[channel][frame] = mFloatInterleaved[(frame * channels) + channel];
+					mInt32Planar[channel][frame] = mInt32Interleaved[(frame * channels) + channel];
+				}
+
+				mFloatPlanarPointers.push_back(mFloatPlanar[channel].data());
+				mInt32PlanarPointers.push_back(mInt32Planar[channel].data());
+				mFloatPlanarOutputPointers.push_back(mFloatPlanarOutput[channel].data());
+				mInt32PlanarOutputPointers.push_back(mInt32PlanarOutput[channel].data());
+			}
+		}
+
+		// Returns a copy of every output buffer, for comparison between implementations
+		std::vector<unsigned char> GetOutput() const
+		{
+			std::vector<unsigned char> output;
+			auto append = [&output](const void *bytes, size_t length) {
+				output.insert(output.end(), (const unsigned char *)bytes, (const unsigned char *)bytes + length);
+			};
+
+			for(unsigned channel = 0; channel < mChannels; ++channel) {
+				append(mFloatPlanarOutput[channel].data(), mFrames * sizeof(float));
+				append(mInt32PlanarOutput[channel].data(), mFrames * sizeof(int32_t));
+			}
+
+			append(mFloatOutput.data(), mSamples * sizeof(float));
+			append(mInt32Output.data(), mSamples * sizeof(int32_t));
+			append(mInt16Output.data(), mSamples * sizeof(int16_t));
+			append(mInt8Output.data(), mSamples * sizeof(int8_t));
+			append(mPackedInt24Output.data(), 3 * mSamples);
+
+			return output;
+		}
+
+		// Zeroes every output buffer
+		void ClearOutput()
+		{
+			for(unsigned channel = 0; channel < mChannels; ++channel) {
+				std::fill(mFloatPlanarOutput[channel].begin(), mFloatPlanarOutput[channel].end(), 0.f);
+				std::fill(mInt32PlanarOutput[channel].begin(), mInt32PlanarOutput[channel].end(), 0);
+			}
+
+			std::fill(mFloatOutput.begin(), mFloatOutput.end(), 0.f);
+			std::fill(mInt32Output.begin(), mInt32Output.end(), 0);
+			std::fill(mInt16Output.begin(), mInt16Output.end(), 0);
+			std::fill(mInt8Output.begin(), mInt8Output.end(), 0);
+			std::fill(mPackedInt24Output.begin(), mPackedInt24Output.end(), 0);
+		}
+
+		unsigned mChannels;
+		size_t mFrames;
+		size_t mSamples;
+
+		std::vector<float> mFloatInterleaved;
+		std::vector<int32_t> mInt32Interleaved;
+		std::vector<std::vector<float>> mFloatPlanar;
+		std::vector<std::vector<int32_t>> mInt32Planar;
+		std::vector<const float *> mFloatPlanarPointers;
+		std::vector<const int32_t *> mInt32PlanarPointers;
+
+		std::vector<std::vector<float>> mFloatPlanarOutput;
+		std::vector<std::vector<int32_t>> mInt32PlanarOutput;
+		std::vector<float *> mFloatPlanarOutputPointers;
+		std::vector<int32_t *> mInt32PlanarOutputPointers;
+		std::vector<float> mFloatOutput;
+		std::vector<int32_t> mInt32Output;
+		std::vector<int16_t> mInt16Output;
+		std::vector<int8_t> mInt8Output;
+		std::vector<uint8_t> mPackedInt24Output;
+	};
+
+	struct Kernel
+	{
+		const char *mName;
+		std::function<void (Buffers&)> mRun;
+	};
+
+	const Kernel sKernels [] = {
+		{ "DeinterleaveFloat", [](Buffers& b) {
+			SampleConversion::DeinterleaveFloat(b.mFloatInterleaved.data(), b.mFloatPlanarOutputPointers.data(), b.mChannels, b.mFrames);
+		}},
+		{ "DeinterleaveInt32", [](Buffers& b) {
+			SampleConversion::DeinterleaveInt32(b.mInt32Interleaved.data(), b.mInt32PlanarOutputPointers.data(), b.mChannels, b.mFrames, 24);
+		}},
+		{ "DeinterleaveInt32ToFloat", [](Buffers& b) {
+			SampleConversion::DeinterleaveInt32ToFloat(b.mInt32Interleaved.data(), b.mFloatPlanarOutputPointers.data(), b.mChannels, b.mFrames, 1.f / 128);
+		}},
+		{ "InterleaveFloat", [](Buffers& b) {
+			SampleConversion::InterleaveFloat(b.mFloatPlanarPointers.data(), b.mFloatOutput.data(), b.mChannels, b.mFrames);
+		}},
+		{ "InterleaveInt32", [](Buffers& b) {
+			SampleConversion::InterleaveInt32(b.mInt32PlanarPointers.data(), b.mInt32Output.data(), b.mChannels, b.mFrames);
+		}},
+		{ "ShiftInt32", [](Buffers& b) {
+			SampleConversion::ShiftInt32(b.mInt32Interleaved.data(), b.mInt32Output.data(), b.mSamples, 24);
+		}},
+		{ "ConvertInt32ToInt16", [](Buffers& b) {
+			SampleConversion::ConvertInt32ToInt16(b.mInt32Interleaved.data(), b.mInt16Output.data(), b.mSamples, 8);
+		}},
+		{ "ConvertInt32ToInt8", [](Buffers& b) {
+			SampleConversion::ConvertInt32ToInt8(b.mInt32Interleaved.data(), b.mInt8Output.data(), b.mSamples, 0);
+		}},
+		{ "ConvertInt32ToPackedInt24", [](Buffers& b) {
+			SampleConversion::ConvertInt32ToPackedInt24(b.mInt32Interleaved.data(), b.mPackedInt24Output.data(), b.mSamples, 16);
+		}},
+		{ "ConvertInt32ToFloat", [](Buffers& b) {
+			SampleConversion::ConvertInt32ToFloat(b.mInt32Interleaved.data(), b.mFloatOutput.data(), b.mSamples, 1.f / 128);
+		}},
+		{ "ConvertFloatToInt32", [](Buffers& b) {
+			SampleConversion::ConvertFloatToInt32(b.mFloatInterleaved.data(), b.mInt32Output.data(), b.mSamples, 32768.f);
+		}},
+		{ "ClipFloat", [](Buffers& b) {
+			SampleConversion::ClipFloat(b.mFloatInterleaved.data(), b.mFloatOutput.data(), b.mSamples, -1.f, 1.f);
+		}},
+	};
+
+	// Returns the throughput of kernel in millions of samples per second
+	double MeasureKernel(const Kernel& kernel, Buffers& buffers, unsigned iterations)
+	{
+		// Warm the caches and branch predictors
+		kernel.mRun(buffers);
+
+		auto start = std::chrono::steady_clock::now();
+		for(unsigned i = 0; i < iterations; ++i)
+			kernel.mRun(buffers);
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+		return ((double)buffers.mSamples * iterations) / elapsed.count() / 1e6;
+	}
+
+}
+
+int main(int argc, char *argv [])
+{
+	size_t frames = 4096;
+	unsigned iterations = 2000;
+
+	if(1 < argc)
+		frames = (size_t)strtoul(argv[1], nullptr, 10);
+	if(2 < argc)
+		iterations = (unsigned)strtoul(argv[2], nullptr, 10);
+
+	if(0 == frames || 0 == iterations) {
+		fprintf(stderr, "Usage: %s [frames [iterations]]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	std::vector<SampleConversion::Implementation> implementations;
+	for(auto implementation : sImplementations) {
+		if(SampleConversion::IsImplementationAvailable(implementation))
+			implementations.push_back(implementation);
+	}
+
+	auto defaultImplementation = SampleConversion::GetImplementation();
+	bool outputsMatch = true;
+
+	printf("%zu frames, %u iterations; throughput in millions of samples per second (speedup over scalar)\n", frames, iterations);
+
+	for(auto channels : sChannelCounts) {
+		Buffers buffers(channels, frames);
+
+		printf("\n%u channels\n%-28s", channels, "Kernel");
+		for(auto implementation : implementations)
+			printf("%18s", SampleConversion::GetImplementationName(implementation));
+		printf("\n");
+
+		for(const auto& kernel : sKernels) {
+			printf("%-28s", kernel.mName);
+
+			double scalarThroughput = 0;
+			std::vector<unsigned char> scalarOutput;
+
+			for(auto implementation : implementations) {
+				SampleConversion::SetImplementation(implementation);
+
+				buffers.ClearOutput();
+				kernel.mRun(buffers);
+				auto output = buffers.GetOutput();
+
+				double throughput = MeasureKernel(kernel, buffers, iterations);
+
+				if(SampleConversion::Implementation::Scalar == implementation) {
+					scalarThroughput = throughput;
+					scalarOutput = std::move(output);
+					printf("%10.0f        ", throughput);
+				}
+				else {
+					bool matches = (output == scalarOutput);
+					outputsMatch = outputsMatch && matches;
+					printf("%10.0f (%4.1fx)%s", throughput, throughput / scalarThroughput, matches ? " " : "!");
+				}
+			}
+
+			printf("\n");
+		}
+	}
+
+	SampleConversion::SetImplementation(defaultImplementation);
+
+	if(!outputsMatch) {
+		printf("\nOutput marked with ! differs from the scalar implementation\n");
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
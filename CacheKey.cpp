@@ -0,0 +1,87 @@
+/*
+ *  Copyright (C) 2013 Stephen F. Booth <me@sbooth.org>
+ *  All Rights Reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    - Neither the name of Stephen F. Booth nor the names of its 
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/stat.h>
+#include <cstdio>
+#include <vector>
+
+#include "CacheKey.h"
+#include "CFWrapper.h"
+
+namespace {
+
+	// 64-bit FNV-1a, used to derive file names that are stable across launches
+	uint64_t HashString(const std::string& s)
+	{
+		uint64_t hash = 0xcbf29ce484222325ull;
+		for(auto c : s) {
+			hash ^= (unsigned char)c;
+			hash *= 0x100000001b3ull;
+		}
+		return hash;
+	}
+
+}
+
+bool SFB::CreateCacheKeyForInputSource(const InputSource& inputSource, const char *tag, std::string& key)
+{
+	CFURLRef url = inputSource.GetURL();
+	if(nullptr == url)
+		return false;
+
+	CFStringRef urlString = CFURLGetString(CFURLGetAbsoluteURL(url));
+
+	CFIndex length = CFStringGetMaximumSizeForEncoding(CFStringGetLength(urlString), kCFStringEncodingUTF8) + 1;
+	std::vector<char> buf((size_t)length);
+	if(!CFStringGetCString(urlString, buf.data(), length, kCFStringEncodingUTF8))
+		return false;
+
+	key = std::string(tag ?: "") + "|" + buf.data();
+
+	// Files are further identified by size and modification date, so edited files are not mistaken for the original
+	SFB::CFString scheme = CFURLCopyScheme(url);
+	if(scheme && kCFCompareEqualTo == CFStringCompare(CFSTR("file"), scheme, kCFCompareCaseInsensitive)) {
+		UInt8 path [PATH_MAX];
+		struct stat s;
+		if(CFURLGetFileSystemRepresentation(url, FALSE, path, PATH_MAX) && 0 == stat((const char *)path, &s))
+			key += "|" + std::to_string((long long)s.st_size) + "|" + std::to_string((long long)s.st_mtimespec.tv_sec) + "." + std::to_string((long long)s.st_mtimespec.tv_nsec);
+	}
+	else
+		key += "|" + std::to_string((long long)inputSource.GetLength());
+
+	return true;
+}
+
+std::string SFB::GetCachePathForKey(const std::string& directory, const std::string& key, const char *extension)
+{
+	char name [32];
+	snprintf(name, sizeof(name), "%016llx.%s", (unsigned long long)HashString(key), extension);
+	return directory + "/" + name;
+}
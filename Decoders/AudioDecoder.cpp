@@ -28,6 +28,16 @@
  *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include <pthread.h>
+
 #include <AudioToolbox/AudioFormat.h>
 #include <CoreFoundation/CoreFoundation.h>
 
@@ -38,15 +48,395 @@
 #include "CFErrorUtilities.h"
 #include "CreateStringForOSType.h"
 #include "LoopableRegionDecoder.h"
+#include "CachingDecoder.h"
 
 // ========================================
 // Error Codes
 // ========================================
 const CFStringRef SFB::Audio::Decoder::ErrorDomain = CFSTR("org.sbooth.AudioEngine.ErrorDomain.AudioDecoder");
 
+const size_t SFB::Audio::Decoder::SignatureLength;
+
+// Repeated regions decoding to at most this many bytes are cached in memory by default
+#define DEFAULT_REGION_CACHE_SIZE_LIMIT	(4 * 1024 * 1024)
+
+// Whole-file decoding divides files into regions of at most this many frames
+#define REGION_SIZE_FRAMES			(1024 * 1024)
+#define REGIONS_AHEAD_PER_THREAD	2
+
+// Audio decoded and discarded before each region is at least this many frames or packets
+#define MIN_PREROLL_FRAMES			4096
+#define PREROLL_PACKETS				4
+#define RETRY_PREROLL_MULTIPLIER	8
+
+#define JOIN_VERIFICATION_FRAMES	1024
+#define BUFFER_SIZE_FRAMES			4096
+
+namespace {
+
+	inline CFTimeInterval ConvertNanosecondsToSeconds(UInt64 nanoseconds)
+	{
+		return (CFTimeInterval)nanoseconds / 1000000000;
+	}
+
+	// Maps a lowercased file extension or MIME type to indexes in sRegisteredSubclasses, in priority order
+	typedef std::unordered_map<std::string, std::vector<size_t>> SubclassLookupTable;
+
+	// Returns the lowercased UTF-8 representation of string, suitable for use as a lookup key
+	std::string CreateLookupKey(CFStringRef string)
+	{
+		if(nullptr == string)
+			return std::string();
+
+		SFB::CFMutableString lowercaseString = CFStringCreateMutableCopy(kCFAllocatorDefault, 0, string);
+		if(!lowercaseString)
+			return std::string();
+
+		CFStringLowercase(lowercaseString, nullptr);
+
+		CFRange range = CFRangeMake(0, CFStringGetLength(lowercaseString));
+		CFIndex count = 0;
+		CFStringGetBytes(lowercaseString, range, kCFStringEncodingUTF8, 0, false, nullptr, 0, &count);
+
+		std::string key(static_cast<size_t>(count), '\0');
+		CFStringGetBytes(lowercaseString, range, kCFStringEncodingUTF8, 0, false, reinterpret_cast<UInt8 *>(&key[0]), count, nullptr);
+
+		return key;
+	}
+
+	void AddToLookupTable(SubclassLookupTable& table, CFArrayRef strings, size_t index)
+	{
+		if(nullptr == strings)
+			return;
+
+		for(CFIndex i = 0; i < CFArrayGetCount(strings); ++i) {
+			auto& indexes = table[CreateLookupKey((CFStringRef)CFArrayGetValueAtIndex(strings, i))];
+			if(indexes.empty() || indexes.back() != index)
+				indexes.push_back(index);
+		}
+	}
+
+	// Reads length bytes of inputSource starting at offset into buffer, restoring the original offset
+	// Returns the number of bytes read, or 0 if the input source could not be sniffed
+	size_t ReadSignature(SFB::InputSource& inputSource, void *buffer, size_t length, SInt64 signatureOffset = 0)
+	{
+		if(!inputSource.IsOpen() || !inputSource.SupportsSeeking())
+			return 0;
+
+		SInt64 offset = inputSource.GetOffset();
+		if(-1 == offset || (signatureOffset != offset && !inputSource.SeekToOffset(signatureOffset)))
+			return 0;
+
+		SInt64 bytesRead = inputSource.Read(buffer, (SInt64)length);
+
+		if(!inputSource.SeekToOffset(offset)) {
+			LOGGER_WARNING("org.sbooth.AudioEngine.Decoder", "Unable to restore input source offset after reading signature");
+			return 0;
+		}
+
+		return 0 < bytesRead ? (size_t)bytesRead : 0;
+	}
+
+	// Returns the size of the ID3v2 tag at the start of bytes, including its header and footer, or 0 if there is none
+	SInt64 GetID3v2TagSize(const unsigned char *bytes, size_t length)
+	{
+		if(10 > length || memcmp(bytes, "ID3", 3))
+			return 0;
+
+		// The tag size is a syncsafe integer
+		if((bytes[6] | bytes[7] | bytes[8] | bytes[9]) & 0x80)
+			return 0;
+
+		SInt64 size = 10 + (((SInt64)bytes[6] << 21) | ((SInt64)bytes[7] << 14) | ((SInt64)bytes[8] << 7) | (SInt64)bytes[9]);
+
+		// Footer present
+		if(0x10 & bytes[5])
+			size += 10;
+
+		return size;
+	}
+
+#pragma mark Whole-File Decoding
+
+	// A portion of a file decoded by its own decoder
+	struct Region
+	{
+		SInt64					mStartingFrame;
+		UInt32					mRequestedFrameCount;
+		UInt32					mRequestedTailFrameCount;
+
+		UInt32					mFrameCount;		// Fewer than requested if the file ended early
+		UInt32					mTailFrameCount;
+
+		SFB::Audio::BufferList	mBufferList;		// The region's audio, unless it is decoded in place
+		SFB::Audio::BufferList	mTail;				// The audio following the region, for verifying the join
+
+		bool					mFinished;
+		bool					mSucceeded;
+	};
+
+	// Reads up to frameCount frames into bufferList beginning at frameOffset, returning the number of frames read
+	UInt32 ReadFrames(SFB::Audio::Decoder& decoder, AudioBufferList *bufferList, UInt32 frameOffset, UInt32 frameCount)
+	{
+		UInt32 bytesPerFrame = decoder.GetFormat().mBytesPerFrame;
+
+		// The alias points to the current write position in bufferList
+		AudioBufferList *bufferListAlias = (AudioBufferList *)alloca(offsetof(AudioBufferList, mBuffers) + (sizeof(AudioBuffer) * bufferList->mNumberBuffers));
+		bufferListAlias->mNumberBuffers = bufferList->mNumberBuffers;
+
+		UInt32 framesRead = 0;
+		while(framesRead < frameCount) {
+			for(UInt32 i = 0; i < bufferListAlias->mNumberBuffers; ++i) {
+				bufferListAlias->mBuffers[i].mData				= (unsigned char *)bufferList->mBuffers[i].mData + ((frameOffset + framesRead) * bytesPerFrame);
+				bufferListAlias->mBuffers[i].mDataByteSize		= (frameCount - framesRead) * bytesPerFrame;
+				bufferListAlias->mBuffers[i].mNumberChannels	= bufferList->mBuffers[i].mNumberChannels;
+			}
+
+			UInt32 framesDecoded = decoder.ReadAudio(bufferListAlias, frameCount - framesRead);
+			if(0 == framesDecoded)
+				break;
+
+			framesRead += framesDecoded;
+		}
+
+		return framesRead;
+	}
+
+	// Decodes region into bufferList beginning at frameOffset, after decoding and discarding up to prerollFrames
+	bool DecodeRegion(CFURLRef url, const AudioStreamBasicDescription& format, Region& region, SInt64 prerollFrames, AudioBufferList *bufferList, UInt32 frameOffset, CFErrorRef *error)
+	{
+		region.mFrameCount = 0;
+		region.mTailFrameCount = 0;
+
+		if(region.mRequestedTailFrameCount && !region.mTail && !region.mTail.Allocate(format, region.mRequestedTailFrameCount)) {
+			if(error)
+				*error = CFErrorCreate(kCFAllocatorDefault, kCFErrorDomainPOSIX, ENOMEM, nullptr);
+			return false;
+		}
+
+		SInt64 firstFrame = std::max((SInt64)0, region.mStartingFrame - prerollFrames);
+
+		auto decoder = SFB::Audio::Decoder::CreateDecoderForURLRegion(url, firstFrame, error);
+		if(!decoder || (!decoder->IsOpen() && !decoder->Open(error)))
+			return false;
+
+		AudioStreamBasicDescription decoderFormat = decoder->GetFormat();
+		if(memcmp(&decoderFormat, &format, sizeof(format))) {
+			LOGGER_ERR("org.sbooth.AudioEngine.Decoder", "Region decoder format doesn't match the file's format");
+			return false;
+		}
+
+		// Bring the codec to the state it would have at the start of the region had the file been decoded serially
+		SInt64 framesToDiscard = region.mStartingFrame - firstFrame;
+		if(framesToDiscard) {
+			SFB::Audio::BufferList discardBuffer;
+			if(!discardBuffer.Allocate(format, BUFFER_SIZE_FRAMES)) {
+				if(error)
+					*error = CFErrorCreate(kCFAllocatorDefault, kCFErrorDomainPOSIX, ENOMEM, nullptr);
+				return false;
+			}
+
+			while(framesToDiscard) {
+				UInt32 framesRead = ReadFrames(*decoder, discardBuffer, 0, (UInt32)std::min(framesToDiscard, (SInt64)BUFFER_SIZE_FRAMES));
+				if(0 == framesRead) {
+					LOGGER_ERR("org.sbooth.AudioEngine.Decoder", "Unable to decode pre-roll for region at frame " << region.mStartingFrame);
+					return false;
+				}
+
+				framesToDiscard -= framesRead;
+			}
+		}
+
+		region.mFrameCount = ReadFrames(*decoder, bufferList, frameOffset, region.mRequestedFrameCount);
+		if(region.mFrameCount == region.mRequestedFrameCount && region.mRequestedTailFrameCount)
+			region.mTailFrameCount = ReadFrames(*decoder, region.mTail, 0, region.mRequestedTailFrameCount);
+
+		return true;
+	}
+
+	// Compares the audio following previous with the start of the next region's audio
+	bool JoinIsExact(const Region& previous, const AudioBufferList *bufferList, UInt32 frameOffset, UInt32 frameCount, UInt32 bytesPerFrame)
+	{
+		UInt32 framesToCompare = std::min(previous.mTailFrameCount, frameCount);
+
+		for(UInt32 i = 0; i < bufferList->mNumberBuffers; ++i) {
+			const unsigned char *tail = (const unsigned char *)previous.mTail->mBuffers[i].mData;
+			const unsigned char *head = (const unsigned char *)bufferList->mBuffers[i].mData + (frameOffset * bytesPerFrame);
+			if(memcmp(tail, head, framesToCompare * bytesPerFrame))
+				return false;
+		}
+
+		return true;
+	}
+
+	// Decodes url in regions on threadCount threads, either in place in outputBufferList or passing each region to sink in order
+	bool DecodeURLInRegions(CFURLRef url, const AudioStreamBasicDescription& format, const AudioStreamBasicDescription& sourceFormat, SInt64 totalFrames, unsigned threadCount,
+							AudioBufferList *outputBufferList, const SFB::Audio::Decoder::AudioSink *sink, SInt64& framesDelivered, CFErrorRef *error)
+	{
+		UInt32 bytesPerFrame = format.mBytesPerFrame;
+		SInt64 prerollFrames = std::max((SInt64)MIN_PREROLL_FRAMES, PREROLL_PACKETS * (SInt64)sourceFormat.mFramesPerPacket);
+
+		// Use enough regions to occupy every thread, but not so many that pre-roll dominates
+		SInt64 regionSize = std::min((SInt64)REGION_SIZE_FRAMES, (totalFrames + threadCount - 1) / threadCount);
+		regionSize = std::max(regionSize, 4 * prerollFrames);
+
+		std::vector<std::unique_ptr<Region>> regions;
+		for(SInt64 frame = 0; frame < totalFrames; frame += regionSize) {
+			std::unique_ptr<Region> region(new Region);
+
+			region->mStartingFrame				= frame;
+			region->mRequestedFrameCount		= (UInt32)std::min(regionSize, totalFrames - frame);
+			region->mRequestedTailFrameCount	= (UInt32)std::max((SInt64)0, std::min((SInt64)JOIN_VERIFICATION_FRAMES, totalFrames - frame - regionSize));
+			region->mFrameCount					= 0;
+			region->mTailFrameCount				= 0;
+			region->mFinished					= false;
+			region->mSucceeded					= false;
+
+			regions.push_back(std::move(region));
+		}
+
+		LOGGER_INFO("org.sbooth.AudioEngine.Decoder", "Decoding " << regions.size() << " regions using " << threadCount << " threads");
+
+		std::mutex mutex;
+		std::condition_variable condition;
+		size_t nextRegionToDecode = 0;
+		size_t nextRegionToDeliver = 0;
+		bool stop = false;
+
+		// When decoding to a sink, limit how far the workers may get ahead
+		size_t regionsAhead = sink ? REGIONS_AHEAD_PER_THREAD * threadCount : regions.size();
+
+		auto decodeRegion = [&](Region& region, SInt64 regionPrerollFrames, CFErrorRef *regionError) -> bool {
+			if(outputBufferList)
+				return DecodeRegion(url, format, region, regionPrerollFrames, outputBufferList, (UInt32)region.mStartingFrame, regionError);
+
+			if(!region.mBufferList && !region.mBufferList.Allocate(format, region.mRequestedFrameCount)) {
+				if(regionError)
+					*regionError = CFErrorCreate(kCFAllocatorDefault, kCFErrorDomainPOSIX, ENOMEM, nullptr);
+				return false;
+			}
+
+			return DecodeRegion(url, format, region, regionPrerollFrames, region.mBufferList, 0, regionError);
+		};
+
+		std::vector<std::thread> threads;
+		for(unsigned i = 0; i < threadCount; ++i) {
+			threads.push_back(std::thread([&]() {
+				pthread_setname_np("org.sbooth.AudioEngine.Decoder.Region");
+
+				for(;;) {
+					Region *region = nullptr;
+
+					{
+						std::unique_lock<std::mutex> lock(mutex);
+						condition.wait(lock, [&]() {
+							return stop || regions.size() == nextRegionToDecode || nextRegionToDecode < nextRegionToDeliver + regionsAhead;
+						});
+
+						if(stop || regions.size() == nextRegionToDecode)
+							return;
+
+						region = regions[nextRegionToDecode++].get();
+					}
+
+					bool succeeded = decodeRegion(*region, prerollFrames, nullptr);
+
+					{
+						std::lock_guard<std::mutex> lock(mutex);
+						region->mSucceeded = succeeded;
+						region->mFinished = true;
+					}
+
+					condition.notify_all();
+				}
+			}));
+		}
+
+		bool result = true;
+		framesDelivered = 0;
+
+		for(size_t i = 0; i < regions.size(); ++i) {
+			Region& region = *regions[i];
+
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				condition.wait(lock, [&]() {
+					return region.mFinished;
+				});
+			}
+
+			AudioBufferList *regionBufferList = outputBufferList ? outputBufferList : (AudioBufferList *)region.mBufferList;
+			UInt32 regionFrameOffset = outputBufferList ? (UInt32)region.mStartingFrame : 0;
+
+			auto regionIsValid = [&]() {
+				return region.mSucceeded
+					&& (region.mFrameCount == region.mRequestedFrameCount || i + 1 == regions.size())
+					&& (0 == i || JoinIsExact(*regions[i - 1], regionBufferList, regionFrameOffset, region.mFrameCount, bytesPerFrame));
+			};
+
+			// Try more pre-roll before resorting to decoding everything preceding the region
+			if(!regionIsValid()) {
+				LOGGER_NOTICE("org.sbooth.AudioEngine.Decoder", "Region at frame " << region.mStartingFrame << " failed verification; decoding with additional pre-roll");
+				region.mSucceeded = decodeRegion(region, RETRY_PREROLL_MULTIPLIER * prerollFrames, nullptr);
+
+				if(!regionIsValid()) {
+					LOGGER_NOTICE("org.sbooth.AudioEngine.Decoder", "Region at frame " << region.mStartingFrame << " failed verification; decoding from the beginning of the file");
+					region.mSucceeded = decodeRegion(region, region.mStartingFrame, error);
+				}
+			}
+
+			// Audio decoded serially from the beginning of the file is correct by definition
+			if(!region.mSucceeded) {
+				result = false;
+				break;
+			}
+
+			if(sink) {
+				for(UInt32 j = 0; j < region.mBufferList->mNumberBuffers; ++j)
+					region.mBufferList->mBuffers[j].mDataByteSize = region.mFrameCount * bytesPerFrame;
+
+				if(region.mFrameCount && !(*sink)(region.mBufferList, region.mFrameCount))
+					break;
+
+				region.mBufferList.Deallocate();
+			}
+
+			framesDelivered += region.mFrameCount;
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				nextRegionToDeliver = i + 1;
+			}
+
+			condition.notify_all();
+
+			// The file ended before its reported length
+			if(region.mFrameCount < region.mRequestedFrameCount)
+				break;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+		}
+
+		condition.notify_all();
+
+		for(auto& thread : threads)
+			thread.join();
+
+		return result;
+	}
+
+}
+
 #pragma mark Static Methods
 
 std::atomic_bool SFB::Audio::Decoder::sAutomaticallyOpenDecoders = ATOMIC_VAR_INIT(false);
+std::atomic<size_t> SFB::Audio::Decoder::sRegionCacheSizeLimit = ATOMIC_VAR_INIT(DEFAULT_REGION_CACHE_SIZE_LIMIT);
+std::atomic_bool SFB::Audio::Decoder::sPerformanceCountersEnabled = ATOMIC_VAR_INIT(false);
+std::map<UInt32, SFB::Audio::Decoder::PerformanceCounterStorage> SFB::Audio::Decoder::sCodecPerformanceCounters;
+std::mutex SFB::Audio::Decoder::sCodecPerformanceCountersMutex;
 std::vector<SFB::Audio::Decoder::SubclassInfo> SFB::Audio::Decoder::sRegisteredSubclasses;
 
 CFArrayRef SFB::Audio::Decoder::CreateSupportedFileExtensions()
@@ -78,12 +468,7 @@ bool SFB::Audio::Decoder::HandlesFilesWithExtension(CFStringRef extension)
 	if(nullptr == extension)
 		return false;
 
-	for(auto subclassInfo : sRegisteredSubclasses) {
-		if(subclassInfo.mHandlesFilesWithExtension(extension))
-			return true;
-	}
-
-	return false;
+	return !GetSubclassesForExtension(extension).empty();
 }
 
 bool SFB::Audio::Decoder::HandlesMIMEType(CFStringRef mimeType)
@@ -91,12 +476,126 @@ bool SFB::Audio::Decoder::HandlesMIMEType(CFStringRef mimeType)
 	if(nullptr == mimeType)
 		return false;
 
-	for(auto subclassInfo : sRegisteredSubclasses) {
-		if(subclassInfo.mHandlesMIMEType(mimeType))
-			return true;
+	return !GetSubclassesForMIMEType(mimeType).empty();
+}
+
+std::vector<size_t> SFB::Audio::Decoder::GetCandidateSubclasses(InputSource& inputSource, CFStringRef mimeType, CFErrorRef *error)
+{
+	// Subclasses matching the MIME type or file extension, in the order they will be tried
+	// The MIME type takes precedence over the file extension
+	std::vector<size_t> candidates;
+
+	if(mimeType)
+		candidates = GetSubclassesForMIMEType(mimeType);
+
+	CFURLRef inputURL = inputSource.GetURL();
+
+	SFB::CFString pathExtension = inputURL ? CFURLCopyPathExtension(inputURL) : nullptr;
+	if(pathExtension) {
+		for(auto index : GetSubclassesForExtension(pathExtension)) {
+			if(std::find(candidates.begin(), candidates.end(), index) == candidates.end())
+				candidates.push_back(index);
+		}
 	}
 
-	return false;
+	// The input source is opened so its signature can be read
+	// If it can't be opened any subclasses matched by name are still returned, and opening the decoder will report the error
+	if(!inputSource.IsOpen() && !inputSource.Open(candidates.empty() ? error : nullptr))
+		return candidates;
+
+	// Some extensions (.oga for example) support multiple audio codecs (Vorbis, FLAC, Speex),
+	// and files are sometimes mislabeled, so when possible the stream's signature is used to reorder the candidates:
+	// subclasses matched by both name and signature are tried first, followed by those matched only by signature,
+	// and finally those matched only by name
+	unsigned char signature [SignatureLength];
+	size_t signatureLength = ReadSignature(inputSource, signature, sizeof(signature));
+
+	// ID3v2 tags are prepended to MP3, FLAC, APE, WavPack and True Audio files alike, so they identify nothing;
+	// the signature is the data following the tag
+	SInt64 signatureOffset = GetID3v2TagSize(signature, signatureLength);
+	if(0 < signatureOffset)
+		signatureLength = ReadSignature(inputSource, signature, sizeof(signature), signatureOffset);
+
+	if(0 < signatureLength) {
+		std::vector<bool> signatureMatches(sRegisteredSubclasses.size(), false);
+		for(size_t i = 0; i < sRegisteredSubclasses.size(); ++i)
+			signatureMatches[i] = sRegisteredSubclasses[i].mHandlesSignature(signature, signatureLength);
+
+		auto namedAndSignatureEnd = std::stable_partition(candidates.begin(), candidates.end(), [&signatureMatches](size_t index) {
+			return signatureMatches[index];
+		});
+
+		std::vector<size_t> signatureOnly;
+		for(size_t i = 0; i < sRegisteredSubclasses.size(); ++i) {
+			if(signatureMatches[i] && std::find(candidates.begin(), candidates.end(), i) == candidates.end())
+				signatureOnly.push_back(i);
+		}
+
+		candidates.insert(namedAndSignatureEnd, signatureOnly.begin(), signatureOnly.end());
+	}
+
+	if(candidates.empty()) {
+		if(error && inputURL) {
+			SFB::CFString description = CFCopyLocalizedString(CFSTR("The type of the file “%@” could not be determined."), "");
+			SFB::CFString failureReason = CFCopyLocalizedString(CFSTR("Unknown file type"), "");
+			SFB::CFString recoverySuggestion = CFCopyLocalizedString(CFSTR("The file's extension may be missing or may not match the file's type."), "");
+			
+			*error = CreateErrorForURL(InputSource::ErrorDomain, InputSource::FileNotFoundError, description, inputURL, failureReason, recoverySuggestion);
+		}
+		else if(error) {
+			SFB::CFString description = CFCopyLocalizedString(CFSTR("The type of the audio data could not be determined."), "");
+			SFB::CFString failureReason = CFCopyLocalizedString(CFSTR("Unknown data type"), "");
+			SFB::CFString recoverySuggestion = CFCopyLocalizedString(CFSTR("The data may be in an unsupported format, or a MIME type may be required."), "");
+
+			*error = CreateError(InputSource::ErrorDomain, InputSource::FileNotFoundError, description, failureReason, recoverySuggestion);
+		}
+	}
+
+	return candidates;
+}
+
+std::vector<size_t> SFB::Audio::Decoder::GetSubclassesForExtension(CFStringRef extension)
+{
+	return LookupSubclasses(extension, false);
+}
+
+std::vector<size_t> SFB::Audio::Decoder::GetSubclassesForMIMEType(CFStringRef mimeType)
+{
+	return LookupSubclasses(mimeType, true);
+}
+
+std::vector<size_t> SFB::Audio::Decoder::LookupSubclasses(CFStringRef string, bool isMIMEType)
+{
+	// The tables are built lazily so subclasses aren't queried during static initialization,
+	// and rebuilt if a subclass has been registered since they were last built
+	static std::mutex sMutex;
+	static SubclassLookupTable sExtensionTable;
+	static SubclassLookupTable sMIMETypeTable;
+	static size_t sSubclassCount = 0;
+
+	std::lock_guard<std::mutex> lock(sMutex);
+
+	if(sRegisteredSubclasses.size() != sSubclassCount || (sExtensionTable.empty() && sMIMETypeTable.empty())) {
+		sExtensionTable.clear();
+		sMIMETypeTable.clear();
+
+		for(size_t i = 0; i < sRegisteredSubclasses.size(); ++i) {
+			SFB::CFArray extensions = sRegisteredSubclasses[i].mCreateSupportedFileExtensions();
+			AddToLookupTable(sExtensionTable, extensions, i);
+
+			SFB::CFArray mimeTypes = sRegisteredSubclasses[i].mCreateSupportedMIMETypes();
+			AddToLookupTable(sMIMETypeTable, mimeTypes, i);
+		}
+
+		sSubclassCount = sRegisteredSubclasses.size();
+	}
+
+	const SubclassLookupTable& table = isMIMEType ? sMIMETypeTable : sExtensionTable;
+	auto iter = table.find(CreateLookupKey(string));
+	if(iter == table.end())
+		return std::vector<size_t>();
+
+	return iter->second;
 }
 
 SFB::Audio::Decoder::unique_ptr SFB::Audio::Decoder::CreateDecoderForURL(CFURLRef url, CFErrorRef *error)
@@ -135,64 +634,36 @@ SFB::Audio::Decoder::unique_ptr SFB::Audio::Decoder::CreateDecoderForInputSource
 	}
 #endif
 
-	// The MIME type takes precedence over the file extension
-	if(mimeType) {
-		for(auto subclassInfo : sRegisteredSubclasses) {
-			if(subclassInfo.mHandlesMIMEType(mimeType)) {
-				unique_ptr decoder(subclassInfo.mCreateDecoder(std::move(inputSource)));
-				if(!AutomaticallyOpenDecoders())
-					return decoder;
-				else {
-					 if(decoder->Open(error))
-						 return decoder;
-					// Take back the input source for reuse if opening fails
-					else
-						 inputSource = std::move(decoder->mInputSource);
-				}
-			}
-		}
+	std::vector<size_t> candidates = GetCandidateSubclasses(*inputSource, mimeType, error);
 
 #if 0
-		if(releaseMIMEType)
-			CFRelease(mimeType), mimeType = nullptr;
+	if(releaseMIMEType)
+		CFRelease(mimeType), mimeType = nullptr;
 #endif
-	}
-
-	// If no MIME type was specified, use the extension-based resolvers
 
-	CFURLRef inputURL = inputSource->GetURL();
-	if(!inputURL)
+	if(candidates.empty())
 		return nullptr;
 
-	SFB::CFString pathExtension = CFURLCopyPathExtension(inputURL);
-	if(!pathExtension) {
-		if(error) {
-			SFB::CFString description = CFCopyLocalizedString(CFSTR("The type of the file “%@” could not be determined."), "");
-			SFB::CFString failureReason = CFCopyLocalizedString(CFSTR("Unknown file type"), "");
-			SFB::CFString recoverySuggestion = CFCopyLocalizedString(CFSTR("The file's extension may be missing or may not match the file's type."), "");
-			
-			*error = CreateErrorForURL(InputSource::ErrorDomain, InputSource::FileNotFoundError, description, inputURL, failureReason, recoverySuggestion);
-		}
+	for(auto index : candidates) {
+		unique_ptr decoder(sRegisteredSubclasses[index].mCreateDecoder(std::move(inputSource)));
+		decoder->mSubclassIndex = index;
 
-		return nullptr;
-	}
+		if(!AutomaticallyOpenDecoders())
+			return decoder;
 
-	// TODO: Some extensions (.oga for example) support multiple audio codecs (Vorbis, FLAC, Speex)
-	// and if openDecoder is false the wrong decoder type may be returned, since the file isn't analyzed
-	// until Open() is called
+		if(decoder->Open(error))
+			return decoder;
 
-	for(auto subclassInfo : sRegisteredSubclasses) {
-		if(subclassInfo.mHandlesFilesWithExtension(pathExtension)) {
-			unique_ptr decoder(subclassInfo.mCreateDecoder(std::move(inputSource)));
-			if(!AutomaticallyOpenDecoders())
-				return decoder;
-			else {
-				if(decoder->Open(error))
-					return decoder;
-				// Take back the input source for reuse if opening fails
-				else
-					inputSource = std::move(decoder->mInputSource);
-			}
+		// Take back the input source for reuse if opening fails
+		inputSource = std::move(decoder->mInputSource);
+
+		// Rewind the input source and discard the error if another subclass will be tried
+		if(index != candidates.back()) {
+			if(inputSource->SupportsSeeking() && 0 != inputSource->GetOffset())
+				inputSource->SeekToOffset(0);
+
+			if(error && *error)
+				CFRelease(*error), *error = nullptr;
 		}
 	}
 
@@ -262,17 +733,144 @@ SFB::Audio::Decoder::unique_ptr SFB::Audio::Decoder::CreateDecoderForDecoderRegi
 	return unique_ptr(new LoopableRegionDecoder(std::move(decoder), startingFrame, frameCount, repeatCount));
 }
 
+SFB::Audio::Decoder::unique_ptr SFB::Audio::Decoder::CreateCachingDecoderForDecoder(Decoder::unique_ptr decoder, size_t cacheSizeLimit, CFErrorRef *)
+{
+	if(!decoder)
+		return nullptr;
+
+	return unique_ptr(new CachingDecoder(std::move(decoder), cacheSizeLimit));
+}
+
+bool SFB::Audio::Decoder::DecodeURL(CFURLRef url, AudioStreamBasicDescription& format, const AudioSink& sink, unsigned threadCount, CFErrorRef *error)
+{
+	if(nullptr == url || !sink)
+		return false;
+
+	auto decoder = CreateDecoderForURL(url, error);
+	if(!decoder || (!decoder->IsOpen() && !decoder->Open(error)))
+		return false;
+
+	format = decoder->GetFormat();
+
+	if(0 == threadCount)
+		threadCount = std::thread::hardware_concurrency();
+
+	SInt64 totalFrames = decoder->GetTotalFrames();
+
+	// Files that can't be divided into regions are decoded serially, as are files with an estimated length
+	// since regions sized from an estimate would drop any audio past it
+	if(1 < threadCount && decoder->SupportsSeeking() && 0 < totalFrames && decoder->TotalFramesAreExact()) {
+		AudioStreamBasicDescription sourceFormat = decoder->GetSourceFormat();
+		decoder.reset();
+
+		SInt64 framesDelivered;
+		return DecodeURLInRegions(url, format, sourceFormat, totalFrames, threadCount, nullptr, &sink, framesDelivered, error);
+	}
+
+	BufferList bufferList;
+	if(!bufferList.Allocate(format, BUFFER_SIZE_FRAMES)) {
+		if(error)
+			*error = CFErrorCreate(kCFAllocatorDefault, kCFErrorDomainPOSIX, ENOMEM, nullptr);
+		return false;
+	}
+
+	for(;;) {
+		bufferList.Reset();
+
+		UInt32 framesRead = decoder->ReadAudio(bufferList, bufferList.GetCapacityFrames());
+		if(0 == framesRead || !sink(bufferList, framesRead))
+			break;
+	}
+
+	return true;
+}
+
+bool SFB::Audio::Decoder::DecodeURL(CFURLRef url, AudioStreamBasicDescription& format, BufferList& bufferList, unsigned threadCount, CFErrorRef *error)
+{
+	if(nullptr == url)
+		return false;
+
+	auto decoder = CreateDecoderForURL(url, error);
+	if(!decoder || (!decoder->IsOpen() && !decoder->Open(error)))
+		return false;
+
+	format = decoder->GetFormat();
+
+	// The buffer is sized for the entire file, and grown if the file's length is an underestimate
+	SInt64 totalFrames = decoder->GetTotalFrames();
+	if(0 >= totalFrames || UINT32_MAX < totalFrames) {
+		LOGGER_ERR("org.sbooth.AudioEngine.Decoder", "Unable to decode to a buffer: the file's length is unknown or too large");
+		if(error)
+			*error = CFErrorCreate(kCFAllocatorDefault, kCFErrorDomainPOSIX, EFBIG, nullptr);
+		return false;
+	}
+
+	if(!bufferList.Allocate(format, (UInt32)totalFrames)) {
+		if(error)
+			*error = CFErrorCreate(kCFAllocatorDefault, kCFErrorDomainPOSIX, ENOMEM, nullptr);
+		return false;
+	}
+
+	if(0 == threadCount)
+		threadCount = std::thread::hardware_concurrency();
+
+	SInt64 framesDelivered = 0;
+	bool result = true;
+
+	if(1 < threadCount && decoder->SupportsSeeking() && decoder->TotalFramesAreExact()) {
+		AudioStreamBasicDescription sourceFormat = decoder->GetSourceFormat();
+		decoder.reset();
+
+		result = DecodeURLInRegions(url, format, sourceFormat, totalFrames, threadCount, bufferList, nullptr, framesDelivered, error);
+	}
+	else {
+		framesDelivered = ReadFrames(*decoder, bufferList, 0, bufferList.GetCapacityFrames());
+
+		// Continue until the end of the file when the buffer fills before the length is known to be exact
+		while(framesDelivered == bufferList.GetCapacityFrames() && (!decoder->TotalFramesAreExact() || framesDelivered < decoder->GetTotalFrames())) {
+			if(UINT32_MAX == framesDelivered) {
+				LOGGER_ERR("org.sbooth.AudioEngine.Decoder", "Unable to decode to a buffer: the file is too large");
+				if(error)
+					*error = CFErrorCreate(kCFAllocatorDefault, kCFErrorDomainPOSIX, EFBIG, nullptr);
+				result = false;
+				break;
+			}
+
+			UInt32 capacityFrames = (UInt32)std::min((SInt64)UINT32_MAX, framesDelivered + std::max(framesDelivered / 4, (SInt64)BUFFER_SIZE_FRAMES));
+
+			BufferList grownBufferList;
+			if(!grownBufferList.Allocate(format, capacityFrames)) {
+				if(error)
+					*error = CFErrorCreate(kCFAllocatorDefault, kCFErrorDomainPOSIX, ENOMEM, nullptr);
+				result = false;
+				break;
+			}
+
+			for(UInt32 i = 0; i < bufferList->mNumberBuffers; ++i)
+				memcpy(grownBufferList->mBuffers[i].mData, bufferList->mBuffers[i].mData, (size_t)framesDelivered * format.mBytesPerFrame);
+
+			bufferList = std::move(grownBufferList);
+			framesDelivered += ReadFrames(*decoder, bufferList, (UInt32)framesDelivered, capacityFrames - (UInt32)framesDelivered);
+		}
+	}
+
+	for(UInt32 i = 0; i < bufferList->mNumberBuffers; ++i)
+		bufferList->mBuffers[i].mDataByteSize = (UInt32)framesDelivered * format.mBytesPerFrame;
+
+	return result;
+}
+
 #pragma mark Creation and Destruction
 
 SFB::Audio::Decoder::Decoder()
-	: mInputSource(nullptr), mIsOpen(false), mRepresentedObject(nullptr)
+	: mInputSource(nullptr), mPrefersFloatOutput(false), mPrefersParallelDecoding(false), mRepresentedObject(nullptr), mIsOpen(false), mSubclassIndex(SIZE_MAX), mCodecPerformanceCounters(nullptr)
 {
 	memset(&mFormat, 0, sizeof(mFormat));
 	memset(&mSourceFormat, 0, sizeof(mSourceFormat));
 }
 
 SFB::Audio::Decoder::Decoder(InputSource::unique_ptr inputSource)
-	: mInputSource(std::move(inputSource)), mIsOpen(false), mRepresentedObject(nullptr)
+	: mInputSource(std::move(inputSource)), mPrefersFloatOutput(false), mPrefersParallelDecoding(false), mRepresentedObject(nullptr), mIsOpen(false), mSubclassIndex(SIZE_MAX), mCodecPerformanceCounters(nullptr)
 {
 	assert(nullptr != mInputSource);
 
@@ -294,8 +892,12 @@ bool SFB::Audio::Decoder::Open(CFErrorRef *error)
 		return false;
 
 	bool result = _Open(error);
-	if(result)
+	if(result) {
 		mIsOpen = true;
+
+		mPerformanceCounters.Reset();
+		mCodecPerformanceCounters = nullptr;
+	}
 	return result;
 }
 
@@ -308,8 +910,10 @@ bool SFB::Audio::Decoder::Close(CFErrorRef *error)
 
 	// Close the decoder
 	bool result = _Close(error);
-	if(result)
+	if(result) {
 		mIsOpen = false;
+		mCodecPerformanceCounters = nullptr;
+	}
 
 	// Close the input source
 	if(!GetInputSource().Close(error))
@@ -318,6 +922,40 @@ bool SFB::Audio::Decoder::Close(CFErrorRef *error)
 	return result;
 }
 
+bool SFB::Audio::Decoder::Rebind(InputSource::unique_ptr inputSource, CFErrorRef *error)
+{
+	if(!inputSource) {
+		LOGGER_WARNING("org.sbooth.AudioEngine.Decoder", "Rebind() called with invalid parameters");
+		return false;
+	}
+
+	if(!IsOpen()) {
+		mInputSource = std::move(inputSource);
+		return true;
+	}
+
+	// Background threads may be using the previous input source
+	_EndBackgroundActivity();
+
+	// The previous input source is no longer needed
+	if(GetInputSource().IsOpen() && !GetInputSource().Close())
+		LOGGER_NOTICE("org.sbooth.AudioEngine.Decoder", "Unable to close the previous input source");
+
+	mInputSource = std::move(inputSource);
+
+	// The new stream may use a different codec
+	mPerformanceCounters.Reset();
+	mCodecPerformanceCounters = nullptr;
+
+	if((mInputSource->IsOpen() || mInputSource->Open(error)) && _Rebind(error))
+		return true;
+
+	_Close(nullptr);
+	mIsOpen = false;
+
+	return false;
+}
+
 CFStringRef SFB::Audio::Decoder::CreateFormatDescription() const
 {
 	if(!IsOpen()) {
@@ -370,6 +1008,41 @@ CFStringRef SFB::Audio::Decoder::CreateChannelLayoutDescription() const
 	return channelLayoutDescription;
 }
 
+bool SFB::Audio::Decoder::SetPrefersFloatOutput(bool prefersFloatOutput)
+{
+	if(IsOpen()) {
+		LOGGER_INFO("org.sbooth.AudioEngine.Decoder", "SetPrefersFloatOutput() called on a Decoder that is already open");
+		return false;
+	}
+
+	mPrefersFloatOutput = prefersFloatOutput;
+	return true;
+}
+
+bool SFB::Audio::Decoder::SetPrefersParallelDecoding(bool prefersParallelDecoding)
+{
+	if(IsOpen()) {
+		LOGGER_INFO("org.sbooth.AudioEngine.Decoder", "SetPrefersParallelDecoding() called on a Decoder that is already open");
+		return false;
+	}
+
+	mPrefersParallelDecoding = prefersParallelDecoding;
+	return true;
+}
+
+bool SFB::Audio::Decoder::ProducesFloatOutput() const
+{
+	if(!IsOpen())
+		return false;
+
+	return (kAudioFormatLinearPCM == mFormat.mFormatID
+			&& (kAudioFormatFlagIsFloat & mFormat.mFormatFlags)
+			&& (kAudioFormatFlagIsNonInterleaved & mFormat.mFormatFlags)
+			&& kAudioFormatFlagsNativeEndian == (kAudioFormatFlagIsBigEndian & mFormat.mFormatFlags)
+			&& 32 == mFormat.mBitsPerChannel
+			&& sizeof(float) == mFormat.mBytesPerFrame);
+}
+
 UInt32 SFB::Audio::Decoder::ReadAudio(AudioBufferList *bufferList, UInt32 frameCount)
 {
 	if(!IsOpen()) {
@@ -382,7 +1055,23 @@ UInt32 SFB::Audio::Decoder::ReadAudio(AudioBufferList *bufferList, UInt32 frameC
 		return 0;
 	}
 
-	return _ReadAudio(bufferList, frameCount);
+	if(!sPerformanceCountersEnabled)
+		return _ReadAudio(bufferList, frameCount);
+
+	auto start = std::chrono::steady_clock::now();
+
+	UInt32 framesRead = _ReadAudio(bufferList, frameCount);
+
+	UInt64 nanoseconds = (UInt64)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	UInt64 audioNanoseconds = 0 < mFormat.mSampleRate ? (UInt64)((framesRead * 1e9) / mFormat.mSampleRate) : 0;
+
+	mPerformanceCounters.AddRead(framesRead, audioNanoseconds, nanoseconds);
+
+	auto codecPerformanceCounters = GetCodecPerformanceCounterStorage();
+	if(codecPerformanceCounters)
+		codecPerformanceCounters->AddRead(framesRead, audioNanoseconds, nanoseconds);
+
+	return framesRead;
 }
 
 SInt64 SFB::Audio::Decoder::GetTotalFrames() const
@@ -395,6 +1084,16 @@ SInt64 SFB::Audio::Decoder::GetTotalFrames() const
 	return _GetTotalFrames();
 }
 
+bool SFB::Audio::Decoder::TotalFramesAreExact() const
+{
+	if(!IsOpen()) {
+		LOGGER_INFO("org.sbooth.AudioEngine.Decoder", "TotalFramesAreExact() called on a Decoder that hasn't been opened");
+		return false;
+	}
+
+	return _TotalFramesAreExact();
+}
+
 SInt64 SFB::Audio::Decoder::GetCurrentFrame() const
 {
 	if(!IsOpen()) {
@@ -427,5 +1126,166 @@ SInt64 SFB::Audio::Decoder::SeekToFrame(SInt64 frame)
 		return -1;
 	}
 
-	return _SeekToFrame(frame);
+	if(!sPerformanceCountersEnabled)
+		return _SeekToFrame(frame);
+
+	auto start = std::chrono::steady_clock::now();
+
+	SInt64 currentFrame = _SeekToFrame(frame);
+
+	UInt64 nanoseconds = (UInt64)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+	mPerformanceCounters.AddSeek(nanoseconds);
+
+	auto codecPerformanceCounters = GetCodecPerformanceCounterStorage();
+	if(codecPerformanceCounters)
+		codecPerformanceCounters->AddSeek(nanoseconds);
+
+	return currentFrame;
+}
+
+#pragma mark Performance Counters
+
+std::vector<SFB::Audio::Decoder::CodecPerformanceCounters> SFB::Audio::Decoder::GetCodecPerformanceCounters()
+{
+	std::lock_guard<std::mutex> lock(sCodecPerformanceCountersMutex);
+
+	std::vector<CodecPerformanceCounters> codecPerformanceCounters;
+	for(const auto& iter : sCodecPerformanceCounters) {
+		if(0 < iter.second.mDecoderCount || 0 < iter.second.mReadCount || 0 < iter.second.mSeekCount)
+			codecPerformanceCounters.push_back({ iter.first, iter.second.mDecoderCount, iter.second.GetSnapshot() });
+	}
+
+	return codecPerformanceCounters;
+}
+
+void SFB::Audio::Decoder::ResetCodecPerformanceCounters()
+{
+	std::lock_guard<std::mutex> lock(sCodecPerformanceCountersMutex);
+
+	// Entries are reset instead of removed because decoders hold pointers to them
+	for(auto& iter : sCodecPerformanceCounters)
+		iter.second.Reset();
+}
+
+SFB::Audio::Decoder::PerformanceCounters SFB::Audio::Decoder::GetPerformanceCounters() const
+{
+	return mPerformanceCounters.GetSnapshot();
+}
+
+void SFB::Audio::Decoder::ResetPerformanceCounters()
+{
+	mPerformanceCounters.Reset();
+}
+
+SFB::Audio::Decoder::PerformanceCounterStorage * SFB::Audio::Decoder::GetCodecPerformanceCounterStorage()
+{
+	if(nullptr == mCodecPerformanceCounters && SIZE_MAX != mSubclassIndex) {
+		std::lock_guard<std::mutex> lock(sCodecPerformanceCountersMutex);
+
+		mCodecPerformanceCounters = &sCodecPerformanceCounters[mSourceFormat.mFormatID];
+		++mCodecPerformanceCounters->mDecoderCount;
+	}
+
+	return mCodecPerformanceCounters;
+}
+
+SFB::Audio::Decoder::PerformanceCounterStorage::PerformanceCounterStorage()
+{
+	Reset();
+}
+
+void SFB::Audio::Decoder::PerformanceCounterStorage::AddRead(UInt64 frames, UInt64 audioNanoseconds, UInt64 nanoseconds)
+{
+	++mReadCount;
+	mFramesDecoded += frames;
+	mAudioNanoseconds += audioNanoseconds;
+	mReadNanoseconds += nanoseconds;
+}
+
+void SFB::Audio::Decoder::PerformanceCounterStorage::AddSeek(UInt64 nanoseconds)
+{
+	++mSeekCount;
+	mSeekNanoseconds += nanoseconds;
+}
+
+SFB::Audio::Decoder::PerformanceCounters SFB::Audio::Decoder::PerformanceCounterStorage::GetSnapshot() const
+{
+	PerformanceCounters performanceCounters = {
+		.mFramesDecoded = mFramesDecoded,
+		.mReadCount = mReadCount,
+		.mSeekCount = mSeekCount,
+		.mAudioDecoded = ConvertNanosecondsToSeconds(mAudioNanoseconds),
+		.mTimeDecoding = ConvertNanosecondsToSeconds(mReadNanoseconds),
+		.mTimeSeeking = ConvertNanosecondsToSeconds(mSeekNanoseconds)
+	};
+
+	return performanceCounters;
+}
+
+void SFB::Audio::Decoder::PerformanceCounterStorage::Reset()
+{
+	mFramesDecoded = 0;
+	mAudioNanoseconds = 0;
+	mReadCount = 0;
+	mReadNanoseconds = 0;
+	mSeekCount = 0;
+	mSeekNanoseconds = 0;
+	mDecoderCount = 0;
+}
+
+#pragma mark Rebinding
+
+bool SFB::Audio::Decoder::_Rebind(CFErrorRef *error)
+{
+	if(!_Close(error))
+		return false;
+
+	memset(&mFormat, 0, sizeof(mFormat));
+	memset(&mSourceFormat, 0, sizeof(mSourceFormat));
+	mChannelLayout = nullptr;
+
+	return _Open(error);
+}
+
+#pragma mark Cloning
+
+SFB::Audio::Decoder::unique_ptr SFB::Audio::Decoder::Clone(CFErrorRef *error) const
+{
+	if(!IsOpen()) {
+		LOGGER_INFO("org.sbooth.AudioEngine.Decoder", "Clone() called on a Decoder that hasn't been opened");
+		return nullptr;
+	}
+
+	return _Clone(error);
+}
+
+SFB::Audio::Decoder::unique_ptr SFB::Audio::Decoder::_Clone(CFErrorRef *error) const
+{
+	// Only decoders created by the factory methods can be recreated
+	if(SIZE_MAX == mSubclassIndex) {
+		if(error)
+			*error = CFErrorCreate(kCFAllocatorDefault, kCFErrorDomainPOSIX, ENOTSUP, nullptr);
+		return nullptr;
+	}
+
+	auto inputSource = mInputSource->Clone(error);
+	if(!inputSource)
+		return nullptr;
+
+	auto decoder = sRegisteredSubclasses[mSubclassIndex].mCreateDecoder(std::move(inputSource));
+	if(!decoder)
+		return nullptr;
+
+	decoder->mSubclassIndex				= mSubclassIndex;
+	decoder->mPrefersFloatOutput		= mPrefersFloatOutput;
+	decoder->mPrefersParallelDecoding	= mPrefersParallelDecoding;
+	decoder->mRepresentedObject			= mRepresentedObject;
+
+	_PrepareClone(*decoder);
+
+	if(!decoder->Open(error))
+		return nullptr;
+
+	return decoder;
 }
@@ -33,12 +33,17 @@
 #include <CoreFoundation/CoreFoundation.h>
 #include <CoreAudio/CoreAudioTypes.h>
 
+#include <atomic>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <vector>
 #include <algorithm>
+#include <functional>
 
 #include "InputSource.h"
 #include "AudioChannelLayout.h"
+#include "AudioBufferList.h"
 
 /*! @file AudioDecoder.h @brief Support for decoding audio to PCM */
 
@@ -97,6 +102,23 @@ namespace SFB {
 			//@}
 
 
+			// ========================================
+			/*!
+			 * @name Content sniffing
+			 * The factory methods open the \c InputSource and, when it is seekable, read its first
+			 * \c Decoder::SignatureLength bytes once and offer them to every registered subclass.
+			 * Subclasses whose signature matches are tried before those matched only by MIME type
+			 * or file extension, so mislabeled or ambiguous files are usually opened on the first attempt.
+			 * A leading ID3v2 tag is skipped, so the bytes offered are those following it.
+			 */
+			//@{
+
+			/*! @brief The maximum number of bytes passed to subclass signature matchers */
+			static const size_t SignatureLength = 128;
+
+			//@}
+
+
 			// ========================================
 			/*! @name Factory Methods */
 			//@{
@@ -236,6 +258,19 @@ namespace SFB {
 			 */
 			static unique_ptr CreateDecoderForDecoderRegion(unique_ptr decoder, SInt64 startingFrame, UInt32 frameCount, UInt32 repeatCount, CFErrorRef *error = nullptr);
 
+			/*!
+			 * @brief Create a \c Decoder object that caches the audio decoded by the specified \c Decoder
+			 *
+			 * Decoded audio is kept in fixed-size blocks, and the least recently used blocks are discarded when
+			 * the cache grows beyond \c cacheSizeLimit bytes.  Reads and seeks within cached audio don't use
+			 * \c decoder, which makes repeated access to the same audio, such as when scrubbing, inexpensive.
+			 * @param decoder The decoder
+			 * @param cacheSizeLimit The maximum size of the cache, in bytes
+			 * @param error An optional pointer to a \c CFErrorRef to receive error information
+			 * @return A \c Decoder object, or \c nullptr on failure
+			 */
+			static unique_ptr CreateCachingDecoderForDecoder(unique_ptr decoder, size_t cacheSizeLimit, CFErrorRef *error = nullptr);
+
 			//@}
 
 
@@ -255,6 +290,75 @@ namespace SFB {
 			//@}
 
 
+			// ========================================
+			/*!
+			 * @name Region caching
+			 * Region decoders that repeat their region normally seek the underlying decoder back to the region's start
+			 * at the end of each pass.  When the decoded region fits within \c RegionCacheSizeLimit() bytes it is
+			 * instead kept in memory as it is decoded during the first pass, and every later pass is read from memory.
+			 * Set the limit to \c 0 to disable caching.
+			 */
+			//@{
+
+			/*! @brief Get the maximum size, in bytes, of a repeated region's PCM cache */
+			static inline size_t RegionCacheSizeLimit()					{ return sRegionCacheSizeLimit.load(); }
+
+			/*! @brief Set the maximum size, in bytes, of a repeated region's PCM cache */
+			static inline void SetRegionCacheSizeLimit(size_t bytes)	{ sRegionCacheSizeLimit.store(bytes); }
+
+			//@}
+
+
+			// ========================================
+			/*!
+			 * @name Whole-file decoding
+			 * These methods decode an entire file on several threads, dividing it into regions that are decoded by
+			 * region decoders with their own \c InputSource.  Each region's decoder first decodes and discards some audio
+			 * preceding the region so codecs with inter-frame dependencies are in the correct state at its start.
+			 * Each region also decodes slightly past its end, and this audio is compared with the start of the following
+			 * region to verify the join is sample-exact.  A region that fails verification is decoded again with
+			 * more pre-roll and, if necessary, from the beginning of the file.  Files that don't support seeking or
+			 * whose length is unknown are decoded serially.
+			 */
+			//@{
+
+			/*!
+			 * @brief A function receiving decoded audio in order
+			 * @param bufferList The decoded audio
+			 * @param frameCount The number of frames in \c bufferList
+			 * @return \c true to continue decoding, \c false to stop
+			 */
+			typedef std::function<bool (const AudioBufferList *bufferList, UInt32 frameCount)> AudioSink;
+
+			/*!
+			 * @brief Decode the specified URL, passing the audio to a sink
+			 * @note \c sink is called on the calling thread, and \c format is set before it is first called
+			 * @note Files whose length is an estimate are decoded serially
+			 * @param url The URL
+			 * @param format An \c AudioStreamBasicDescription to receive the format of the decoded audio
+			 * @param sink The function to receive the audio
+			 * @param threadCount The number of threads to use, or \c 0 for one per processor
+			 * @param error An optional pointer to a \c CFErrorRef to receive error information
+			 * @return \c true on success or if \c sink stopped decoding, \c false otherwise
+			 */
+			static bool DecodeURL(CFURLRef url, AudioStreamBasicDescription& format, const AudioSink& sink, unsigned threadCount = 0, CFErrorRef *error = nullptr);
+
+			/*!
+			 * @brief Decode the specified URL to a buffer
+			 * @note Each region is decoded in place, so no copying is required. Files whose length is an estimate
+			 * are decoded serially and the buffer is grown if the estimate is too small.
+			 * @param url The URL
+			 * @param format An \c AudioStreamBasicDescription to receive the format of the decoded audio
+			 * @param bufferList A \c BufferList to be allocated and filled with the audio
+			 * @param threadCount The number of threads to use, or \c 0 for one per processor
+			 * @param error An optional pointer to a \c CFErrorRef to receive error information
+			 * @return \c true on success, \c false otherwise
+			 */
+			static bool DecodeURL(CFURLRef url, AudioStreamBasicDescription& format, BufferList& bufferList, unsigned threadCount = 0, CFErrorRef *error = nullptr);
+
+			//@}
+
+
 			// ========================================
 			/*! @name Creation and Destruction */
 			//@{
@@ -298,7 +402,11 @@ namespace SFB {
 			/*! @brief Get the URL associated with this decoder's \c InputSource */
 			inline CFURLRef GetURL() const								{ return _GetURL(); }
 
-			/*! @brief Get the \c InputSource feeding this decoder */
+			/*!
+			 * @brief Get the \c InputSource feeding this decoder
+			 * @note The I/O statistics and trace records of the returned \c InputSource reflect the access pattern of this decoder
+			 * @see InputSource::GetStatistics()
+			 */
 			inline InputSource& GetInputSource() const					{ return _GetInputSource(); }
 
 			//@}
@@ -327,6 +435,34 @@ namespace SFB {
 			/*! @brief Query the decoder's \c InputSource to determine if it is open */
 			inline bool IsOpen() const									{ return mIsOpen; }
 
+			/*!
+			 * @brief Reuse this decoder for a different \c InputSource
+			 *
+			 * If the decoder is open it is opened on \c inputSource, which should contain audio of the same type.
+			 * Subclasses that support it reset their codec state instead of releasing it, keeping codec handles and
+			 * buffers when the new stream's format is compatible.  This is cheaper than creating a new decoder
+			 * for each of several similar streams, such as the tracks of an album.
+			 * @note The decoder takes ownership of \c inputSource, and is closed if it can't be opened on it
+			 * @param inputSource The new input source
+			 * @param error An optional pointer to a \c CFErrorRef to receive error information
+			 * @return \c true on success, \c false otherwise
+			 * @see DecoderPool
+			 */
+			bool Rebind(InputSource::unique_ptr inputSource, CFErrorRef *error = nullptr);
+
+			/*!
+			 * @brief Create an open decoder for the same audio with its own position
+			 *
+			 * The clone reads from a clone of this decoder's \c InputSource, so the two may be used concurrently on different
+			 * threads.  Immutable state, such as parsed stream information and seek tables, is shared with the clone instead
+			 * of being rebuilt, which makes reading several positions in the same file at once inexpensive.
+			 * @note Only decoders created by the factory methods, and region and caching decoders wrapping them, can be cloned
+			 * @param error An optional pointer to a \c CFErrorRef to receive error information
+			 * @return A \c Decoder object, or \c nullptr on failure
+			 * @see InputSource::Clone()
+			 */
+			unique_ptr Clone(CFErrorRef *error = nullptr) const;
+
 			//@}
 
 
@@ -367,6 +503,40 @@ namespace SFB {
 			CFStringRef CreateChannelLayoutDescription() const;
 
 
+			/*!
+			 * @brief Request non-interleaved 32-bit float output at the source's sample rate
+			 *
+			 * Decoders that produce integer samples internally may be able to convert them to float as they are decoded,
+			 * which is cheaper than converting the decoder's output afterwards.  Decoders that can't honor the request
+			 * ignore it, so use ProducesFloatOutput() after opening to determine the actual output format.
+			 * @note This must be called before Open()
+			 * @param prefersFloatOutput Whether float output is desired
+			 * @return \c true on success, \c false if the decoder is already open
+			 */
+			bool SetPrefersFloatOutput(bool prefersFloatOutput);
+
+			/*! @brief Query whether non-interleaved 32-bit float output was requested */
+			inline bool PrefersFloatOutput() const						{ return mPrefersFloatOutput; }
+
+			/*! @brief Query whether this decoder provides native-endian, non-interleaved 32-bit float PCM */
+			bool ProducesFloatOutput() const;
+
+			/*!
+			 * @brief Request that audio be decoded ahead on multiple threads
+			 *
+			 * This is intended for bulk, mostly sequential work such as analysis and transcoding, where throughput matters
+			 * more than memory use or the latency of the first read.  Decoders that can't decode in parallel ignore the
+			 * request and decode serially.
+			 * @note This must be called before Open()
+			 * @param prefersParallelDecoding Whether parallel decoding is desired
+			 * @return \c true on success, \c false if the decoder is already open
+			 */
+			bool SetPrefersParallelDecoding(bool prefersParallelDecoding);
+
+			/*! @brief Query whether parallel decoding was requested */
+			inline bool PrefersParallelDecoding() const					{ return mPrefersParallelDecoding; }
+
+
 			/*!
 			 * @brief Decode audio into the specified buffer
 			 * @param bufferList A buffer to receive the decoded audio
@@ -379,6 +549,12 @@ namespace SFB {
 			/*! @brief Get the total number of audio frames */
 			SInt64 GetTotalFrames() const ;
 
+			/*!
+			 * @brief Query whether the value returned by \c GetTotalFrames() is exact
+			 * Some formats only provide an estimate of their length until the entire file has been scanned
+			 */
+			bool TotalFramesAreExact() const;
+
 			/*! @brief Get the current audio frame */
 			SInt64 GetCurrentFrame() const;
 
@@ -398,6 +574,67 @@ namespace SFB {
 
 			//@}
 
+
+			// ========================================
+			/*!
+			 * @name Performance counters
+			 * When enabled, every call to ReadAudio() and SeekToFrame() is counted and timed.  Counters are kept for each
+			 * decoder and are also aggregated by codec, identified by the \c mFormatID of the source format, for decoders
+			 * created by the factory methods.  Counting is disabled by default since timing each call has a small cost.
+			 */
+			//@{
+
+			/*! @brief Cumulative decoding statistics */
+			struct PerformanceCounters
+			{
+				UInt64 mFramesDecoded;				/*!< @brief The total number of frames returned by ReadAudio() */
+				UInt64 mReadCount;					/*!< @brief The number of calls to ReadAudio() */
+				UInt64 mSeekCount;					/*!< @brief The number of calls to SeekToFrame() */
+				CFTimeInterval mAudioDecoded;		/*!< @brief The duration of the audio returned by ReadAudio(), in seconds */
+				CFTimeInterval mTimeDecoding;		/*!< @brief The time spent in ReadAudio(), in seconds */
+				CFTimeInterval mTimeSeeking;		/*!< @brief The time spent in SeekToFrame(), in seconds */
+
+				/*! @brief Get the average number of frames returned per call to ReadAudio() */
+				inline double GetAverageFramesPerRead() const	{ return 0 < mReadCount ? (double)mFramesDecoded / mReadCount : 0; }
+
+				/*! @brief Get the average time spent per call to SeekToFrame(), in seconds */
+				inline CFTimeInterval GetAverageSeekTime() const	{ return 0 < mSeekCount ? mTimeSeeking / mSeekCount : 0; }
+
+				/*! @brief Get the ratio of the duration of the audio decoded to the time spent decoding it */
+				inline double GetRealtimeFactor() const			{ return 0 < mTimeDecoding ? mAudioDecoded / mTimeDecoding : 0; }
+			};
+
+			/*! @brief Performance counters aggregated for all decoders of a codec */
+			struct CodecPerformanceCounters
+			{
+				UInt32 mFormatID;					/*!< @brief The source format ID identifying the codec */
+				UInt64 mDecoderCount;				/*!< @brief The number of decoders first counted since the counters were reset */
+				PerformanceCounters mCounters;		/*!< @brief The aggregated counters */
+			};
+
+			/*! @brief Query whether performance counters are collected */
+			static inline bool PerformanceCountersEnabled()				{ return sPerformanceCountersEnabled.load(); }
+
+			/*! @brief Set whether performance counters are collected */
+			static inline void SetPerformanceCountersEnabled(bool flag)	{ sPerformanceCountersEnabled.store(flag); }
+
+			/*! @brief Get a snapshot of the counters aggregated for each codec, ordered by format ID */
+			static std::vector<CodecPerformanceCounters> GetCodecPerformanceCounters();
+
+			/*! @brief Reset the counters aggregated for each codec */
+			static void ResetCodecPerformanceCounters();
+
+			/*!
+			 * @brief Get a snapshot of this decoder's performance counters
+			 * @note The counters are reset when the decoder is opened or rebound
+			 */
+			PerformanceCounters GetPerformanceCounters() const;
+
+			/*! @brief Reset this decoder's performance counters */
+			void ResetPerformanceCounters();
+
+			//@}
+
 		protected:
 
 			InputSource::unique_ptr			mInputSource;		/*!< @brief The input source feeding this decoder */
@@ -407,6 +644,9 @@ namespace SFB {
 
 			AudioStreamBasicDescription		mSourceFormat;		/*!< @brief The native format of the source file */
 
+			bool							mPrefersFloatOutput;	/*!< @brief Whether the caller requested non-interleaved float output */
+			bool							mPrefersParallelDecoding;	/*!< @brief Whether the caller requested parallel decoding */
+
 
 			/*! @brief Create a new \c Decoder and initialize \c Decoder::mInputSource to \c nullptr */
 			Decoder();
@@ -414,6 +654,9 @@ namespace SFB {
 			/*! @brief Create a new \c Decoder and initialize \c Decoder::mInputSource to \c inputSource */
 			Decoder(InputSource::unique_ptr inputSource);
 
+			/*! @brief Stop any threads \c decoder is running in the background, for use by decoders wrapping another */
+			static inline void EndBackgroundActivity(Decoder& decoder)	{ decoder._EndBackgroundActivity(); }
+
 		private:
 
 			// Override these carefully
@@ -431,18 +674,78 @@ namespace SFB {
 			virtual SInt64 _GetTotalFrames() const = 0;
 			virtual SInt64 _GetCurrentFrame() const = 0;
 
+			// Optional support for formats whose length is estimated
+			virtual bool _TotalFramesAreExact() const					{ return true; }
+
 			// Optional seeking support
 			virtual bool _SupportsSeeking() const						{ return false; }
 			virtual SInt64 _SeekToFrame(SInt64 frame)					{ return -1; }
 
+			// Optional support for reusing codec state when rebinding; called with the new input source open
+			// The default implementation closes and reopens the decoder
+			virtual bool _Rebind(CFErrorRef *error);
+
+			// Optional support for stopping background threads that use the input source or codec state
+			// Called before the input source is closed or replaced while the decoder remains open
+			virtual void _EndBackgroundActivity()						{}
+
+			// Optional cloning support
+			// The default implementation creates a decoder of the same registered subclass on a clone of the input source,
+			// passes it to _PrepareClone() and opens it
+			virtual unique_ptr _Clone(CFErrorRef *error) const;
+
+			// Optional sharing of immutable state with a clone, which is of the same class and not yet open
+			virtual void _PrepareClone(Decoder& /*clone*/) const		{}
+
 			// Data members
 			void							*mRepresentedObject;
 			bool							mIsOpen;
 
+			// The index in sRegisteredSubclasses of the subclass, for decoders created by the factory methods
+			size_t							mSubclassIndex;
+
+			// Performance counters; durations are in nanoseconds
+			struct PerformanceCounterStorage
+			{
+				PerformanceCounterStorage();
+
+				void AddRead(UInt64 frames, UInt64 audioNanoseconds, UInt64 nanoseconds);
+				void AddSeek(UInt64 nanoseconds);
+
+				PerformanceCounters GetSnapshot() const;
+				void Reset();
+
+				std::atomic<UInt64>			mFramesDecoded;
+				std::atomic<UInt64>			mAudioNanoseconds;
+				std::atomic<UInt64>			mReadCount;
+				std::atomic<UInt64>			mReadNanoseconds;
+				std::atomic<UInt64>			mSeekCount;
+				std::atomic<UInt64>			mSeekNanoseconds;
+				std::atomic<UInt64>			mDecoderCount;		// Used only for codec aggregates
+			};
+
+			PerformanceCounterStorage		mPerformanceCounters;
+			PerformanceCounterStorage		*mCodecPerformanceCounters;	// Resolved when first needed after opening
+
+			// Returns the aggregate for this decoder's codec, or nullptr if the decoder wasn't created by a factory method
+			PerformanceCounterStorage * GetCodecPerformanceCounterStorage();
+
+			friend class DecoderPool;
+
 			// ========================================
 			// Controls whether Open() is called for decoders created in the factory methods
 			static std::atomic_bool			sAutomaticallyOpenDecoders;
 
+			// The maximum size of the PCM cache used by repeated region decoders
+			static std::atomic<size_t>		sRegionCacheSizeLimit;
+
+			// Controls whether ReadAudio() and SeekToFrame() are counted and timed
+			static std::atomic_bool			sPerformanceCountersEnabled;
+
+			// Performance counters aggregated by source format ID; entries are never removed
+			static std::map<UInt32, PerformanceCounterStorage>	sCodecPerformanceCounters;
+			static std::mutex				sCodecPerformanceCountersMutex;
+
 			// ========================================
 			// Subclass registration support
 			struct SubclassInfo
@@ -453,6 +756,8 @@ namespace SFB {
 				bool (*mHandlesFilesWithExtension)(CFStringRef);
 				bool (*mHandlesMIMEType)(CFStringRef);
 
+				bool (*mHandlesSignature)(const void *, size_t);
+
 				Decoder::unique_ptr (*mCreateDecoder)(InputSource::unique_ptr);
 
 				int mPriority;
@@ -460,10 +765,23 @@ namespace SFB {
 
 			static std::vector <SubclassInfo> sRegisteredSubclasses;
 
+			// Hashed lookup of registered subclasses by file extension and MIME type
+			// Returns indexes into sRegisteredSubclasses in priority order
+			static std::vector<size_t> GetSubclassesForExtension(CFStringRef extension);
+			static std::vector<size_t> GetSubclassesForMIMEType(CFStringRef mimeType);
+			static std::vector<size_t> LookupSubclasses(CFStringRef string, bool isMIMEType);
+
+			// Returns the subclasses to try for inputSource, in order
+			static std::vector<size_t> GetCandidateSubclasses(InputSource& inputSource, CFStringRef mimeType, CFErrorRef *error);
+
 		public:
 
 			/*!
 			 * @brief Register a \c Decoder subclass
+			 *
+			 * In addition to the static methods for supported file extensions and MIME types, \c T
+			 * must provide <tt>static bool HandlesSignature(const void *header, size_t length)</tt>, which
+			 * returns \c true if the leading bytes of a stream identify a format handled by \c T
 			 * @tparam T The subclass name
 			 * @param priority The priority of the subclass
 			 */
@@ -481,6 +799,8 @@ namespace SFB {
 				
 				.mHandlesFilesWithExtension = T::HandlesFilesWithExtension,
 				.mHandlesMIMEType = T::HandlesMIMEType,
+
+				.mHandlesSignature = T::HandlesSignature,
 				
 				.mCreateDecoder = T::CreateDecoder,
 				
@@ -0,0 +1,226 @@
+/*
+ *  Copyright (C) 2013 Stephen F. Booth <me@sbooth.org>
+ *  All Rights Reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    - Neither the name of Stephen F. Booth nor the names of its 
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "CachingDecoder.h"
+#include "Logger.h"
+
+// Audio is cached in blocks of this many frames
+#define BLOCK_SIZE_FRAMES 16384
+
+SFB::Audio::CachingDecoder::CachingDecoder(Decoder::unique_ptr decoder, size_t cacheSizeLimit)
+	: mDecoder(std::move(decoder)), mCurrentFrame(0), mCacheSizeLimit(cacheSizeLimit), mCacheSize(0)
+{
+	assert(nullptr != mDecoder);
+}
+
+bool SFB::Audio::CachingDecoder::_Open(CFErrorRef *error)
+{
+	if(!mDecoder->IsOpen())
+		mDecoder->SetPrefersFloatOutput(mPrefersFloatOutput);
+
+	if(!mDecoder->IsOpen() && !mDecoder->Open(error))
+		return false;
+
+	mFormat			= mDecoder->GetFormat();
+	mChannelLayout	= mDecoder->GetChannelLayout();
+	mSourceFormat	= mDecoder->GetSourceFormat();
+
+	mCurrentFrame	= mDecoder->GetCurrentFrame();
+
+	return true;
+}
+
+bool SFB::Audio::CachingDecoder::_Close(CFErrorRef *error)
+{
+	ClearCache();
+
+	if(!mDecoder->Close(error))
+		return false;
+
+	return true;
+}
+
+bool SFB::Audio::CachingDecoder::_Rebind(CFErrorRef *error)
+{
+	ClearCache();
+
+	if(!mDecoder->Rebind(std::move(mInputSource), error))
+		return false;
+
+	mFormat			= mDecoder->GetFormat();
+	mChannelLayout	= mDecoder->GetChannelLayout();
+	mSourceFormat	= mDecoder->GetSourceFormat();
+
+	mCurrentFrame	= mDecoder->GetCurrentFrame();
+
+	return true;
+}
+
+SFB::Audio::Decoder::unique_ptr SFB::Audio::CachingDecoder::_Clone(CFErrorRef *error) const
+{
+	auto decoder = mDecoder->Clone(error);
+	if(!decoder)
+		return nullptr;
+
+	auto clone = std::unique_ptr<CachingDecoder>(new CachingDecoder(std::move(decoder), mCacheSizeLimit));
+	clone->mPrefersFloatOutput = mPrefersFloatOutput;
+
+	if(!clone->Open(error))
+		return nullptr;
+
+	return std::move(clone);
+}
+
+SFB::CFString SFB::Audio::CachingDecoder::_GetSourceFormatDescription() const
+{
+	return mDecoder->CreateSourceFormatDescription();
+}
+
+#pragma mark Functionality
+
+UInt32 SFB::Audio::CachingDecoder::_ReadAudio(AudioBufferList *bufferList, UInt32 frameCount)
+{
+	UInt32 initialBufferCapacityBytes = bufferList->mBuffers[0].mDataByteSize;
+	UInt32 framesRead = 0;
+
+	while(framesRead < frameCount && framesRead * mFormat.mBytesPerFrame < initialBufferCapacityBytes) {
+		SInt64 blockIndex	= mCurrentFrame / BLOCK_SIZE_FRAMES;
+		UInt32 blockOffset	= (UInt32)(mCurrentFrame % BLOCK_SIZE_FRAMES);
+
+		const Block *block = GetBlock(blockIndex);
+		if(!block)
+			block = DecodeBlock(blockIndex);
+
+		// Blocks are only short at the end of the stream
+		if(!block || blockOffset >= block->mFrameCount)
+			break;
+
+		UInt32 framesToCopy = std::min(frameCount - framesRead, block->mFrameCount - blockOffset);
+		framesToCopy = std::min(framesToCopy, (initialBufferCapacityBytes / mFormat.mBytesPerFrame) - framesRead);
+
+		for(UInt32 i = 0; i < bufferList->mNumberBuffers; ++i)
+			memcpy((int8_t *)bufferList->mBuffers[i].mData + (framesRead * mFormat.mBytesPerFrame), (int8_t *)(*block->mBufferList)->mBuffers[i].mData + (blockOffset * mFormat.mBytesPerFrame), framesToCopy * mFormat.mBytesPerFrame);
+
+		framesRead		+= framesToCopy;
+		mCurrentFrame	+= framesToCopy;
+	}
+
+	for(UInt32 i = 0; i < bufferList->mNumberBuffers; ++i)
+		bufferList->mBuffers[i].mDataByteSize = framesRead * mFormat.mBytesPerFrame;
+
+	return framesRead;
+}
+
+SInt64 SFB::Audio::CachingDecoder::_SeekToFrame(SInt64 frame)
+{
+	// Seeking is deferred until a read misses the cache
+	mCurrentFrame = frame;
+	return _GetCurrentFrame();
+}
+
+const SFB::Audio::CachingDecoder::Block * SFB::Audio::CachingDecoder::GetBlock(SInt64 index)
+{
+	auto iter = mBlocks.find(index);
+	if(iter == mBlocks.end())
+		return nullptr;
+
+	mBlockUse.splice(mBlockUse.begin(), mBlockUse, iter->second.mUse);
+
+	return &iter->second;
+}
+
+const SFB::Audio::CachingDecoder::Block * SFB::Audio::CachingDecoder::DecodeBlock(SInt64 index)
+{
+	SInt64 blockStartingFrame = index * BLOCK_SIZE_FRAMES;
+
+	// The wrapped decoder is only repositioned when it isn't already at the start of the block
+	if(mDecoder->GetCurrentFrame() != blockStartingFrame) {
+		if(!mDecoder->SupportsSeeking() || blockStartingFrame != mDecoder->SeekToFrame(blockStartingFrame)) {
+			LOGGER_ERR("org.sbooth.AudioEngine.Decoder.Caching", "Unable to seek to frame " << blockStartingFrame);
+			return nullptr;
+		}
+	}
+
+	std::unique_ptr<BufferList> bufferList(new BufferList());
+	if(!bufferList->Allocate(mFormat, BLOCK_SIZE_FRAMES)) {
+		LOGGER_ERR("org.sbooth.AudioEngine.Decoder.Caching", "Unable to allocate memory");
+		return nullptr;
+	}
+
+	// Allocate an alias to the buffer list, which will contain pointers to the current write position in the block
+	AudioBufferList *bufferListAlias = (AudioBufferList *)alloca(offsetof(AudioBufferList, mBuffers) + (sizeof(AudioBuffer) * (*bufferList)->mNumberBuffers));
+	bufferListAlias->mNumberBuffers = (*bufferList)->mNumberBuffers;
+
+	UInt32 framesDecoded = 0;
+	while(BLOCK_SIZE_FRAMES > framesDecoded) {
+		for(UInt32 i = 0; i < bufferListAlias->mNumberBuffers; ++i) {
+			bufferListAlias->mBuffers[i].mData				= (int8_t *)(*bufferList)->mBuffers[i].mData + (framesDecoded * mFormat.mBytesPerFrame);
+			bufferListAlias->mBuffers[i].mDataByteSize		= (BLOCK_SIZE_FRAMES - framesDecoded) * mFormat.mBytesPerFrame;
+			bufferListAlias->mBuffers[i].mNumberChannels	= (*bufferList)->mBuffers[i].mNumberChannels;
+		}
+
+		UInt32 framesRead = mDecoder->ReadAudio(bufferListAlias, BLOCK_SIZE_FRAMES - framesDecoded);
+		if(0 == framesRead)
+			break;
+
+		framesDecoded += framesRead;
+	}
+
+	if(0 == framesDecoded)
+		return nullptr;
+
+	// Discard the least recently used blocks to make room
+	size_t blockSize = BLOCK_SIZE_FRAMES * mFormat.mBytesPerFrame * (*bufferList)->mNumberBuffers;
+	while(!mBlockUse.empty() && mCacheSize + blockSize > mCacheSizeLimit) {
+		mBlocks.erase(mBlockUse.back());
+		mBlockUse.pop_back();
+		mCacheSize -= blockSize;
+	}
+
+	mBlockUse.push_front(index);
+	mCacheSize += blockSize;
+
+	Block& block = mBlocks[index];
+	block.mBufferList	= std::move(bufferList);
+	block.mFrameCount	= framesDecoded;
+	block.mUse			= mBlockUse.begin();
+
+	return &block;
+}
+
+void SFB::Audio::CachingDecoder::ClearCache()
+{
+	mBlocks.clear();
+	mBlockUse.clear();
+	mCacheSize = 0;
+}
@@ -0,0 +1,118 @@
+/*
+ *  Copyright (C) 2013 Stephen F. Booth <me@sbooth.org>
+ *  All Rights Reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    - Neither the name of Stephen F. Booth nor the names of its 
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <list>
+#include <unordered_map>
+
+#include "AudioDecoder.h"
+#include "AudioBufferList.h"
+
+namespace SFB {
+
+	namespace Audio {
+
+		// ========================================
+		// A wrapper around a Decoder that keeps recently decoded audio in memory
+		// Audio is cached in fixed-size blocks, and the least recently used blocks are
+		// discarded when the cache exceeds its size limit
+		// ========================================
+		class CachingDecoder : public Decoder
+		{
+
+			friend class Decoder;
+
+		protected:
+
+			CachingDecoder(Decoder::unique_ptr decoder, size_t cacheSizeLimit);
+
+		private:
+
+			// Source access
+			inline virtual CFURLRef _GetURL() const					{ return mDecoder->GetURL(); }
+			inline virtual InputSource& _GetInputSource() const		{ return mDecoder->GetInputSource(); }
+
+			// Audio access
+			virtual bool _Open(CFErrorRef *error);
+			virtual bool _Close(CFErrorRef *error);
+
+			// The native format of the source audio
+			virtual SFB::CFString _GetSourceFormatDescription() const;
+
+			// Attempt to read frameCount frames of audio, returning the actual number of frames read
+			virtual UInt32 _ReadAudio(AudioBufferList *bufferList, UInt32 frameCount);
+
+			// Source audio information
+			inline virtual SInt64 _GetTotalFrames() const			{ return mDecoder->GetTotalFrames(); }
+			inline virtual SInt64 _GetCurrentFrame() const			{ return mCurrentFrame; }
+			inline virtual bool _TotalFramesAreExact() const		{ return mDecoder->TotalFramesAreExact(); }
+
+			// Seeking support; the wrapped decoder is repositioned only when a read misses the cache
+			inline virtual bool _SupportsSeeking() const			{ return mDecoder->SupportsSeeking(); }
+			virtual SInt64 _SeekToFrame(SInt64 frame);
+
+			// The wrapped decoder is rebound and the cache emptied
+			virtual bool _Rebind(CFErrorRef *error);
+			inline virtual void _EndBackgroundActivity()			{ EndBackgroundActivity(*mDecoder); }
+
+			// The wrapped decoder is cloned; the clone has its own cache of the same size
+			virtual Decoder::unique_ptr _Clone(CFErrorRef *error) const;
+
+
+			// A block of decoded audio starting at a multiple of the block size
+			struct Block
+			{
+				std::unique_ptr<BufferList>		mBufferList;
+				UInt32							mFrameCount;
+				std::list<SInt64>::iterator		mUse;
+			};
+
+			// Returns the cached block at index, marking it as most recently used, or nullptr
+			const Block * GetBlock(SInt64 index);
+
+			// Decodes and caches the block at index, returning nullptr on error or at the end of the stream
+			const Block * DecodeBlock(SInt64 index);
+
+			// Discards all cached blocks
+			void ClearCache();
+
+			// Data members
+			Decoder::unique_ptr						mDecoder;
+			SInt64									mCurrentFrame;
+
+			size_t									mCacheSizeLimit;
+			size_t									mCacheSize;
+			std::unordered_map<SInt64, Block>		mBlocks;
+			std::list<SInt64>						mBlockUse;		// Most recently used first
+		};
+		
+	}
+}
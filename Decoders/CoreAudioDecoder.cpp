@@ -167,6 +167,28 @@ bool SFB::Audio::CoreAudioDecoder::HandlesMIMEType(CFStringRef mimeType)
 	return false;
 }
 
+bool SFB::Audio::CoreAudioDecoder::HandlesSignature(const void *header, size_t length)
+{
+	if(nullptr == header || 12 > length)
+		return false;
+
+	const char *bytes = static_cast<const char *>(header);
+
+	// WAVE, AIFF/AIFC, CAF, AU, MPEG-4 and AMR
+	if(!memcmp(bytes, "RIFF", 4) && !memcmp(bytes + 8, "WAVE", 4))
+		return true;
+	else if(!memcmp(bytes, "FORM", 4) && (!memcmp(bytes + 8, "AIFF", 4) || !memcmp(bytes + 8, "AIFC", 4)))
+		return true;
+	else if(!memcmp(bytes, "caff", 4) || !memcmp(bytes, ".snd", 4))
+		return true;
+	else if(!memcmp(bytes + 4, "ftyp", 4))
+		return true;
+	else if(!memcmp(bytes, "#!AMR", 5))
+		return true;
+
+	return false;
+}
+
 SFB::Audio::Decoder::unique_ptr SFB::Audio::CoreAudioDecoder::CreateDecoder(InputSource::unique_ptr inputSource)
 {
 	return unique_ptr(new CoreAudioDecoder(std::move(inputSource)));
@@ -251,10 +273,10 @@ bool SFB::Audio::CoreAudioDecoder::_Open(CFErrorRef *error)
 	// Tell the ExtAudioFile the format in which we'd like our data
 	
 	// For Linear PCM formats, leave the data untouched
-	if(kAudioFormatLinearPCM == mSourceFormat.mFormatID)
+	if(kAudioFormatLinearPCM == mSourceFormat.mFormatID && !mPrefersFloatOutput)
 		mFormat = mSourceFormat;
 	// For Apple Lossless, convert to high-aligned signed ints in 32 bits
-	else if(kAudioFormatAppleLossless == mSourceFormat.mFormatID) {
+	else if(kAudioFormatAppleLossless == mSourceFormat.mFormatID && !mPrefersFloatOutput) {
 		mFormat.mFormatID			= kAudioFormatLinearPCM;
 		mFormat.mFormatFlags		= kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsSignedInteger | kAudioFormatFlagIsAlignedHigh;
 		
@@ -277,7 +299,7 @@ bool SFB::Audio::CoreAudioDecoder::_Open(CFErrorRef *error)
 		mFormat.mReserved			= 0;
 		
 	}
-	// For all other formats convert to the canonical Core Audio format
+	// For all other formats, or if float output was requested, convert to the canonical Core Audio format
 	else {
 		mFormat.mFormatID			= kAudioFormatLinearPCM;
 		mFormat.mFormatFlags		= kAudioFormatFlagsNativeFloatPacked | kAudioFormatFlagIsNonInterleaved;
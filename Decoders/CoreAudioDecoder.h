@@ -53,6 +53,7 @@ namespace SFB {
 
 			static bool HandlesFilesWithExtension(CFStringRef extension);
 			static bool HandlesMIMEType(CFStringRef mimeType);
+			static bool HandlesSignature(const void *header, size_t length);
 
 			static Decoder::unique_ptr CreateDecoder(InputSource::unique_ptr inputSource);
 
@@ -0,0 +1,662 @@
+/*
+ *  Copyright (C) 2013 Stephen F. Booth <me@sbooth.org>
+ *  All Rights Reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    - Neither the name of Stephen F. Booth nor the names of its 
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+#include <Accelerate/Accelerate.h>
+
+#include "DSDDecoder.h"
+#include "CFWrapper.h"
+#include "CFErrorUtilities.h"
+#include "Logger.h"
+
+// The first stage filter has 8 taps per lookup table, one table per byte of history
+#define FIRST_STAGE_TABLE_COUNT		16
+#define FIRST_STAGE_TAPS			(8 * FIRST_STAGE_TABLE_COUNT)
+#define FIRST_STAGE_CUTOFF			0.05
+
+// Each half-band stage halves the sample rate
+#define HALF_BAND_TAPS				64
+#define HALF_BAND_CUTOFF			0.25
+
+// The number of bytes of DSD per channel decimated at once
+#define CHUNK_SIZE_BYTES			4096
+
+// The number of bytes of DSD per channel decoded and discarded before the target of a seek
+#define PREROLL_SIZE_BYTES			4096
+
+// The DSD idle pattern, used to fill the filter history
+#define DSD_SILENCE_BYTE			0x69
+
+#define DEFAULT_PCM_SAMPLE_RATE		176400
+#define MAX_DECIMATION				512
+
+namespace {
+
+	void RegisterDSDDecoder() __attribute__ ((constructor));
+	void RegisterDSDDecoder()
+	{
+		SFB::Audio::Decoder::RegisterSubclass<SFB::Audio::DSDDecoder>();
+	}
+
+	std::atomic<Float64> sPCMSampleRate(DEFAULT_PCM_SAMPLE_RATE);
+
+#pragma mark Byte Access
+
+	inline uint32_t ReadUInt32LE(const uint8_t *p)		{ return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24); }
+	inline uint64_t ReadUInt64LE(const uint8_t *p)		{ return (uint64_t)ReadUInt32LE(p) | ((uint64_t)ReadUInt32LE(p + 4) << 32); }
+
+	inline uint16_t ReadUInt16BE(const uint8_t *p)		{ return (uint16_t)((p[0] << 8) | p[1]); }
+	inline uint32_t ReadUInt32BE(const uint8_t *p)		{ return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3]; }
+	inline uint64_t ReadUInt64BE(const uint8_t *p)		{ return ((uint64_t)ReadUInt32BE(p) << 32) | (uint64_t)ReadUInt32BE(p + 4); }
+
+	bool ReadBytes(SFB::InputSource& inputSource, void *buffer, SInt64 byteCount)
+	{
+		return byteCount == inputSource.Read(buffer, byteCount);
+	}
+
+#pragma mark Filters
+
+	// A Blackman-windowed sinc lowpass filter with unity gain at DC; cutoff is relative to the sample rate
+	void DesignLowpassFilter(double *coefficients, size_t length, double cutoff)
+	{
+		double sum = 0;
+		for(size_t n = 0; n < length; ++n) {
+			double x = (double)n - (double)(length - 1) / 2;
+			double sinc = (0 == x) ? 2 * cutoff : sin(2 * M_PI * cutoff * x) / (M_PI * x);
+			double window = 0.42 - 0.5 * cos(2 * M_PI * n / (length - 1)) + 0.08 * cos(4 * M_PI * n / (length - 1));
+			coefficients[n] = sinc * window;
+			sum += coefficients[n];
+		}
+
+		for(size_t n = 0; n < length; ++n)
+			coefficients[n] /= sum;
+	}
+
+	struct Filters
+	{
+		Filters()
+		{
+			// The first stage is evaluated a byte at a time: for each byte of history a table holds the
+			// filter's response to all 256 patterns of eight 1-bit samples, most significant bit first
+			double firstStage [FIRST_STAGE_TAPS];
+			DesignLowpassFilter(firstStage, FIRST_STAGE_TAPS, FIRST_STAGE_CUTOFF);
+
+			for(unsigned table = 0; table < FIRST_STAGE_TABLE_COUNT; ++table) {
+				for(unsigned byte = 0; byte < 256; ++byte) {
+					double sum = 0;
+					for(unsigned bit = 0; bit < 8; ++bit) {
+						double tap = firstStage[(table * 8) + 7 - bit];
+						sum += ((byte >> (7 - bit)) & 1) ? tap : -tap;
+					}
+					mFirstStage[table][byte] = (float)sum;
+				}
+			}
+
+			double halfBand [HALF_BAND_TAPS];
+			DesignLowpassFilter(halfBand, HALF_BAND_TAPS, HALF_BAND_CUTOFF);
+			for(unsigned n = 0; n < HALF_BAND_TAPS; ++n)
+				mHalfBand[n] = (float)halfBand[n];
+
+			for(unsigned byte = 0; byte < 256; ++byte) {
+				uint8_t reversed = 0;
+				for(unsigned bit = 0; bit < 8; ++bit)
+					reversed |= ((byte >> bit) & 1) << (7 - bit);
+				mBitReverse[byte] = reversed;
+			}
+		}
+
+		float		mFirstStage [FIRST_STAGE_TABLE_COUNT][256];
+		float		mHalfBand [HALF_BAND_TAPS];
+		uint8_t		mBitReverse [256];
+	};
+
+	const Filters& GetFilters()
+	{
+		static const Filters filters;
+		return filters;
+	}
+
+}
+
+#pragma mark Static Methods
+
+Float64 SFB::Audio::DSDDecoder::GetPCMSampleRate()
+{
+	return sPCMSampleRate.load();
+}
+
+void SFB::Audio::DSDDecoder::SetPCMSampleRate(Float64 sampleRate)
+{
+	sPCMSampleRate.store(sampleRate);
+}
+
+CFArrayRef SFB::Audio::DSDDecoder::CreateSupportedFileExtensions()
+{
+	CFStringRef supportedExtensions [] = { CFSTR("dsf"), CFSTR("dff") };
+	return CFArrayCreate(kCFAllocatorDefault, (const void **)supportedExtensions, 2, &kCFTypeArrayCallBacks);
+}
+
+CFArrayRef SFB::Audio::DSDDecoder::CreateSupportedMIMETypes()
+{
+	CFStringRef supportedMIMETypes [] = { CFSTR("audio/dsf"), CFSTR("audio/x-dsf"), CFSTR("audio/dff"), CFSTR("audio/x-dff") };
+	return CFArrayCreate(kCFAllocatorDefault, (const void **)supportedMIMETypes, 4, &kCFTypeArrayCallBacks);
+}
+
+bool SFB::Audio::DSDDecoder::HandlesFilesWithExtension(CFStringRef extension)
+{
+	if(nullptr == extension)
+		return false;
+
+	if(kCFCompareEqualTo == CFStringCompare(extension, CFSTR("dsf"), kCFCompareCaseInsensitive))
+		return true;
+	else if(kCFCompareEqualTo == CFStringCompare(extension, CFSTR("dff"), kCFCompareCaseInsensitive))
+		return true;
+
+	return false;
+}
+
+bool SFB::Audio::DSDDecoder::HandlesMIMEType(CFStringRef mimeType)
+{
+	if(nullptr == mimeType)
+		return false;
+
+	SFB::CFArray supportedMIMETypes = CreateSupportedMIMETypes();
+	for(CFIndex i = 0; i < CFArrayGetCount(supportedMIMETypes); ++i) {
+		if(kCFCompareEqualTo == CFStringCompare(mimeType, (CFStringRef)CFArrayGetValueAtIndex(supportedMIMETypes, i), kCFCompareCaseInsensitive))
+			return true;
+	}
+
+	return false;
+}
+
+bool SFB::Audio::DSDDecoder::HandlesSignature(const void *header, size_t length)
+{
+	if(nullptr == header || 16 > length)
+		return false;
+
+	const char *bytes = static_cast<const char *>(header);
+
+	if(!memcmp(bytes, "DSD ", 4))
+		return true;
+	else if(!memcmp(bytes, "FRM8", 4) && !memcmp(bytes + 12, "DSD ", 4))
+		return true;
+
+	return false;
+}
+
+SFB::Audio::Decoder::unique_ptr SFB::Audio::DSDDecoder::CreateDecoder(InputSource::unique_ptr inputSource)
+{
+	return unique_ptr(new DSDDecoder(std::move(inputSource)));
+}
+
+#pragma mark Creation and Destruction
+
+SFB::Audio::DSDDecoder::DSDDecoder(InputSource::unique_ptr inputSource)
+	: Decoder(std::move(inputSource)), mContainer(Container::DSF), mDSDSampleRate(0), mSampleCount(0), mDataOffset(0), mBlockSize(0), mLSBFirst(false), mDecimation(0), mStageCount(0), mBlockPosition(0), mBytePosition(0), mBufferFrameOffset(0), mFramesToDiscard(0), mTotalFrames(0), mCurrentFrame(0)
+{}
+
+#pragma mark Functionality
+
+bool SFB::Audio::DSDDecoder::_Open(CFErrorRef *error)
+{
+	uint8_t header [4];
+	bool parsed = false;
+
+	if(mInputSource->SeekToOffset(0) && ReadBytes(*mInputSource, header, sizeof(header))) {
+		if(!memcmp(header, "DSD ", 4))
+			parsed = ParseDSF();
+		else if(!memcmp(header, "FRM8", 4))
+			parsed = ParseDSDIFF();
+	}
+
+	// Only uncompressed DSD at a multiple of 2.8224 MHz is supported
+	if(!parsed || 0 == mDSDSampleRate || 0 != mDSDSampleRate % (64 * 44100) || 0 == mFormat.mChannelsPerFrame) {
+		if(error) {
+			SFB::CFString description = CFCopyLocalizedString(CFSTR("The file “%@” is not a supported DSD file."), "");
+			SFB::CFString failureReason = CFCopyLocalizedString(CFSTR("File Format Not Supported"), "");
+			SFB::CFString recoverySuggestion = CFCopyLocalizedString(CFSTR("The file's extension may not match the file's type."), "");
+
+			*error = CreateErrorForURL(Decoder::ErrorDomain, Decoder::FileFormatNotSupportedError, description, mInputSource->GetURL(), failureReason, recoverySuggestion);
+		}
+
+		return false;
+	}
+
+	// Choose the largest decimation whose output sample rate isn't lower than the preferred rate
+	Float64 preferredSampleRate = GetPCMSampleRate();
+	mDecimation = 8;
+	mStageCount = 0;
+	while(MAX_DECIMATION > mDecimation && mDSDSampleRate / (2 * mDecimation) >= preferredSampleRate) {
+		mDecimation *= 2;
+		++mStageCount;
+	}
+
+	UInt32 channels = mFormat.mChannelsPerFrame;
+
+	mFormat.mFormatID			= kAudioFormatLinearPCM;
+	mFormat.mFormatFlags		= kAudioFormatFlagsNativeFloatPacked | kAudioFormatFlagIsNonInterleaved;
+
+	mFormat.mSampleRate			= (Float64)mDSDSampleRate / mDecimation;
+	mFormat.mChannelsPerFrame	= channels;
+	mFormat.mBitsPerChannel		= 8 * sizeof(float);
+
+	mFormat.mBytesPerPacket		= (mFormat.mBitsPerChannel / 8);
+	mFormat.mFramesPerPacket	= 1;
+	mFormat.mBytesPerFrame		= mFormat.mBytesPerPacket * mFormat.mFramesPerPacket;
+
+	mFormat.mReserved			= 0;
+
+	mSourceFormat.mFormatID				= 'DSD ';
+	mSourceFormat.mSampleRate			= mDSDSampleRate;
+	mSourceFormat.mChannelsPerFrame		= channels;
+	mSourceFormat.mBitsPerChannel		= 1;
+
+	if(!mBufferList.Allocate(mFormat, CHUNK_SIZE_BYTES)) {
+		if(error)
+			*error = CFErrorCreate(kCFAllocatorDefault, kCFErrorDomainPOSIX, ENOMEM, nullptr);
+
+		return false;
+	}
+
+	mChannels.resize(channels);
+	for(auto& channel : mChannels) {
+		channel.mBytes.reserve(FIRST_STAGE_TABLE_COUNT + CHUNK_SIZE_BYTES);
+		channel.mStages.resize(mStageCount);
+		for(auto& stage : channel.mStages)
+			stage.reserve(HALF_BAND_TAPS + CHUNK_SIZE_BYTES);
+	}
+
+	mTotalFrames	= mSampleCount / mDecimation;
+	mCurrentFrame	= 0;
+
+	if(!SetDSDPosition(0)) {
+		if(error)
+			*error = CFErrorCreate(kCFAllocatorDefault, Decoder::ErrorDomain, Decoder::InputOutputError, nullptr);
+
+		return false;
+	}
+
+	return true;
+}
+
+bool SFB::Audio::DSDDecoder::_Close(CFErrorRef */*error*/)
+{
+	mBufferList.Deallocate();
+	mChannels.clear();
+	mBlock.clear();
+
+	mDSDSampleRate		= 0;
+	mSampleCount		= 0;
+	mTotalFrames		= 0;
+	mCurrentFrame		= 0;
+
+	return true;
+}
+
+SFB::CFString SFB::Audio::DSDDecoder::_GetSourceFormatDescription() const
+{
+	return CFStringCreateWithFormat(kCFAllocatorDefault,
+									nullptr,
+									CFSTR("%s DSD%u, %u channels, %u Hz"),
+									Container::DSF == mContainer ? "DSF" : "DSDIFF",
+									(unsigned int)(mDSDSampleRate / 44100),
+									(unsigned int)mSourceFormat.mChannelsPerFrame,
+									(unsigned int)mSourceFormat.mSampleRate);
+}
+
+UInt32 SFB::Audio::DSDDecoder::_ReadAudio(AudioBufferList *bufferList, UInt32 frameCount)
+{
+	if(bufferList->mNumberBuffers != mFormat.mChannelsPerFrame) {
+		LOGGER_WARNING("org.sbooth.AudioEngine.Decoder.DSD", "_ReadAudio() called with invalid parameters");
+		return 0;
+	}
+
+	UInt32 framesRead = 0;
+	while(framesRead < frameCount && mCurrentFrame < mTotalFrames) {
+		UInt32 framesAvailable = (mBufferList->mBuffers[0].mDataByteSize / mFormat.mBytesPerFrame) - mBufferFrameOffset;
+
+		if(0 == framesAvailable) {
+			size_t byteCount = ReadDSD(CHUNK_SIZE_BYTES);
+			if(0 == byteCount)
+				break;
+
+			Decimate(byteCount);
+			continue;
+		}
+
+		UInt32 framesToCopy = std::min(framesAvailable, frameCount - framesRead);
+		framesToCopy = (UInt32)std::min((SInt64)framesToCopy, mTotalFrames - mCurrentFrame);
+
+		for(UInt32 i = 0; i < mBufferList->mNumberBuffers; ++i)
+			memcpy((float *)bufferList->mBuffers[i].mData + framesRead, (const float *)mBufferList->mBuffers[i].mData + mBufferFrameOffset, framesToCopy * sizeof(float));
+
+		mBufferFrameOffset	+= framesToCopy;
+		framesRead			+= framesToCopy;
+		mCurrentFrame		+= framesToCopy;
+	}
+
+	for(UInt32 i = 0; i < bufferList->mNumberBuffers; ++i)
+		bufferList->mBuffers[i].mDataByteSize = framesRead * mFormat.mBytesPerFrame;
+
+	return framesRead;
+}
+
+SInt64 SFB::Audio::DSDDecoder::_SeekToFrame(SInt64 frame)
+{
+	if(0 > frame || frame > mTotalFrames)
+		return -1;
+
+	// The filters are brought to the correct state by decoding audio preceding the target frame
+	SInt64 bytesPerFrame = mDecimation / 8;
+	SInt64 prerollFrames = (PREROLL_SIZE_BYTES + bytesPerFrame - 1) / bytesPerFrame;
+	SInt64 startingFrame = std::max((SInt64)0, frame - prerollFrames);
+
+	if(!SetDSDPosition(startingFrame * bytesPerFrame))
+		return -1;
+
+	mFramesToDiscard	= (UInt32)(frame - startingFrame);
+	mCurrentFrame		= frame;
+
+	return mCurrentFrame;
+}
+
+#pragma mark Container Parsing
+
+bool SFB::Audio::DSDDecoder::ParseDSF()
+{
+	mContainer = Container::DSF;
+
+	// The DSD chunk is followed by the fmt chunk and the data chunk, all little-endian
+	uint8_t dsdChunk [28], fmtChunk [52], dataChunk [12];
+	if(!mInputSource->SeekToOffset(0) || !ReadBytes(*mInputSource, dsdChunk, sizeof(dsdChunk)) || memcmp(dsdChunk, "DSD ", 4))
+		return false;
+
+	SInt64 offset = (SInt64)ReadUInt64LE(dsdChunk + 4);
+	if(!mInputSource->SeekToOffset(offset) || !ReadBytes(*mInputSource, fmtChunk, sizeof(fmtChunk)) || memcmp(fmtChunk, "fmt ", 4))
+		return false;
+
+	uint32_t formatID			= ReadUInt32LE(fmtChunk + 16);
+	uint32_t channels			= ReadUInt32LE(fmtChunk + 24);
+	uint32_t sampleRate			= ReadUInt32LE(fmtChunk + 28);
+	uint32_t bitsPerSample		= ReadUInt32LE(fmtChunk + 32);
+	uint64_t sampleCount		= ReadUInt64LE(fmtChunk + 36);
+	uint32_t blockSize			= ReadUInt32LE(fmtChunk + 44);
+
+	// Format ID 0 is raw DSD; one bit per sample indicates the least significant bit is first
+	if(0 != formatID || !(1 == bitsPerSample || 8 == bitsPerSample) || 0 == channels || 6 < channels || 0 == blockSize)
+		return false;
+
+	offset += (SInt64)ReadUInt64LE(fmtChunk + 4);
+	if(!mInputSource->SeekToOffset(offset) || !ReadBytes(*mInputSource, dataChunk, sizeof(dataChunk)) || memcmp(dataChunk, "data", 4))
+		return false;
+
+	mDSDSampleRate				= sampleRate;
+	mSampleCount				= (SInt64)sampleCount;
+	mDataOffset					= offset + 12;
+	mBlockSize					= blockSize;
+	mLSBFirst					= (1 == bitsPerSample);
+	mFormat.mChannelsPerFrame	= channels;
+
+	return true;
+}
+
+bool SFB::Audio::DSDDecoder::ParseDSDIFF()
+{
+	mContainer = Container::DSDIFF;
+
+	uint8_t formHeader [16];
+	if(!mInputSource->SeekToOffset(0) || !ReadBytes(*mInputSource, formHeader, sizeof(formHeader)) || memcmp(formHeader + 12, "DSD ", 4))
+		return false;
+
+	bool foundProperties = false;
+
+	// Chunks are big-endian and padded to an even length
+	SInt64 offset = 16;
+	for(;;) {
+		uint8_t chunkHeader [12];
+		if(!mInputSource->SeekToOffset(offset) || !ReadBytes(*mInputSource, chunkHeader, sizeof(chunkHeader)))
+			return false;
+
+		SInt64 chunkSize = (SInt64)ReadUInt64BE(chunkHeader + 4);
+		if(0 > chunkSize)
+			return false;
+
+		if(!memcmp(chunkHeader, "PROP", 4)) {
+			uint8_t propertyType [4];
+			if(!ReadBytes(*mInputSource, propertyType, sizeof(propertyType)) || memcmp(propertyType, "SND ", 4))
+				return false;
+
+			SInt64 propertyOffset = offset + 16;
+			SInt64 propertyEnd = offset + 12 + chunkSize;
+			while(propertyOffset + 12 <= propertyEnd) {
+				uint8_t propertyHeader [12], property [4];
+				if(!mInputSource->SeekToOffset(propertyOffset) || !ReadBytes(*mInputSource, propertyHeader, sizeof(propertyHeader)))
+					return false;
+
+				SInt64 propertySize = (SInt64)ReadUInt64BE(propertyHeader + 4);
+				if(0 > propertySize)
+					return false;
+
+				if(!memcmp(propertyHeader, "FS  ", 4)) {
+					if(!ReadBytes(*mInputSource, property, 4))
+						return false;
+					mDSDSampleRate = ReadUInt32BE(property);
+				}
+				else if(!memcmp(propertyHeader, "CHNL", 4)) {
+					if(!ReadBytes(*mInputSource, property, 2))
+						return false;
+					mFormat.mChannelsPerFrame = ReadUInt16BE(property);
+				}
+				// DST-compressed audio is not supported
+				else if(!memcmp(propertyHeader, "CMPR", 4)) {
+					if(!ReadBytes(*mInputSource, property, 4) || memcmp(property, "DSD ", 4))
+						return false;
+				}
+
+				propertyOffset += 12 + propertySize + (propertySize & 1);
+			}
+
+			foundProperties = true;
+		}
+		else if(!memcmp(chunkHeader, "DSD ", 4)) {
+			if(!foundProperties || 0 == mFormat.mChannelsPerFrame)
+				return false;
+
+			// Samples are interleaved a byte at a time, most significant bit first
+			mDataOffset		= offset + 12;
+			mSampleCount	= (chunkSize / mFormat.mChannelsPerFrame) * 8;
+			mBlockSize		= 1;
+			mLSBFirst		= false;
+
+			return true;
+		}
+		else if(!memcmp(chunkHeader, "DST ", 4))
+			return false;
+
+		offset += 12 + chunkSize + (chunkSize & 1);
+	}
+}
+
+#pragma mark DSD Input
+
+bool SFB::Audio::DSDDecoder::SetDSDPosition(SInt64 byte)
+{
+	UInt32 channels = mFormat.mChannelsPerFrame;
+	SInt64 blockIndex = byte / mBlockSize;
+
+	if(!mInputSource->SeekToOffset(mDataOffset + (blockIndex * mBlockSize * channels)))
+		return false;
+
+	// Blocks are loaded as they are needed, so a position within a block requires loading it now
+	mBlock.resize(mBlockSize * channels);
+	mBlockPosition = mBlockSize;
+	mBytePosition = blockIndex * mBlockSize;
+
+	SInt64 offsetInBlock = byte - mBytePosition;
+	if(0 < offsetInBlock) {
+		if(!ReadBytes(*mInputSource, mBlock.data(), (SInt64)mBlock.size()))
+			return false;
+		mBlockPosition = (size_t)offsetInBlock;
+		mBytePosition = byte;
+	}
+
+	// Reset the filters to silence
+	for(auto& channel : mChannels) {
+		channel.mBytes.assign(FIRST_STAGE_TABLE_COUNT - 1, DSD_SILENCE_BYTE);
+		for(auto& stage : channel.mStages)
+			stage.assign(HALF_BAND_TAPS - 1, 0);
+	}
+
+	mBufferList->mBuffers[0].mDataByteSize = 0;
+	mBufferFrameOffset = 0;
+	mFramesToDiscard = 0;
+
+	return true;
+}
+
+size_t SFB::Audio::DSDDecoder::ReadDSD(size_t byteCount)
+{
+	const Filters& filters = GetFilters();
+
+	UInt32 channels = mFormat.mChannelsPerFrame;
+	SInt64 bytesRemaining = ((mSampleCount + 7) / 8) - mBytePosition;
+	byteCount = (size_t)std::min((SInt64)byteCount, std::max((SInt64)0, bytesRemaining));
+
+	size_t bytesRead = 0;
+	while(bytesRead < byteCount) {
+		if(mBlockPosition == mBlockSize) {
+			// DSDIFF has no blocks, so its byte-interleaved data is read in larger pieces
+			if(1 == mBlockSize)
+				mBlock.resize(std::min(byteCount - bytesRead, (size_t)CHUNK_SIZE_BYTES) * channels);
+
+			if(!ReadBytes(*mInputSource, mBlock.data(), (SInt64)mBlock.size())) {
+				LOGGER_ERR("org.sbooth.AudioEngine.Decoder.DSD", "Error reading DSD audio");
+				break;
+			}
+
+			mBlockPosition = 0;
+		}
+
+		size_t count;
+		if(1 == mBlockSize) {
+			count = mBlock.size() / channels;
+			for(UInt32 c = 0; c < channels; ++c) {
+				auto& bytes = mChannels[c].mBytes;
+				for(size_t i = 0; i < count; ++i)
+					bytes.push_back(mBlock[(i * channels) + c]);
+			}
+			mBlockPosition = mBlockSize;
+		}
+		else {
+			count = std::min(byteCount - bytesRead, mBlockSize - mBlockPosition);
+			for(UInt32 c = 0; c < channels; ++c) {
+				const uint8_t *source = mBlock.data() + (c * mBlockSize) + mBlockPosition;
+				auto& bytes = mChannels[c].mBytes;
+				if(mLSBFirst) {
+					for(size_t i = 0; i < count; ++i)
+						bytes.push_back(filters.mBitReverse[source[i]]);
+				}
+				else
+					bytes.insert(bytes.end(), source, source + count);
+			}
+			mBlockPosition += count;
+		}
+
+		bytesRead += count;
+	}
+
+	mBytePosition += bytesRead;
+
+	return bytesRead;
+}
+
+#pragma mark Decimation
+
+void SFB::Audio::DSDDecoder::Decimate(size_t byteCount)
+{
+	const Filters& filters = GetFilters();
+
+	UInt32 frameCount = 0;
+	for(UInt32 c = 0; c < mFormat.mChannelsPerFrame; ++c) {
+		auto& channel = mChannels[c];
+		float *output = (float *)mBufferList->mBuffers[c].mData;
+
+		// The first stage produces one sample per byte
+		std::vector<float> *firstStageOutput = mStageCount ? &channel.mStages[0] : nullptr;
+		size_t firstStageOffset = firstStageOutput ? firstStageOutput->size() : 0;
+		if(firstStageOutput)
+			firstStageOutput->resize(firstStageOffset + byteCount);
+
+		float *samples = firstStageOutput ? firstStageOutput->data() + firstStageOffset : output;
+		const uint8_t *bytes = channel.mBytes.data() + FIRST_STAGE_TABLE_COUNT - 1;
+
+		for(size_t i = 0; i < byteCount; ++i) {
+			float sum = 0;
+			for(unsigned table = 0; table < FIRST_STAGE_TABLE_COUNT; ++table)
+				sum += filters.mFirstStage[table][bytes[i - table]];
+			samples[i] = sum;
+		}
+
+		channel.mBytes.erase(channel.mBytes.begin(), channel.mBytes.end() - (FIRST_STAGE_TABLE_COUNT - 1));
+
+		UInt32 channelFrameCount = (UInt32)byteCount;
+
+		// Each half-band stage halves the sample rate
+		for(unsigned s = 0; s < mStageCount; ++s) {
+			auto& stage = channel.mStages[s];
+			bool isLastStage = (s + 1 == mStageCount);
+
+			size_t outputCount = (stage.size() - (HALF_BAND_TAPS - 1)) / 2;
+
+			std::vector<float> *next = isLastStage ? nullptr : &channel.mStages[s + 1];
+			size_t nextOffset = next ? next->size() : 0;
+			if(next)
+				next->resize(nextOffset + outputCount);
+
+			vDSP_desamp(stage.data(), 2, filters.mHalfBand, next ? next->data() + nextOffset : output, outputCount, HALF_BAND_TAPS);
+
+			stage.erase(stage.begin(), stage.begin() + (2 * outputCount));
+			channelFrameCount = (UInt32)outputCount;
+		}
+
+		frameCount = channelFrameCount;
+	}
+
+	for(UInt32 c = 0; c < mBufferList->mNumberBuffers; ++c)
+		mBufferList->mBuffers[c].mDataByteSize = frameCount * mFormat.mBytesPerFrame;
+
+	// Audio preceding the target of a seek is discarded
+	mBufferFrameOffset = std::min(frameCount, mFramesToDiscard);
+	mFramesToDiscard -= mBufferFrameOffset;
+}
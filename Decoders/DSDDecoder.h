@@ -0,0 +1,156 @@
+/*
+ *  Copyright (C) 2013 Stephen F. Booth <me@sbooth.org>
+ *  All Rights Reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    - Neither the name of Stephen F. Booth nor the names of its 
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "AudioDecoder.h"
+#include "AudioBufferList.h"
+
+namespace SFB {
+
+	namespace Audio {
+
+		/*!
+		 * @brief A \c Decoder subclass converting 1-bit DSD audio in DSF and DSDIFF files to PCM
+		 *
+		 * DSD is decimated by a table-driven FIR filter that reduces the sample rate by a factor of 8, followed by
+		 * half-band FIR stages that each halve it, until the output sample rate is as close as possible to
+		 * \c DSDDecoder::GetPCMSampleRate() without falling below it.  DST-compressed DSDIFF files are not supported.
+		 */
+		class DSDDecoder : public Decoder
+		{
+
+		public:
+
+			// ========================================
+			/*! @name Output sample rate */
+			//@{
+
+			/*! @brief Get the preferred PCM sample rate, 176.4 kHz by default */
+			static Float64 GetPCMSampleRate();
+
+			/*!
+			 * @brief Set the preferred PCM sample rate for decoders opened after this call
+			 * @note The actual rate is the DSD sample rate divided by a power of two no smaller than 8
+			 */
+			static void SetPCMSampleRate(Float64 sampleRate);
+
+			//@}
+
+			/*! @cond */
+
+			// Data types handled by this class
+			static CFArrayRef CreateSupportedFileExtensions();
+			static CFArrayRef CreateSupportedMIMETypes();
+
+			static bool HandlesFilesWithExtension(CFStringRef extension);
+			static bool HandlesMIMEType(CFStringRef mimeType);
+			static bool HandlesSignature(const void *header, size_t length);
+
+			static Decoder::unique_ptr CreateDecoder(InputSource::unique_ptr inputSource);
+
+			// Creation
+			DSDDecoder(InputSource::unique_ptr inputSource);
+
+			/*! @endcond */
+
+		private:
+
+			// Audio access
+			virtual bool _Open(CFErrorRef *error);
+			virtual bool _Close(CFErrorRef *error);
+
+			// The native format of the source audio
+			virtual SFB::CFString _GetSourceFormatDescription() const;
+
+			// Attempt to read frameCount frames of audio, returning the actual number of frames read
+			virtual UInt32 _ReadAudio(AudioBufferList *bufferList, UInt32 frameCount);
+
+			// Source audio information
+			inline virtual SInt64 _GetTotalFrames() const			{ return mTotalFrames; }
+			inline virtual SInt64 _GetCurrentFrame() const			{ return mCurrentFrame; }
+
+			// Seeking support
+			inline virtual bool _SupportsSeeking() const			{ return mInputSource->SupportsSeeking(); }
+			virtual SInt64 _SeekToFrame(SInt64 frame);
+
+			// Container parsing; each sets the stream parameters and data location
+			bool ParseDSF();
+			bool ParseDSDIFF();
+
+			// Reads up to byteCount bytes of DSD for each channel into mChannels, returning the number read
+			size_t ReadDSD(size_t byteCount);
+
+			// Positions the input at byte of each channel's DSD and resets the filters
+			bool SetDSDPosition(SInt64 byte);
+
+			// Decimates the DSD in mChannels into mBufferList
+			void Decimate(size_t byteCount);
+
+			// Filter state for one channel
+			struct Channel
+			{
+				std::vector<uint8_t>				mBytes;		// Filter history followed by new DSD bytes
+				std::vector<std::vector<float>>		mStages;	// History followed by new samples for each half-band stage
+			};
+
+			enum class Container {
+				DSF,
+				DSDIFF
+			};
+
+			// Data members
+			Container					mContainer;
+			UInt32						mDSDSampleRate;
+			SInt64						mSampleCount;		// DSD samples per channel
+			SInt64						mDataOffset;
+			UInt32						mBlockSize;			// Bytes per channel in each DSF block, or 1 for DSDIFF's byte interleaving
+			bool						mLSBFirst;
+
+			UInt32						mDecimation;
+			unsigned					mStageCount;		// Half-band stages following the first stage
+
+			std::vector<uint8_t>		mBlock;				// The current block of interleaved data
+			size_t						mBlockPosition;		// Bytes per channel consumed from mBlock
+			SInt64						mBytePosition;		// Bytes per channel read
+
+			std::vector<Channel>		mChannels;
+			BufferList					mBufferList;
+			UInt32						mBufferFrameOffset;
+			UInt32						mFramesToDiscard;
+
+			SInt64						mTotalFrames;
+			SInt64						mCurrentFrame;
+		};
+
+	}
+}
@@ -0,0 +1,116 @@
+/*
+ *  Copyright (C) 2013 Stephen F. Booth <me@sbooth.org>
+ *  All Rights Reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    - Neither the name of Stephen F. Booth nor the names of its 
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "DecoderPool.h"
+#include "Logger.h"
+
+SFB::Audio::DecoderPool::DecoderPool(size_t capacity)
+	: mCapacity(capacity)
+{}
+
+SFB::Audio::Decoder::unique_ptr SFB::Audio::DecoderPool::CreateDecoderForURL(CFURLRef url, CFErrorRef *error)
+{
+	return CreateDecoderForInputSource(InputSource::CreateInputSourceForURL(url, 0, error), nullptr, error);
+}
+
+SFB::Audio::Decoder::unique_ptr SFB::Audio::DecoderPool::CreateDecoderForInputSource(InputSource::unique_ptr inputSource, CFStringRef mimeType, CFErrorRef *error)
+{
+	if(!inputSource)
+		return nullptr;
+
+	// Only the preferred subclass is considered; if it can't handle the stream the factory will try the others
+	std::vector<size_t> candidates = Decoder::GetCandidateSubclasses(*inputSource, mimeType, nullptr);
+	if(!candidates.empty()) {
+		auto decoder = TakeIdleDecoder(candidates.front());
+		if(decoder) {
+			if(decoder->Rebind(std::move(inputSource), nullptr))
+				return decoder;
+
+			LOGGER_INFO("org.sbooth.AudioEngine.DecoderPool", "Unable to rebind decoder, creating a new one");
+
+			// The decoder owns the input source even though rebinding failed
+			inputSource = std::move(decoder->mInputSource);
+			if(inputSource->IsOpen() && !inputSource->SeekToOffset(0)) {
+				inputSource->Close();
+				if(!inputSource->Open(error))
+					return nullptr;
+			}
+		}
+	}
+
+	return Decoder::CreateDecoderForInputSource(std::move(inputSource), mimeType, error);
+}
+
+void SFB::Audio::DecoderPool::Recycle(Decoder::unique_ptr decoder)
+{
+	if(!decoder || SIZE_MAX == decoder->mSubclassIndex || !decoder->IsOpen())
+		return;
+
+	// The input source isn't needed while the decoder is idle, and background threads may be using it
+	decoder->_EndBackgroundActivity();
+	if(decoder->GetInputSource().IsOpen() && !decoder->GetInputSource().Close())
+		LOGGER_NOTICE("org.sbooth.AudioEngine.DecoderPool", "Unable to close the input source of a recycled decoder");
+
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	mIdleDecoders.push_back(std::move(decoder));
+
+	// The least recently used decoders are discarded first
+	while(mIdleDecoders.size() > mCapacity)
+		mIdleDecoders.pop_front();
+}
+
+void SFB::Audio::DecoderPool::Clear()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mIdleDecoders.clear();
+}
+
+size_t SFB::Audio::DecoderPool::GetIdleDecoderCount() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mIdleDecoders.size();
+}
+
+SFB::Audio::Decoder::unique_ptr SFB::Audio::DecoderPool::TakeIdleDecoder(size_t index)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	// The most recently recycled decoder is preferred since its buffers are most likely to fit
+	for(auto iter = mIdleDecoders.rbegin(); iter != mIdleDecoders.rend(); ++iter) {
+		if((*iter)->mSubclassIndex == index) {
+			auto decoder = std::move(*iter);
+			mIdleDecoders.erase(std::next(iter).base());
+			return decoder;
+		}
+	}
+
+	return nullptr;
+}
@@ -0,0 +1,135 @@
+/*
+ *  Copyright (C) 2013 Stephen F. Booth <me@sbooth.org>
+ *  All Rights Reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    - Neither the name of Stephen F. Booth nor the names of its 
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <deque>
+
+#include "AudioDecoder.h"
+
+/*! @file DecoderPool.h @brief A pool of reusable \c Decoder objects */
+
+namespace SFB {
+
+	namespace Audio {
+
+		/*!
+		 * @brief A pool of idle decoders that are rebound instead of recreated
+		 *
+		 * Opening a decoder can be expensive: codec handles are allocated, tables are built and buffers are sized.
+		 * When many streams of the same type are opened in succession, as when playing an album or scanning a library,
+		 * a \c DecoderPool keeps decoders that are no longer needed and rebinds them to new input sources
+		 * using \c Decoder::Rebind().
+		 *
+		 * Only decoders created by the \c Decoder factory methods may be pooled.  If no idle decoder of the correct
+		 * type is available, or rebinding fails, a new decoder is created in the usual way.
+		 * @note This class is thread safe
+		 */
+		class DecoderPool
+		{
+
+		public:
+
+			// ========================================
+			/*! @name Creation */
+			//@{
+
+			/*!
+			 * @brief Create a new \c DecoderPool
+			 * @param capacity The maximum number of idle decoders to retain
+			 */
+			explicit DecoderPool(size_t capacity = 4);
+
+			/*! @cond */
+
+			/*! @internal This class is non-copyable */
+			DecoderPool(const DecoderPool& rhs) = delete;
+
+			/*! @internal This class is non-assignable */
+			DecoderPool& operator=(const DecoderPool& rhs) = delete;
+
+			/*! @endcond */
+
+			//@}
+
+
+			// ========================================
+			/*! @name Decoder Access */
+			//@{
+
+			/*!
+			 * @brief Get a \c Decoder object for the specified URL, reusing an idle decoder if possible
+			 * @param url The URL
+			 * @param error An optional pointer to a \c CFErrorRef to receive error information
+			 * @return A \c Decoder object, or \c nullptr on failure
+			 */
+			Decoder::unique_ptr CreateDecoderForURL(CFURLRef url, CFErrorRef *error = nullptr);
+
+			/*!
+			 * @brief Get a \c Decoder object for the specified \c InputSource, reusing an idle decoder if possible
+			 * @note The MIME type takes precedence over the file extension for type resolution
+			 * @param inputSource The input source
+			 * @param mimeType The MIME type of the audio
+			 * @param error An optional pointer to a \c CFErrorRef to receive error information
+			 * @return A \c Decoder object, or \c nullptr on failure
+			 */
+			Decoder::unique_ptr CreateDecoderForInputSource(InputSource::unique_ptr inputSource, CFStringRef mimeType = nullptr, CFErrorRef *error = nullptr);
+
+			/*!
+			 * @brief Return a decoder to the pool
+			 *
+			 * The decoder's input source is closed but the decoder itself remains open, keeping its codec state.
+			 * Decoders not created by the factory methods, and decoders in excess of the pool's capacity, are destroyed.
+			 * @param decoder The decoder to recycle
+			 */
+			void Recycle(Decoder::unique_ptr decoder);
+
+			/*! @brief Destroy all idle decoders */
+			void Clear();
+
+			/*! @brief Get the number of idle decoders */
+			size_t GetIdleDecoderCount() const;
+
+			//@}
+
+		private:
+
+			// Removes and returns an idle decoder of the registered subclass at index, if any
+			Decoder::unique_ptr TakeIdleDecoder(size_t index);
+
+			// Data members
+			size_t							mCapacity;
+			std::deque<Decoder::unique_ptr>	mIdleDecoders;
+			mutable std::mutex				mMutex;
+		};
+
+	}
+}
@@ -0,0 +1,171 @@
+/*
+ *  Copyright (C) 2013 Stephen F. Booth <me@sbooth.org>
+ *  All Rights Reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    - Neither the name of Stephen F. Booth nor the names of its 
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+
+#include "DecoderScheduler.h"
+#include "Logger.h"
+
+SFB::Audio::DecoderScheduler::DecoderScheduler(size_t blockingThreadLimit)
+	: mBlockingThreadLimit(std::max(blockingThreadLimit, (size_t)1)), mActiveRequestCount(0), mStopping(false)
+{
+	mLocalLane.mIdleThreadCount = 0;
+	mBlockingLane.mIdleThreadCount = 0;
+
+	// A single thread suffices for local inputs since their reads don't stall
+	// Threads for inputs that may block are created as requests arrive
+	mLocalLane.mThreads.emplace_back(&DecoderScheduler::ServiceLane, this, std::ref(mLocalLane));
+}
+
+SFB::Audio::DecoderScheduler::~DecoderScheduler()
+{
+	WaitForPendingRequests();
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStopping = true;
+	}
+
+	mCondition.notify_all();
+
+	for(auto& thread : mLocalLane.mThreads)
+		thread.join();
+	for(auto& thread : mBlockingLane.mThreads)
+		thread.join();
+}
+
+bool SFB::Audio::DecoderScheduler::ReadAudio(Decoder& decoder, AudioBufferList *bufferList, UInt32 frameCount, ReadCompletion completion)
+{
+	if(!decoder.IsOpen() || nullptr == bufferList || 0 == frameCount) {
+		LOGGER_WARNING("org.sbooth.AudioEngine.DecoderScheduler", "ReadAudio() called with invalid parameters");
+		return false;
+	}
+
+	Lane& lane = decoder.GetInputSource().MayBlock() ? mBlockingLane : mLocalLane;
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if(mStopping || mCancelledDecoders.count(&decoder))
+			return false;
+
+		lane.mRequests.push_back({ &decoder, bufferList, frameCount, std::move(completion) });
+
+		// Each decoder able to make progress needs a thread, so a stalled read can't delay another decoder
+		if(&mBlockingLane == &lane && lane.mThreads.size() < mBlockingThreadLimit) {
+			std::unordered_set<const Decoder *> runnableDecoders;
+			for(const auto& request : lane.mRequests) {
+				if(0 == mBusyDecoders.count(request.mDecoder))
+					runnableDecoders.insert(request.mDecoder);
+			}
+
+			if(runnableDecoders.size() > lane.mIdleThreadCount) {
+				lane.mThreads.emplace_back(&DecoderScheduler::ServiceLane, this, std::ref(lane));
+				if(mBlockingThreadLimit == lane.mThreads.size())
+					LOGGER_NOTICE("org.sbooth.AudioEngine.DecoderScheduler", "Reached the limit of " << mBlockingThreadLimit << " threads for inputs that may block");
+			}
+		}
+	}
+
+	mCondition.notify_all();
+
+	return true;
+}
+
+void SFB::Audio::DecoderScheduler::CancelRequests(const Decoder& decoder)
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+
+	// A completion called while waiting may request another read, which must not outlive the cancellation
+	mCancelledDecoders.insert(&decoder);
+
+	auto matchesDecoder = [&decoder](const Request& request) { return request.mDecoder == &decoder; };
+	mLocalLane.mRequests.erase(std::remove_if(mLocalLane.mRequests.begin(), mLocalLane.mRequests.end(), matchesDecoder), mLocalLane.mRequests.end());
+	mBlockingLane.mRequests.erase(std::remove_if(mBlockingLane.mRequests.begin(), mBlockingLane.mRequests.end(), matchesDecoder), mBlockingLane.mRequests.end());
+
+	mCondition.wait(lock, [this, &decoder] { return 0 == mBusyDecoders.count(&decoder); });
+
+	mCancelledDecoders.erase(&decoder);
+
+	// Waiters for pending requests may be satisfied now
+	mCondition.notify_all();
+}
+
+void SFB::Audio::DecoderScheduler::WaitForPendingRequests()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	mCondition.wait(lock, [this] { return mLocalLane.mRequests.empty() && mBlockingLane.mRequests.empty() && 0 == mActiveRequestCount; });
+}
+
+size_t SFB::Audio::DecoderScheduler::GetPendingRequestCount() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mLocalLane.mRequests.size() + mBlockingLane.mRequests.size() + mActiveRequestCount;
+}
+
+void SFB::Audio::DecoderScheduler::ServiceLane(Lane& lane)
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+
+	for(;;) {
+		// The oldest request whose decoder isn't in use by another thread is performed next,
+		// which keeps each decoder's requests in order
+		auto iter = lane.mRequests.end();
+		++lane.mIdleThreadCount;
+		mCondition.wait(lock, [&] {
+			iter = std::find_if(lane.mRequests.begin(), lane.mRequests.end(), [this](const Request& request) {
+				return 0 == mBusyDecoders.count(request.mDecoder);
+			});
+			return mStopping || lane.mRequests.end() != iter;
+		});
+		--lane.mIdleThreadCount;
+
+		if(lane.mRequests.end() == iter)
+			return;
+
+		Request request = std::move(*iter);
+		lane.mRequests.erase(iter);
+
+		mBusyDecoders.insert(request.mDecoder);
+		++mActiveRequestCount;
+
+		lock.unlock();
+
+		UInt32 framesRead = request.mDecoder->ReadAudio(request.mBufferList, request.mFrameCount);
+		if(request.mCompletion)
+			request.mCompletion(framesRead);
+
+		lock.lock();
+
+		mBusyDecoders.erase(request.mDecoder);
+		--mActiveRequestCount;
+
+		mCondition.notify_all();
+	}
+}
@@ -0,0 +1,172 @@
+/*
+ *  Copyright (C) 2013 Stephen F. Booth <me@sbooth.org>
+ *  All Rights Reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    - Neither the name of Stephen F. Booth nor the names of its 
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "AudioDecoder.h"
+
+/*! @file DecoderScheduler.h @brief Asynchronous decoding for many decoders on a few threads */
+
+namespace SFB {
+
+	namespace Audio {
+
+		/*!
+		 * @brief Services asynchronous reads from many decoders without letting one stalled input delay the rest
+		 *
+		 * \c Decoder::ReadAudio() blocks until its input provides enough data, which for network inputs may take
+		 * arbitrarily long.  A \c DecoderScheduler accepts read requests without blocking and performs them on its own
+		 * threads, invoking a completion function with the result.  Requests for decoders whose input is local are
+		 * multiplexed on a single thread.  Requests for decoders whose input may block are performed on a separate
+		 * set of threads that grows on demand, giving each such decoder with work a thread of its own, so a stalled
+		 * stream holds up only its own requests.  The number of these threads is bounded; once the bound is reached
+		 * further requests wait for a thread to become available.
+		 *
+		 * Requests for the same decoder are performed in the order they were submitted and never concurrently.
+		 * @note This class is thread safe
+		 * @see InputSource::MayBlock()
+		 */
+		class DecoderScheduler
+		{
+
+		public:
+
+			/*!
+			 * @brief A function called when a read request completes
+			 * @note This is called on one of the scheduler's threads and should return promptly
+			 * @param framesRead The number of frames read, as returned by \c Decoder::ReadAudio()
+			 */
+			typedef std::function<void (UInt32 framesRead)> ReadCompletion;
+
+			// ========================================
+			/*! @name Creation and Destruction */
+			//@{
+
+			/*!
+			 * @brief Create a new \c DecoderScheduler
+			 * @param blockingThreadLimit The maximum number of threads servicing decoders whose input may block
+			 */
+			explicit DecoderScheduler(size_t blockingThreadLimit = 64);
+
+			/*! @brief Destroy the \c DecoderScheduler after performing all pending requests */
+			~DecoderScheduler();
+
+			/*! @cond */
+
+			/*! @internal This class is non-copyable */
+			DecoderScheduler(const DecoderScheduler& rhs) = delete;
+
+			/*! @internal This class is non-assignable */
+			DecoderScheduler& operator=(const DecoderScheduler& rhs) = delete;
+
+			/*! @endcond */
+
+			//@}
+
+
+			// ========================================
+			/*! @name Asynchronous reading */
+			//@{
+
+			/*!
+			 * @brief Request that audio be decoded into the specified buffer
+			 * @note \c decoder and \c bufferList must remain valid until \c completion is called or the request is cancelled
+			 * @param decoder The decoder
+			 * @param bufferList A buffer to receive the decoded audio
+			 * @param frameCount The requested number of audio frames
+			 * @param completion The function to call when the read completes
+			 * @return \c true if the request was queued, \c false otherwise
+			 */
+			bool ReadAudio(Decoder& decoder, AudioBufferList *bufferList, UInt32 frameCount, ReadCompletion completion);
+
+			/*!
+			 * @brief Cancel the pending requests for a decoder
+			 *
+			 * Queued requests are discarded without calling their completion functions.  If a request for \c decoder is
+			 * being performed this waits for it to complete, after which the decoder may safely be destroyed.
+			 * Requests for \c decoder submitted while this is waiting, for example by a completion function, are rejected.
+			 * @note This must not be called from a completion function
+			 * @param decoder The decoder
+			 */
+			void CancelRequests(const Decoder& decoder);
+
+			/*! @brief Wait until all pending requests have been performed */
+			void WaitForPendingRequests();
+
+			/*! @brief Get the number of requests queued or being performed */
+			size_t GetPendingRequestCount() const;
+
+			//@}
+
+		private:
+
+			struct Request
+			{
+				Decoder				*mDecoder;
+				AudioBufferList		*mBufferList;
+				UInt32				mFrameCount;
+				ReadCompletion		mCompletion;
+			};
+
+			// Requests are divided by whether their decoder's input may block
+			struct Lane
+			{
+				std::deque<Request>			mRequests;
+				std::vector<std::thread>	mThreads;
+				size_t						mIdleThreadCount;
+			};
+
+			// Performs requests from lane until the scheduler is destroyed
+			void ServiceLane(Lane& lane);
+
+			// Data members
+			Lane							mLocalLane;
+			Lane							mBlockingLane;
+			size_t							mBlockingThreadLimit;
+
+			std::unordered_set<const Decoder *>	mBusyDecoders;	// Decoders with a request being performed
+			std::unordered_set<const Decoder *>	mCancelledDecoders;	// Decoders whose requests are being cancelled
+			size_t							mActiveRequestCount;
+			bool							mStopping;
+
+			mutable std::mutex				mMutex;
+			std::condition_variable			mCondition;
+		};
+
+	}
+}
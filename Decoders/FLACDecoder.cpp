@@ -28,6 +28,10 @@
  *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <algorithm>
+
+#include <pthread.h>
+
 #include <AudioToolbox/AudioFormat.h>
 
 #include <FLAC/metadata.h>
@@ -35,8 +39,19 @@
 #include "FLACDecoder.h"
 #include "CFWrapper.h"
 #include "CFErrorUtilities.h"
+#include "SampleConversion.h"
 #include "Logger.h"
 
+// Parallel decoding divides the stream into segments of roughly this many compressed bytes
+#define SEGMENT_SIZE_BYTES			(1024 * 1024)
+#define MIN_SEGMENT_SIZE_BYTES		4096
+// Segments are shortened when necessary to limit the memory required for their decoded audio
+#define MAX_SEGMENT_FRAMES			(1024 * 1024)
+#define SEGMENTS_AHEAD_PER_THREAD	2
+
+#define SYNC_SEARCH_SIZE			16384
+#define FRAME_HEADER_MAX_SIZE		16
+
 namespace {
 	
 	void RegisterFLACDecoder() __attribute__ ((constructor));
@@ -138,6 +153,180 @@ namespace {
 		flacDecoder->Error(decoder, status);
 	}
 
+#pragma mark Sample Conversion
+
+	// Convert a decoded FLAC frame to format, placing it in bufferList starting at frameOffset
+	void ConvertFrame(const FLAC__Frame *frame, const FLAC__int32 * const buffer[], const AudioStreamBasicDescription& format, unsigned bitsPerSample, AudioBufferList *bufferList, UInt32 frameOffset)
+	{
+		// FLAC hands us 32-bit signed ints with the samples low-aligned; shift them to high alignment
+		UInt32 shift = (kAudioFormatFlagIsPacked & format.mFormatFlags) ? 0 : (8 * format.mBytesPerFrame) - format.mBitsPerChannel;
+
+		// For float output, scale the samples to [-1, 1)
+		float scale = 1.f / (float)(1u << (bitsPerSample - 1));
+
+		// Convert to native endian samples, high-aligned if necessary
+		for(unsigned channel = 0; channel < frame->header.channels; ++channel) {
+			unsigned char *pullBuffer = (unsigned char *)bufferList->mBuffers[channel].mData + (frameOffset * format.mBytesPerFrame);
+
+			if(kAudioFormatFlagIsFloat & format.mFormatFlags)
+				SFB::Audio::SampleConversion::ConvertInt32ToFloat(buffer[channel], (float *)pullBuffer, frame->header.blocksize, scale);
+			else {
+				switch(format.mBytesPerFrame) {
+					case 1:		SFB::Audio::SampleConversion::ConvertInt32ToInt8(buffer[channel], (int8_t *)pullBuffer, frame->header.blocksize, shift);			break;
+					case 2:		SFB::Audio::SampleConversion::ConvertInt32ToInt16(buffer[channel], (int16_t *)pullBuffer, frame->header.blocksize, shift);		break;
+					case 3:		SFB::Audio::SampleConversion::ConvertInt32ToPackedInt24(buffer[channel], (uint8_t *)pullBuffer, frame->header.blocksize, shift);	break;
+					case 4:		SFB::Audio::SampleConversion::ShiftInt32(buffer[channel], (int32_t *)pullBuffer, frame->header.blocksize, shift);				break;
+				}
+			}
+
+			bufferList->mBuffers[channel].mNumberChannels		= 1;
+			bufferList->mBuffers[channel].mDataByteSize			= (frameOffset + frame->header.blocksize) * format.mBytesPerFrame;
+		}
+	}
+
+#pragma mark Frame Headers
+
+	uint8_t CRC8(const unsigned char *bytes, size_t length)
+	{
+		uint8_t crc = 0;
+		while(length--) {
+			crc ^= *bytes++;
+			for(int i = 0; i < 8; ++i)
+				crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+		}
+
+		return crc;
+	}
+
+	// Validate a frame header against the stream's parameters and determine the number of its first sample
+	bool ParseFrameHeader(const unsigned char *bytes, size_t length, const FLAC__StreamMetadata_StreamInfo& streamInfo, bool& variableBlocksize, SInt64& sampleNumber)
+	{
+		if(5 > length || 0xff != bytes[0] || 0xf8 != (bytes[1] & 0xfe))
+			return false;
+
+		unsigned blocksizeCode		= bytes[2] >> 4;
+		unsigned sampleRateCode		= bytes[2] & 0x0f;
+		unsigned channelAssignment	= bytes[3] >> 4;
+		unsigned sampleSizeCode		= (bytes[3] >> 1) & 0x07;
+
+		// Reject reserved values
+		if(0x00 == blocksizeCode || 0x0f == sampleRateCode || 0x0a < channelAssignment || 0x03 == sampleSizeCode || (bytes[3] & 0x01))
+			return false;
+
+		unsigned channels = (0x08 > channelAssignment) ? channelAssignment + 1 : 2;
+		if(channels != streamInfo.channels)
+			return false;
+
+		// The frame or sample number is coded like UTF-8, using up to 7 bytes
+		unsigned char lead = bytes[4];
+		FLAC__uint64 number;
+		unsigned continuationBytes;
+		if(!(lead & 0x80))				{ number = lead;			continuationBytes = 0; }
+		else if(0xc0 == (lead & 0xe0))	{ number = lead & 0x1f;		continuationBytes = 1; }
+		else if(0xe0 == (lead & 0xf0))	{ number = lead & 0x0f;		continuationBytes = 2; }
+		else if(0xf0 == (lead & 0xf8))	{ number = lead & 0x07;		continuationBytes = 3; }
+		else if(0xf8 == (lead & 0xfc))	{ number = lead & 0x03;		continuationBytes = 4; }
+		else if(0xfc == (lead & 0xfe))	{ number = lead & 0x01;		continuationBytes = 5; }
+		else if(0xfe == lead)			{ number = 0;				continuationBytes = 6; }
+		else
+			return false;
+
+		size_t headerLength = 5 + continuationBytes;
+		headerLength += (0x06 == blocksizeCode) ? 1 : ((0x07 == blocksizeCode) ? 2 : 0);
+		headerLength += (0x0c == sampleRateCode) ? 1 : ((0x0d <= sampleRateCode) ? 2 : 0);
+		headerLength += 1;
+
+		if(headerLength > length)
+			return false;
+
+		for(unsigned i = 0; i < continuationBytes; ++i) {
+			unsigned char byte = bytes[5 + i];
+			if(0x80 != (byte & 0xc0))
+				return false;
+			number = (number << 6) | (byte & 0x3f);
+		}
+
+		if(CRC8(bytes, headerLength - 1) != bytes[headerLength - 1])
+			return false;
+
+		variableBlocksize = bytes[1] & 0x01;
+		sampleNumber = variableBlocksize ? (SInt64)number : (SInt64)number * streamInfo.max_blocksize;
+
+		return true;
+	}
+
+#pragma mark Segment Callbacks
+
+	// The compressed audio for a segment, presented to libFLAC following the stream's header
+	struct SegmentContext
+	{
+		const std::vector<unsigned char>	*mHeader;
+		std::vector<unsigned char>			mData;
+		size_t								mPosition;
+
+		AudioStreamBasicDescription			mFormat;
+		unsigned							mBitsPerSample;
+		SFB::Audio::BufferList				*mBufferList;
+		UInt32								mFramesDecoded;
+	};
+
+	FLAC__StreamDecoderReadStatus segmentReadCallback(const FLAC__StreamDecoder */*decoder*/, FLAC__byte buffer[], size_t *bytes, void *client_data)
+	{
+		assert(nullptr != client_data);
+
+		SegmentContext *context = static_cast<SegmentContext *>(client_data);
+
+		size_t headerSize = context->mHeader->size();
+		size_t bytesRead = 0;
+
+		while(bytesRead < *bytes) {
+			const unsigned char *source = nullptr;
+			size_t bytesAvailable = 0;
+
+			if(context->mPosition < headerSize) {
+				source = context->mHeader->data() + context->mPosition;
+				bytesAvailable = headerSize - context->mPosition;
+			}
+			else if(context->mPosition - headerSize < context->mData.size()) {
+				source = context->mData.data() + (context->mPosition - headerSize);
+				bytesAvailable = context->mData.size() - (context->mPosition - headerSize);
+			}
+			else
+				break;
+
+			size_t bytesToCopy = std::min(bytesAvailable, *bytes - bytesRead);
+			memcpy(buffer + bytesRead, source, bytesToCopy);
+
+			bytesRead += bytesToCopy;
+			context->mPosition += bytesToCopy;
+		}
+
+		*bytes = bytesRead;
+
+		return (bytesRead ? FLAC__STREAM_DECODER_READ_STATUS_CONTINUE : FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM);
+	}
+
+	FLAC__StreamDecoderWriteStatus segmentWriteCallback(const FLAC__StreamDecoder */*decoder*/, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data)
+	{
+		assert(nullptr != client_data);
+
+		SegmentContext *context = static_cast<SegmentContext *>(client_data);
+
+		// A frame that doesn't fit means the segment boundaries are wrong
+		if(frame->header.channels != context->mFormat.mChannelsPerFrame || frame->header.blocksize > context->mBufferList->GetCapacityFrames() - context->mFramesDecoded)
+			return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+
+		ConvertFrame(frame, buffer, context->mFormat, context->mBitsPerSample, *context->mBufferList, context->mFramesDecoded);
+		context->mFramesDecoded += frame->header.blocksize;
+
+		return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+	}
+
+	void segmentErrorCallback(const FLAC__StreamDecoder */*decoder*/, FLAC__StreamDecoderErrorStatus status, void */*client_data*/)
+	{
+		LOGGER_NOTICE("org.sbooth.AudioEngine.Decoder.FLAC", "FLAC error in segment: " << FLAC__StreamDecoderErrorStatusString[status]);
+	}
+
 }
 
 #pragma mark Static Methods
@@ -180,6 +369,25 @@ bool SFB::Audio::FLACDecoder::HandlesMIMEType(CFStringRef mimeType)
 	return false;
 }
 
+bool SFB::Audio::FLACDecoder::HandlesSignature(const void *header, size_t length)
+{
+	if(nullptr == header || 4 > length)
+		return false;
+
+	const unsigned char *bytes = static_cast<const unsigned char *>(header);
+
+	// Native FLAC
+	if(!memcmp(bytes, "fLaC", 4))
+		return true;
+
+	// Ogg FLAC: the first packet begins after the page header and segment table
+	if(27 > length || memcmp(bytes, "OggS", 4))
+		return false;
+
+	size_t packetOffset = 27 + bytes[26];
+	return packetOffset + 5 <= length && !memcmp(bytes + packetOffset, "\x7f" "FLAC", 5);
+}
+
 SFB::Audio::Decoder::unique_ptr SFB::Audio::FLACDecoder::CreateDecoder(InputSource::unique_ptr inputSource)
 {
 	return unique_ptr(new FLACDecoder(std::move(inputSource)));
@@ -188,28 +396,45 @@ SFB::Audio::Decoder::unique_ptr SFB::Audio::FLACDecoder::CreateDecoder(InputSour
 #pragma mark Creation and Destruction
 
 SFB::Audio::FLACDecoder::FLACDecoder(InputSource::unique_ptr inputSource)
-	: Decoder(std::move(inputSource)), mFLAC(nullptr, nullptr), mCurrentFrame(0)
+	: Decoder(std::move(inputSource)), mFLAC(nullptr, nullptr), mCurrentFrame(0), mBufferFrameOffset(0), mOutputBufferList(nullptr), mOutputFrameOffset(0), mOutputFrameCapacity(0), mDecodingInParallel(false), mNextSegmentToDecode(0), mNextSegmentToRead(0), mSegmentGeneration(0), mStopWorkers(false), mSegmentFrameOffset(0)
 {
 	memset(&mStreamInfo, 0, sizeof(mStreamInfo));
 }
 
+SFB::Audio::FLACDecoder::~FLACDecoder()
+{
+	if(IsOpen())
+		Close();
+}
+
 #pragma mark Functionality
 
 bool SFB::Audio::FLACDecoder::_Open(CFErrorRef *error)
 {
-	SFB::CFString extension = CFURLCopyPathExtension(GetURL());
-	if(!extension)
-		return false;
+	// Determine whether the stream is native or Ogg FLAC, preferring the stream's signature to the file's extension
+	bool isOggFLAC = false;
+
+	unsigned char signature [4];
+	if(mInputSource->SupportsSeeking() && 0 == mInputSource->GetOffset() && sizeof(signature) == mInputSource->Read(signature, sizeof(signature)) && mInputSource->SeekToOffset(0))
+		isOggFLAC = !memcmp(signature, "OggS", 4);
+	else {
+		SFB::CFString extension = GetURL() ? CFURLCopyPathExtension(GetURL()) : nullptr;
+		if(!extension)
+			return false;
 
-	// Create FLAC decoder
-	mFLAC = unique_FLAC_ptr(FLAC__stream_decoder_new(), [](FLAC__StreamDecoder *decoder){
-		if(decoder) {
-			if(!FLAC__stream_decoder_finish(decoder))
-				LOGGER_NOTICE("org.sbooth.AudioEngine.Decoder.FLAC", "FLAC__stream_decoder_finish failed: " << FLAC__stream_decoder_get_resolved_state_string(decoder));
+		isOggFLAC = kCFCompareEqualTo == CFStringCompare(extension, CFSTR("oga"), kCFCompareCaseInsensitive);
+	}
 
-			FLAC__stream_decoder_delete(decoder);
-		}
-	});
+	// Create FLAC decoder, unless one remains from an earlier stream
+	if(!mFLAC)
+		mFLAC = unique_FLAC_ptr(FLAC__stream_decoder_new(), [](FLAC__StreamDecoder *decoder){
+			if(decoder) {
+				if(!FLAC__stream_decoder_finish(decoder))
+					LOGGER_NOTICE("org.sbooth.AudioEngine.Decoder.FLAC", "FLAC__stream_decoder_finish failed: " << FLAC__stream_decoder_get_resolved_state_string(decoder));
+
+				FLAC__stream_decoder_delete(decoder);
+			}
+		});
 
 	if(!mFLAC) {
 		if(error)
@@ -220,8 +445,7 @@ bool SFB::Audio::FLACDecoder::_Open(CFErrorRef *error)
 	// Initialize decoder
 	FLAC__StreamDecoderInitStatus status = FLAC__STREAM_DECODER_INIT_STATUS_ERROR_OPENING_FILE;
 	
-	// Attempt to create a stream decoder based on the file's extension
-	if(kCFCompareEqualTo == CFStringCompare(extension, CFSTR("flac"), kCFCompareCaseInsensitive))
+	if(!isOggFLAC)
 		status = FLAC__stream_decoder_init_stream(mFLAC.get(),
 												  readCallback,
 												  seekCallback,
@@ -232,7 +456,7 @@ bool SFB::Audio::FLACDecoder::_Open(CFErrorRef *error)
 												  metadataCallback,
 												  errorCallback,
 												  this);
-	else if(kCFCompareEqualTo == CFStringCompare(extension, CFSTR("oga"), kCFCompareCaseInsensitive))
+	else
 		status = FLAC__stream_decoder_init_ogg_stream(mFLAC.get(),
 													  readCallback,
 													  seekCallback,
@@ -318,6 +542,15 @@ bool SFB::Audio::FLACDecoder::_Open(CFErrorRef *error)
 		}
 	}
 	
+	// Convert the samples to float as they are decoded if requested
+	if(mPrefersFloatOutput) {
+		mFormat.mFormatFlags		= kAudioFormatFlagsNativeFloatPacked | kAudioFormatFlagIsNonInterleaved;
+		mFormat.mBitsPerChannel		= 8 * sizeof(float);
+
+		mFormat.mBytesPerPacket		= sizeof(float);
+		mFormat.mBytesPerFrame		= mFormat.mBytesPerPacket * mFormat.mFramesPerPacket;
+	}
+
 	// Set up the source format
 	mSourceFormat.mFormatID				= 'FLAC';
 	
@@ -339,7 +572,9 @@ bool SFB::Audio::FLACDecoder::_Open(CFErrorRef *error)
 	}
 	
 	// Allocate the buffer list (which will convert from FLAC's push model to Core Audio's pull model)
-	if(!mBufferList.Allocate(mFormat, mStreamInfo.max_blocksize)) {
+	// A buffer from an earlier stream is reused if it is large enough
+	bool bufferIsReusable = mBufferList && mBufferList->mNumberBuffers == mFormat.mChannelsPerFrame && mBufferList.GetBytesPerFrame() == mFormat.mBytesPerFrame && mBufferList.GetCapacityFrames() >= mStreamInfo.max_blocksize;
+	if(!bufferIsReusable && !mBufferList.Allocate(mFormat, mStreamInfo.max_blocksize)) {
 		LOGGER_CRIT("org.sbooth.AudioEngine.Decoder.FLAC", "Unable to allocate memory")
 
 		if(error)
@@ -350,12 +585,19 @@ bool SFB::Audio::FLACDecoder::_Open(CFErrorRef *error)
 
 	for(UInt32 i = 0; i < mBufferList->mNumberBuffers; ++i)
 		mBufferList->mBuffers[i].mDataByteSize = 0;
+	mBufferFrameOffset = 0;
+
+	// FLAC frames decode independently, so bulk work can trade memory for throughput by decoding ahead on several threads
+	if(mPrefersParallelDecoding && !isOggFLAC)
+		mDecodingInParallel = BeginParallelDecoding();
 
 	return true;
 }
 
 bool SFB::Audio::FLACDecoder::_Close(CFErrorRef */*error*/)
 {
+	EndParallelDecoding();
+
 	mFLAC.reset();
 	mBufferList.Deallocate();
 	memset(&mStreamInfo, 0, sizeof(mStreamInfo));
@@ -379,6 +621,16 @@ UInt32 SFB::Audio::FLACDecoder::_ReadAudio(AudioBufferList *bufferList, UInt32 f
 		return 0;
 	}
 
+	if(mDecodingInParallel) {
+		UInt32 framesRead = ReadAudioInParallel(bufferList, frameCount);
+
+		// If a segment failed to decode parallel decoding has ended, and the request can be completed serially
+		if(mDecodingInParallel || framesRead) {
+			mCurrentFrame += framesRead;
+			return framesRead;
+		}
+	}
+
 	UInt32 framesRead = 0;
 
 	// Reset output buffer data size
@@ -387,26 +639,28 @@ UInt32 SFB::Audio::FLACDecoder::_ReadAudio(AudioBufferList *bufferList, UInt32 f
 
 	for(;;) {
 		UInt32	framesRemaining	= frameCount - framesRead;
-		UInt32	framesToSkip	= (UInt32)(bufferList->mBuffers[0].mDataByteSize / mFormat.mBytesPerFrame);
-		UInt32	framesInBuffer	= (UInt32)(mBufferList->mBuffers[0].mDataByteSize / mFormat.mBytesPerFrame);
+		UInt32	framesInBuffer	= (UInt32)(mBufferList->mBuffers[0].mDataByteSize / mFormat.mBytesPerFrame) - mBufferFrameOffset;
 		UInt32	framesToCopy	= std::min(framesInBuffer, framesRemaining);
 
-		// Copy data from the buffer to output
-		for(UInt32 i = 0; i < mBufferList->mNumberBuffers; ++i) {
-			unsigned char *pullBuffer = (unsigned char *)bufferList->mBuffers[i].mData;
-			memcpy(pullBuffer + (framesToSkip * mFormat.mBytesPerFrame), mBufferList->mBuffers[i].mData, framesToCopy * mFormat.mBytesPerFrame);
-			bufferList->mBuffers[i].mDataByteSize += framesToCopy * mFormat.mBytesPerFrame;
-
-			// Move remaining data in buffer to beginning
-			if(framesToCopy != framesInBuffer) {
-				pullBuffer = (unsigned char *)mBufferList->mBuffers[i].mData;
-				memmove(pullBuffer, pullBuffer + (framesToCopy * mFormat.mBytesPerFrame), (framesInBuffer - framesToCopy) * mFormat.mBytesPerFrame);
+		// Copy data from the buffer to output, advancing past the frames consumed
+		if(framesToCopy) {
+			for(UInt32 i = 0; i < mBufferList->mNumberBuffers; ++i) {
+				unsigned char *pullBuffer = (unsigned char *)bufferList->mBuffers[i].mData;
+				const unsigned char *stagedBuffer = (const unsigned char *)mBufferList->mBuffers[i].mData;
+				memcpy(pullBuffer + (framesRead * mFormat.mBytesPerFrame), stagedBuffer + (mBufferFrameOffset * mFormat.mBytesPerFrame), framesToCopy * mFormat.mBytesPerFrame);
+				bufferList->mBuffers[i].mDataByteSize += framesToCopy * mFormat.mBytesPerFrame;
 			}
 
-			mBufferList->mBuffers[i].mDataByteSize -= (UInt32)(framesToCopy * mFormat.mBytesPerFrame);
+			mBufferFrameOffset += framesToCopy;
+			framesRead += framesToCopy;
 		}
 
-		framesRead += framesToCopy;
+		// Once the buffer is drained it may be refilled from the beginning
+		if(framesToCopy == framesInBuffer) {
+			for(UInt32 i = 0; i < mBufferList->mNumberBuffers; ++i)
+				mBufferList->mBuffers[i].mDataByteSize = 0;
+			mBufferFrameOffset = 0;
+		}
 
 		// All requested frames were read
 		if(framesRead == frameCount)
@@ -416,10 +670,20 @@ UInt32 SFB::Audio::FLACDecoder::_ReadAudio(AudioBufferList *bufferList, UInt32 f
 		if(FLAC__STREAM_DECODER_END_OF_STREAM == FLAC__stream_decoder_get_state(mFLAC.get()))
 			break;
 
-		// Grab the next frame
+		// Grab the next frame, which Write() places directly in the output if there is room
+		mOutputBufferList = bufferList;
+		mOutputFrameOffset = framesRead;
+		mOutputFrameCapacity = frameCount;
+
 		FLAC__bool result = FLAC__stream_decoder_process_single(mFLAC.get());
-		if(!result)
+
+		framesRead = mOutputFrameOffset;
+		mOutputBufferList = nullptr;
+
+		if(!result) {
 			LOGGER_ERR("org.sbooth.AudioEngine.Decoder.FLAC", "FLAC__stream_decoder_process_single failed: " << FLAC__stream_decoder_get_resolved_state_string(mFLAC.get()));
+			break;
+		}
 	}
 
 	mCurrentFrame += framesRead;
@@ -429,21 +693,43 @@ UInt32 SFB::Audio::FLACDecoder::_ReadAudio(AudioBufferList *bufferList, UInt32 f
 
 SInt64 SFB::Audio::FLACDecoder::_SeekToFrame(SInt64 frame)
 {
+	if(mDecodingInParallel)
+		return SeekToFrameInParallel(frame);
+
+	// libFLAC delivers the frame containing the target sample during the seek, so empty the buffer beforehand
+	for(UInt32 i = 0; i < mBufferList->mNumberBuffers; ++i)
+		mBufferList->mBuffers[i].mDataByteSize = 0;
+	mBufferFrameOffset = 0;
+
 	FLAC__bool result = FLAC__stream_decoder_seek_absolute(mFLAC.get(), (FLAC__uint64)frame);
 	
 	// Attempt to re-sync the stream if necessary
-	if(FLAC__STREAM_DECODER_SEEK_ERROR == FLAC__stream_decoder_get_state(mFLAC.get()))
+	if(FLAC__STREAM_DECODER_SEEK_ERROR == FLAC__stream_decoder_get_state(mFLAC.get())) {
 		result = FLAC__stream_decoder_flush(mFLAC.get());
-	
-	if(result) {
-		mCurrentFrame = frame;
 		for(UInt32 i = 0; i < mBufferList->mNumberBuffers; ++i)
-			mBufferList->mBuffers[i].mDataByteSize = 0;	
+			mBufferList->mBuffers[i].mDataByteSize = 0;
 	}
 	
+	if(result)
+		mCurrentFrame = frame;
+	
 	return (result ? frame : -1);
 }
 
+bool SFB::Audio::FLACDecoder::_Rebind(CFErrorRef *error)
+{
+	EndParallelDecoding();
+
+	// Finishing returns the decoder to the uninitialized state so it may be initialized for the new stream
+	if(!FLAC__stream_decoder_finish(mFLAC.get()))
+		LOGGER_NOTICE("org.sbooth.AudioEngine.Decoder.FLAC", "FLAC__stream_decoder_finish failed: " << FLAC__stream_decoder_get_resolved_state_string(mFLAC.get()));
+
+	memset(&mStreamInfo, 0, sizeof(mStreamInfo));
+	mCurrentFrame = 0;
+
+	return _Open(error);
+}
+
 #pragma mark Callbacks
 
 FLAC__StreamDecoderWriteStatus SFB::Audio::FLACDecoder::Write(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[])
@@ -456,85 +742,21 @@ FLAC__StreamDecoderWriteStatus SFB::Audio::FLACDecoder::Write(const FLAC__Stream
 	if(nullptr == mBufferList || mBufferList->mNumberBuffers != frame->header.channels)
 		return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
 
-	// FLAC hands us 32-bit signed ints with the samples low-aligned; shift them to high alignment
-	UInt32 shift = (kAudioFormatFlagIsPacked & mFormat.mFormatFlags) ? 0 : (8 * mFormat.mBytesPerFrame) - mFormat.mBitsPerChannel;
-
-	// Convert to native endian samples, high-aligned if necessary
-	switch(mFormat.mBytesPerFrame) {
-		case 1:
-		{
-			for(unsigned channel = 0; channel < frame->header.channels; ++channel) {
-				char *pullBuffer = (char *)mBufferList->mBuffers[channel].mData;
-
-				for(unsigned sample = 0; sample < frame->header.blocksize; ++sample)
-					*pullBuffer++ = (char)(buffer[channel][sample] << shift);
-				
-				mBufferList->mBuffers[channel].mNumberChannels		= 1;
-				mBufferList->mBuffers[channel].mDataByteSize		= frame->header.blocksize * sizeof(char);
-			}
-
-			break;
-		}
-
-		case 2:
-		{
-			for(unsigned channel = 0; channel < frame->header.channels; ++channel) {
-				short *pullBuffer = (short *)mBufferList->mBuffers[channel].mData;
-				
-				for(unsigned sample = 0; sample < frame->header.blocksize; ++sample)
-					*pullBuffer++ = (short)(buffer[channel][sample] << shift);
-				
-				mBufferList->mBuffers[channel].mNumberChannels		= 1;
-				mBufferList->mBuffers[channel].mDataByteSize		= frame->header.blocksize * sizeof(short);
-			}
-			
-			break;
-		}
+	// Decode directly into the caller's buffer when the whole frame fits; otherwise stage it
+	AudioBufferList *bufferList = mBufferList;
+	UInt32 frameOffset = 0;
+	if(nullptr != mOutputBufferList && frame->header.blocksize <= mOutputFrameCapacity - mOutputFrameOffset) {
+		bufferList = mOutputBufferList;
+		frameOffset = mOutputFrameOffset;
+	}
+	else if(frame->header.blocksize > mBufferList.GetCapacityFrames())
+		return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
 
-		case 3:
-		{
-			for(unsigned channel = 0; channel < frame->header.channels; ++channel) {
-				unsigned char *pullBuffer = (unsigned char *)mBufferList->mBuffers[channel].mData;
-
-				FLAC__int32 value;
-				for(unsigned sample = 0; sample < frame->header.blocksize; ++sample) {
-					value = buffer[channel][sample] << shift;
-#if __BIG_ENDIAN__
-					*pullBuffer++ = (unsigned char)((value >> 16) & 0xff);
-					*pullBuffer++ = (unsigned char)((value >> 8) & 0xff);
-					*pullBuffer++ = (unsigned char)(value & 0xff);
-#elif __LITTLE_ENDIAN__
-					*pullBuffer++ = (unsigned char)(value & 0xff);
-					*pullBuffer++ = (unsigned char)((value >> 8) & 0xff);
-					*pullBuffer++ = (unsigned char)((value >> 16) & 0xff);
-#else
-#  error Unknown OS byte order
-#endif
-				}
+	ConvertFrame(frame, buffer, mFormat, mStreamInfo.bits_per_sample, bufferList, frameOffset);
 
-				mBufferList->mBuffers[channel].mNumberChannels		= 1;
-				mBufferList->mBuffers[channel].mDataByteSize		= frame->header.blocksize * 3 * sizeof(unsigned char);
-			}
+	if(bufferList == mOutputBufferList)
+		mOutputFrameOffset += frame->header.blocksize;
 
-			break;
-		}
-
-		case 4:
-		{
-			for(unsigned channel = 0; channel < frame->header.channels; ++channel) {
-				int *pullBuffer = (int *)mBufferList->mBuffers[channel].mData;
-				
-				for(unsigned sample = 0; sample < frame->header.blocksize; ++sample)
-					*pullBuffer++ = (int)(buffer[channel][sample] << shift);
-				
-				mBufferList->mBuffers[channel].mNumberChannels		= 1;
-				mBufferList->mBuffers[channel].mDataByteSize		= frame->header.blocksize * sizeof(int);
-			}
-			
-			break;
-		}
-	}
-	
 	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;	
 }
 
@@ -559,3 +781,363 @@ void SFB::Audio::FLACDecoder::Error(const FLAC__StreamDecoder *decoder, FLAC__St
 	
 	LOGGER_ERR("org.sbooth.AudioEngine.Decoder.FLAC", "FLAC error: " << FLAC__StreamDecoderErrorStatusString[status]);
 }
+
+#pragma mark Parallel Decoding
+
+bool SFB::Audio::FLACDecoder::BeginParallelDecoding()
+{
+	unsigned threadCount = std::thread::hardware_concurrency();
+	if(2 > threadCount || 0 == mStreamInfo.total_samples || !mInputSource->SupportsSeeking())
+		return false;
+
+	// After the metadata has been processed the decode position is the offset of the first frame
+	FLAC__uint64 firstFrameOffset;
+	if(!FLAC__stream_decoder_get_decode_position(mFLAC.get(), &firstFrameOffset))
+		return false;
+
+	SInt64 length = mInputSource->GetLength();
+	if(-1 == length || (SInt64)firstFrameOffset + SEGMENT_SIZE_BYTES >= length)
+		return false;
+
+	// libFLAC has read ahead, so restore the input's position afterwards for serial decoding
+	SInt64 inputOffset = mInputSource->GetOffset();
+
+	// Save everything preceding the first frame so each segment can be presented to libFLAC as a complete stream
+	mStreamHeader.resize((size_t)firstFrameOffset);
+
+	bool headerWasRead = mInputSource->SeekToOffset(0) && (SInt64)firstFrameOffset == mInputSource->Read(mStreamHeader.data(), (SInt64)firstFrameOffset);
+
+	// The first frame's header determines the blocking strategy, which all subsequent frames share
+	unsigned char frameHeader [FRAME_HEADER_MAX_SIZE];
+	SInt64 frameHeaderSize = headerWasRead ? mInputSource->Read(frameHeader, sizeof(frameHeader)) : 0;
+
+	bool variableBlocksize = false;
+	SInt64 firstSample = -1;
+
+	if(0 >= frameHeaderSize || !ParseFrameHeader(frameHeader, (size_t)frameHeaderSize, mStreamInfo, variableBlocksize, firstSample) || 0 != firstSample) {
+		LOGGER_NOTICE("org.sbooth.AudioEngine.Decoder.FLAC", "Unable to locate the first frame; decoding serially");
+		mStreamHeader.clear();
+		mInputSource->SeekToOffset(inputOffset);
+		return false;
+	}
+
+	// Divide the audio into segments at frame boundaries, limiting both their compressed and decoded sizes
+	SInt64 totalFrames = (SInt64)mStreamInfo.total_samples;
+	SInt64 distance = SEGMENT_SIZE_BYTES;
+
+	mSegments.push_back({ (SInt64)firstFrameOffset, 0 });
+
+	for(;;) {
+		Segment last = mSegments.back();
+		Segment next;
+
+		bool found = last.mOffset + distance < length && FindFrame(last.mOffset + distance, variableBlocksize, next);
+
+		// A boundary out of sequence indicates a false sync or a damaged stream; leave the remainder as a single segment
+		if(found && (next.mFrame <= last.mFrame || next.mFrame >= totalFrames))
+			break;
+
+		SInt64 segmentFrames = (found ? next.mFrame : totalFrames) - last.mFrame;
+		if(MAX_SEGMENT_FRAMES < segmentFrames && MIN_SEGMENT_SIZE_BYTES < distance) {
+			distance /= 2;
+			continue;
+		}
+
+		if(!found)
+			break;
+
+		mSegments.push_back(next);
+		distance = SEGMENT_SIZE_BYTES;
+	}
+
+	mSegments.push_back({ length, totalFrames });
+
+	mInputSource->SeekToOffset(inputOffset);
+
+	// Decoding a stream that couldn't be divided sensibly in parallel gains nothing
+	bool segmentsAreUsable = 2 < mSegments.size();
+	for(size_t i = 1; segmentsAreUsable && i < mSegments.size(); ++i)
+		segmentsAreUsable = 4 * MAX_SEGMENT_FRAMES >= mSegments[i].mFrame - mSegments[i - 1].mFrame;
+
+	if(!segmentsAreUsable) {
+		LOGGER_INFO("org.sbooth.AudioEngine.Decoder.FLAC", "Unable to divide the stream into segments; decoding serially");
+		mSegments.clear();
+		mStreamHeader.clear();
+		return false;
+	}
+
+	LOGGER_INFO("org.sbooth.AudioEngine.Decoder.FLAC", "Decoding " << (mSegments.size() - 1) << " segments using " << threadCount << " threads");
+
+	mNextSegmentToDecode = 0;
+	mNextSegmentToRead = 0;
+	mStopWorkers = false;
+
+	for(unsigned i = 0; i < threadCount; ++i)
+		mWorkerThreads.push_back(std::thread(&FLACDecoder::ParallelDecodingThreadEntry, this, (size_t)(SEGMENTS_AHEAD_PER_THREAD * threadCount)));
+
+	return true;
+}
+
+void SFB::Audio::FLACDecoder::EndParallelDecoding()
+{
+	{
+		std::lock_guard<std::mutex> lock(mSegmentMutex);
+		mStopWorkers = true;
+	}
+
+	mSegmentCondition.notify_all();
+
+	for(auto& thread : mWorkerThreads)
+		thread.join();
+
+	mWorkerThreads.clear();
+	mDecodedSegments.clear();
+	mCurrentSegment.reset();
+	mSegmentFrameOffset = 0;
+	mSegments.clear();
+	mStreamHeader.clear();
+
+	mStopWorkers = false;
+	mDecodingInParallel = false;
+}
+
+bool SFB::Audio::FLACDecoder::FindFrame(SInt64 offset, bool variableBlocksize, Segment& segment)
+{
+	// This is only called before the worker threads are started, so the input source may be used directly
+	unsigned char buffer [SYNC_SEARCH_SIZE];
+	SInt64 searchEnd = offset + SEGMENT_SIZE_BYTES;
+
+	while(offset < searchEnd) {
+		if(!mInputSource->SeekToOffset(offset))
+			return false;
+
+		SInt64 bytesRead = mInputSource->Read(buffer, sizeof(buffer));
+		if(0 >= bytesRead)
+			return false;
+
+		// Frames begin with a sync code and are confirmed by the header's CRC
+		unsigned char syncByte = variableBlocksize ? 0xf9 : 0xf8;
+		for(SInt64 i = 0; i + 1 < bytesRead; ++i) {
+			if(0xff != buffer[i] || syncByte != buffer[i + 1])
+				continue;
+
+			bool frameIsVariableBlocksize;
+			SInt64 sampleNumber;
+			if(ParseFrameHeader(buffer + i, (size_t)(bytesRead - i), mStreamInfo, frameIsVariableBlocksize, sampleNumber)) {
+				segment.mOffset = offset + i;
+				segment.mFrame = sampleNumber;
+				return true;
+			}
+		}
+
+		if((SInt64)sizeof(buffer) > bytesRead)
+			return false;
+
+		// Overlap the windows so a header spanning them isn't missed
+		offset += bytesRead - FRAME_HEADER_MAX_SIZE;
+	}
+
+	return false;
+}
+
+std::unique_ptr<SFB::Audio::FLACDecoder::DecodedSegment> SFB::Audio::FLACDecoder::DecodeSegment(size_t segmentIndex)
+{
+	const Segment& first = mSegments[segmentIndex];
+	const Segment& next = mSegments[segmentIndex + 1];
+
+	std::unique_ptr<DecodedSegment> segment(new DecodedSegment);
+	segment->mFrameCount = (UInt32)(next.mFrame - first.mFrame);
+	segment->mSucceeded = false;
+
+	if(!segment->mBufferList.Allocate(mFormat, segment->mFrameCount)) {
+		LOGGER_ERR("org.sbooth.AudioEngine.Decoder.FLAC", "Unable to allocate memory");
+		return segment;
+	}
+
+	SegmentContext context;
+	context.mHeader			= &mStreamHeader;
+	context.mPosition		= 0;
+	context.mFormat			= mFormat;
+	context.mBitsPerSample	= mStreamInfo.bits_per_sample;
+	context.mBufferList		= &segment->mBufferList;
+	context.mFramesDecoded	= 0;
+
+	context.mData.resize((size_t)(next.mOffset - first.mOffset));
+
+	{
+		std::lock_guard<std::mutex> lock(mInputMutex);
+		if(!mInputSource->SeekToOffset(first.mOffset) || (SInt64)context.mData.size() != mInputSource->Read(context.mData.data(), (SInt64)context.mData.size())) {
+			LOGGER_ERR("org.sbooth.AudioEngine.Decoder.FLAC", "Unable to read segment " << segmentIndex);
+			return segment;
+		}
+	}
+
+	auto flac = unique_FLAC_ptr(FLAC__stream_decoder_new(), [](FLAC__StreamDecoder *decoder){
+		if(decoder) {
+			FLAC__stream_decoder_finish(decoder);
+			FLAC__stream_decoder_delete(decoder);
+		}
+	});
+
+	if(!flac || FLAC__STREAM_DECODER_INIT_STATUS_OK != FLAC__stream_decoder_init_stream(flac.get(), segmentReadCallback, nullptr, nullptr, nullptr, nullptr, segmentWriteCallback, nullptr, segmentErrorCallback, &context)) {
+		LOGGER_ERR("org.sbooth.AudioEngine.Decoder.FLAC", "Unable to create a decoder for segment " << segmentIndex);
+		return segment;
+	}
+
+	if(!FLAC__stream_decoder_process_until_end_of_stream(flac.get())) {
+		LOGGER_ERR("org.sbooth.AudioEngine.Decoder.FLAC", "FLAC__stream_decoder_process_until_end_of_stream failed for segment " << segmentIndex << ": " << FLAC__stream_decoder_get_resolved_state_string(flac.get()));
+		return segment;
+	}
+
+	// The join is sample-exact only if the segment decoded to precisely the expected number of frames
+	segment->mSucceeded = context.mFramesDecoded == segment->mFrameCount;
+	if(!segment->mSucceeded)
+		LOGGER_NOTICE("org.sbooth.AudioEngine.Decoder.FLAC", "Segment " << segmentIndex << " decoded to " << context.mFramesDecoded << " frames, expected " << segment->mFrameCount);
+
+	return segment;
+}
+
+void SFB::Audio::FLACDecoder::ParallelDecodingThreadEntry(size_t segmentsAhead)
+{
+	pthread_setname_np("org.sbooth.AudioEngine.Decoder.FLAC.Worker");
+
+	size_t segmentCount = mSegments.size() - 1;
+
+	for(;;) {
+		size_t segmentIndex;
+		UInt32 generation;
+
+		// Claim the next segment, staying a bounded distance ahead of the reader
+		{
+			std::unique_lock<std::mutex> lock(mSegmentMutex);
+			mSegmentCondition.wait(lock, [&]() {
+				return mStopWorkers || (mNextSegmentToDecode < segmentCount && mNextSegmentToDecode < mNextSegmentToRead + segmentsAhead);
+			});
+
+			if(mStopWorkers)
+				return;
+
+			segmentIndex = mNextSegmentToDecode++;
+			generation = mSegmentGeneration;
+		}
+
+		auto segment = DecodeSegment(segmentIndex);
+
+		{
+			std::lock_guard<std::mutex> lock(mSegmentMutex);
+			if(generation == mSegmentGeneration)
+				mDecodedSegments[segmentIndex] = std::move(segment);
+		}
+
+		mSegmentCondition.notify_all();
+	}
+}
+
+UInt32 SFB::Audio::FLACDecoder::ReadAudioInParallel(AudioBufferList *bufferList, UInt32 frameCount)
+{
+	size_t segmentCount = mSegments.size() - 1;
+	UInt32 framesRead = 0;
+
+	while(framesRead < frameCount) {
+		UInt32 framesInSegment = mCurrentSegment ? mCurrentSegment->mFrameCount - mSegmentFrameOffset : 0;
+		if(framesInSegment) {
+			UInt32 framesToCopy = std::min(framesInSegment, frameCount - framesRead);
+
+			for(UInt32 i = 0; i < bufferList->mNumberBuffers; ++i) {
+				unsigned char *pullBuffer = (unsigned char *)bufferList->mBuffers[i].mData;
+				const unsigned char *segmentBuffer = (const unsigned char *)mCurrentSegment->mBufferList->mBuffers[i].mData;
+				memcpy(pullBuffer + (framesRead * mFormat.mBytesPerFrame), segmentBuffer + (mSegmentFrameOffset * mFormat.mBytesPerFrame), framesToCopy * mFormat.mBytesPerFrame);
+			}
+
+			mSegmentFrameOffset += framesToCopy;
+			framesRead += framesToCopy;
+
+			continue;
+		}
+
+		// EOS?
+		if(mNextSegmentToRead >= segmentCount)
+			break;
+
+		// Segments complete out of order, so wait for the next one in sequence
+		std::unique_ptr<DecodedSegment> segment;
+		size_t segmentIndex;
+
+		{
+			std::unique_lock<std::mutex> lock(mSegmentMutex);
+			mSegmentCondition.wait(lock, [&]() {
+				return mDecodedSegments.count(mNextSegmentToRead);
+			});
+
+			auto iter = mDecodedSegments.find(mNextSegmentToRead);
+			segment = std::move(iter->second);
+			mDecodedSegments.erase(iter);
+
+			segmentIndex = mNextSegmentToRead++;
+		}
+
+		mSegmentCondition.notify_all();
+
+		SInt64 position = mCurrentFrame + framesRead;
+
+		// Continue serially from the first undelivered frame
+		if(!segment->mSucceeded) {
+			LOGGER_NOTICE("org.sbooth.AudioEngine.Decoder.FLAC", "Parallel decoding failed at segment " << segmentIndex << "; decoding serially");
+
+			EndParallelDecoding();
+
+			for(UInt32 i = 0; i < mBufferList->mNumberBuffers; ++i)
+				mBufferList->mBuffers[i].mDataByteSize = 0;
+			mBufferFrameOffset = 0;
+
+			if(!FLAC__stream_decoder_seek_absolute(mFLAC.get(), (FLAC__uint64)position))
+				LOGGER_ERR("org.sbooth.AudioEngine.Decoder.FLAC", "FLAC__stream_decoder_seek_absolute failed: " << FLAC__stream_decoder_get_resolved_state_string(mFLAC.get()));
+
+			break;
+		}
+
+		// Following a seek the position may be within the segment
+		mCurrentSegment = std::move(segment);
+		mSegmentFrameOffset = (UInt32)(position - mSegments[segmentIndex].mFrame);
+	}
+
+	for(UInt32 i = 0; i < bufferList->mNumberBuffers; ++i) {
+		bufferList->mBuffers[i].mNumberChannels = 1;
+		bufferList->mBuffers[i].mDataByteSize = framesRead * mFormat.mBytesPerFrame;
+	}
+
+	return framesRead;
+}
+
+SInt64 SFB::Audio::FLACDecoder::SeekToFrameInParallel(SInt64 frame)
+{
+	auto iter = std::upper_bound(mSegments.begin(), mSegments.end() - 1, frame, [](SInt64 value, const Segment& segment) {
+		return value < segment.mFrame;
+	});
+
+	size_t segmentIndex = (size_t)(iter - mSegments.begin()) - 1;
+
+	// Seeks within the current segment don't require decoding
+	if(mCurrentSegment && segmentIndex + 1 == mNextSegmentToRead) {
+		mSegmentFrameOffset = (UInt32)(frame - mSegments[segmentIndex].mFrame);
+		mCurrentFrame = frame;
+		return mCurrentFrame;
+	}
+
+	// Discard decoded audio and restart the workers at the segment containing frame
+	{
+		std::lock_guard<std::mutex> lock(mSegmentMutex);
+		++mSegmentGeneration;
+		mDecodedSegments.clear();
+		mNextSegmentToDecode = segmentIndex;
+		mNextSegmentToRead = segmentIndex;
+	}
+
+	mSegmentCondition.notify_all();
+
+	mCurrentSegment.reset();
+	mSegmentFrameOffset = 0;
+	mCurrentFrame = frame;
+
+	return mCurrentFrame;
+}
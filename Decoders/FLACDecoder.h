@@ -30,6 +30,12 @@
 
 #pragma once
 
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include <FLAC/stream_decoder.h>
 
 #include "AudioDecoder.h"
@@ -53,11 +59,13 @@ namespace SFB {
 
 			static bool HandlesFilesWithExtension(CFStringRef extension);
 			static bool HandlesMIMEType(CFStringRef mimeType);
+			static bool HandlesSignature(const void *header, size_t length);
 
 			static Decoder::unique_ptr CreateDecoder(InputSource::unique_ptr inputSource);
 
 			// Creation
 			FLACDecoder(InputSource::unique_ptr inputSource);
+			~FLACDecoder();
 
 		private:
 
@@ -79,15 +87,70 @@ namespace SFB {
 			inline virtual bool _SupportsSeeking() const			{ return mInputSource->SupportsSeeking(); }
 			virtual SInt64 _SeekToFrame(SInt64 frame);
 
+			// Reuse the libFLAC decoder and buffers for a new stream
+			virtual bool _Rebind(CFErrorRef *error);
+
+			// The worker threads read from the input source
+			inline virtual void _EndBackgroundActivity()			{ EndParallelDecoding(); }
+
 			typedef std::unique_ptr<FLAC__StreamDecoder, void(*)(FLAC__StreamDecoder *)> unique_FLAC_ptr;
 
+			// A run of whole FLAC frames beginning at a frame boundary
+			struct Segment
+			{
+				SInt64 mOffset;		// The byte offset of the first frame
+				SInt64 mFrame;		// The first audio frame
+			};
+
+			// A segment's audio, converted to mFormat
+			struct DecodedSegment
+			{
+				BufferList	mBufferList;
+				UInt32		mFrameCount;
+				bool		mSucceeded;
+			};
+
+			// Parallel decoding
+			bool BeginParallelDecoding();
+			void EndParallelDecoding();
+			bool FindFrame(SInt64 offset, bool variableBlocksize, Segment& segment);
+			std::unique_ptr<DecodedSegment> DecodeSegment(size_t segmentIndex);
+			void ParallelDecodingThreadEntry(size_t segmentsAhead);
+			UInt32 ReadAudioInParallel(AudioBufferList *bufferList, UInt32 frameCount);
+			SInt64 SeekToFrameInParallel(SInt64 frame);
+
 			// Data members
 			unique_FLAC_ptr						mFLAC;
 			FLAC__StreamMetadata_StreamInfo		mStreamInfo;
 			SInt64								mCurrentFrame;
 
-			// For converting push to pull
+			// For converting push to pull; frames before mBufferFrameOffset have been consumed
 			BufferList							mBufferList;
+			UInt32								mBufferFrameOffset;
+
+			// The caller's buffer during _ReadAudio(), so frames that fit may be decoded in place
+			AudioBufferList						*mOutputBufferList;
+			UInt32								mOutputFrameOffset;
+			UInt32								mOutputFrameCapacity;
+
+			// Parallel decoding: mSegments ends with a sentinel marking the end of the audio
+			bool								mDecodingInParallel;
+			std::vector<Segment>				mSegments;
+			std::vector<unsigned char>			mStreamHeader;		// The stream's bytes preceding the first frame
+			std::vector<std::thread>			mWorkerThreads;
+			std::mutex							mInputMutex;		// Serializes worker access to mInputSource
+
+			// Segments are decoded ahead into a reorder buffer and consumed in order
+			std::mutex										mSegmentMutex;
+			std::condition_variable							mSegmentCondition;
+			std::map<size_t, std::unique_ptr<DecodedSegment>>	mDecodedSegments;
+			size_t								mNextSegmentToDecode;
+			size_t								mNextSegmentToRead;
+			UInt32								mSegmentGeneration;	// Incremented when seeking so stale results are dropped
+			bool								mStopWorkers;
+
+			std::unique_ptr<DecodedSegment>		mCurrentSegment;
+			UInt32								mSegmentFrameOffset;
 
 		public:
 
@@ -28,10 +28,10 @@
  *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <algorithm>
+#include <vector>
+
 #include "LibavDecoder.h"
-#include "AllocateABL.h"
-#include "DeallocateABL.h"
-#include "CreateChannelLayout.h"
 #include "CFWrapper.h"
 #include "CFErrorUtilities.h"
 #include "Logger.h"
@@ -42,65 +42,75 @@ extern "C" {
 	#include <libavutil/mathematics.h>
 }
 
-
 #define BUF_SIZE 4096
 #define ERRBUF_SIZE 512
 
-static void RegisterLibavDecoder() __attribute__ ((constructor));
-static void RegisterLibavDecoder()
-{
-	AudioDecoder::RegisterSubclass<LibavDecoder>(-1);
-}
+namespace {
+
+	void RegisterLibavDecoder() __attribute__ ((constructor));
+	void RegisterLibavDecoder()
+	{
+		SFB::Audio::Decoder::RegisterSubclass<SFB::Audio::LibavDecoder>(-1);
+	}
 
 #pragma mark Initialization
 
-static void Setuplibav() __attribute__ ((constructor));
-static void Setuplibav()
-{
-	// Register codecs and disable logging
-	av_register_all();
-	av_log_set_level(AV_LOG_QUIET);
-}
+	void Setuplibav() __attribute__ ((constructor));
+	void Setuplibav()
+	{
+		// Register codecs and disable logging
+		av_register_all();
+		av_log_set_level(AV_LOG_QUIET);
+	}
 
 #pragma mark Callbacks
 
-static int
-my_read_packet(void *opaque, uint8_t *buf, int buf_size)
-{
-	assert(nullptr != opaque);
+	int my_read_packet(void *opaque, uint8_t *buf, int buf_size)
+	{
+		assert(nullptr != opaque);
 
-	LibavDecoder *decoder = static_cast<LibavDecoder *>(opaque);
-	return (int)decoder->GetInputSource()->Read(buf, buf_size);
-}
+		auto decoder = static_cast<SFB::Audio::LibavDecoder *>(opaque);
+		return (int)decoder->GetInputSource().Read(buf, buf_size);
+	}
 
-static int64_t
-my_seek(void *opaque, int64_t offset, int whence)
-{
-	assert(nullptr != opaque);
+	int64_t my_seek(void *opaque, int64_t offset, int whence)
+	{
+		assert(nullptr != opaque);
 
-	LibavDecoder *decoder = static_cast<LibavDecoder *>(opaque);
-	InputSource *inputSource = decoder->GetInputSource();
+		auto decoder = static_cast<SFB::Audio::LibavDecoder *>(opaque);
+		SFB::InputSource& inputSource = decoder->GetInputSource();
 
-	if(!inputSource->SupportsSeeking())
-		return -1;
+		if(!inputSource.SupportsSeeking())
+			return -1;
+
+		// Adjust offset as required
+		switch(whence) {
+			case SEEK_SET:		/* offset remains unchanged */			break;
+			case SEEK_CUR:		offset += inputSource.GetOffset();		break;
+			case SEEK_END:		offset += inputSource.GetLength();		break;
+			case AVSEEK_SIZE:	return inputSource.GetLength();			/* break; */
+		}
 
-	// Adjust offset as required
-	switch(whence) {
-		case SEEK_SET:		/* offset remains unchanged */			break;
-		case SEEK_CUR:		offset += inputSource->GetOffset();		break;
-		case SEEK_END:		offset += inputSource->GetLength();		break;
-		case AVSEEK_SIZE:	return inputSource->GetLength();		/* break; */
+		if(!inputSource.SeekToOffset(offset))
+			return -1;
+
+		return inputSource.GetOffset();
 	}
 
-	if(!inputSource->SeekToOffset(offset))
-		return -1;
+	void LogLibavError(const char *function, int result)
+	{
+		char errbuf [ERRBUF_SIZE];
+		if(0 == av_strerror(result, errbuf, ERRBUF_SIZE))
+			LOGGER_ERR("org.sbooth.AudioEngine.Decoder.Libav", function << " failed: " << errbuf);
+		else
+			LOGGER_ERR("org.sbooth.AudioEngine.Decoder.Libav", function << " failed: " << result);
+	}
 
-	return inputSource->GetOffset();
 }
 
 #pragma mark Static Methods
 
-CFArrayRef LibavDecoder::CreateSupportedFileExtensions()
+CFArrayRef SFB::Audio::LibavDecoder::CreateSupportedFileExtensions()
 {
 	CFMutableArrayRef supportedExtensions = CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
 
@@ -120,54 +130,65 @@ CFArrayRef LibavDecoder::CreateSupportedFileExtensions()
 	return supportedExtensions;
 }
 
-CFArrayRef LibavDecoder::CreateSupportedMIMETypes()
+CFArrayRef SFB::Audio::LibavDecoder::CreateSupportedMIMETypes()
 {
 	return CFArrayCreate(kCFAllocatorDefault, nullptr, 0, &kCFTypeArrayCallBacks);
 }
 
-bool LibavDecoder::HandlesFilesWithExtension(CFStringRef extension)
+bool SFB::Audio::LibavDecoder::HandlesFilesWithExtension(CFStringRef extension)
 {
 	if(nullptr == extension)
 		return false;
 
-	CFArrayRef supportedExtensions = CreateSupportedFileExtensions();
-
-	if(nullptr == supportedExtensions)
+	SFB::CFArray supportedExtensions = CreateSupportedFileExtensions();
+	if(!supportedExtensions)
 		return false;
-	
-	bool extensionIsSupported = false;
-	
+
 	CFIndex numberOfSupportedExtensions = CFArrayGetCount(supportedExtensions);
 	for(CFIndex currentIndex = 0; currentIndex < numberOfSupportedExtensions; ++currentIndex) {
 		CFStringRef currentExtension = (CFStringRef)CFArrayGetValueAtIndex(supportedExtensions, currentIndex);
-		if(kCFCompareEqualTo == CFStringCompare(extension, currentExtension, kCFCompareCaseInsensitive)) {
-			extensionIsSupported = true;
-			break;
-		}
+		if(kCFCompareEqualTo == CFStringCompare(extension, currentExtension, kCFCompareCaseInsensitive))
+			return true;
 	}
-		
-	CFRelease(supportedExtensions), supportedExtensions = nullptr;
-	
-	return extensionIsSupported;
+
+	return false;
 }
 
-bool LibavDecoder::HandlesMIMEType(CFStringRef /*mimeType*/)
+bool SFB::Audio::LibavDecoder::HandlesMIMEType(CFStringRef /*mimeType*/)
 {
 	return false;
 }
 
-AudioDecoder * LibavDecoder::CreateDecoder(InputSource *inputSource)
+bool SFB::Audio::LibavDecoder::HandlesSignature(const void *header, size_t length)
 {
-	return new LibavDecoder(inputSource);
+	if(nullptr == header || 0 == length)
+		return false;
+
+	// libav requires zeroed padding following the probe data
+	std::vector<unsigned char> buf(length + AVPROBE_PADDING_SIZE, 0);
+	memcpy(buf.data(), header, length);
+
+	AVProbeData probeData = {
+		.filename = "",
+		.buf = buf.data(),
+		.buf_size = (int)length
+	};
+
+	return nullptr != av_probe_input_format(&probeData, 1);
+}
+
+SFB::Audio::Decoder::unique_ptr SFB::Audio::LibavDecoder::CreateDecoder(InputSource::unique_ptr inputSource)
+{
+	return unique_ptr(new LibavDecoder(std::move(inputSource)));
 }
 
 #pragma mark Creation and Destruction
 
-LibavDecoder::LibavDecoder(InputSource *inputSource)
-	: AudioDecoder(inputSource), mBufferList(nullptr), mIOContext(nullptr), mFrame(nullptr), mFormatContext(nullptr), mCurrentFrame(0)
+SFB::Audio::LibavDecoder::LibavDecoder(InputSource::unique_ptr inputSource)
+	: Decoder(std::move(inputSource)), mStreamIndex(-1), mCurrentFrame(0), mFrameOffset(0), mHasPendingPacket(false), mInputFinished(false), mSeekMode(SeekMode::Accurate), mFramesToDiscard(0)
 {}
 
-LibavDecoder::~LibavDecoder()
+SFB::Audio::LibavDecoder::~LibavDecoder()
 {
 	if(IsOpen())
 		Close();
@@ -175,19 +196,10 @@ LibavDecoder::~LibavDecoder()
 
 #pragma mark Functionality
 
-bool LibavDecoder::Open(CFErrorRef *error)
+bool SFB::Audio::LibavDecoder::_Open(CFErrorRef *error)
 {
-	if(IsOpen()) {
-		LOGGER_WARNING("org.sbooth.AudioEngine.AudioDecoder.Libav", "Open() called on an AudioDecoder that is already open");
-		return true;
-	}
-
-	// Ensure the input source is open
-	if(!mInputSource->IsOpen() && !mInputSource->Open(error))
-		return false;
-
 	auto ioContext = std::unique_ptr<AVIOContext, std::function<void (AVIOContext *)>>(avio_alloc_context((unsigned char *)av_malloc(BUF_SIZE), BUF_SIZE, 0, this, my_read_packet, nullptr, my_seek),
-																				   [](AVIOContext *context) { av_free(context); });
+																					   [](AVIOContext *context) { av_free(context); });
 
 	auto formatContext = std::unique_ptr<AVFormatContext, std::function<void (AVFormatContext *)>>(avformat_alloc_context(), [](AVFormatContext *context) { avformat_free_context(context); });
 	formatContext->pb = ioContext.get();
@@ -195,96 +207,93 @@ bool LibavDecoder::Open(CFErrorRef *error)
 	auto rawFormatContext = formatContext.get();
 	int result = avformat_open_input(&rawFormatContext, nullptr, nullptr, nullptr);
 	if(0 != result) {
-		char errbuf [ERRBUF_SIZE];
-		if(0 == av_strerror(result, errbuf, ERRBUF_SIZE)) {
-			LOGGER_ERR("org.sbooth.AudioEngine.AudioDecoder.Libav", "avformat_open_input failed: " << errbuf);
-		}
-		else
-			LOGGER_ERR("org.sbooth.AudioEngine.AudioDecoder.Libav", "avformat_open_input failed: " << result);
+		LogLibavError("avformat_open_input", result);
 
-		if(nullptr != error) {
+		if(error) {
 			SFB::CFString description = CFCopyLocalizedString(CFSTR("The format of the file “%@” was not recognized."), "");
 			SFB::CFString failureReason = CFCopyLocalizedString(CFSTR("File Format Not Recognized"), "");
 			SFB::CFString recoverySuggestion = CFCopyLocalizedString(CFSTR("The file's extension may not match the file's type."), "");
 
-			*error = CreateErrorForURL(AudioDecoderErrorDomain, AudioDecoderInputOutputError, description, mInputSource->GetURL(), failureReason, recoverySuggestion);
+			*error = CreateErrorForURL(Decoder::ErrorDomain, Decoder::InputOutputError, description, mInputSource->GetURL(), failureReason, recoverySuggestion);
 		}
 
 		return false;
 	}
 
 	// Retrieve stream information
-    if(0 > avformat_find_stream_info(formatContext.get(), nullptr)) {
-		LOGGER_ERR("org.sbooth.AudioEngine.AudioDecoder.Libav", "Could not find stream information");
+	if(0 > avformat_find_stream_info(formatContext.get(), nullptr)) {
+		LOGGER_ERR("org.sbooth.AudioEngine.Decoder.Libav", "Could not find stream information");
 
-		if(nullptr != error) {
+		if(error) {
 			SFB::CFString description = CFCopyLocalizedString(CFSTR("The format of the file “%@” was not recognized."), "");
 			SFB::CFString failureReason = CFCopyLocalizedString(CFSTR("File Format Not Recognized"), "");
 			SFB::CFString recoverySuggestion = CFCopyLocalizedString(CFSTR("The file's extension may not match the file's type."), "");
 
-			*error = CreateErrorForURL(AudioDecoderErrorDomain, AudioDecoderInputOutputError, description, mInputSource->GetURL(), failureReason, recoverySuggestion);
+			*error = CreateErrorForURL(Decoder::ErrorDomain, Decoder::InputOutputError, description, mInputSource->GetURL(), failureReason, recoverySuggestion);
 		}
 
 		return false;
-    }
+	}
 
 	// Use the best audio stream present in the file
 	AVCodec *codec = nullptr;
 	result = av_find_best_stream(formatContext.get(), AVMEDIA_TYPE_AUDIO, -1, -1, &codec, 0);
 	if(0 > result) {
-		char errbuf [ERRBUF_SIZE];
-		if(0 == av_strerror(result, errbuf, ERRBUF_SIZE)) {
-			LOGGER_ERR("org.sbooth.AudioEngine.AudioDecoder.Libav", "av_find_best_stream failed: " << errbuf);
-		}
-		else
-			LOGGER_ERR("org.sbooth.AudioEngine.AudioDecoder.Libav", "av_find_best_stream failed: " << result);
+		LogLibavError("av_find_best_stream", result);
 
-		if(nullptr != error) {
+		if(error) {
 			SFB::CFString description = CFCopyLocalizedString(CFSTR("The format of the file “%@” was not recognized."), "");
 			SFB::CFString failureReason = CFCopyLocalizedString(CFSTR("File Format Not Recognized"), "");
 			SFB::CFString recoverySuggestion = CFCopyLocalizedString(CFSTR("The file's extension may not match the file's type."), "");
 
-			*error = CreateErrorForURL(AudioDecoderErrorDomain, AudioDecoderInputOutputError, description, mInputSource->GetURL(), failureReason, recoverySuggestion);
+			*error = CreateErrorForURL(Decoder::ErrorDomain, Decoder::InputOutputError, description, mInputSource->GetURL(), failureReason, recoverySuggestion);
 		}
 
 		return false;
 	}
 
-	mStreamIndex = result;
+	int streamIndex = result;
 
-	auto stream = formatContext->streams[mStreamIndex];
-	auto codecContext = stream->codec;
+	auto stream = formatContext->streams[streamIndex];
 
-	AVCodec *decoder = avcodec_find_decoder(codecContext->codec_id);
+	AVCodec *decoder = avcodec_find_decoder(stream->codecpar->codec_id);
 	if(!decoder) {
-		LOGGER_ERR("org.sbooth.AudioEngine.AudioDecoder.Libav", "avcodec_find_decoder(" << codecContext->codec_id << ") failed");
+		LOGGER_ERR("org.sbooth.AudioEngine.Decoder.Libav", "avcodec_find_decoder(" << stream->codecpar->codec_id << ") failed");
 
-		if(nullptr != error) {
+		if(error) {
 			SFB::CFString description = CFCopyLocalizedString(CFSTR("The format of the file “%@” was not recognized."), "");
 			SFB::CFString failureReason = CFCopyLocalizedString(CFSTR("File Format Not Recognized"), "");
 			SFB::CFString recoverySuggestion = CFCopyLocalizedString(CFSTR("The file's extension may not match the file's type."), "");
 
-			*error = CreateErrorForURL(AudioDecoderErrorDomain, AudioDecoderInputOutputError, description, mInputSource->GetURL(), failureReason, recoverySuggestion);
+			*error = CreateErrorForURL(Decoder::ErrorDomain, Decoder::InputOutputError, description, mInputSource->GetURL(), failureReason, recoverySuggestion);
 		}
 
 		return false;
 	}
 
-	result = avcodec_open2(codecContext, decoder, nullptr);
+	auto codecContext = std::unique_ptr<AVCodecContext, std::function<void (AVCodecContext *)>>(avcodec_alloc_context3(decoder), [](AVCodecContext *context) { avcodec_free_context(&context); });
+	if(!codecContext || 0 > avcodec_parameters_to_context(codecContext.get(), stream->codecpar)) {
+		if(error)
+			*error = CFErrorCreate(kCFAllocatorDefault, kCFErrorDomainPOSIX, ENOMEM, nullptr);
+
+		return false;
+	}
+
+	// Let the codec decode multiple frames concurrently where supported
+	codecContext->thread_count = 0;
+	codecContext->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+	codecContext->pkt_timebase = stream->time_base;
+
+	result = avcodec_open2(codecContext.get(), decoder, nullptr);
 	if(0 != result) {
-		char errbuf [ERRBUF_SIZE];
-		if(0 == av_strerror(result, errbuf, ERRBUF_SIZE)) {
-			LOGGER_ERR("org.sbooth.AudioEngine.AudioDecoder.Libav", "avcodec_open2 failed: " << errbuf);
-		}
-		else
-			LOGGER_ERR("org.sbooth.AudioEngine.AudioDecoder.Libav", "avcodec_open2 failed: " << result);
+		LogLibavError("avcodec_open2", result);
 
-		if(nullptr != error) {
+		if(error) {
 			SFB::CFString description = CFCopyLocalizedString(CFSTR("The format of the file “%@” was not recognized."), "");
 			SFB::CFString failureReason = CFCopyLocalizedString(CFSTR("File Format Not Recognized"), "");
 			SFB::CFString recoverySuggestion = CFCopyLocalizedString(CFSTR("The file's extension may not match the file's type."), "");
 
-			*error = CreateErrorForURL(AudioDecoderErrorDomain, AudioDecoderInputOutputError, description, mInputSource->GetURL(), failureReason, recoverySuggestion);
+			*error = CreateErrorForURL(Decoder::ErrorDomain, Decoder::InputOutputError, description, mInputSource->GetURL(), failureReason, recoverySuggestion);
 		}
 
 		return false;
@@ -379,7 +388,7 @@ bool LibavDecoder::Open(CFErrorRef *error)
 			break;
 
 		default:
-			LOGGER_ERR("org.sbooth.AudioEngine.AudioDecoder.Libav", "Unknown sample format")
+			LOGGER_ERR("org.sbooth.AudioEngine.Decoder.Libav", "Unknown sample format");
 			break;
 	}
 
@@ -394,214 +403,252 @@ bool LibavDecoder::Open(CFErrorRef *error)
 	mSourceFormat.mFormatFlags			= mFormat.mFormatFlags;
 	mSourceFormat.mBitsPerChannel		= mFormat.mBitsPerChannel;
 
-	// TODO: Determine max frame size
-	mBufferList = AllocateABL(mFormat, 4096);
-	if(nullptr == mBufferList) {
+	// Decoded frames are retained by reference and copied directly to the caller's buffers
+	auto frame = std::unique_ptr<AVFrame, std::function<void (AVFrame *)>>(av_frame_alloc(), [](AVFrame *f) { av_frame_free(&f); });
+	auto packet = std::unique_ptr<AVPacket, std::function<void (AVPacket *)>>(av_packet_alloc(), [](AVPacket *p) { av_packet_free(&p); });
+	if(!frame || !packet) {
 		if(error)
 			*error = CFErrorCreate(kCFAllocatorDefault, kCFErrorDomainPOSIX, ENOMEM, nullptr);
 
 		return false;
 	}
 
-	// Allocate the libav frame
-	auto frame = std::unique_ptr<AVFrame, std::function<void (AVFrame *)>>(avcodec_alloc_frame(), [](AVFrame *f) { av_free(f); });
-	mFrame = std::move(frame);
-
+	mStreamIndex = streamIndex;
 	mIOContext = std::move(ioContext);
 	mFormatContext = std::move(formatContext);
+	mCodecContext = std::move(codecContext);
+	mFrame = std::move(frame);
+	mPacket = std::move(packet);
 
-	for(UInt32 i = 0; i < mBufferList->mNumberBuffers; ++i)
-		mBufferList->mBuffers[i].mDataByteSize = 0;
+	mFrameOffset = 0;
+	mHasPendingPacket = false;
+	mInputFinished = false;
+
+	mCurrentFrame = 0;
+	mFramesToDiscard = 0;
 
-	mIsOpen = true;
 	return true;
 }
 
-bool LibavDecoder::Close(CFErrorRef */*error*/)
+bool SFB::Audio::LibavDecoder::_Close(CFErrorRef */*error*/)
 {
-	if(!IsOpen()) {
-		LOGGER_WARNING("org.sbooth.AudioEngine.AudioDecoder.Libav", "Close() called on an AudioDecoder that hasn't been opened");
-		return true;
-	}
-
 	mStreamIndex = -1;
 
+	mPacket.reset();
 	mFrame.reset();
-	mIOContext.reset();
+	mCodecContext.reset();
 	mFormatContext.reset();
+	mIOContext.reset();
 
-	mIsOpen = false;
 	return true;
 }
 
-CFStringRef LibavDecoder::CreateSourceFormatDescription() const
+SFB::CFString SFB::Audio::LibavDecoder::_GetSourceFormatDescription() const
 {
-	if(!IsOpen())
-		return nullptr;
-
 	return CFStringCreateWithFormat(kCFAllocatorDefault,
-									nullptr, 
-									CFSTR("%s, %u channels, %u Hz"), 
-									mFormatContext->streams[mStreamIndex]->codec->codec->long_name,
-									mSourceFormat.mChannelsPerFrame, 
+									nullptr,
+									CFSTR("%s, %u channels, %u Hz"),
+									mCodecContext->codec->long_name,
+									(unsigned int)mSourceFormat.mChannelsPerFrame,
 									(unsigned int)mSourceFormat.mSampleRate);
 }
 
-SInt64 LibavDecoder::GetTotalFrames() const
+SInt64 SFB::Audio::LibavDecoder::_GetTotalFrames() const
 {
-	if(!IsOpen())
-		return -1;
+	auto stream = mFormatContext->streams[mStreamIndex];
 
-	if(mFormatContext->streams[mStreamIndex]->nb_frames)
-		return mFormatContext->streams[mStreamIndex]->nb_frames;
+	if(AV_NOPTS_VALUE != stream->duration)
+		return av_rescale_q(stream->duration, stream->time_base, AVRational{1, (int)mFormat.mSampleRate});
 
-	return av_rescale(mFormatContext->streams[mStreamIndex]->duration, mFormatContext->streams[mStreamIndex]->time_base.num, mFormatContext->streams[mStreamIndex]->time_base.den) * (SInt64)mFormat.mSampleRate;
+	// Fall back to the container's duration, which is in AV_TIME_BASE units
+	if(AV_NOPTS_VALUE != mFormatContext->duration)
+		return av_rescale(mFormatContext->duration, (int64_t)mFormat.mSampleRate, AV_TIME_BASE);
+
+	return -1;
 }
 
-SInt64 LibavDecoder::GetCurrentFrame() const
+SInt64 SFB::Audio::LibavDecoder::_SeekToFrame(SInt64 frame)
 {
-	if(!IsOpen())
+	// Seek to the keyframe at or preceding the target using the container's index
+	int result = av_seek_frame(mFormatContext.get(), mStreamIndex, TimestampForFrame(frame), AVSEEK_FLAG_BACKWARD);
+	if(0 > result) {
+		LogLibavError("av_seek_frame", result);
 		return -1;
+	}
 
-	return mCurrentFrame;
-}
+	// Discard any audio remaining from the previous position
+	avcodec_flush_buffers(mCodecContext.get());
+	av_frame_unref(mFrame.get());
+	av_packet_unref(mPacket.get());
+	mFrameOffset = 0;
+	mFramesToDiscard = 0;
+	mHasPendingPacket = false;
+	mInputFinished = false;
+
+	// The timestamp of the first packet determines where decoding resumes
+	if(!ReadPacket()) {
+		// Seeking to the end of the stream is not an error
+		mCurrentFrame = frame;
+		return mCurrentFrame;
+	}
 
-SInt64 LibavDecoder::SeekToFrame(SInt64 frame)
-{
-	if(!IsOpen() || 0 > frame || frame >= GetTotalFrames())
-		return -1;
+	mHasPendingPacket = true;
 
-	int64_t timestamp = av_rescale(frame / (SInt64)mFormat.mSampleRate, mFormatContext->streams[mStreamIndex]->time_base.den, mFormatContext->streams[mStreamIndex]->time_base.num);
-	int result = av_seek_frame(mFormatContext.get(), mStreamIndex, timestamp, 0);
-	if(0 > result) {
-		char errbuf [ERRBUF_SIZE];
-		if(0 == av_strerror(result, errbuf, ERRBUF_SIZE)) {
-			LOGGER_ERR("org.sbooth.AudioEngine.AudioDecoder.Libav", "av_seek_frame failed: " << errbuf);
-		}
-		else
-			LOGGER_ERR("org.sbooth.AudioEngine.AudioDecoder.Libav", "av_seek_frame failed: " << result);
+	int64_t timestamp = (AV_NOPTS_VALUE != mPacket->pts) ? mPacket->pts : mPacket->dts;
+	SInt64 resumeFrame = (AV_NOPTS_VALUE != timestamp) ? FrameForTimestamp(timestamp) : -1;
 
-		return -1;
+	if(-1 == resumeFrame) {
+		LOGGER_INFO("org.sbooth.AudioEngine.Decoder.Libav", "Packet has no timestamp; position after seek is approximate");
+		mCurrentFrame = frame;
 	}
+	// In accurate mode decode and discard the audio preceding the target as it is read
+	else if(SeekMode::Accurate == mSeekMode && resumeFrame < frame) {
+		mFramesToDiscard = frame - resumeFrame;
+		mCurrentFrame = frame;
+	}
+	else
+		mCurrentFrame = resumeFrame;
 
-	avcodec_flush_buffers(mFormatContext->streams[mStreamIndex]->codec);
-
-	mCurrentFrame = frame;
 	return mCurrentFrame;
 }
 
-UInt32 LibavDecoder::ReadAudio(AudioBufferList *bufferList, UInt32 frameCount)
+UInt32 SFB::Audio::LibavDecoder::_ReadAudio(AudioBufferList *bufferList, UInt32 frameCount)
 {
-	if(!IsOpen() || nullptr == bufferList || 0 == frameCount)
+	if(bufferList->mNumberBuffers != mFormat.mChannelsPerFrame && (kAudioFormatFlagIsNonInterleaved & mFormat.mFormatFlags)) {
+		LOGGER_WARNING("org.sbooth.AudioEngine.Decoder.Libav", "_ReadAudio() called with invalid parameters");
 		return 0;
+	}
 
+	bool isPlanar = av_sample_fmt_is_planar(mCodecContext->sample_fmt);
 	UInt32 framesRead = 0;
 
-	// Reset output buffer data size
-	for(UInt32 i = 0; i < bufferList->mNumberBuffers; ++i)
-		bufferList->mBuffers[i].mDataByteSize = 0;
-
-	for(;;) {
-		UInt32 bytesRemaining	= (frameCount - framesRead) * mFormat.mBytesPerFrame;
-		UInt32 bytesToSkip		= bufferList->mBuffers[0].mDataByteSize;
-		UInt32 bytesInBuffer	= mBufferList->mBuffers[0].mDataByteSize;
-
-		UInt32 bytesToCopy		= std::min(bytesInBuffer, bytesRemaining);
-
-		// Copy data from the buffer to output
-		for(UInt32 i = 0; i < mBufferList->mNumberBuffers; ++i) {
-			unsigned char *buffer = (unsigned char *)bufferList->mBuffers[i].mData;
-			memcpy(buffer + bytesToSkip, mBufferList->mBuffers[i].mData, bytesToCopy);
-			bufferList->mBuffers[i].mDataByteSize += bytesToCopy;
-
-			// Move remaining data in buffer to beginning
-			if(bytesToCopy != bytesInBuffer) {
-				buffer = (unsigned char *)mBufferList->mBuffers[i].mData;
-				memmove(buffer, buffer + bytesToCopy, (bytesInBuffer - bytesToCopy));
+	while(framesRead < frameCount) {
+		// Copy audio from the current frame into the caller's buffers
+		// ReadAudio() fills buffers owned by the caller, so the frame's planes can't be handed over without copying,
+		// even when the layouts match; holding the frame by reference only avoids a second, intermediate copy
+		UInt32 framesInFrame = (mFrame->nb_samples > (int)mFrameOffset) ? (UInt32)mFrame->nb_samples - mFrameOffset : 0;
+		if(framesInFrame) {
+			UInt32 framesToCopy = std::min(framesInFrame, frameCount - framesRead);
+
+			// mBytesPerFrame is the size of a frame within a single plane for planar formats
+			// linesize is padded, so the sample count determines the amount of audio
+			for(UInt32 bufferIndex = 0; bufferIndex < bufferList->mNumberBuffers; ++bufferIndex) {
+				const uint8_t *source = mFrame->extended_data[isPlanar ? bufferIndex : 0] + mFrameOffset * mFormat.mBytesPerFrame;
+				memcpy((uint8_t *)bufferList->mBuffers[bufferIndex].mData + framesRead * mFormat.mBytesPerFrame, source, framesToCopy * mFormat.mBytesPerFrame);
 			}
 
-			mBufferList->mBuffers[i].mDataByteSize -= bytesToCopy;
-		}
+			mFrameOffset += framesToCopy;
+			framesRead += framesToCopy;
 
-		framesRead += (bytesToCopy / mFormat.mBytesPerFrame);
+			continue;
+		}
 
-		// All requested frames were read
-		if(framesRead == frameCount)
+		if(!ReceiveFrame())
 			break;
+	}
 
-		// Read a single frame from the file
-		AVPacket packet;
-		av_init_packet(&packet);
+	for(UInt32 bufferIndex = 0; bufferIndex < bufferList->mNumberBuffers; ++bufferIndex) {
+		bufferList->mBuffers[bufferIndex].mDataByteSize = framesRead * mFormat.mBytesPerFrame;
+		bufferList->mBuffers[bufferIndex].mNumberChannels = isPlanar ? 1 : mFormat.mChannelsPerFrame;
+	}
 
-		int result = av_read_frame(mFormatContext.get(), &packet);
-		if(0 != result) {
-			// EOF reached
-			if(AVERROR_EOF == result) {
-				if(CODEC_CAP_DELAY & mFormatContext->streams[mStreamIndex]->codec->codec->capabilities) {
-					// TODO: Flush buffer using avcodec_decode_audio4
-				}
+	mCurrentFrame += framesRead;
 
-			}
-			else {
-				char errbuf [ERRBUF_SIZE];
-				if(0 == av_strerror(result, errbuf, ERRBUF_SIZE)) {
-					LOGGER_ERR("org.sbooth.AudioEngine.AudioDecoder.Libav", "av_read_frame failed: " << errbuf);
-				}
-				else
-					LOGGER_ERR("org.sbooth.AudioEngine.AudioDecoder.Libav", "av_read_frame failed: " << result);
-			}
+	return framesRead;
+}
 
-			break;
+#pragma mark Decoding
+
+bool SFB::Audio::LibavDecoder::ReadPacket()
+{
+	for(;;) {
+		av_packet_unref(mPacket.get());
+
+		int result = av_read_frame(mFormatContext.get(), mPacket.get());
+		if(0 != result) {
+			if(AVERROR_EOF != result)
+				LogLibavError("av_read_frame", result);
+			return false;
 		}
 
-		if(packet.stream_index != mStreamIndex)
-			continue;
+		if(mPacket->stream_index == mStreamIndex)
+			return true;
+	}
+}
 
-		// Decode the audio
-		avcodec_get_frame_defaults(mFrame.get());
+bool SFB::Audio::LibavDecoder::ReceiveFrame()
+{
+	av_frame_unref(mFrame.get());
+	mFrameOffset = 0;
 
-		// Feed the packet to the decoder unitl no frames are returned or the input is fully consumed
-		while(0 < packet.size) {
-			int gotFrame = 0;
-			int bytesConsumed = avcodec_decode_audio4(mFormatContext->streams[mStreamIndex]->codec, mFrame.get(), &gotFrame, &packet);
+	for(;;) {
+		int result = avcodec_receive_frame(mCodecContext.get(), mFrame.get());
 
-			if(0 > bytesConsumed) {
-				char errbuf [ERRBUF_SIZE];
-				if(0 == av_strerror(bytesConsumed, errbuf, ERRBUF_SIZE)) {
-					LOGGER_ERR("org.sbooth.AudioEngine.AudioDecoder.Libav", "avcodec_decode_audio4 failed: " << errbuf);
-				}
-				else
-					LOGGER_ERR("org.sbooth.AudioEngine.AudioDecoder.Libav", "avcodec_decode_audio4 failed: " << result);
+		if(0 == result) {
+			// Drop the audio preceding the target of an accurate seek
+			UInt32 framesToSkip = (UInt32)std::min(mFramesToDiscard, (SInt64)mFrame->nb_samples);
+			mFramesToDiscard -= framesToSkip;
+			mFrameOffset = framesToSkip;
 
-				packet.size = 0;
+			if(mFrameOffset < (UInt32)mFrame->nb_samples)
+				return true;
 
-				continue;
-			}
-			else if(gotFrame) {
-				// Planar formats are not interleaved
-				if(av_sample_fmt_is_planar(mFormatContext->streams[mStreamIndex]->codec->sample_fmt)) {
-					for(UInt32 bufferIndex = 0; bufferIndex < mBufferList->mNumberBuffers; ++bufferIndex) {
-						memcpy(mBufferList->mBuffers[bufferIndex].mData, mFrame->extended_data[bufferIndex], (size_t)mFrame->linesize[0]);
-						mBufferList->mBuffers[bufferIndex].mDataByteSize = (UInt32)mFrame->linesize[0];
-						mBufferList->mBuffers[bufferIndex].mNumberChannels = 1;
-					}
-				}
-				else {
-					memcpy(mBufferList->mBuffers[0].mData, mFrame->extended_data[0], (size_t)mFrame->linesize[0]);
-					mBufferList->mBuffers[0].mDataByteSize = (UInt32)mFrame->linesize[0];
-					mBufferList->mBuffers[0].mNumberChannels = mFormat.mChannelsPerFrame;
-				}
+			av_frame_unref(mFrame.get());
+			mFrameOffset = 0;
+			continue;
+		}
+		// The codec has been completely drained
+		else if(AVERROR_EOF == result)
+			return false;
+		else if(AVERROR(EAGAIN) != result) {
+			LogLibavError("avcodec_receive_frame", result);
+			return false;
+		}
+
+		// The codec requires more input
+		if(mInputFinished)
+			return false;
+
+		if(!mHasPendingPacket && !ReadPacket()) {
+			// Enter draining mode to retrieve any delayed frames
+			mInputFinished = true;
+			result = avcodec_send_packet(mCodecContext.get(), nullptr);
+			if(0 > result) {
+				LogLibavError("avcodec_send_packet", result);
+				return false;
 			}
 
-			// Adjust packet size and buffer
-			packet.data += bytesConsumed;
-			packet.size -= bytesConsumed;
+			continue;
 		}
 
-		av_free_packet(&packet);
+		mHasPendingPacket = false;
+
+		result = avcodec_send_packet(mCodecContext.get(), mPacket.get());
+		av_packet_unref(mPacket.get());
+
+		// Skip packets the codec can't decode
+		if(0 > result && AVERROR(EAGAIN) != result)
+			LogLibavError("avcodec_send_packet", result);
 	}
+}
 
-	mCurrentFrame += framesRead;
+#pragma mark Timestamps
 
-	return framesRead;
+SInt64 SFB::Audio::LibavDecoder::FrameForTimestamp(int64_t timestamp) const
+{
+	auto stream = mFormatContext->streams[mStreamIndex];
+	if(AV_NOPTS_VALUE != stream->start_time)
+		timestamp -= stream->start_time;
+
+	return av_rescale_q(timestamp, stream->time_base, AVRational{1, (int)mFormat.mSampleRate});
+}
+
+int64_t SFB::Audio::LibavDecoder::TimestampForFrame(SInt64 frame) const
+{
+	auto stream = mFormatContext->streams[mStreamIndex];
+	int64_t timestamp = av_rescale_q(frame, AVRational{1, (int)mFormat.mSampleRate}, stream->time_base);
+	if(AV_NOPTS_VALUE != stream->start_time)
+		timestamp += stream->start_time;
+
+	return timestamp;
 }
@@ -31,72 +31,103 @@
 #pragma once
 
 #include <functional>
-
-#include <CoreFoundation/CoreFoundation.h>
+#include <memory>
 
 #include "AudioDecoder.h"
 
 struct AVFrame;
 struct AVIOContext;
 struct AVFormatContext;
+struct AVCodecContext;
+struct AVPacket;
+
+namespace SFB {
+
+	namespace Audio {
+
+		// ========================================
+		// A Decoder subclass supporting all formats handled by libav
+		// ========================================
+		class LibavDecoder : public Decoder
+		{
+
+		public:
+
+			// Data types handled by this class
+			static CFArrayRef CreateSupportedFileExtensions();
+			static CFArrayRef CreateSupportedMIMETypes();
+
+			static bool HandlesFilesWithExtension(CFStringRef extension);
+			static bool HandlesMIMEType(CFStringRef mimeType);
+			static bool HandlesSignature(const void *header, size_t length);
+
+			static Decoder::unique_ptr CreateDecoder(InputSource::unique_ptr inputSource);
+
+			// Creation and destruction
+			LibavDecoder(InputSource::unique_ptr inputSource);
+			virtual ~LibavDecoder();
+
+			// Seeking precision
+			enum class SeekMode {
+				Accurate,		// Seek to the requested frame by decoding and discarding audio following the preceding keyframe
+				Keyframe		// Seek to the keyframe preceding the requested frame, suitable for scrubbing
+			};
+
+			inline SeekMode GetSeekMode() const						{ return mSeekMode; }
+			inline void SetSeekMode(SeekMode seekMode)				{ mSeekMode = seekMode; }
+
+		private:
 
-// ========================================
-// An AudioDecoder subclass supporting all formats handled by libav
-// ========================================
-class LibavDecoder : public AudioDecoder
-{
+			// Audio access
+			virtual bool _Open(CFErrorRef *error);
+			virtual bool _Close(CFErrorRef *error);
 
-public:
+			// The native format of the source audio
+			virtual SFB::CFString _GetSourceFormatDescription() const;
 
-	// ========================================
-	// The data types handled by this class
-	static CFArrayRef CreateSupportedFileExtensions();
-	static CFArrayRef CreateSupportedMIMETypes();
+			// Attempt to read frameCount frames of audio, returning the actual number of frames read
+			virtual UInt32 _ReadAudio(AudioBufferList *bufferList, UInt32 frameCount);
 
-	static bool HandlesFilesWithExtension(CFStringRef extension);
-	static bool HandlesMIMEType(CFStringRef mimeType);
+			// Source audio information
+			virtual SInt64 _GetTotalFrames() const;
+			inline virtual SInt64 _GetCurrentFrame() const			{ return mCurrentFrame; }
 
-	static AudioDecoder * CreateDecoder(InputSource *inputSource);
+			// Stream and container durations are estimates for many formats
+			inline virtual bool _TotalFramesAreExact() const		{ return false; }
 
-	// ========================================
-	// Creation
-	LibavDecoder(InputSource *inputSource);
+			// Seeking support
+			inline virtual bool _SupportsSeeking() const			{ return mInputSource->SupportsSeeking(); }
+			virtual SInt64 _SeekToFrame(SInt64 frame);
 
-	// ========================================
-	// Destruction
-	virtual ~LibavDecoder();
+			// Read the next packet for the audio stream into mPacket
+			bool ReadPacket();
 
-	// ========================================
-	// Audio access
-	virtual bool Open(CFErrorRef *error = nullptr);
-	virtual bool Close(CFErrorRef *error = nullptr);
+			// Receive the next frame from the codec into mFrame, feeding it packets (and draining at end of stream) as required
+			bool ReceiveFrame();
 
-	// ========================================
-	// The native format of the source audio
-	virtual CFStringRef CreateSourceFormatDescription() const;
+			// Conversion between audio frames and the stream's time base
+			SInt64 FrameForTimestamp(int64_t timestamp) const;
+			int64_t TimestampForFrame(SInt64 frame) const;
 
-	// ========================================
-	// Attempt to read frameCount frames of audio, returning the actual number of frames read
-	virtual UInt32 ReadAudio(AudioBufferList *bufferList, UInt32 frameCount);
+			// Data members
+			std::unique_ptr<AVIOContext, std::function<void (AVIOContext *)>>			mIOContext;
+			std::unique_ptr<AVFormatContext, std::function<void (AVFormatContext *)>>	mFormatContext;
+			std::unique_ptr<AVCodecContext, std::function<void (AVCodecContext *)>>		mCodecContext;
 
-	// ========================================
-	// Source audio information
-	virtual SInt64 GetTotalFrames() const;
-	virtual SInt64 GetCurrentFrame() const;
+			// The most recently received frame, which is consumed in place
+			std::unique_ptr<AVFrame, std::function<void (AVFrame *)>>					mFrame;
+			std::unique_ptr<AVPacket, std::function<void (AVPacket *)>>				mPacket;
 
-	// ========================================
-	// Seeking support
-	virtual inline bool SupportsSeeking() const				{ return mInputSource->SupportsSeeking(); }
-	virtual SInt64 SeekToFrame(SInt64 frame);
+			int				mStreamIndex;
+			SInt64			mCurrentFrame;
 
-private:
+			UInt32			mFrameOffset;		// The number of frames in mFrame already consumed
+			bool			mHasPendingPacket;	// True if mPacket was read while seeking and not yet sent to the codec
+			bool			mInputFinished;		// True once the codec has been told to drain
 
-	std::unique_ptr<AVFrame, std::function<void (AVFrame *)>> mFrame;
-	std::unique_ptr<AVIOContext, std::function<void (AVIOContext *)>> mIOContext;
-	std::unique_ptr<AVFormatContext, std::function<void (AVFormatContext *)>> mFormatContext;
+			SeekMode		mSeekMode;
+			SInt64			mFramesToDiscard;
+		};
 
-	int mStreamIndex;
-	SInt64 mCurrentFrame;
-	AudioBufferList *mBufferList;
-	
-};
+	}
+}
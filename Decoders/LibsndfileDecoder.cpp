@@ -152,6 +152,23 @@ bool SFB::Audio::LibsndfileDecoder::HandlesMIMEType(CFStringRef /*mimeType*/)
 	return false;
 }
 
+bool SFB::Audio::LibsndfileDecoder::HandlesSignature(const void *header, size_t length)
+{
+	if(nullptr == header || 12 > length)
+		return false;
+
+	const char *bytes = static_cast<const char *>(header);
+
+	if(!memcmp(bytes, "RIFF", 4) || !memcmp(bytes, "RIFX", 4) || !memcmp(bytes, "RF64", 4))
+		return true;
+	else if(!memcmp(bytes, "FORM", 4) && (!memcmp(bytes + 8, "AIFF", 4) || !memcmp(bytes + 8, "AIFC", 4) || !memcmp(bytes + 8, "8SVX", 4)))
+		return true;
+	else if(!memcmp(bytes, "caff", 4) || !memcmp(bytes, ".snd", 4) || !memcmp(bytes, "dns.", 4))
+		return true;
+
+	return false;
+}
+
 SFB::Audio::Decoder::unique_ptr SFB::Audio::LibsndfileDecoder::CreateDecoder(InputSource::unique_ptr inputSource)
 {
 	return unique_ptr(new LibsndfileDecoder(std::move(inputSource)));
@@ -29,31 +29,35 @@
  */
 
 #include <algorithm>
+#include <cstring>
 
 #include "LoopableRegionDecoder.h"
 #include "AudioDecoder.h"
 #include "Logger.h"
 
 SFB::Audio::LoopableRegionDecoder::LoopableRegionDecoder(Decoder::unique_ptr decoder, SInt64 startingFrame)
-	: mDecoder(std::move(decoder)), mStartingFrame(startingFrame), mFrameCount(0), mRepeatCount(0), mFramesReadInCurrentPass(0), mTotalFramesRead(0), mCompletedPasses(0)
+	: mDecoder(std::move(decoder)), mStartingFrame(startingFrame), mFrameCount(0), mRepeatCount(0), mFramesReadInCurrentPass(0), mTotalFramesRead(0), mCompletedPasses(0), mCachedFrames(0)
 {
 	assert(nullptr != mDecoder);
 }
 
 SFB::Audio::LoopableRegionDecoder::LoopableRegionDecoder(Decoder::unique_ptr decoder, SInt64 startingFrame, UInt32 frameCount)
-	: mDecoder(std::move(decoder)), mStartingFrame(startingFrame), mFrameCount(frameCount), mRepeatCount(0), mFramesReadInCurrentPass(0), mTotalFramesRead(0), mCompletedPasses(0)
+	: mDecoder(std::move(decoder)), mStartingFrame(startingFrame), mFrameCount(frameCount), mRepeatCount(0), mFramesReadInCurrentPass(0), mTotalFramesRead(0), mCompletedPasses(0), mCachedFrames(0)
 {
 	assert(nullptr != mDecoder);
 }
 
 SFB::Audio::LoopableRegionDecoder::LoopableRegionDecoder(Decoder::unique_ptr decoder, SInt64 startingFrame, UInt32 frameCount, UInt32 repeatCount)
-	: mDecoder(std::move(decoder)), mStartingFrame(startingFrame), mFrameCount(frameCount), mRepeatCount(repeatCount), mFramesReadInCurrentPass(0), mTotalFramesRead(0), mCompletedPasses(0)
+	: mDecoder(std::move(decoder)), mStartingFrame(startingFrame), mFrameCount(frameCount), mRepeatCount(repeatCount), mFramesReadInCurrentPass(0), mTotalFramesRead(0), mCompletedPasses(0), mCachedFrames(0)
 {
 	assert(nullptr != mDecoder);
 }
 
 bool SFB::Audio::LoopableRegionDecoder::_Open(CFErrorRef *error)
 {
+	if(!mDecoder->IsOpen())
+		mDecoder->SetPrefersFloatOutput(mPrefersFloatOutput);
+
 	if(!mDecoder->IsOpen() && !mDecoder->Open(error))
 		return false;
 
@@ -67,12 +71,35 @@ bool SFB::Audio::LoopableRegionDecoder::_Open(CFErrorRef *error)
 
 bool SFB::Audio::LoopableRegionDecoder::_Close(CFErrorRef *error)
 {
+	mCache.Deallocate();
+	mCachedFrames = 0;
+
 	if(!mDecoder->Close(error))
 		return false;
 
 	return true;
 }
 
+bool SFB::Audio::LoopableRegionDecoder::_Rebind(CFErrorRef *error)
+{
+	return mDecoder->Rebind(std::move(mInputSource), error) && SetupDecoder();
+}
+
+SFB::Audio::Decoder::unique_ptr SFB::Audio::LoopableRegionDecoder::_Clone(CFErrorRef *error) const
+{
+	auto decoder = mDecoder->Clone(error);
+	if(!decoder)
+		return nullptr;
+
+	auto clone = std::unique_ptr<LoopableRegionDecoder>(new LoopableRegionDecoder(std::move(decoder), mStartingFrame, mFrameCount, mRepeatCount));
+	clone->mPrefersFloatOutput = mPrefersFloatOutput;
+
+	if(!clone->Open(error))
+		return nullptr;
+
+	return std::move(clone);
+}
+
 SFB::CFString SFB::Audio::LoopableRegionDecoder::_GetSourceFormatDescription() const
 {
 	return mDecoder->CreateSourceFormatDescription();
@@ -113,18 +140,42 @@ UInt32 SFB::Audio::LoopableRegionDecoder::_ReadAudio(AudioBufferList *bufferList
 	UInt32 totalFramesRead = 0;
 	
 	while(0 < framesRemaining) {
-		UInt32 framesRemainingInCurrentPass	= (UInt32)(mStartingFrame + mFrameCount - mDecoder->GetCurrentFrame());
-		UInt32 framesToRead					= std::min(framesRemaining, framesRemainingInCurrentPass);
-		
-		// Nothing left to read
-		if(0 == framesToRead)
-			break;
+		UInt32 framesRead = 0;
 
-		UInt32 framesRead = mDecoder->ReadAudio(bufferListAlias, framesToRead);
-		
-		// A read error occurred
-		if(0 == framesRead)
-			break;
+		// Once the region is cached every pass is read from memory
+		if(CacheIsComplete()) {
+			framesRead = std::min(framesRemaining, mFrameCount - mFramesReadInCurrentPass);
+
+			// Nothing left to read
+			if(0 == framesRead)
+				break;
+
+			for(UInt32 i = 0; i < bufferListAlias->mNumberBuffers; ++i) {
+				memcpy(bufferListAlias->mBuffers[i].mData, (int8_t *)mCache->mBuffers[i].mData + (mFramesReadInCurrentPass * mFormat.mBytesPerFrame), framesRead * mFormat.mBytesPerFrame);
+				bufferListAlias->mBuffers[i].mDataByteSize = framesRead * mFormat.mBytesPerFrame;
+			}
+		}
+		else {
+			UInt32 framesRemainingInCurrentPass	= (UInt32)(mStartingFrame + mFrameCount - mDecoder->GetCurrentFrame());
+			UInt32 framesToRead					= std::min(framesRemaining, framesRemainingInCurrentPass);
+
+			// Nothing left to read
+			if(0 == framesToRead)
+				break;
+
+			framesRead = mDecoder->ReadAudio(bufferListAlias, framesToRead);
+
+			// A read error occurred
+			if(0 == framesRead)
+				break;
+
+			// Frames contiguous with those already cached are appended to the cache
+			if(mCache && mFramesReadInCurrentPass == mCachedFrames) {
+				for(UInt32 i = 0; i < bufferListAlias->mNumberBuffers; ++i)
+					memcpy((int8_t *)mCache->mBuffers[i].mData + (mCachedFrames * mFormat.mBytesPerFrame), bufferListAlias->mBuffers[i].mData, framesRead * mFormat.mBytesPerFrame);
+				mCachedFrames += framesRead;
+			}
+		}
 
 		// Advance the write pointers and update the capacity
 		for(UInt32 i = 0; i < bufferListAlias->mNumberBuffers; ++i) {
@@ -148,8 +199,8 @@ UInt32 SFB::Audio::LoopableRegionDecoder::_ReadAudio(AudioBufferList *bufferList
 			++mCompletedPasses;
 			mFramesReadInCurrentPass = 0;
 			
-			// Only seek to the beginning of the region if more passes remain
-			if(mRepeatCount >= mCompletedPasses)
+			// Only seek to the beginning of the region if more passes remain and they aren't cached
+			if(mRepeatCount >= mCompletedPasses && !CacheIsComplete())
 				mDecoder->SeekToFrame(mStartingFrame);
 		}
 	}
@@ -163,7 +214,8 @@ SInt64 SFB::Audio::LoopableRegionDecoder::_SeekToFrame(SInt64 frame)
 	mFramesReadInCurrentPass	= (UInt32)(frame % mFrameCount);
 	mTotalFramesRead			= frame;
 
-	mDecoder->SeekToFrame(mStartingFrame + mFramesReadInCurrentPass);
+	if(!CacheIsComplete())
+		mDecoder->SeekToFrame(mStartingFrame + mFramesReadInCurrentPass);
 
 	return _GetCurrentFrame();
 }
@@ -177,6 +229,9 @@ bool SFB::Audio::LoopableRegionDecoder::Reset()
 	mTotalFramesRead			= 0;
 	mCompletedPasses			= 0;
 
+	if(CacheIsComplete())
+		return true;
+
 	return (mStartingFrame == mDecoder->SeekToFrame(mStartingFrame));
 }
 
@@ -191,9 +246,29 @@ bool SFB::Audio::LoopableRegionDecoder::SetupDecoder(bool forceReset)
 	
 	if(0 == mFrameCount)
 		mFrameCount = (UInt32)(mDecoder->GetTotalFrames() - mStartingFrame);
+
+	SetupCache();
 	
 	if(forceReset || 0 != mStartingFrame)
 		return Reset();
 
 	return true;
 }
+
+void SFB::Audio::LoopableRegionDecoder::SetupCache()
+{
+	mCache.Deallocate();
+	mCachedFrames = 0;
+
+	// Only repeated regions benefit from caching
+	if(0 == mRepeatCount || 0 == mFrameCount)
+		return;
+
+	UInt32 bufferCount = (kAudioFormatFlagIsNonInterleaved & mFormat.mFormatFlags) ? mFormat.mChannelsPerFrame : 1;
+	UInt64 cacheSizeBytes = (UInt64)mFrameCount * mFormat.mBytesPerFrame * bufferCount;
+	if(0 == cacheSizeBytes || cacheSizeBytes > RegionCacheSizeLimit())
+		return;
+
+	if(!mCache.Allocate(mFormat, mFrameCount))
+		LOGGER_NOTICE("org.sbooth.AudioEngine.Decoder.LoopableRegion", "Unable to allocate region cache; each pass will be decoded");
+}
@@ -32,6 +32,7 @@
 
 #include <AudioToolbox/ExtendedAudioFile.h>
 #include "AudioDecoder.h"
+#include "AudioBufferList.h"
 
 namespace SFB {
 
@@ -70,11 +71,19 @@ namespace SFB {
 			// Source audio information
 			inline virtual SInt64 _GetTotalFrames() const			{ return ((mRepeatCount + 1) * mFrameCount);}
 			inline virtual SInt64 _GetCurrentFrame() const			{ return mTotalFramesRead;}
+			inline virtual bool _TotalFramesAreExact() const		{ return mDecoder->TotalFramesAreExact(); }
 
 			// Seeking support
 			inline virtual bool _SupportsSeeking() const			{ return mDecoder->SupportsSeeking(); }
 			virtual SInt64 _SeekToFrame(SInt64 frame);
 
+			// The wrapped decoder is rebound; the region is preserved
+			virtual bool _Rebind(CFErrorRef *error);
+			inline virtual void _EndBackgroundActivity()			{ EndBackgroundActivity(*mDecoder); }
+
+			// The wrapped decoder is cloned; the region is preserved but the cache isn't shared
+			virtual Decoder::unique_ptr _Clone(CFErrorRef *error) const;
+
 
 			// The starting frame for this audio file region
 			inline SInt64 GetStartingFrame() const					{ return mStartingFrame; }
@@ -96,6 +105,12 @@ namespace SFB {
 			// Called when mDecoder is open
 			bool SetupDecoder(bool forceReset = true);
 
+			// Allocates mCache if the region is repeated and small enough to cache
+			void SetupCache();
+
+			// True when every frame in the region has been cached
+			inline bool CacheIsComplete() const						{ return mCache && mCachedFrames == mFrameCount; }
+
 			// Data members
 			Decoder::unique_ptr		mDecoder;
 
@@ -106,6 +121,9 @@ namespace SFB {
 			UInt32					mFramesReadInCurrentPass;
 			SInt64					mTotalFramesRead;
 			UInt32					mCompletedPasses;
+
+			BufferList				mCache;
+			UInt32					mCachedFrames;
 		};
 		
 	}
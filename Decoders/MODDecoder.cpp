@@ -37,8 +37,25 @@
 #define DUMB_CHANNELS		2
 #define DUMB_BIT_DEPTH		16
 
+// DUMB positions are measured in units of 1/65536 second, independent of the rendering sample rate
+#define DUMB_POSITION_UNITS_PER_SECOND	65536
+
+// DUMB checkpoints the renderer every 30 seconds (IT_CHECKPOINT_INTERVAL) when a module is loaded
+#define DUMB_CHECKPOINT_INTERVAL	(30 * DUMB_POSITION_UNITS_PER_SECOND)
+
 namespace {
 
+	// Convert between audio frames at DUMB_SAMPLE_RATE and DUMB positions
+	inline long PositionForFrame(SInt64 frame)
+	{
+		return (long)((frame * DUMB_POSITION_UNITS_PER_SECOND) / DUMB_SAMPLE_RATE);
+	}
+
+	inline SInt64 FrameForPosition(long position)
+	{
+		return ((SInt64)position * DUMB_SAMPLE_RATE) / DUMB_POSITION_UNITS_PER_SECOND;
+	}
+
 	void RegisterMODDecoder() __attribute__ ((constructor));
 	void RegisterMODDecoder()
 	{
@@ -128,6 +145,25 @@ bool SFB::Audio::MODDecoder::HandlesMIMEType(CFStringRef mimeType)
 	return false;
 }
 
+bool SFB::Audio::MODDecoder::HandlesSignature(const void *header, size_t length)
+{
+	if(nullptr == header || 4 > length)
+		return false;
+
+	const char *bytes = static_cast<const char *>(header);
+
+	// Impulse Tracker, FastTracker 2 and Scream Tracker 3
+	// ProTracker signatures are at offset 1080, beyond the sniffed header, so those files are matched by extension
+	if(!memcmp(bytes, "IMPM", 4))
+		return true;
+	else if(17 <= length && !memcmp(bytes, "Extended Module: ", 17))
+		return true;
+	else if(48 <= length && !memcmp(bytes + 44, "SCRM", 4))
+		return true;
+
+	return false;
+}
+
 SFB::Audio::Decoder::unique_ptr SFB::Audio::MODDecoder::CreateDecoder(InputSource::unique_ptr inputSource)
 {
 	return unique_ptr(new MODDecoder(std::move(inputSource)));
@@ -154,18 +190,36 @@ bool SFB::Audio::MODDecoder::_Open(CFErrorRef *error)
 		return false;
 	}
 
-	SFB::CFString pathExtension = CFURLCopyPathExtension(GetURL());
-	if(nullptr == pathExtension)
-		return false;
+	// Determine the module type from its signature, falling back to the file's extension
+	SFB::CFString pathExtension = GetURL() ? CFURLCopyPathExtension(GetURL()) : nullptr;
+	CFStringRef moduleType = pathExtension;
 
-	// Attempt to create the appropriate decoder based on the file's extension
-	if(kCFCompareEqualTo == CFStringCompare(pathExtension, CFSTR("it"), kCFCompareCaseInsensitive))
+	unsigned char header [48];
+	SInt64 headerLength = 0;
+	if(mInputSource->SupportsSeeking() && 0 == mInputSource->GetOffset()) {
+		headerLength = mInputSource->Read(header, sizeof(header));
+		if(!mInputSource->SeekToOffset(0))
+			return false;
+	}
+
+	if(4 <= headerLength && !memcmp(header, "IMPM", 4))
+		moduleType = CFSTR("it");
+	else if(17 <= headerLength && !memcmp(header, "Extended Module: ", 17))
+		moduleType = CFSTR("xm");
+	else if(48 <= headerLength && !memcmp(header + 44, "SCRM", 4))
+		moduleType = CFSTR("s3m");
+	// ProTracker signatures are too far into the file to be useful
+	else if(nullptr == moduleType)
+		moduleType = CFSTR("mod");
+
+	// Attempt to create the appropriate decoder based on the module type
+	if(kCFCompareEqualTo == CFStringCompare(moduleType, CFSTR("it"), kCFCompareCaseInsensitive))
 		duh = unique_DUH_ptr(dumb_read_it(df.get()), unload_duh);
-	else if(kCFCompareEqualTo == CFStringCompare(pathExtension, CFSTR("xm"), kCFCompareCaseInsensitive))
+	else if(kCFCompareEqualTo == CFStringCompare(moduleType, CFSTR("xm"), kCFCompareCaseInsensitive))
 		duh = unique_DUH_ptr(dumb_read_xm(df.get()), unload_duh);
-	else if(kCFCompareEqualTo == CFStringCompare(pathExtension, CFSTR("s3m"), kCFCompareCaseInsensitive))
+	else if(kCFCompareEqualTo == CFStringCompare(moduleType, CFSTR("s3m"), kCFCompareCaseInsensitive))
 		duh = unique_DUH_ptr(dumb_read_s3m(df.get()), unload_duh);
-	else if(kCFCompareEqualTo == CFStringCompare(pathExtension, CFSTR("mod"), kCFCompareCaseInsensitive))
+	else if(kCFCompareEqualTo == CFStringCompare(moduleType, CFSTR("mod"), kCFCompareCaseInsensitive))
 		duh = unique_DUH_ptr(dumb_read_mod(df.get()), unload_duh);
 	
 	if(!duh) {
@@ -265,14 +319,20 @@ UInt32 SFB::Audio::MODDecoder::_ReadAudio(AudioBufferList *bufferList, UInt32 fr
 
 SInt64 SFB::Audio::MODDecoder::_SeekToFrame(SInt64 frame)
 {
-	// DUMB cannot seek backwards, so the decoder must be reset
-	if(frame < mCurrentFrame) {
-		if(!_Close(nullptr) || !mInputSource->SeekToOffset(0) || !_Open(nullptr)) {
-			LOGGER_ERR("org.sbooth.AudioEngine.Decoder.MOD", "Error reseting DUMB decoder");
+	// DUMB cannot seek backwards, but a new renderer started at a position is restored from the
+	// nearest checkpoint taken during the module's initial run-through and only renders the remainder.
+	// Forward seeks shorter than the checkpoint interval are cheaper to render in place.
+	if(frame < mCurrentFrame || frame - mCurrentFrame >= FrameForPosition(DUMB_CHECKPOINT_INTERVAL)) {
+		unique_DUH_SIGRENDERER_ptr renderer(duh_start_sigrenderer(duh.get(), 0, DUMB_CHANNELS, PositionForFrame(frame)), duh_end_sigrenderer);
+		if(!renderer) {
+			LOGGER_ERR("org.sbooth.AudioEngine.Decoder.MOD", "Error starting DUMB renderer at frame " << frame);
 			return -1;
 		}
 
-		mCurrentFrame = 0;
+		dsr = std::move(renderer);
+		mCurrentFrame = frame;
+
+		return mCurrentFrame;
 	}
 
 	long framesToSkip = frame - mCurrentFrame;
@@ -31,16 +31,20 @@
 #include <algorithm>
 
 #include <unistd.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
-
-#include <Accelerate/Accelerate.h>
+#include <sys/resource.h>
 
 #include "MPEGDecoder.h"
 #include "CFWrapper.h"
 #include "CFErrorUtilities.h"
+#include "SampleConversion.h"
 #include "Logger.h"
 
+// The number of bytes examined when searching for the first MPEG frame
+#define VBR_HEADER_SEARCH_SIZE 4096
+
 namespace {
 
 	void RegisterMPEGDecoder() __attribute__ ((constructor));
@@ -105,6 +109,167 @@ namespace {
 		return offset;
 	}
 
+	// State for the handle performing a background scan
+	struct ScanContext
+	{
+		SFB::InputSource		*mInputSource;
+		const std::atomic_bool	*mCancel;
+	};
+
+	ssize_t scan_read_callback(void *dataSource, void *ptr, size_t size)
+	{
+		assert(nullptr != dataSource);
+
+		auto context = static_cast<ScanContext *>(dataSource);
+
+		// Returning an error causes mpg123_scan() to stop early
+		if(context->mCancel->load(std::memory_order_relaxed))
+			return -1;
+
+		return (ssize_t)context->mInputSource->Read(ptr, (SInt64)size);
+	}
+
+	off_t scan_lseek_callback(void *dataSource, off_t offset, int whence)
+	{
+		assert(nullptr != dataSource);
+
+		auto context = static_cast<ScanContext *>(dataSource);
+		SFB::InputSource& inputSource = *context->mInputSource;
+
+		switch(whence) {
+			case SEEK_SET:
+				break;
+			case SEEK_CUR:
+				offset += inputSource.GetOffset();
+				break;
+			case SEEK_END:
+				offset += inputSource.GetLength();
+				break;
+		}
+
+		if(!inputSource.SeekToOffset(offset))
+			return -1;
+
+		return offset;
+	}
+
+#pragma mark Xing, Info and VBRI Headers
+
+	// Information contained in the first frame of a VBR (or LAME-encoded CBR) stream
+	struct VBRHeader
+	{
+		UInt32	mFrameCount;			// The number of MPEG frames, excluding the frame containing the header
+		UInt32	mSamplesPerFrame;
+		UInt32	mEncoderDelay;			// From the LAME tag
+		UInt32	mEncoderPadding;		// From the LAME tag
+		bool	mHasTOC;				// True for Xing/Info headers containing a seek table
+	};
+
+	inline UInt32 ReadUInt32BigEndian(const unsigned char *bytes)
+	{
+		return ((UInt32)bytes[0] << 24) | ((UInt32)bytes[1] << 16) | ((UInt32)bytes[2] << 8) | (UInt32)bytes[3];
+	}
+
+	// Reads the Xing, Info or VBRI header from the first frame of the stream, leaving inputSource at an undefined offset
+	bool ReadVBRHeader(SFB::InputSource& inputSource, VBRHeader& header)
+	{
+		unsigned char buf [VBR_HEADER_SEARCH_SIZE];
+
+		// Skip any ID3v2 tag, since mpg123 will do the same
+		SInt64 offset = 0;
+		if(10 != inputSource.Read(buf, 10))
+			return false;
+
+		if(!memcmp(buf, "ID3", 3)) {
+			offset = 10 + (((SInt64)(buf[6] & 0x7f) << 21) | ((buf[7] & 0x7f) << 14) | ((buf[8] & 0x7f) << 7) | (buf[9] & 0x7f));
+			// Footer present
+			if(0x10 & buf[5])
+				offset += 10;
+		}
+
+		if(!inputSource.SeekToOffset(offset))
+			return false;
+
+		SInt64 bytesRead = inputSource.Read(buf, VBR_HEADER_SEARCH_SIZE);
+		if(4 > bytesRead)
+			return false;
+
+		// The first valid frame header determines whether the stream has a VBR header
+		for(SInt64 i = 0; i + 4 <= bytesRead; ++i) {
+			const unsigned char *frame = buf + i;
+
+			if(0xff != frame[0] || 0xe0 != (frame[1] & 0xe0))
+				continue;
+
+			unsigned version			= (frame[1] >> 3) & 0x03;
+			unsigned layer				= (frame[1] >> 1) & 0x03;
+			unsigned bitrateIndex		= (frame[2] >> 4) & 0x0f;
+			unsigned sampleRateIndex	= (frame[2] >> 2) & 0x03;
+			unsigned channelMode		= (frame[3] >> 6) & 0x03;
+
+			if(0x01 == version || 0x00 == layer || 0x00 == bitrateIndex || 0x0f == bitrateIndex || 0x03 == sampleRateIndex)
+				continue;
+
+			bool isMPEG1 = (0x03 == version);
+			bool isMono = (0x03 == channelMode);
+
+			memset(&header, 0, sizeof(header));
+
+			switch(layer) {
+				case 0x03:	header.mSamplesPerFrame = 384;						break;	// Layer I
+				case 0x02:	header.mSamplesPerFrame = 1152;						break;	// Layer II
+				case 0x01:	header.mSamplesPerFrame = isMPEG1 ? 1152 : 576;		break;	// Layer III
+			}
+
+			// Xing and Info headers follow the side information
+			SInt64 xingOffset = i + 4 + (isMPEG1 ? (isMono ? 17 : 32) : (isMono ? 9 : 17));
+			if(0x01 == layer && xingOffset + 8 <= bytesRead && (!memcmp(buf + xingOffset, "Xing", 4) || !memcmp(buf + xingOffset, "Info", 4))) {
+				UInt32 flags = ReadUInt32BigEndian(buf + xingOffset + 4);
+				SInt64 position = xingOffset + 8;
+
+				if(0x01 & flags) {
+					if(position + 4 > bytesRead)
+						return false;
+					header.mFrameCount = ReadUInt32BigEndian(buf + position);
+					position += 4;
+				}
+
+				// Byte count
+				if(0x02 & flags)
+					position += 4;
+
+				if(0x04 & flags) {
+					header.mHasTOC = true;
+					position += 100;
+				}
+
+				// Quality indicator
+				if(0x08 & flags)
+					position += 4;
+
+				// The LAME tag contains the encoder delay and padding in bytes 21-23
+				if(position + 24 <= bytesRead && 'L' == buf[position]) {
+					const unsigned char *delayAndPadding = buf + position + 21;
+					header.mEncoderDelay	= ((UInt32)delayAndPadding[0] << 4) | (delayAndPadding[1] >> 4);
+					header.mEncoderPadding	= ((UInt32)(delayAndPadding[1] & 0x0f) << 8) | delayAndPadding[2];
+				}
+
+				return 0 != header.mFrameCount;
+			}
+
+			// VBRI headers are always located 32 bytes after the frame header
+			SInt64 vbriOffset = i + 4 + 32;
+			if(vbriOffset + 18 <= bytesRead && !memcmp(buf + vbriOffset, "VBRI", 4)) {
+				header.mFrameCount = ReadUInt32BigEndian(buf + vbriOffset + 14);
+				return 0 != header.mFrameCount;
+			}
+
+			return false;
+		}
+
+		return false;
+	}
+
 }
 
 #pragma mark Static Methods
@@ -143,6 +308,41 @@ bool SFB::Audio::MPEGDecoder::HandlesMIMEType(CFStringRef mimeType)
 	return false;
 }
 
+bool SFB::Audio::MPEGDecoder::HandlesSignature(const void *header, size_t length)
+{
+	if(nullptr == header || 4 > length)
+		return false;
+
+	const unsigned char *bytes = static_cast<const unsigned char *>(header);
+
+	// An ID3v2 tag may precede any number of formats, so the frame header following it must also be present
+	if(10 <= length && !memcmp(bytes, "ID3", 3)) {
+		if((bytes[6] | bytes[7] | bytes[8] | bytes[9]) & 0x80)
+			return false;
+
+		size_t tagSize = 10 + (((size_t)bytes[6] << 21) | ((size_t)bytes[7] << 14) | ((size_t)bytes[8] << 7) | (size_t)bytes[9]);
+		// Footer present
+		if(0x10 & bytes[5])
+			tagSize += 10;
+
+		if(tagSize + 4 > length)
+			return false;
+
+		bytes += tagSize;
+	}
+
+	// MPEG audio frame header: sync word, layer, bitrate and sample rate must be valid
+	if(0xff != bytes[0] || 0xe0 != (bytes[1] & 0xe0))
+		return false;
+
+	unsigned version		= (bytes[1] >> 3) & 0x03;
+	unsigned layer			= (bytes[1] >> 1) & 0x03;
+	unsigned bitrateIndex	= (bytes[2] >> 4) & 0x0f;
+	unsigned sampleRateIndex	= (bytes[2] >> 2) & 0x03;
+
+	return 0x01 != version && 0x00 != layer && 0x0f != bitrateIndex && 0x03 != sampleRateIndex;
+}
+
 SFB::Audio::Decoder::unique_ptr SFB::Audio::MPEGDecoder::CreateDecoder(InputSource::unique_ptr inputSource)
 {
 	return unique_ptr(new MPEGDecoder(std::move(inputSource)));
@@ -151,14 +351,23 @@ SFB::Audio::Decoder::unique_ptr SFB::Audio::MPEGDecoder::CreateDecoder(InputSour
 #pragma mark Creation and Destruction
 
 SFB::Audio::MPEGDecoder::MPEGDecoder(InputSource::unique_ptr inputSource)
-	: Decoder(std::move(inputSource)), mDecoder(nullptr), mCurrentFrame(0)
+	: Decoder(std::move(inputSource)), mDecoder(nullptr), mBufferFrameOffset(0), mCurrentFrame(0), mEstimatedTotalFrames(-1), mHasSeekTable(false), mPositionIsApproximate(false), mCancelScan(ATOMIC_VAR_INIT(false)), mScanFinished(ATOMIC_VAR_INIT(false)), mExactTotalFrames(ATOMIC_VAR_INIT(-1)), mScannedIndexStep(0), mScannedIndexAdopted(false), mAwaitingSharedScan(false)
 {}
 
+SFB::Audio::MPEGDecoder::~MPEGDecoder()
+{
+	if(IsOpen())
+		Close();
+
+	CancelBackgroundScan();
+}
+
 #pragma mark Functionality
 
 bool SFB::Audio::MPEGDecoder::_Open(CFErrorRef *error)
 {
-	auto decoder = unique_mpg123_ptr(mpg123_new(nullptr, nullptr), [](mpg123_handle *mh) {
+	// A handle remaining from an earlier stream is reused
+	auto decoder = mDecoder ? std::move(mDecoder) : unique_mpg123_ptr(mpg123_new(nullptr, nullptr), [](mpg123_handle *mh) {
 		mpg123_close(mh);
 		mpg123_delete(mh);
 	});
@@ -175,6 +384,27 @@ bool SFB::Audio::MPEGDecoder::_Open(CFErrorRef *error)
 		return false;
 	}
 
+	// Use the Xing, Info or VBRI header for an immediate duration instead of scanning the entire file
+	mEstimatedTotalFrames = -1;
+	mHasSeekTable = false;
+	mPositionIsApproximate = false;
+
+	if(mInputSource->SupportsSeeking()) {
+		VBRHeader vbrHeader;
+		if(ReadVBRHeader(*mInputSource, vbrHeader)) {
+			SInt64 totalFrames = (SInt64)vbrHeader.mFrameCount * vbrHeader.mSamplesPerFrame;
+			mEstimatedTotalFrames = std::max(totalFrames - vbrHeader.mEncoderDelay - vbrHeader.mEncoderPadding, (SInt64)0);
+			mHasSeekTable = vbrHeader.mHasTOC;
+		}
+
+		if(!mInputSource->SeekToOffset(0)) {
+			if(error)
+				*error = CFErrorCreate(kCFAllocatorDefault, kCFErrorDomainPOSIX, EIO, nullptr);
+
+			return false;
+		}
+	}
+
 	// Force decode to floating point instead of 16-bit signed integer
 	mpg123_param(decoder.get(), MPG123_FLAGS, MPG123_FORCE_FLOAT | MPG123_SKIP_ID3V2 | MPG123_GAPLESS | MPG123_QUIET, 0);
 	mpg123_param(decoder.get(), MPG123_RESYNC_LIMIT, 2048, 0);
@@ -248,20 +478,9 @@ bool SFB::Audio::MPEGDecoder::_Open(CFErrorRef *error)
 		case 2:		mChannelLayout = ChannelLayout::ChannelLayoutWithTag(kAudioChannelLayoutTag_Stereo);	break;
 	}
 
-	if(MPG123_OK != mpg123_scan(decoder.get())) {
-		if(error) {
-			SFB::CFString description = CFCopyLocalizedString(CFSTR("The file “%@” is not a valid MP3 file."), "");
-			SFB::CFString failureReason = CFCopyLocalizedString(CFSTR("Not an MP3 file"), "");
-			SFB::CFString recoverySuggestion = CFCopyLocalizedString(CFSTR("The file's extension may not match the file's type."), "");
-			
-			*error = CreateErrorForURL(Decoder::ErrorDomain, Decoder::InputOutputError, description, mInputSource->GetURL(), failureReason, recoverySuggestion);
-		}
-
-		return false;
-	}
-	
-	// Allocate the buffer list
-	if(!mBufferList.Allocate(mFormat, framesPerMPEGFrame)) {
+	// Allocate the buffer list, reusing one from an earlier stream if it is large enough
+	bool bufferIsReusable = mBufferList && mBufferList->mNumberBuffers == mFormat.mChannelsPerFrame && mBufferList.GetBytesPerFrame() == mFormat.mBytesPerFrame && mBufferList.GetCapacityFrames() >= framesPerMPEGFrame;
+	if(!bufferIsReusable && !mBufferList.Allocate(mFormat, framesPerMPEGFrame)) {
 		if(error)
 			*error = CFErrorCreate(kCFAllocatorDefault, kCFErrorDomainPOSIX, ENOMEM, nullptr);
 		
@@ -270,20 +489,58 @@ bool SFB::Audio::MPEGDecoder::_Open(CFErrorRef *error)
 	
 	for(UInt32 i = 0; i < mBufferList->mNumberBuffers; ++i)
 		mBufferList->mBuffers[i].mDataByteSize = 0;
+	mBufferFrameOffset = 0;
 
 	mDecoder = std::move(decoder);
 
+	// An index saved by an earlier decoder makes the length and seeking exact immediately
+	// Clones are given their original's index, and take over its scan if the original is closed first
+	if(!mSeekIndex)
+		mSeekIndex = SeekIndex::SeekIndexForInputSource(*mInputSource, "MPEG");
+	if(mSeekIndex && mSeekIndex->IsComplete() && InstallSeekIndex())
+		return true;
+
+	StartBackgroundScan();
+
 	return true;
 }
 
 bool SFB::Audio::MPEGDecoder::_Close(CFErrorRef */*error*/)
 {
+	CancelBackgroundScan();
+
+	if(mSeekIndex) {
+		mSeekIndex->Save();
+		mSeekIndex.reset();
+	}
+
 	mDecoder.reset();
 	mBufferList.Deallocate();
 
 	return true;
 }
 
+bool SFB::Audio::MPEGDecoder::_Rebind(CFErrorRef *error)
+{
+	CancelBackgroundScan();
+
+	if(mSeekIndex) {
+		mSeekIndex->Save();
+		mSeekIndex.reset();
+	}
+
+	// Closing the stream leaves the handle's parameters and buffers intact
+	mpg123_close(mDecoder.get());
+	mCurrentFrame = 0;
+
+	return _Open(error);
+}
+
+void SFB::Audio::MPEGDecoder::_PrepareClone(Decoder& clone) const
+{
+	static_cast<MPEGDecoder&>(clone).mSeekIndex = mSeekIndex;
+}
+
 SFB::CFString SFB::Audio::MPEGDecoder::_GetSourceFormatDescription() const
 {
 	mpg123_frameinfo mi;
@@ -325,6 +582,10 @@ UInt32 SFB::Audio::MPEGDecoder::_ReadAudio(AudioBufferList *bufferList, UInt32 f
 		return 0;
 	}
 
+	// Take over the scan if the decoder performing it stopped early
+	if(mAwaitingSharedScan)
+		StartBackgroundScan();
+
 	UInt32 framesRead = 0;
 
 	// Reset output buffer data size
@@ -332,28 +593,28 @@ UInt32 SFB::Audio::MPEGDecoder::_ReadAudio(AudioBufferList *bufferList, UInt32 f
 		bufferList->mBuffers[i].mDataByteSize = 0;
 	
 	for(;;) {
-		
 		UInt32	framesRemaining	= frameCount - framesRead;
-		UInt32	framesToSkip	= (UInt32)(bufferList->mBuffers[0].mDataByteSize / sizeof(float));
-		UInt32	framesInBuffer	= (UInt32)(mBufferList->mBuffers[0].mDataByteSize / sizeof(float));
+		UInt32	framesInBuffer	= (UInt32)(mBufferList->mBuffers[0].mDataByteSize / sizeof(float)) - mBufferFrameOffset;
 		UInt32	framesToCopy	= std::min(framesInBuffer, framesRemaining);
-		
-		// Copy data from the buffer to output
-		for(UInt32 i = 0; i < mBufferList->mNumberBuffers; ++i) {
-			float *floatBuffer = (float *)bufferList->mBuffers[i].mData;
-			memcpy(floatBuffer + framesToSkip, mBufferList->mBuffers[i].mData, framesToCopy * sizeof(float));
-			bufferList->mBuffers[i].mDataByteSize += framesToCopy * sizeof(float);
-			
-			// Move remaining data in buffer to beginning
-			if(framesToCopy != framesInBuffer) {
-				floatBuffer = (float *)mBufferList->mBuffers[i].mData;
-				memmove(floatBuffer, floatBuffer + framesToCopy, (framesInBuffer - framesToCopy) * sizeof(float));
+
+		// Copy data from the buffer to output, advancing past the frames consumed
+		if(framesToCopy) {
+			for(UInt32 i = 0; i < mBufferList->mNumberBuffers; ++i) {
+				float *floatBuffer = (float *)bufferList->mBuffers[i].mData;
+				memcpy(floatBuffer + framesRead, (const float *)mBufferList->mBuffers[i].mData + mBufferFrameOffset, framesToCopy * sizeof(float));
+				bufferList->mBuffers[i].mDataByteSize += framesToCopy * sizeof(float);
 			}
-			
-			mBufferList->mBuffers[i].mDataByteSize -= framesToCopy * sizeof(float);
+
+			mBufferFrameOffset += framesToCopy;
+			framesRead += framesToCopy;
+		}
+
+		// Once the buffer is drained it may be refilled from the beginning
+		if(framesToCopy == framesInBuffer) {
+			for(UInt32 i = 0; i < mBufferList->mNumberBuffers; ++i)
+				mBufferList->mBuffers[i].mDataByteSize = 0;
+			mBufferFrameOffset = 0;
 		}
-		
-		framesRead += framesToCopy;
 
 		// All requested frames were read
 		if(framesRead == frameCount)
@@ -365,8 +626,14 @@ UInt32 SFB::Audio::MPEGDecoder::_ReadAudio(AudioBufferList *bufferList, UInt32 f
 		size_t bytesDecoded;
 		int result = mpg123_decode_frame(mDecoder.get(), &frameNumber, &audioData, &bytesDecoded);
 
-		if(MPG123_DONE == result)
+		if(MPG123_DONE == result) {
+			// The exact length is known once the end of the stream is reached
+			if(!mPositionIsApproximate && !_TotalFramesAreExact()) {
+				mExactTotalFrames.store(mCurrentFrame + framesRead, std::memory_order_relaxed);
+				StoreSeekIndex(mDecoder.get(), mCurrentFrame + framesRead);
+			}
 			break;
+		}
 		else if(MPG123_OK != result) {
 			LOGGER_ERR("org.sbooth.AudioEngine.Decoder.MPEG", "mpg123_decode_frame failed: " << mpg123_strerror(mDecoder.get()));
 			break;
@@ -375,18 +642,25 @@ UInt32 SFB::Audio::MPEGDecoder::_ReadAudio(AudioBufferList *bufferList, UInt32 f
 		// The analyzer error about division by zero may be safely ignored, because mChannelsPerFrame is verified > 0 in Open()
 		UInt32 framesDecoded = (UInt32)(bytesDecoded / (sizeof(float) * mFormat.mChannelsPerFrame));
 
-		// Deinterleave the samples
-		// In my experiments adding zero using Accelerate.framework is faster than looping through the buffer and copying each sample
-		float zero = 0;
-		for(UInt32 channel = 0; channel < mFormat.mChannelsPerFrame; ++channel) {
-			float *inputBuffer = (float *)audioData + channel;
-			float *outputBuffer = (float *)mBufferList->mBuffers[channel].mData;
+		// Deinterleave the samples directly into the output if they fit
+		if(framesDecoded <= frameCount - framesRead) {
+			SampleConversion::DeinterleaveFloat((const float *)audioData, bufferList, mFormat.mChannelsPerFrame, framesDecoded, framesRead);
 
-			vDSP_vsadd(inputBuffer, (vDSP_Stride)mFormat.mChannelsPerFrame, &zero, outputBuffer, 1, framesDecoded);
+			for(UInt32 channel = 0; channel < mFormat.mChannelsPerFrame; ++channel)
+				bufferList->mBuffers[channel].mDataByteSize += framesDecoded * sizeof(float);
 
-			mBufferList->mBuffers[channel].mNumberChannels	= 1;
-			mBufferList->mBuffers[channel].mDataByteSize	= framesDecoded * sizeof(float);
-		}		
+			framesRead += framesDecoded;
+		}
+		// Otherwise deinterleave them into the buffer
+		else {
+			framesDecoded = std::min(framesDecoded, mBufferList.GetCapacityFrames());
+			SampleConversion::DeinterleaveFloat((const float *)audioData, mBufferList, mFormat.mChannelsPerFrame, framesDecoded);
+
+			for(UInt32 channel = 0; channel < mFormat.mChannelsPerFrame; ++channel) {
+				mBufferList->mBuffers[channel].mNumberChannels	= 1;
+				mBufferList->mBuffers[channel].mDataByteSize	= framesDecoded * sizeof(float);
+			}
+		}
 	}
 	
 	mCurrentFrame += framesRead;
@@ -396,14 +670,244 @@ UInt32 SFB::Audio::MPEGDecoder::_ReadAudio(AudioBufferList *bufferList, UInt32 f
 
 SInt64 SFB::Audio::MPEGDecoder::_GetTotalFrames() const
 {
+	SInt64 exactTotalFrames = mExactTotalFrames.load(std::memory_order_relaxed);
+	if(-1 != exactTotalFrames)
+		return exactTotalFrames;
+
+	// A shared index may have been completed by another decoder since this one was opened
+	if(mSeekIndex && mSeekIndex->IsComplete())
+		return mSeekIndex->GetTotalFrames();
+
+	if(-1 != mEstimatedTotalFrames)
+		return mEstimatedTotalFrames;
+
+	// Estimated by mpg123 from the file size and bitrate
 	return mpg123_length(mDecoder.get());
 }
 
+bool SFB::Audio::MPEGDecoder::_TotalFramesAreExact() const
+{
+	return -1 != mExactTotalFrames.load(std::memory_order_relaxed) || (mSeekIndex && mSeekIndex->IsComplete());
+}
+
 SInt64 SFB::Audio::MPEGDecoder::_SeekToFrame(SInt64 frame)
 {
+	AdoptScannedIndex();
+
+	if(mAwaitingSharedScan)
+		StartBackgroundScan();
+
+	// A shared index may have been completed by another decoder since this one was opened
+	if(!mScannedIndexAdopted && mSeekIndex && mSeekIndex->IsComplete())
+		InstallSeekIndex();
+
+	// Without an exact index mpg123 must read every frame header between the last indexed frame and the target
+	// When the stream has a seek table use it to jump directly to the approximate position instead
+	bool useSeekTable = false;
+	if(mHasSeekTable && !mScannedIndexAdopted) {
+		off_t *offsets = nullptr;
+		off_t step = 0;
+		size_t fill = 0;
+		if(MPG123_OK == mpg123_index(mDecoder.get(), &offsets, &step, &fill))
+			useSeekTable = (frame / (SInt64)mSourceFormat.mFramesPerPacket) > (SInt64)(step * (off_t)fill);
+	}
+
+	if(useSeekTable)
+		mpg123_param(mDecoder.get(), MPG123_ADD_FLAGS, MPG123_FUZZY, 0);
+
 	frame = mpg123_seek(mDecoder.get(), frame, SEEK_SET);
-	if(0 <= frame)
+
+	if(useSeekTable)
+		mpg123_param(mDecoder.get(), MPG123_REMOVE_FLAGS, MPG123_FUZZY, 0);
+
+	if(0 <= frame) {
 		mCurrentFrame = frame;
+		mPositionIsApproximate = useSeekTable;
+
+		// Discard any frames remaining from the previous position
+		for(UInt32 i = 0; i < mBufferList->mNumberBuffers; ++i)
+			mBufferList->mBuffers[i].mDataByteSize = 0;
+		mBufferFrameOffset = 0;
+	}
 
 	return ((0 <= frame) ? mCurrentFrame : -1);
 }
+
+#pragma mark Background Scanning
+
+void SFB::Audio::MPEGDecoder::StartBackgroundScan()
+{
+	// Build the exact frame index in the background for local files
+	// Other sources build the index incrementally as they are decoded
+	if(!mAwaitingSharedScan) {
+		SFB::CFString scheme = mInputSource->GetURL() ? CFURLCopyScheme(mInputSource->GetURL()) : nullptr;
+		if(!mSeekIndex || !scheme || kCFCompareEqualTo != CFStringCompare(CFSTR("file"), scheme, kCFCompareCaseInsensitive) || !mInputSource->SupportsSeeking())
+			return;
+	}
+
+	mAwaitingSharedScan = false;
+
+	// Only one decoder scans a file at a time; the others use the completed shared index
+	if(!mSeekIndex->BeginBuilding()) {
+		mAwaitingSharedScan = !mSeekIndex->IsComplete();
+		return;
+	}
+
+	SFB::CFURL url = (CFURLRef)CFRetain(mInputSource->GetURL());
+	SeekIndex::shared_ptr seekIndex = mSeekIndex;
+	mScanThread = std::thread([this, url, seekIndex]() {
+		ScanInBackground(url);
+		seekIndex->EndBuilding();
+	});
+}
+
+void SFB::Audio::MPEGDecoder::ScanInBackground(CFURLRef url)
+{
+	pthread_setname_np("org.sbooth.AudioEngine.Decoder.MPEG.Scan");
+
+	// The scan is speculative, so stay out of the way of playback I/O
+	if(-1 == setiopolicy_np(IOPOL_TYPE_DISK, IOPOL_SCOPE_THREAD, IOPOL_THROTTLE))
+		LOGGER_WARNING("org.sbooth.AudioEngine.Decoder.MPEG", "Couldn't set scan thread I/O policy: " << strerror(errno));
+
+	CFErrorRef error = nullptr;
+	auto inputSource = InputSource::CreateInputSourceForURL(url, 0, &error);
+	if(!inputSource || !inputSource->Open(&error)) {
+		if(error) {
+			LOGGER_WARNING("org.sbooth.AudioEngine.Decoder.MPEG", "Unable to open input source for scanning: " << error);
+			CFRelease(error), error = nullptr;
+		}
+
+		return;
+	}
+
+	auto scanner = unique_mpg123_ptr(mpg123_new(nullptr, nullptr), [](mpg123_handle *mh) {
+		mpg123_close(mh);
+		mpg123_delete(mh);
+	});
+
+	if(!scanner)
+		return;
+
+	// The parameters must match those used by mDecoder for the length and index to be applicable
+	mpg123_param(scanner.get(), MPG123_FLAGS, MPG123_FORCE_FLOAT | MPG123_SKIP_ID3V2 | MPG123_GAPLESS | MPG123_QUIET, 0);
+	mpg123_param(scanner.get(), MPG123_RESYNC_LIMIT, 2048, 0);
+
+	ScanContext context = { inputSource.get(), &mCancelScan };
+	if(MPG123_OK != mpg123_replace_reader_handle(scanner.get(), scan_read_callback, scan_lseek_callback, nullptr) || MPG123_OK != mpg123_open_handle(scanner.get(), &context))
+		return;
+
+	if(MPG123_OK != mpg123_scan(scanner.get())) {
+		if(!mCancelScan.load(std::memory_order_relaxed))
+			LOGGER_WARNING("org.sbooth.AudioEngine.Decoder.MPEG", "mpg123_scan failed: " << mpg123_strerror(scanner.get()));
+		return;
+	}
+
+	off_t *offsets = nullptr;
+	off_t step = 0;
+	size_t fill = 0;
+	if(MPG123_OK == mpg123_index(scanner.get(), &offsets, &step, &fill) && offsets) {
+		std::lock_guard<std::mutex> lock(mScanMutex);
+		mScannedIndex.assign(offsets, offsets + fill);
+		mScannedIndexStep = step;
+	}
+
+	off_t length = mpg123_length(scanner.get());
+	if(0 <= length) {
+		mExactTotalFrames.store(length, std::memory_order_relaxed);
+		StoreSeekIndex(scanner.get(), length);
+	}
+
+	mScanFinished.store(true, std::memory_order_release);
+
+	LOGGER_DEBUG("org.sbooth.AudioEngine.Decoder.MPEG", "Background scan found " << length << " frames for \"" << url << "\"");
+}
+
+void SFB::Audio::MPEGDecoder::CancelBackgroundScan()
+{
+	if(mScanThread.joinable()) {
+		mCancelScan.store(true, std::memory_order_relaxed);
+		mScanThread.join();
+	}
+
+	mCancelScan.store(false, std::memory_order_relaxed);
+	mScanFinished.store(false, std::memory_order_relaxed);
+	mExactTotalFrames.store(-1, std::memory_order_relaxed);
+
+	mScannedIndex.clear();
+	mScannedIndexStep = 0;
+	mScannedIndexAdopted = false;
+	mAwaitingSharedScan = false;
+}
+
+void SFB::Audio::MPEGDecoder::AdoptScannedIndex()
+{
+	if(mScannedIndexAdopted || !mScanFinished.load(std::memory_order_acquire))
+		return;
+
+	std::lock_guard<std::mutex> lock(mScanMutex);
+	if(!mScannedIndex.empty() && MPG123_OK != mpg123_set_index(mDecoder.get(), mScannedIndex.data(), mScannedIndexStep, mScannedIndex.size()))
+		LOGGER_WARNING("org.sbooth.AudioEngine.Decoder.MPEG", "mpg123_set_index failed: " << mpg123_strerror(mDecoder.get()));
+
+	// The index is only needed once
+	mScannedIndexAdopted = true;
+	mScannedIndex.clear();
+	mScannedIndex.shrink_to_fit();
+}
+
+#pragma mark Seek Index
+
+void SFB::Audio::MPEGDecoder::StoreSeekIndex(mpg123_handle *handle, SInt64 totalFrames)
+{
+	if(!mSeekIndex || mSeekIndex->IsComplete())
+		return;
+
+	off_t *offsets = nullptr;
+	off_t step = 0;
+	size_t fill = 0;
+	if(MPG123_OK != mpg123_index(handle, &offsets, &step, &fill) || !offsets || 0 == fill)
+		return;
+
+	// mpg123 indexes every step MPEG frames, and the index is stored using audio frames
+	SInt64 framesPerStep = (SInt64)step * mSourceFormat.mFramesPerPacket;
+
+	std::vector<SeekIndex::Point> points;
+	points.reserve(fill);
+	for(size_t i = 0; i < fill; ++i)
+		points.push_back({ (SInt64)i * framesPerStep, (SInt64)offsets[i] });
+
+	mSeekIndex->SetPoints(std::move(points));
+	mSeekIndex->SetTotalFrames(totalFrames);
+	mSeekIndex->SetComplete(true);
+	mSeekIndex->Save();
+}
+
+bool SFB::Audio::MPEGDecoder::InstallSeekIndex()
+{
+	auto points = mSeekIndex->GetPoints();
+	SInt64 totalFrames = mSeekIndex->GetTotalFrames();
+	if(2 > points.size() || 0 > totalFrames || 0 == mSourceFormat.mFramesPerPacket)
+		return false;
+
+	// mpg123 requires evenly spaced index entries
+	SInt64 framesPerStep = points[1].mFrame - points[0].mFrame;
+	if(0 != points[0].mFrame || 0 >= framesPerStep || 0 != framesPerStep % mSourceFormat.mFramesPerPacket)
+		return false;
+
+	std::vector<off_t> offsets;
+	offsets.reserve(points.size());
+	for(size_t i = 0; i < points.size(); ++i) {
+		if(points[i].mFrame != (SInt64)i * framesPerStep)
+			return false;
+		offsets.push_back((off_t)points[i].mOffset);
+	}
+
+	if(MPG123_OK != mpg123_set_index(mDecoder.get(), offsets.data(), (off_t)(framesPerStep / mSourceFormat.mFramesPerPacket), offsets.size())) {
+		LOGGER_WARNING("org.sbooth.AudioEngine.Decoder.MPEG", "mpg123_set_index failed: " << mpg123_strerror(mDecoder.get()));
+		return false;
+	}
+
+	mExactTotalFrames.store(totalFrames, std::memory_order_relaxed);
+	mScannedIndexAdopted = true;
+
+	return true;
+}
@@ -30,10 +30,16 @@
 
 #pragma once
 
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include <mpg123/mpg123.h>
 
 #include "AudioDecoder.h"
 #include "AudioBufferList.h"
+#include "SeekIndex.h"
 
 namespace SFB {
 
@@ -53,11 +59,13 @@ namespace SFB {
 
 			static bool HandlesFilesWithExtension(CFStringRef extension);
 			static bool HandlesMIMEType(CFStringRef mimeType);
+			static bool HandlesSignature(const void *header, size_t length);
 
 			static Decoder::unique_ptr CreateDecoder(InputSource::unique_ptr inputSource);
 
-			// Creation
+			// Creation and destruction
 			MPEGDecoder(InputSource::unique_ptr inputSource);
+			virtual ~MPEGDecoder();
 
 		private:
 
@@ -75,16 +83,62 @@ namespace SFB {
 			virtual SInt64 _GetTotalFrames() const;
 			inline virtual SInt64 _GetCurrentFrame() const			{ return mCurrentFrame; }
 
+			// Until the background scan finishes or the end of the stream is reached the length is
+			// estimated from the Xing, Info or VBRI header (or the bitrate if none exists)
+			virtual bool _TotalFramesAreExact() const;
+
 			// Seeking support
 			inline virtual bool _SupportsSeeking() const			{ return mInputSource->SupportsSeeking(); }
 			virtual SInt64 _SeekToFrame(SInt64 frame);
 
+			// Reuse the mpg123 handle and buffers for a new stream
+			virtual bool _Rebind(CFErrorRef *error);
+
+			// The background scan is cancelled
+			inline virtual void _EndBackgroundActivity()			{ CancelBackgroundScan(); }
+
+			// Clones share the seek index
+			virtual void _PrepareClone(Decoder& clone) const;
+
 			typedef std::unique_ptr<mpg123_handle, std::function<void (mpg123_handle *)>> unique_mpg123_ptr;
 
+			// Builds an exact frame index for file URLs using a second handle
+			// A scan is only started if no other decoder sharing mSeekIndex is already performing one
+			void StartBackgroundScan();
+			void ScanInBackground(CFURLRef url);
+			void CancelBackgroundScan();
+
+			// Installs the index from a completed background scan into mDecoder
+			void AdoptScannedIndex();
+
+			// Copies the frame index from handle into mSeekIndex, or installs mSeekIndex into mDecoder
+			void StoreSeekIndex(mpg123_handle *handle, SInt64 totalFrames);
+			bool InstallSeekIndex();
+
 			// Data members
 			unique_mpg123_ptr	mDecoder;
 			BufferList			mBufferList;
+			UInt32				mBufferFrameOffset;
 			SInt64				mCurrentFrame;
+
+			// Information from the Xing, Info or VBRI header
+			SInt64				mEstimatedTotalFrames;
+			bool				mHasSeekTable;
+			bool				mPositionIsApproximate;
+
+			// Frame indexes persisted across decoders
+			SeekIndex::shared_ptr	mSeekIndex;
+
+			// Background scan state
+			std::thread			mScanThread;
+			std::atomic_bool	mCancelScan;
+			std::atomic_bool	mScanFinished;
+			std::atomic_llong	mExactTotalFrames;
+			std::mutex			mScanMutex;
+			std::vector<off_t>	mScannedIndex;
+			off_t				mScannedIndexStep;
+			bool				mScannedIndexAdopted;
+			bool				mAwaitingSharedScan;	// Another decoder is scanning the same file
 		};
 		
 	}
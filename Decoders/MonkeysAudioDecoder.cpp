@@ -186,6 +186,14 @@ bool SFB::Audio::MonkeysAudioDecoder::HandlesMIMEType(CFStringRef mimeType)
 	return false;
 }
 
+bool SFB::Audio::MonkeysAudioDecoder::HandlesSignature(const void *header, size_t length)
+{
+	if(nullptr == header || 4 > length)
+		return false;
+
+	return !memcmp(header, "MAC ", 4);
+}
+
 SFB::Audio::Decoder::unique_ptr SFB::Audio::MonkeysAudioDecoder::CreateDecoder(InputSource::unique_ptr inputSource)
 {
 	return unique_ptr(new MonkeysAudioDecoder(std::move(inputSource)));
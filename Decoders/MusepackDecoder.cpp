@@ -29,13 +29,13 @@
  */
 
 #include <AudioToolbox/AudioFormat.h>
-#include <Accelerate/Accelerate.h>
 
 #include <algorithm>
 
 #include "MusepackDecoder.h"
 #include "CFWrapper.h"
 #include "CFErrorUtilities.h"
+#include "SampleConversion.h"
 #include "Logger.h"
 
 namespace {
@@ -129,6 +129,15 @@ bool SFB::Audio::MusepackDecoder::HandlesMIMEType(CFStringRef mimeType)
 	return false;
 }
 
+bool SFB::Audio::MusepackDecoder::HandlesSignature(const void *header, size_t length)
+{
+	if(nullptr == header || 4 > length)
+		return false;
+
+	// SV8 and SV7
+	return !memcmp(header, "MPCK", 4) || !memcmp(header, "MP+", 3);
+}
+
 SFB::Audio::Decoder::unique_ptr SFB::Audio::MusepackDecoder::CreateDecoder(InputSource::unique_ptr inputSource)
 {
 	return unique_ptr(new MusepackDecoder(std::move(inputSource)));
@@ -152,10 +161,6 @@ SFB::Audio::MusepackDecoder::~MusepackDecoder()
 
 bool SFB::Audio::MusepackDecoder::_Open(CFErrorRef *error)
 {
-	UInt8 buf [PATH_MAX];
-	if(!CFURLGetFileSystemRepresentation(mInputSource->GetURL(), FALSE, buf, PATH_MAX))
-		return false;
-
 	mReader.read = read_callback;
 	mReader.seek = seek_callback;
 	mReader.tell = tell_callback;
@@ -314,15 +319,12 @@ UInt32 SFB::Audio::MusepackDecoder::_ReadAudio(AudioBufferList *bufferList, UInt
 		float minValue = -1.f;
 		float maxValue = 8388607.f / 8388608.f;
 
-		vDSP_vclip(inputBuffer, 1, &minValue, &maxValue, inputBuffer, 1, frame.samples * mFormat.mChannelsPerFrame);
+		SampleConversion::ClipFloat(inputBuffer, inputBuffer, frame.samples * mFormat.mChannelsPerFrame, minValue, maxValue);
 
 		// Deinterleave the normalized samples
-		for(UInt32 channel = 0; channel < mFormat.mChannelsPerFrame; ++channel) {
-			float *floatBuffer = (float *)mBufferList->mBuffers[channel].mData;
+		SampleConversion::DeinterleaveFloat(inputBuffer, mBufferList, mFormat.mChannelsPerFrame, frame.samples);
 
-			for(UInt32 sample = channel; sample < frame.samples * mFormat.mChannelsPerFrame; sample += mFormat.mChannelsPerFrame)
-				*floatBuffer++ = inputBuffer[sample];
-			
+		for(UInt32 channel = 0; channel < mFormat.mChannelsPerFrame; ++channel) {
 			mBufferList->mBuffers[channel].mNumberChannels	= 1;
 			mBufferList->mBuffers[channel].mDataByteSize	= frame.samples * sizeof(float);
 		}
@@ -28,12 +28,20 @@
  *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <algorithm>
+#include <vector>
+
 #include "OggOpusDecoder.h"
 #include "CFWrapper.h"
 #include "CFErrorUtilities.h"
+#include "SampleConversion.h"
 #include "Logger.h"
 
 #define OPUS_SAMPLE_RATE 48000
+#define BUFFER_SIZE_FRAMES 2048
+
+// The amount of audio decoded before the target of a seek to allow the decoder to converge (80 ms)
+#define OPUS_PREROLL_FRAMES 3840
 
 namespace {
 
@@ -128,6 +136,21 @@ bool SFB::Audio::OggOpusDecoder::HandlesMIMEType(CFStringRef mimeType)
 	return false;
 }
 
+bool SFB::Audio::OggOpusDecoder::HandlesSignature(const void *header, size_t length)
+{
+	if(nullptr == header)
+		return false;
+
+	const unsigned char *bytes = static_cast<const unsigned char *>(header);
+
+	// The first packet of an Ogg stream begins after the page header and segment table
+	if(27 > length || memcmp(bytes, "OggS", 4))
+		return false;
+
+	size_t packetOffset = 27 + bytes[26];
+	return packetOffset + 8 <= length && !memcmp(bytes + packetOffset, "OpusHead", 8);
+}
+
 SFB::Audio::Decoder::unique_ptr SFB::Audio::OggOpusDecoder::CreateDecoder(InputSource::unique_ptr inputSource)
 {
 	return unique_ptr(new OggOpusDecoder(std::move(inputSource)));
@@ -185,6 +208,15 @@ bool SFB::Audio::OggOpusDecoder::_Open(CFErrorRef *error)
 
 	mFormat.mReserved			= 0;
 
+	// If requested, deinterleave the samples as they are decoded
+	if(mPrefersFloatOutput) {
+		mFormat.mFormatFlags		|= kAudioFormatFlagIsNonInterleaved;
+		mFormat.mBytesPerPacket		= (mFormat.mBitsPerChannel / 8);
+		mFormat.mBytesPerFrame		= mFormat.mBytesPerPacket * mFormat.mFramesPerPacket;
+
+		mBuffer = std::unique_ptr<float []>(new float [BUFFER_SIZE_FRAMES * mFormat.mChannelsPerFrame]);
+	}
+
 	// Set up the source format
 	mSourceFormat.mFormatID				= 'OPUS';
 
@@ -217,12 +249,16 @@ bool SFB::Audio::OggOpusDecoder::_Open(CFErrorRef *error)
 			break;
 	}
 
+	mPageIndex.Open(*mInputSource, "Ogg Opus");
+
 	return true;
 }
 
 bool SFB::Audio::OggOpusDecoder::_Close(CFErrorRef */*error*/)
 {
+	mPageIndex.Close();
 	mOpusFile.reset();
+	mBuffer.reset();
 	return true;
 }
 
@@ -237,6 +273,42 @@ SFB::CFString SFB::Audio::OggOpusDecoder::_GetSourceFormatDescription() const
 
 UInt32 SFB::Audio::OggOpusDecoder::_ReadAudio(AudioBufferList *bufferList, UInt32 frameCount)
 {
+	if(mBuffer) {
+		if(bufferList->mNumberBuffers != mFormat.mChannelsPerFrame) {
+			LOGGER_WARNING("org.sbooth.AudioEngine.Decoder.OggOpus", "_ReadAudio() called with invalid parameters");
+			return 0;
+		}
+
+		UInt32 framesRemaining = frameCount;
+		UInt32 totalFramesRead = 0;
+
+		while(0 < framesRemaining) {
+			UInt32 framesToRead = std::min(framesRemaining, (UInt32)BUFFER_SIZE_FRAMES);
+			int framesRead = op_read_float(mOpusFile.get(), mBuffer.get(), (int)(framesToRead * mFormat.mChannelsPerFrame), nullptr);
+
+			if(0 > framesRead) {
+				LOGGER_ERR("org.sbooth.AudioEngine.Decoder.OggOpus", "Ogg Opus decoding error: " << framesRead);
+				return 0;
+			}
+
+			// 0 frames indicates EOS
+			if(0 == framesRead)
+				break;
+
+			SampleConversion::DeinterleaveFloat(mBuffer.get(), bufferList, mFormat.mChannelsPerFrame, (size_t)framesRead, totalFramesRead);
+
+			totalFramesRead += (UInt32)framesRead;
+			framesRemaining -= (UInt32)framesRead;
+		}
+
+		for(UInt32 i = 0; i < bufferList->mNumberBuffers; ++i) {
+			bufferList->mBuffers[i].mDataByteSize = totalFramesRead * mFormat.mBytesPerFrame;
+			bufferList->mBuffers[i].mNumberChannels = 1;
+		}
+
+		return totalFramesRead;
+	}
+
 	if(bufferList->mBuffers[0].mNumberChannels != mFormat.mChannelsPerFrame) {
 		LOGGER_WARNING("org.sbooth.AudioEngine.Decoder.OggOpus", "_ReadAudio() called with invalid parameters");
 		return 0;
@@ -272,6 +344,9 @@ UInt32 SFB::Audio::OggOpusDecoder::_ReadAudio(AudioBufferList *bufferList, UInt3
 
 SInt64 SFB::Audio::OggOpusDecoder::_SeekToFrame(SInt64 frame)
 {
+	if(SeekUsingPageIndex(frame))
+		return this->GetCurrentFrame();
+
 	if(0 != op_pcm_seek(mOpusFile.get(), frame)) {
 		LOGGER_ERR("org.sbooth.AudioEngine.Decoder.OggOpus", "op_pcm_seek() failed");
 		return -1;
@@ -279,3 +354,37 @@ SInt64 SFB::Audio::OggOpusDecoder::_SeekToFrame(SInt64 frame)
 
 	return this->GetCurrentFrame();
 }
+
+bool SFB::Audio::OggOpusDecoder::SeekUsingPageIndex(SInt64 frame)
+{
+	// The index only covers the first link
+	if(1 != op_link_count(mOpusFile.get()))
+		return false;
+
+	if(!mPageIndex.IsBuilt() && !(OggPageIndex::CanScanCheaply(*mInputSource) && mPageIndex.Build(*mInputSource, (long)op_serialno(mOpusFile.get(), 0), OPUS_SAMPLE_RATE / 2)))
+		return false;
+
+	// Opus granule positions include the pre-skip, and decoding starts early enough to allow for pre-roll
+	SInt64 granulePosition = frame + op_head(mOpusFile.get(), 0)->pre_skip;
+
+	SeekIndex::Point point;
+	if(!mPageIndex.FindPage(std::max(granulePosition - OPUS_PREROLL_FRAMES, (SInt64)0), point) || 0 != op_raw_seek(mOpusFile.get(), point.mOffset))
+		return false;
+
+	SInt64 currentFrame = op_pcm_tell(mOpusFile.get());
+	if(0 > currentFrame || currentFrame > frame)
+		return false;
+
+	// Decode and discard the frames preceding the target
+	std::vector<float> buffer(BUFFER_SIZE_FRAMES * mFormat.mChannelsPerFrame);
+	while(currentFrame < frame) {
+		int framesToRead = (int)std::min(frame - currentFrame, (SInt64)BUFFER_SIZE_FRAMES);
+		int framesRead = op_read_float(mOpusFile.get(), buffer.data(), framesToRead * (int)mFormat.mChannelsPerFrame, nullptr);
+		if(0 >= framesRead)
+			return false;
+
+		currentFrame += framesRead;
+	}
+
+	return true;
+}
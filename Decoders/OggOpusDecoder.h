@@ -32,6 +32,7 @@
 
 #include <opus/opusfile.h>
 #include "AudioDecoder.h"
+#include "OggPageIndex.h"
 
 namespace SFB {
 
@@ -51,6 +52,7 @@ namespace SFB {
 
 			static bool HandlesFilesWithExtension(CFStringRef extension);
 			static bool HandlesMIMEType(CFStringRef mimeType);
+			static bool HandlesSignature(const void *header, size_t length);
 
 			static Decoder::unique_ptr CreateDecoder(InputSource::unique_ptr inputSource);
 
@@ -77,10 +79,15 @@ namespace SFB {
 			inline virtual bool _SupportsSeeking() const			{ return mInputSource->SupportsSeeking(); }
 			virtual SInt64 _SeekToFrame(SInt64 frame);
 
+			// Seek using a single read near frame, decoding forward to reach it
+			bool SeekUsingPageIndex(SInt64 frame);
+
 			typedef std::unique_ptr<OggOpusFile, std::function<void(OggOpusFile *)>> unique_op_ptr;
 
 			// Data members
-			unique_op_ptr		mOpusFile;
+			unique_op_ptr				mOpusFile;
+			std::unique_ptr<float []>	mBuffer;		// Interleaved audio awaiting deinterleaving, used for float output
+			OggPageIndex				mPageIndex;
 		};
 		
 	}
@@ -0,0 +1,204 @@
+/*
+ *  Copyright (C) 2013 Stephen F. Booth <me@sbooth.org>
+ *  All Rights Reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    - Neither the name of Stephen F. Booth nor the names of its 
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstring>
+#include <vector>
+
+#include "OggPageIndex.h"
+#include "CFWrapper.h"
+#include "Logger.h"
+
+// The number of bytes read when searching for a lost page
+#define RESYNC_SIZE_BYTES 65536
+
+namespace {
+
+	// The fixed portion of an Ogg page header, preceding the segment table
+	const size_t kOggPageHeaderSize = 27;
+
+	inline SInt64 ReadInt64LittleEndian(const unsigned char *bytes)
+	{
+		uint64_t value = 0;
+		for(int i = 7; i >= 0; --i)
+			value = (value << 8) | bytes[i];
+		return (SInt64)value;
+	}
+
+	inline long ReadUInt32LittleEndian(const unsigned char *bytes)
+	{
+		return (long)((uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24));
+	}
+
+	// Search forward from offset for the next capture pattern, returning its offset or -1 if none was found
+	SInt64 FindNextPage(SFB::InputSource& inputSource, SInt64 offset)
+	{
+		std::vector<unsigned char> buf(RESYNC_SIZE_BYTES);
+
+		for(;;) {
+			if(!inputSource.SeekToOffset(offset))
+				return -1;
+
+			SInt64 bytesRead = inputSource.Read(buf.data(), RESYNC_SIZE_BYTES);
+			if(4 > bytesRead)
+				return -1;
+
+			for(SInt64 i = 0; i + 4 <= bytesRead; ++i) {
+				if(!memcmp(buf.data() + i, "OggS", 4))
+					return offset + i;
+			}
+
+			// The capture pattern may straddle the boundary
+			offset += bytesRead - 3;
+		}
+	}
+
+}
+
+SFB::Audio::OggPageIndex::OggPageIndex()
+	: mSeekIndex(nullptr)
+{}
+
+void SFB::Audio::OggPageIndex::Open(const InputSource& inputSource, const char *codec)
+{
+	mSeekIndex = SeekIndex::SeekIndexForInputSource(inputSource, codec);
+}
+
+void SFB::Audio::OggPageIndex::Close()
+{
+	if(mSeekIndex) {
+		mSeekIndex->Save();
+		mSeekIndex.reset();
+	}
+}
+
+bool SFB::Audio::OggPageIndex::IsBuilt() const
+{
+	return mSeekIndex && mSeekIndex->IsComplete();
+}
+
+bool SFB::Audio::OggPageIndex::CanScanCheaply(const InputSource& inputSource)
+{
+	CFURLRef url = inputSource.GetURL();
+	if(nullptr == url || !inputSource.SupportsSeeking())
+		return false;
+
+	SFB::CFString scheme = CFURLCopyScheme(url);
+	return scheme && kCFCompareEqualTo == CFStringCompare(CFSTR("file"), scheme, kCFCompareCaseInsensitive);
+}
+
+bool SFB::Audio::OggPageIndex::Build(InputSource& inputSource, long serialNumber, SInt64 minimumSpacing)
+{
+	if(!mSeekIndex || !inputSource.SupportsSeeking())
+		return false;
+
+	SInt64 savedOffset = inputSource.GetOffset();
+
+	std::vector<SeekIndex::Point> points;
+	SInt64 previousGranulePosition = -1;
+	SInt64 offset = 0;
+
+	unsigned char header [kOggPageHeaderSize + 255];
+
+	for(;;) {
+		if(!inputSource.SeekToOffset(offset) || (SInt64)kOggPageHeaderSize != inputSource.Read(header, kOggPageHeaderSize))
+			break;
+
+		// Skip over any garbage between pages
+		if(memcmp(header, "OggS", 4) || 0 != header[4]) {
+			offset = FindNextPage(inputSource, offset + 1);
+			if(-1 == offset)
+				break;
+			continue;
+		}
+
+		unsigned segmentCount = header[26];
+		if((SInt64)segmentCount != inputSource.Read(header + kOggPageHeaderSize, segmentCount))
+			break;
+
+		SInt64 bodySize = 0;
+		for(unsigned i = 0; i < segmentCount; ++i)
+			bodySize += header[kOggPageHeaderSize + i];
+
+		bool continued = (0x01 & header[5]);
+		SInt64 granulePosition = ReadInt64LittleEndian(header + 6);
+
+		if(ReadUInt32LittleEndian(header + 14) == (serialNumber & 0xffffffff)) {
+			// Decoding may start at a page beginning with a complete packet
+			if(!continued && -1 != previousGranulePosition) {
+				// Of several pages sharing a granule position (the header pages), keep the last
+				if(!points.empty() && points.back().mFrame == previousGranulePosition)
+					points.back().mOffset = offset;
+				else if(points.empty() || previousGranulePosition - points.back().mFrame >= minimumSpacing)
+					points.push_back({ previousGranulePosition, offset });
+			}
+
+			if(-1 != granulePosition)
+				previousGranulePosition = granulePosition;
+		}
+
+		offset += (SInt64)kOggPageHeaderSize + segmentCount + bodySize;
+	}
+
+	if(!inputSource.SeekToOffset(savedOffset))
+		LOGGER_WARNING("org.sbooth.AudioEngine.OggPageIndex", "Unable to restore input source offset");
+
+	if(points.empty())
+		return false;
+
+	LOGGER_DEBUG("org.sbooth.AudioEngine.OggPageIndex", "Indexed " << points.size() << " pages, last granule position " << previousGranulePosition);
+
+	mSeekIndex->SetPoints(std::move(points));
+	mSeekIndex->SetTotalFrames(previousGranulePosition);
+	mSeekIndex->SetComplete(true);
+	mSeekIndex->Save();
+
+	return true;
+}
+
+bool SFB::Audio::OggPageIndex::FindPage(SInt64 granulePosition, SeekIndex::Point& point) const
+{
+	if(!mSeekIndex)
+		return false;
+
+	// Positions before the first indexed page are reached from the first audio page
+	if(!mSeekIndex->FindPoint(granulePosition, point)) {
+		auto points = mSeekIndex->GetPoints();
+		if(points.empty())
+			return false;
+		point = points.front();
+	}
+
+	return true;
+}
+
+SInt64 SFB::Audio::OggPageIndex::GetLastGranulePosition() const
+{
+	return mSeekIndex ? mSeekIndex->GetTotalFrames() : -1;
+}
@@ -0,0 +1,85 @@
+/*
+ *  Copyright (C) 2013 Stephen F. Booth <me@sbooth.org>
+ *  All Rights Reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    - Neither the name of Stephen F. Booth nor the names of its 
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "InputSource.h"
+#include "SeekIndex.h"
+
+namespace SFB {
+
+	namespace Audio {
+
+		// ========================================
+		// An index of the pages in a logical Ogg bitstream, shared by the Ogg decoders
+		//
+		// Each sync point maps the granule position preceding a page to the page's byte offset.
+		// Only pages that begin with a complete packet are indexed, so decoding may start at any sync point.
+		// The index is built by a single pass over the page headers (skipping page bodies) and is
+		// cached and persisted using SeekIndex.
+		// ========================================
+		class OggPageIndex
+		{
+
+		public:
+
+			OggPageIndex();
+
+			OggPageIndex(const OggPageIndex& rhs) = delete;
+			OggPageIndex& operator=(const OggPageIndex& rhs) = delete;
+
+			// Attach to the cached index for inputSource, if any
+			void Open(const InputSource& inputSource, const char *codec);
+			void Close();
+
+			// Returns true if the index covers the entire bitstream
+			bool IsBuilt() const;
+
+			// Returns true if the page headers of inputSource may be scanned cheaply (file URLs)
+			// Scanning other sources requires one request per page
+			static bool CanScanCheaply(const InputSource& inputSource);
+
+			// Scan the page headers of the logical bitstream with serialNumber, restoring the input source's offset when finished
+			// Sync points are placed at least minimumSpacing granules apart
+			bool Build(InputSource& inputSource, long serialNumber, SInt64 minimumSpacing);
+
+			// Find the last page that may be decoded to reach granulePosition
+			bool FindPage(SInt64 granulePosition, SeekIndex::Point& point) const;
+
+			// The granule position of the last page in the bitstream, or -1 if unknown
+			SInt64 GetLastGranulePosition() const;
+
+		private:
+
+			SeekIndex::shared_ptr	mSeekIndex;
+		};
+
+	}
+}
@@ -92,6 +92,21 @@ bool SFB::Audio::OggSpeexDecoder::HandlesMIMEType(CFStringRef mimeType)
 	return false;
 }
 
+bool SFB::Audio::OggSpeexDecoder::HandlesSignature(const void *header, size_t length)
+{
+	if(nullptr == header)
+		return false;
+
+	const unsigned char *bytes = static_cast<const unsigned char *>(header);
+
+	// The first packet of an Ogg stream begins after the page header and segment table
+	if(27 > length || memcmp(bytes, "OggS", 4))
+		return false;
+
+	size_t packetOffset = 27 + bytes[26];
+	return packetOffset + 8 <= length && !memcmp(bytes + packetOffset, "Speex   ", 8);
+}
+
 SFB::Audio::Decoder::unique_ptr SFB::Audio::OggSpeexDecoder::CreateDecoder(InputSource::unique_ptr inputSource)
 {
 	return unique_ptr(new OggSpeexDecoder(std::move(inputSource)));
@@ -328,11 +343,18 @@ bool SFB::Audio::OggSpeexDecoder::_Open(CFErrorRef *error)
 	for(UInt32 i = 0; i < mBufferList->mNumberBuffers; ++i)
 		mBufferList->mBuffers[i].mDataByteSize = 0;
 
+	// A previously built page index provides the length without reading the entire stream
+	mPageIndex.Open(*mInputSource, "Ogg Speex");
+	if(mPageIndex.IsBuilt())
+		mTotalFrames = mPageIndex.GetLastGranulePosition();
+
 	return true;
 }
 
 bool SFB::Audio::OggSpeexDecoder::_Close(CFErrorRef */*error*/)
 {
+	mPageIndex.Close();
+
 	mBufferList.Deallocate();
 
 	// Speex cleanup
@@ -530,3 +552,53 @@ UInt32 SFB::Audio::OggSpeexDecoder::_ReadAudio(AudioBufferList *bufferList, UInt
 
 	return framesRead;
 }
+
+SInt64 SFB::Audio::OggSpeexDecoder::_SeekToFrame(SInt64 frame)
+{
+	if(-1 == mSpeexSerialNumber)
+		return -1;
+
+	// Speex has no seek table of its own, so build the page index on first use
+	if(!mPageIndex.IsBuilt()) {
+		if(!mPageIndex.Build(*mInputSource, mSpeexSerialNumber, (SInt64)mFormat.mSampleRate / 2)) {
+			LOGGER_ERR("org.sbooth.AudioEngine.Decoder.OggSpeex", "Unable to build Ogg page index");
+			return -1;
+		}
+
+		mTotalFrames = mPageIndex.GetLastGranulePosition();
+	}
+
+	// Speex granule positions are frame numbers
+	SeekIndex::Point point;
+	if(!mPageIndex.FindPage(frame, point) || !mInputSource->SeekToOffset(point.mOffset))
+		return -1;
+
+	// Discard all buffered data and decoder state
+	ogg_sync_reset(&mOggSyncState);
+	ogg_stream_reset(&mOggStreamState);
+
+	speex_bits_reset(&mSpeexBits);
+	speex_decoder_ctl(mSpeexDecoder, SPEEX_RESET_STATE, nullptr);
+	speex_stereo_state_reset(mSpeexStereoState);
+
+	for(UInt32 i = 0; i < mBufferList->mNumberBuffers; ++i)
+		mBufferList->mBuffers[i].mDataByteSize = 0;
+
+	// Indexed pages contain only audio packets
+	mOggPacketCount = std::max((UInt32)2, 1 + mExtraSpeexHeaderCount);
+	mSpeexEOSReached = false;
+	mCurrentFrame = point.mFrame;
+
+	// Decode and discard the frames preceding the target
+	if(mCurrentFrame < frame) {
+		BufferList discardBufferList(mFormat, mBufferList.GetCapacityFrames());
+		while(mCurrentFrame < frame) {
+			discardBufferList.Reset();
+			UInt32 framesToRead = (UInt32)std::min(frame - mCurrentFrame, (SInt64)discardBufferList.GetCapacityFrames());
+			if(0 == _ReadAudio(discardBufferList, framesToRead))
+				break;
+		}
+	}
+
+	return mCurrentFrame;
+}
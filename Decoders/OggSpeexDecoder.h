@@ -36,6 +36,7 @@
 
 #include "AudioDecoder.h"
 #include "AudioBufferList.h"
+#include "OggPageIndex.h"
 
 namespace SFB {
 
@@ -55,6 +56,7 @@ namespace SFB {
 
 			static bool HandlesFilesWithExtension(CFStringRef extension);
 			static bool HandlesMIMEType(CFStringRef mimeType);
+			static bool HandlesSignature(const void *header, size_t length);
 
 			static Decoder::unique_ptr CreateDecoder(InputSource::unique_ptr inputSource);
 
@@ -78,6 +80,10 @@ namespace SFB {
 			inline virtual SInt64 _GetTotalFrames() const			{ return mTotalFrames; }
 			inline virtual SInt64 _GetCurrentFrame() const			{ return mCurrentFrame; }
 
+			// Seeking support
+			inline virtual bool _SupportsSeeking() const			{ return mInputSource->SupportsSeeking(); }
+			virtual SInt64 _SeekToFrame(SInt64 frame);
+
 			// Data members
 			BufferList			mBufferList;
 			SInt64				mCurrentFrame;
@@ -96,6 +102,8 @@ namespace SFB {
 			spx_int32_t			mSpeexFramesPerOggPacket;
 			UInt32				mOggPacketCount;
 			UInt32				mExtraSpeexHeaderCount;
+
+			OggPageIndex		mPageIndex;
 		};
 		
 	}
@@ -129,6 +129,21 @@ bool SFB::Audio::OggVorbisDecoder::HandlesMIMEType(CFStringRef mimeType)
 	return false;
 }
 
+bool SFB::Audio::OggVorbisDecoder::HandlesSignature(const void *header, size_t length)
+{
+	if(nullptr == header)
+		return false;
+
+	const unsigned char *bytes = static_cast<const unsigned char *>(header);
+
+	// The first packet of an Ogg stream begins after the page header and segment table
+	if(27 > length || memcmp(bytes, "OggS", 4))
+		return false;
+
+	size_t packetOffset = 27 + bytes[26];
+	return packetOffset + 7 <= length && !memcmp(bytes + packetOffset, "\x01" "vorbis", 7);
+}
+
 SFB::Audio::Decoder::unique_ptr SFB::Audio::OggVorbisDecoder::CreateDecoder(InputSource::unique_ptr inputSource)
 {
 	return unique_ptr(new OggVorbisDecoder(std::move(inputSource)));
@@ -236,11 +251,15 @@ bool SFB::Audio::OggVorbisDecoder::_Open(CFErrorRef *error)
 			break;
 	}
 
+	mPageIndex.Open(*mInputSource, "Ogg Vorbis");
+
 	return true;
 }
 
 bool SFB::Audio::OggVorbisDecoder::_Close(CFErrorRef */*error*/)
 {
+	mPageIndex.Close();
+
 	if(0 != ov_clear(&mVorbisFile))
 		LOGGER_NOTICE("org.sbooth.AudioEngine.Decoder.OggVorbis", "ov_clear failed");
 
@@ -306,6 +325,9 @@ UInt32 SFB::Audio::OggVorbisDecoder::_ReadAudio(AudioBufferList *bufferList, UIn
 
 SInt64 SFB::Audio::OggVorbisDecoder::_SeekToFrame(SInt64 frame)
 {
+	if(SeekUsingPageIndex(frame))
+		return _GetCurrentFrame();
+
 	if(0 != ov_pcm_seek(&mVorbisFile, frame)) {
 		LOGGER_ERR("org.sbooth.AudioEngine.Decoder.OggVorbis", "Ogg Vorbis seek error");
 		return -1;
@@ -313,3 +335,36 @@ SInt64 SFB::Audio::OggVorbisDecoder::_SeekToFrame(SInt64 frame)
 
 	return _GetCurrentFrame();
 }
+
+bool SFB::Audio::OggVorbisDecoder::SeekUsingPageIndex(SInt64 frame)
+{
+	// The index only covers the first logical bitstream
+	if(1 != ov_streams(&mVorbisFile))
+		return false;
+
+	if(!mPageIndex.IsBuilt() && !(OggPageIndex::CanScanCheaply(*mInputSource) && mPageIndex.Build(*mInputSource, ov_serialnumber(&mVorbisFile, 0), (SInt64)mFormat.mSampleRate / 2)))
+		return false;
+
+	// Vorbis granule positions are frame numbers
+	SeekIndex::Point point;
+	if(!mPageIndex.FindPage(frame, point) || 0 != ov_raw_seek(&mVorbisFile, point.mOffset))
+		return false;
+
+	// vorbisfile determines the position from the page's granule position
+	SInt64 currentFrame = ov_pcm_tell(&mVorbisFile);
+	if(0 > currentFrame || currentFrame > frame)
+		return false;
+
+	// Decode and discard the frames preceding the target; ov_read_float() does not copy
+	while(currentFrame < frame) {
+		float **buffer = nullptr;
+		int currentSection = 0;
+		long framesRead = ov_read_float(&mVorbisFile, &buffer, (int)std::min(frame - currentFrame, (SInt64)BUFFER_SIZE_FRAMES), &currentSection);
+		if(0 >= framesRead)
+			return false;
+
+		currentFrame += framesRead;
+	}
+
+	return true;
+}
@@ -38,6 +38,7 @@
 #pragma clang diagnostic pop
 
 #import "AudioDecoder.h"
+#import "OggPageIndex.h"
 
 namespace SFB {
 
@@ -57,6 +58,7 @@ namespace SFB {
 
 			static bool HandlesFilesWithExtension(CFStringRef extension);
 			static bool HandlesMIMEType(CFStringRef mimeType);
+			static bool HandlesSignature(const void *header, size_t length);
 
 			static Decoder::unique_ptr CreateDecoder(InputSource::unique_ptr inputSource);
 
@@ -84,8 +86,12 @@ namespace SFB {
 			inline virtual bool _SupportsSeeking() const			{ return mInputSource->SupportsSeeking(); }
 			virtual SInt64 _SeekToFrame(SInt64 frame);
 
+			// Seek using a single read near frame, decoding forward to reach it
+			bool SeekUsingPageIndex(SInt64 frame);
+
 			// Data members
 			OggVorbis_File		mVorbisFile;
+			OggPageIndex		mPageIndex;
 		};
 		
 	}
@@ -0,0 +1,538 @@
+/*
+ *  Copyright (C) 2013 Stephen F. Booth <me@sbooth.org>
+ *  All Rights Reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    - Neither the name of Stephen F. Booth nor the names of its 
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "PCMDecoder.h"
+#include "CFWrapper.h"
+#include "CFErrorUtilities.h"
+#include "Logger.h"
+
+namespace {
+
+	void RegisterPCMDecoder() __attribute__ ((constructor));
+	void RegisterPCMDecoder()
+	{
+		SFB::Audio::Decoder::RegisterSubclass<SFB::Audio::PCMDecoder>();
+	}
+
+#pragma mark Byte Access
+
+	inline uint16_t ReadUInt16LE(const uint8_t *p)		{ return (uint16_t)(p[0] | (p[1] << 8)); }
+	inline uint32_t ReadUInt32LE(const uint8_t *p)		{ return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24); }
+	inline uint64_t ReadUInt64LE(const uint8_t *p)		{ return (uint64_t)ReadUInt32LE(p) | ((uint64_t)ReadUInt32LE(p + 4) << 32); }
+
+	inline uint16_t ReadUInt16BE(const uint8_t *p)		{ return (uint16_t)((p[0] << 8) | p[1]); }
+	inline uint32_t ReadUInt32BE(const uint8_t *p)		{ return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3]; }
+	inline uint64_t ReadUInt64BE(const uint8_t *p)		{ return ((uint64_t)ReadUInt32BE(p) << 32) | (uint64_t)ReadUInt32BE(p + 4); }
+
+	// Converts an 80-bit IEEE 754 extended precision number, as used for the AIFF sample rate
+	double ReadExtendedBE(const uint8_t *p)
+	{
+		int exponent = ((p[0] & 0x7f) << 8) | p[1];
+		uint64_t mantissa = ReadUInt64BE(p + 2);
+
+		if(0 == exponent && 0 == mantissa)
+			return 0;
+
+		double value = ldexp((double)mantissa, exponent - 16383 - 63);
+		return (p[0] & 0x80) ? -value : value;
+	}
+
+	bool ReadBytes(SFB::InputSource& inputSource, void *buffer, SInt64 byteCount)
+	{
+		return byteCount == inputSource.Read(buffer, byteCount);
+	}
+
+	// Positions inputSource at offset, reading and discarding bytes if it can't seek
+	bool MoveToOffset(SFB::InputSource& inputSource, SInt64 offset)
+	{
+		SInt64 currentOffset = inputSource.GetOffset();
+		if(offset == currentOffset)
+			return true;
+
+		if(inputSource.SupportsSeeking())
+			return inputSource.SeekToOffset(offset);
+
+		if(offset < currentOffset)
+			return false;
+
+		uint8_t buffer [4096];
+		while(currentOffset < offset) {
+			SInt64 bytesRead = inputSource.Read(buffer, std::min(offset - currentOffset, (SInt64)sizeof(buffer)));
+			if(0 >= bytesRead)
+				return false;
+			currentOffset += bytesRead;
+		}
+
+		return true;
+	}
+
+	// Fills in the linear PCM fields of format
+	bool SetPCMFormat(AudioStreamBasicDescription& format, Float64 sampleRate, UInt32 channels, UInt32 bitsPerChannel, bool isFloat, bool isSigned, bool isBigEndian)
+	{
+		if(0 == channels || 0 == sampleRate || 0 == bitsPerChannel || 0 != bitsPerChannel % 8)
+			return false;
+
+		if(isFloat ? !(32 == bitsPerChannel || 64 == bitsPerChannel) : 32 < bitsPerChannel)
+			return false;
+
+		memset(&format, 0, sizeof(format));
+
+		format.mFormatID			= kAudioFormatLinearPCM;
+		format.mFormatFlags			= kAudioFormatFlagIsPacked;
+
+		if(isFloat)
+			format.mFormatFlags		|= kAudioFormatFlagIsFloat;
+		else if(isSigned)
+			format.mFormatFlags		|= kAudioFormatFlagIsSignedInteger;
+
+		// Byte order is irrelevant for single-byte samples
+		if(isBigEndian && 8 < bitsPerChannel)
+			format.mFormatFlags		|= kAudioFormatFlagIsBigEndian;
+
+		format.mSampleRate			= sampleRate;
+		format.mChannelsPerFrame	= channels;
+		format.mBitsPerChannel		= bitsPerChannel;
+
+		format.mBytesPerFrame		= (bitsPerChannel / 8) * channels;
+		format.mFramesPerPacket		= 1;
+		format.mBytesPerPacket		= format.mBytesPerFrame;
+
+		return true;
+	}
+
+}
+
+#pragma mark Static Methods
+
+CFArrayRef SFB::Audio::PCMDecoder::CreateSupportedFileExtensions()
+{
+	CFStringRef supportedExtensions [] = { CFSTR("wav"), CFSTR("wave"), CFSTR("rf64"), CFSTR("aif"), CFSTR("aiff"), CFSTR("aifc"), CFSTR("caf") };
+	return CFArrayCreate(kCFAllocatorDefault, (const void **)supportedExtensions, 7, &kCFTypeArrayCallBacks);
+}
+
+CFArrayRef SFB::Audio::PCMDecoder::CreateSupportedMIMETypes()
+{
+	CFStringRef supportedMIMETypes [] = { CFSTR("audio/wav"), CFSTR("audio/x-wav"), CFSTR("audio/wave"), CFSTR("audio/aiff"), CFSTR("audio/x-aiff"), CFSTR("audio/x-caf") };
+	return CFArrayCreate(kCFAllocatorDefault, (const void **)supportedMIMETypes, 6, &kCFTypeArrayCallBacks);
+}
+
+bool SFB::Audio::PCMDecoder::HandlesFilesWithExtension(CFStringRef extension)
+{
+	if(nullptr == extension)
+		return false;
+
+	SFB::CFArray supportedExtensions = CreateSupportedFileExtensions();
+	for(CFIndex i = 0; i < CFArrayGetCount(supportedExtensions); ++i) {
+		if(kCFCompareEqualTo == CFStringCompare(extension, (CFStringRef)CFArrayGetValueAtIndex(supportedExtensions, i), kCFCompareCaseInsensitive))
+			return true;
+	}
+
+	return false;
+}
+
+bool SFB::Audio::PCMDecoder::HandlesMIMEType(CFStringRef mimeType)
+{
+	if(nullptr == mimeType)
+		return false;
+
+	SFB::CFArray supportedMIMETypes = CreateSupportedMIMETypes();
+	for(CFIndex i = 0; i < CFArrayGetCount(supportedMIMETypes); ++i) {
+		if(kCFCompareEqualTo == CFStringCompare(mimeType, (CFStringRef)CFArrayGetValueAtIndex(supportedMIMETypes, i), kCFCompareCaseInsensitive))
+			return true;
+	}
+
+	return false;
+}
+
+bool SFB::Audio::PCMDecoder::HandlesSignature(const void *header, size_t length)
+{
+	if(nullptr == header || 12 > length)
+		return false;
+
+	const char *bytes = static_cast<const char *>(header);
+
+	if((!memcmp(bytes, "RIFF", 4) || !memcmp(bytes, "RF64", 4)) && !memcmp(bytes + 8, "WAVE", 4))
+		return true;
+	else if(!memcmp(bytes, "FORM", 4) && (!memcmp(bytes + 8, "AIFF", 4) || !memcmp(bytes + 8, "AIFC", 4)))
+		return true;
+	else if(!memcmp(bytes, "caff", 4))
+		return true;
+
+	return false;
+}
+
+SFB::Audio::Decoder::unique_ptr SFB::Audio::PCMDecoder::CreateDecoder(InputSource::unique_ptr inputSource)
+{
+	return unique_ptr(new PCMDecoder(std::move(inputSource)));
+}
+
+#pragma mark Creation and Destruction
+
+SFB::Audio::PCMDecoder::PCMDecoder(InputSource::unique_ptr inputSource)
+	: Decoder(std::move(inputSource)), mContainerName(nullptr), mBytes(nullptr), mDataOffset(0), mDataSize(0), mTotalFrames(0), mCurrentFrame(0)
+{}
+
+#pragma mark Functionality
+
+bool SFB::Audio::PCMDecoder::_Open(CFErrorRef *error)
+{
+	// Clones already have the container information from their original
+	bool parsed = (nullptr != mContainerName);
+	if(!parsed) {
+		uint8_t header [12];
+		if(!MoveToOffset(*mInputSource, 0) || !ReadBytes(*mInputSource, header, sizeof(header))) {
+			if(error)
+				*error = CFErrorCreate(kCFAllocatorDefault, Decoder::ErrorDomain, Decoder::InputOutputError, nullptr);
+			return false;
+		}
+
+		if((!memcmp(header, "RIFF", 4) || !memcmp(header, "RF64", 4)) && !memcmp(header + 8, "WAVE", 4))
+			parsed = ParseWAVE(!memcmp(header, "RF64", 4));
+		else if(!memcmp(header, "FORM", 4) && (!memcmp(header + 8, "AIFF", 4) || !memcmp(header + 8, "AIFC", 4)))
+			parsed = ParseAIFF(!memcmp(header + 8, "AIFC", 4));
+		else if(!memcmp(header, "caff", 4))
+			parsed = ParseCAF();
+	}
+
+	// Compressed audio and unusual sample formats are left to other decoders
+	if(!parsed || 0 == mFormat.mBytesPerFrame) {
+		mContainerName = nullptr;
+
+		if(error) {
+			SFB::CFString description = CFCopyLocalizedString(CFSTR("The file “%@” does not contain uncompressed audio in a supported format."), "");
+			SFB::CFString failureReason = CFCopyLocalizedString(CFSTR("File Format Not Supported"), "");
+			SFB::CFString recoverySuggestion = CFCopyLocalizedString(CFSTR("The file's extension may not match the file's type."), "");
+
+			*error = CreateErrorForURL(Decoder::ErrorDomain, Decoder::FileFormatNotSupportedError, description, mInputSource->GetURL(), failureReason, recoverySuggestion);
+		}
+
+		return false;
+	}
+
+	// Files truncated during recording often have data chunks that extend past the end of the file
+	SInt64 length = mInputSource->GetLength();
+	if(0 < length && (-1 == mDataSize || mDataOffset + mDataSize > length))
+		mDataSize = std::max((SInt64)0, length - mDataOffset);
+
+	mTotalFrames	= mDataSize / mFormat.mBytesPerFrame;
+	mCurrentFrame	= 0;
+
+	mSourceFormat	= mFormat;
+
+	// Inputs resident in memory are read in place
+	mBytes = static_cast<const uint8_t *>(mInputSource->GetBytes());
+	if(!mBytes && !MoveToOffset(*mInputSource, mDataOffset)) {
+		if(error)
+			*error = CFErrorCreate(kCFAllocatorDefault, Decoder::ErrorDomain, Decoder::InputOutputError, nullptr);
+		return false;
+	}
+
+	return true;
+}
+
+bool SFB::Audio::PCMDecoder::_Close(CFErrorRef */*error*/)
+{
+	mContainerName	= nullptr;
+	mBytes			= nullptr;
+	mDataOffset		= 0;
+	mDataSize		= 0;
+	mTotalFrames	= 0;
+	mCurrentFrame	= 0;
+
+	return true;
+}
+
+void SFB::Audio::PCMDecoder::_PrepareClone(Decoder& clone) const
+{
+	auto& decoder = static_cast<PCMDecoder&>(clone);
+
+	decoder.mContainerName	= mContainerName;
+	decoder.mFormat			= mFormat;
+	decoder.mChannelLayout	= mChannelLayout;
+	decoder.mDataOffset		= mDataOffset;
+	decoder.mDataSize		= mDataSize;
+}
+
+SFB::CFString SFB::Audio::PCMDecoder::_GetSourceFormatDescription() const
+{
+	const char *sampleFormat = "signed integer";
+	if(kAudioFormatFlagIsFloat & mSourceFormat.mFormatFlags)
+		sampleFormat = "floating point";
+	else if(!(kAudioFormatFlagIsSignedInteger & mSourceFormat.mFormatFlags))
+		sampleFormat = "unsigned integer";
+
+	return CFStringCreateWithFormat(kCFAllocatorDefault,
+									nullptr,
+									CFSTR("%s, %u-bit %s, %u channels, %u Hz"),
+									mContainerName,
+									(unsigned int)mSourceFormat.mBitsPerChannel,
+									sampleFormat,
+									(unsigned int)mSourceFormat.mChannelsPerFrame,
+									(unsigned int)mSourceFormat.mSampleRate);
+}
+
+UInt32 SFB::Audio::PCMDecoder::_ReadAudio(AudioBufferList *bufferList, UInt32 frameCount)
+{
+	UInt32 framesToRead = (UInt32)std::min((SInt64)frameCount, mTotalFrames - mCurrentFrame);
+	framesToRead = std::min(framesToRead, bufferList->mBuffers[0].mDataByteSize / mFormat.mBytesPerFrame);
+
+	UInt32 byteCount = framesToRead * mFormat.mBytesPerFrame;
+
+	if(mBytes)
+		memcpy(bufferList->mBuffers[0].mData, mBytes + mDataOffset + (mCurrentFrame * mFormat.mBytesPerFrame), byteCount);
+	else if(0 < byteCount) {
+		SInt64 bytesRead = mInputSource->Read(bufferList->mBuffers[0].mData, byteCount);
+		if(-1 == bytesRead) {
+			LOGGER_ERR("org.sbooth.AudioEngine.Decoder.PCM", "Error reading audio");
+			bytesRead = 0;
+		}
+
+		// A partial frame at the end of a short read is discarded
+		framesToRead	= (UInt32)(bytesRead / mFormat.mBytesPerFrame);
+		byteCount		= framesToRead * mFormat.mBytesPerFrame;
+
+		if((SInt64)byteCount != bytesRead)
+			mInputSource->SeekToOffset(mDataOffset + ((mCurrentFrame + framesToRead) * mFormat.mBytesPerFrame));
+	}
+
+	bufferList->mBuffers[0].mDataByteSize = byteCount;
+	mCurrentFrame += framesToRead;
+
+	return framesToRead;
+}
+
+SInt64 SFB::Audio::PCMDecoder::_SeekToFrame(SInt64 frame)
+{
+	if(0 > frame || frame > mTotalFrames)
+		return -1;
+
+	if(!mBytes && !mInputSource->SeekToOffset(mDataOffset + (frame * mFormat.mBytesPerFrame)))
+		return -1;
+
+	mCurrentFrame = frame;
+	return mCurrentFrame;
+}
+
+#pragma mark Container Parsing
+
+bool SFB::Audio::PCMDecoder::ParseWAVE(bool isRF64)
+{
+	mContainerName = isRF64 ? "RF64" : "WAVE";
+
+	uint64_t rf64DataSize = 0;
+	bool foundFormat = false;
+
+	// Chunks follow the 12-byte RIFF header and are padded to an even length
+	SInt64 offset = 12;
+	for(;;) {
+		uint8_t chunkHeader [8];
+		if(!MoveToOffset(*mInputSource, offset) || !ReadBytes(*mInputSource, chunkHeader, sizeof(chunkHeader)))
+			return false;
+
+		SInt64 chunkSize = ReadUInt32LE(chunkHeader + 4);
+
+		if(!memcmp(chunkHeader, "ds64", 4)) {
+			uint8_t ds64 [24];
+			if(24 > chunkSize || !ReadBytes(*mInputSource, ds64, sizeof(ds64)))
+				return false;
+			rf64DataSize = ReadUInt64LE(ds64 + 8);
+		}
+		else if(!memcmp(chunkHeader, "fmt ", 4)) {
+			uint8_t fmt [40];
+			if(16 > chunkSize || !ReadBytes(*mInputSource, fmt, std::min(chunkSize, (SInt64)sizeof(fmt))))
+				return false;
+
+			uint16_t formatTag			= ReadUInt16LE(fmt);
+			uint16_t channels			= ReadUInt16LE(fmt + 2);
+			uint32_t sampleRate			= ReadUInt32LE(fmt + 4);
+			uint16_t blockAlign			= ReadUInt16LE(fmt + 12);
+			uint16_t bitsPerSample		= ReadUInt16LE(fmt + 14);
+
+			// WAVE_FORMAT_EXTENSIBLE stores the actual format tag at the start of the subformat GUID
+			if(0xfffe == formatTag) {
+				if(40 > chunkSize)
+					return false;
+
+				UInt32 channelMask = ReadUInt32LE(fmt + 20);
+				if(channelMask)
+					mChannelLayout = ChannelLayout::ChannelLayoutWithBitmap(channelMask);
+
+				formatTag = ReadUInt16LE(fmt + 24);
+			}
+
+			// Only integer (WAVE_FORMAT_PCM) and floating point (WAVE_FORMAT_IEEE_FLOAT) audio is handled here
+			if(!(1 == formatTag || 3 == formatTag))
+				return false;
+
+			// 8-bit samples are unsigned; samples in wider containers are left-justified
+			if(!SetPCMFormat(mFormat, sampleRate, channels, ((bitsPerSample + 7) / 8) * 8, 3 == formatTag, 8 < bitsPerSample, false) || blockAlign != mFormat.mBytesPerFrame)
+				return false;
+
+			foundFormat = true;
+		}
+		else if(!memcmp(chunkHeader, "data", 4)) {
+			if(!foundFormat)
+				return false;
+
+			mDataOffset = offset + 8;
+			mDataSize = (isRF64 && 0xffffffff == chunkSize) ? (SInt64)rf64DataSize : chunkSize;
+			return true;
+		}
+
+		offset += 8 + chunkSize + (chunkSize & 1);
+	}
+}
+
+bool SFB::Audio::PCMDecoder::ParseAIFF(bool isAIFC)
+{
+	mContainerName = isAIFC ? "AIFF-C" : "AIFF";
+
+	bool foundFormat = false;
+
+	SInt64 offset = 12;
+	for(;;) {
+		uint8_t chunkHeader [8];
+		if(!MoveToOffset(*mInputSource, offset) || !ReadBytes(*mInputSource, chunkHeader, sizeof(chunkHeader)))
+			return false;
+
+		SInt64 chunkSize = ReadUInt32BE(chunkHeader + 4);
+
+		if(!memcmp(chunkHeader, "COMM", 4)) {
+			uint8_t comm [22];
+			if((isAIFC ? 22 : 18) > chunkSize || !ReadBytes(*mInputSource, comm, isAIFC ? 22 : 18))
+				return false;
+
+			uint16_t channels		= ReadUInt16BE(comm);
+			uint16_t sampleSize		= ReadUInt16BE(comm + 6);
+			double sampleRate		= ReadExtendedBE(comm + 8);
+
+			bool isFloat = false, isBigEndian = true;
+			UInt32 bitsPerChannel = ((sampleSize + 7) / 8) * 8;
+
+			if(isAIFC) {
+				const uint8_t *compressionType = comm + 18;
+				if(!memcmp(compressionType, "sowt", 4))
+					isBigEndian = false;
+				else if(!memcmp(compressionType, "fl32", 4) || !memcmp(compressionType, "FL32", 4)) {
+					isFloat = true;
+					bitsPerChannel = 32;
+				}
+				else if(!memcmp(compressionType, "fl64", 4) || !memcmp(compressionType, "FL64", 4)) {
+					isFloat = true;
+					bitsPerChannel = 64;
+				}
+				else if(memcmp(compressionType, "NONE", 4) && memcmp(compressionType, "twos", 4))
+					return false;
+			}
+
+			// AIFF samples are signed and, in wider containers, left-justified
+			if(!SetPCMFormat(mFormat, sampleRate, channels, bitsPerChannel, isFloat, true, isBigEndian))
+				return false;
+
+			foundFormat = true;
+		}
+		else if(!memcmp(chunkHeader, "SSND", 4)) {
+			uint8_t ssnd [8];
+			if(!foundFormat || 8 > chunkSize || !ReadBytes(*mInputSource, ssnd, sizeof(ssnd)))
+				return false;
+
+			SInt64 dataOffset = ReadUInt32BE(ssnd);
+			mDataOffset = offset + 16 + dataOffset;
+			mDataSize = std::max((SInt64)0, chunkSize - 8 - dataOffset);
+			return true;
+		}
+
+		offset += 8 + chunkSize + (chunkSize & 1);
+	}
+}
+
+bool SFB::Audio::PCMDecoder::ParseCAF()
+{
+	mContainerName = "CAF";
+
+	bool foundFormat = false;
+
+	// Chunks follow the 8-byte file header and are not padded
+	SInt64 offset = 8;
+	for(;;) {
+		uint8_t chunkHeader [12];
+		if(!MoveToOffset(*mInputSource, offset) || !ReadBytes(*mInputSource, chunkHeader, sizeof(chunkHeader)))
+			return false;
+
+		SInt64 chunkSize = (SInt64)ReadUInt64BE(chunkHeader + 4);
+
+		if(!memcmp(chunkHeader, "desc", 4)) {
+			uint8_t desc [32];
+			if(32 > chunkSize || !ReadBytes(*mInputSource, desc, sizeof(desc)))
+				return false;
+
+			uint64_t sampleRateBits = ReadUInt64BE(desc);
+			double sampleRate;
+			memcpy(&sampleRate, &sampleRateBits, sizeof(sampleRate));
+
+			UInt32 formatID			= ReadUInt32BE(desc + 8);
+			UInt32 formatFlags		= ReadUInt32BE(desc + 12);
+			UInt32 bytesPerPacket	= ReadUInt32BE(desc + 16);
+			UInt32 framesPerPacket	= ReadUInt32BE(desc + 20);
+			UInt32 channels			= ReadUInt32BE(desc + 24);
+			UInt32 bitsPerChannel	= ReadUInt32BE(desc + 28);
+
+			if(kAudioFormatLinearPCM != formatID || 1 != framesPerPacket)
+				return false;
+
+			// kCAFLinearPCMFormatFlagIsFloat and kCAFLinearPCMFormatFlagIsLittleEndian
+			bool isFloat		= formatFlags & (1 << 0);
+			bool isBigEndian	= !(formatFlags & (1 << 1));
+
+			if(!SetPCMFormat(mFormat, sampleRate, channels, bitsPerChannel, isFloat, true, isBigEndian) || bytesPerPacket != mFormat.mBytesPerFrame)
+				return false;
+
+			foundFormat = true;
+		}
+		else if(!memcmp(chunkHeader, "data", 4)) {
+			if(!foundFormat)
+				return false;
+
+			// The audio follows a 4-byte edit count; a size of -1 means the chunk extends to the end of the file
+			mDataOffset = offset + 12 + 4;
+			mDataSize = (-1 == chunkSize) ? -1 : std::max((SInt64)0, chunkSize - 4);
+			return true;
+		}
+
+		if(0 > chunkSize)
+			return false;
+
+		offset += 12 + chunkSize;
+	}
+}
@@ -0,0 +1,357 @@
+/*
+ *  Copyright (C) 2013 Stephen F. Booth <me@sbooth.org>
+ *  All Rights Reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    - Neither the name of Stephen F. Booth nor the names of its 
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <list>
+
+#include "SeekIndex.h"
+#include "CacheKey.h"
+#include "CFWrapper.h"
+#include "Logger.h"
+
+// The default number of indexes kept in memory
+#define DEFAULT_MEMORY_CACHE_CAPACITY 32
+
+// Identifies seek index files; the trailing digit is the format version
+#define SEEK_INDEX_FILE_MAGIC "SFBSEEK1"
+
+namespace {
+
+	std::mutex sCacheMutex;
+	std::list<SFB::Audio::SeekIndex::shared_ptr> sMemoryCache;
+	size_t sMemoryCacheCapacity = DEFAULT_MEMORY_CACHE_CAPACITY;
+	std::string sCacheDirectoryPath;
+
+}
+
+#pragma mark Cache
+
+SFB::Audio::SeekIndex::shared_ptr SFB::Audio::SeekIndex::SeekIndexForInputSource(const InputSource& inputSource, const char *codec)
+{
+	std::string key;
+	if(!SFB::CreateCacheKeyForInputSource(inputSource, codec, key))
+		return shared_ptr(new SeekIndex(std::string()));
+
+	std::string directory;
+	{
+		std::lock_guard<std::mutex> lock(sCacheMutex);
+
+		auto iter = std::find_if(sMemoryCache.begin(), sMemoryCache.end(), [&key](const shared_ptr& index) {
+			return index->mKey == key;
+		});
+
+		// Move the index to the front of the cache
+		if(iter != sMemoryCache.end()) {
+			auto index = *iter;
+			sMemoryCache.erase(iter);
+			sMemoryCache.push_front(index);
+			return index;
+		}
+
+		directory = sCacheDirectoryPath;
+	}
+
+	auto index = shared_ptr(new SeekIndex(key));
+	if(!directory.empty())
+		index->Load(SFB::GetCachePathForKey(directory, key, "seekindex"));
+
+	std::lock_guard<std::mutex> lock(sCacheMutex);
+
+	// Another thread may have created the same index in the meantime
+	auto iter = std::find_if(sMemoryCache.begin(), sMemoryCache.end(), [&key](const shared_ptr& cached) {
+		return cached->mKey == key;
+	});
+	if(iter != sMemoryCache.end())
+		return *iter;
+
+	if(0 != sMemoryCacheCapacity) {
+		sMemoryCache.push_front(index);
+		while(sMemoryCache.size() > sMemoryCacheCapacity)
+			sMemoryCache.pop_back();
+	}
+
+	return index;
+}
+
+void SFB::Audio::SeekIndex::SetCacheDirectory(CFURLRef url)
+{
+	std::string path;
+	if(url) {
+		UInt8 buf [PATH_MAX];
+		if(!CFURLGetFileSystemRepresentation(url, TRUE, buf, PATH_MAX)) {
+			LOGGER_WARNING("org.sbooth.AudioEngine.SeekIndex", "Invalid cache directory: " << url);
+			return;
+		}
+		path = (const char *)buf;
+	}
+
+	std::lock_guard<std::mutex> lock(sCacheMutex);
+	sCacheDirectoryPath = path;
+}
+
+void SFB::Audio::SeekIndex::SetMemoryCacheCapacity(size_t capacity)
+{
+	std::lock_guard<std::mutex> lock(sCacheMutex);
+	sMemoryCacheCapacity = capacity;
+	while(sMemoryCache.size() > sMemoryCacheCapacity)
+		sMemoryCache.pop_back();
+}
+
+void SFB::Audio::SeekIndex::ClearMemoryCache()
+{
+	std::lock_guard<std::mutex> lock(sCacheMutex);
+	sMemoryCache.clear();
+}
+
+#pragma mark Creation
+
+SFB::Audio::SeekIndex::SeekIndex(std::string key)
+	: mKey(std::move(key)), mMinimumSpacing(0), mTotalFrames(-1), mComplete(false), mDirty(false), mBuilding(false)
+{}
+
+#pragma mark Sync Points
+
+void SFB::Audio::SeekIndex::AddPoint(SInt64 frame, SInt64 offset)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	auto iter = std::lower_bound(mPoints.begin(), mPoints.end(), frame, [](const Point& point, SInt64 value) {
+		return point.mFrame < value;
+	});
+
+	if(iter != mPoints.end() && iter->mFrame - frame < std::max(mMinimumSpacing, (SInt64)1))
+		return;
+	if(iter != mPoints.begin() && frame - (iter - 1)->mFrame < std::max(mMinimumSpacing, (SInt64)1))
+		return;
+
+	mPoints.insert(iter, Point{frame, offset});
+	mDirty = true;
+}
+
+bool SFB::Audio::SeekIndex::FindPoint(SInt64 frame, Point& point) const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	auto iter = std::upper_bound(mPoints.begin(), mPoints.end(), frame, [](SInt64 value, const Point& p) {
+		return value < p.mFrame;
+	});
+
+	if(iter == mPoints.begin())
+		return false;
+
+	point = *(iter - 1);
+	return true;
+}
+
+std::vector<SFB::Audio::SeekIndex::Point> SFB::Audio::SeekIndex::GetPoints() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mPoints;
+}
+
+void SFB::Audio::SeekIndex::SetPoints(std::vector<Point> points)
+{
+	std::sort(points.begin(), points.end(), [](const Point& lhs, const Point& rhs) {
+		return lhs.mFrame < rhs.mFrame;
+	});
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	mPoints = std::move(points);
+	mDirty = true;
+}
+
+SInt64 SFB::Audio::SeekIndex::GetMinimumSpacing() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mMinimumSpacing;
+}
+
+void SFB::Audio::SeekIndex::SetMinimumSpacing(SInt64 frames)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mMinimumSpacing = frames;
+}
+
+#pragma mark Stream Information
+
+SInt64 SFB::Audio::SeekIndex::GetTotalFrames() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mTotalFrames;
+}
+
+void SFB::Audio::SeekIndex::SetTotalFrames(SInt64 totalFrames)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	if(totalFrames != mTotalFrames) {
+		mTotalFrames = totalFrames;
+		mDirty = true;
+	}
+}
+
+bool SFB::Audio::SeekIndex::IsComplete() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mComplete;
+}
+
+void SFB::Audio::SeekIndex::SetComplete(bool complete)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	if(complete != mComplete) {
+		mComplete = complete;
+		mDirty = true;
+	}
+}
+
+#pragma mark Building
+
+bool SFB::Audio::SeekIndex::BeginBuilding()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	if(mComplete || mBuilding)
+		return false;
+
+	mBuilding = true;
+	return true;
+}
+
+void SFB::Audio::SeekIndex::EndBuilding()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mBuilding = false;
+}
+
+#pragma mark Persistence
+
+bool SFB::Audio::SeekIndex::Save()
+{
+	std::string directory;
+	{
+		std::lock_guard<std::mutex> lock(sCacheMutex);
+		directory = sCacheDirectoryPath;
+	}
+
+	if(directory.empty() || mKey.empty())
+		return true;
+
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	if(!mDirty)
+		return true;
+
+	std::string path = SFB::GetCachePathForKey(directory, mKey, "seekindex");
+	std::string temporaryPath = path + ".tmp";
+
+	FILE *file = fopen(temporaryPath.c_str(), "wb");
+	if(nullptr == file) {
+		LOGGER_WARNING("org.sbooth.AudioEngine.SeekIndex", "Unable to create \"" << temporaryPath << "\": " << strerror(errno));
+		return false;
+	}
+
+	uint32_t keyLength = (uint32_t)mKey.size();
+	uint8_t complete = mComplete ? 1 : 0;
+	uint64_t count = mPoints.size();
+
+	bool success = 1 == fwrite(SEEK_INDEX_FILE_MAGIC, 8, 1, file)
+		&& 1 == fwrite(&keyLength, sizeof(keyLength), 1, file)
+		&& keyLength == fwrite(mKey.data(), 1, keyLength, file)
+		&& 1 == fwrite(&mTotalFrames, sizeof(mTotalFrames), 1, file)
+		&& 1 == fwrite(&complete, sizeof(complete), 1, file)
+		&& 1 == fwrite(&count, sizeof(count), 1, file)
+		&& (0 == count || count == fwrite(mPoints.data(), sizeof(Point), count, file));
+
+	if(0 != fclose(file))
+		success = false;
+
+	if(!success || 0 != rename(temporaryPath.c_str(), path.c_str())) {
+		LOGGER_WARNING("org.sbooth.AudioEngine.SeekIndex", "Unable to write \"" << path << "\": " << strerror(errno));
+		unlink(temporaryPath.c_str());
+		return false;
+	}
+
+	mDirty = false;
+
+	return true;
+}
+
+bool SFB::Audio::SeekIndex::Load(const std::string& path)
+{
+	FILE *file = fopen(path.c_str(), "rb");
+	if(nullptr == file)
+		return false;
+
+	char magic [8];
+	uint32_t keyLength = 0;
+	std::string key;
+	SInt64 totalFrames = -1;
+	uint8_t complete = 0;
+	uint64_t count = 0;
+	std::vector<Point> points;
+
+	bool success = 1 == fread(magic, sizeof(magic), 1, file) && !memcmp(magic, SEEK_INDEX_FILE_MAGIC, 8)
+		&& 1 == fread(&keyLength, sizeof(keyLength), 1, file) && keyLength == mKey.size();
+
+	if(success) {
+		key.resize(keyLength);
+		success = keyLength == fread(&key[0], 1, keyLength, file) && key == mKey
+			&& 1 == fread(&totalFrames, sizeof(totalFrames), 1, file)
+			&& 1 == fread(&complete, sizeof(complete), 1, file)
+			&& 1 == fread(&count, sizeof(count), 1, file);
+	}
+
+	if(success && 0 != count) {
+		// Guard against corrupt files requesting huge allocations
+		struct stat s;
+		success = 0 == fstat(fileno(file), &s) && count <= (uint64_t)s.st_size / sizeof(Point);
+		if(success) {
+			points.resize((size_t)count);
+			success = count == fread(points.data(), sizeof(Point), (size_t)count, file);
+		}
+	}
+
+	fclose(file);
+
+	// A different file with the same hash is simply replaced on the next save
+	if(!success)
+		return false;
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	mTotalFrames = totalFrames;
+	mComplete = (0 != complete);
+	mPoints = std::move(points);
+	mDirty = false;
+
+	return true;
+}
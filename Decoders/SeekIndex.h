@@ -0,0 +1,203 @@
+/*
+ *  Copyright (C) 2013 Stephen F. Booth <me@sbooth.org>
+ *  All Rights Reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    - Neither the name of Stephen F. Booth nor the names of its 
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <CoreFoundation/CoreFoundation.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "InputSource.h"
+
+/*! @file SeekIndex.h @brief A sparse audio frame to byte offset table */
+
+/*! @brief \c SFBAudioEngine's encompassing namespace */
+namespace SFB {
+
+	/*! @brief %Audio functionality */
+	namespace Audio {
+
+		/*!
+		 * @brief A sparse table mapping audio frames to byte offsets in an encoded stream
+		 *
+		 * Decoders whose formats require bisection or scanning to seek may record sync points as they are
+		 * discovered and consult them later to jump to the nearest preceding sync point and decode forward.
+		 * Indexes are shared between decoders for the same file, kept in a small in-memory cache, and
+		 * optionally persisted to disk.  Files are identified by URL and, for \c file URLs, size and modification date.
+		 *
+		 * The meaning of a frame and a byte offset is defined by the decoder that builds the index; the \c codec
+		 * passed to \c SeekIndex::SeekIndexForInputSource() keeps indexes from different decoders apart.
+		 * All methods are thread safe.
+		 */
+		class SeekIndex
+		{
+
+		public:
+
+			/*! @brief A \c std::shared_ptr for \c SeekIndex objects */
+			typedef std::shared_ptr<SeekIndex> shared_ptr;
+
+			/*! @brief A sync point */
+			struct Point
+			{
+				SInt64 mFrame;		/*!< @brief The first audio frame decoded from \c mOffset */
+				SInt64 mOffset;		/*!< @brief The byte offset of the sync point */
+			};
+
+
+			// ========================================
+			/*! @name Cache */
+			//@{
+
+			/*!
+			 * @brief Get the index for \c inputSource, creating an empty one if none is cached
+			 * @param inputSource The input source, which must be open
+			 * @param codec A short string identifying the decoder building the index
+			 * @return The index; indexes for input sources without a URL are neither cached nor persisted
+			 */
+			static shared_ptr SeekIndexForInputSource(const InputSource& inputSource, const char *codec);
+
+			/*!
+			 * @brief Set the directory used to persist indexes
+			 * @param url The directory URL, or \c nullptr to disable persistence (the default)
+			 */
+			static void SetCacheDirectory(CFURLRef url);
+
+			/*! @brief Set the maximum number of indexes kept in memory */
+			static void SetMemoryCacheCapacity(size_t capacity);
+
+			/*! @brief Remove all indexes from the in-memory cache */
+			static void ClearMemoryCache();
+
+			//@}
+
+
+			// ========================================
+			/*! @name Sync Points */
+			//@{
+
+			/*!
+			 * @brief Add a sync point
+			 * Points closer than \c GetMinimumSpacing() frames to an existing point are ignored
+			 */
+			void AddPoint(SInt64 frame, SInt64 offset);
+
+			/*!
+			 * @brief Find the sync point at or preceding \c frame
+			 * @return \c true if a point was found
+			 */
+			bool FindPoint(SInt64 frame, Point& point) const;
+
+			/*! @brief Get a copy of all sync points, in increasing frame order */
+			std::vector<Point> GetPoints() const;
+
+			/*! @brief Replace all sync points */
+			void SetPoints(std::vector<Point> points);
+
+			/*! @brief Get the minimum number of frames between sync points */
+			SInt64 GetMinimumSpacing() const;
+
+			/*! @brief Set the minimum number of frames between sync points */
+			void SetMinimumSpacing(SInt64 frames);
+
+			//@}
+
+
+			// ========================================
+			/*! @name Stream Information */
+			//@{
+
+			/*! @brief Get the total number of frames in the stream, or \c -1 if unknown */
+			SInt64 GetTotalFrames() const;
+
+			/*! @brief Set the total number of frames in the stream */
+			void SetTotalFrames(SInt64 totalFrames);
+
+			/*! @brief Query whether the index covers the entire stream */
+			bool IsComplete() const;
+
+			/*! @brief Mark the index as covering the entire stream */
+			void SetComplete(bool complete);
+
+			//@}
+
+
+			// ========================================
+			/*! @name Building */
+			//@{
+
+			/*!
+			 * @brief Claim the work of building a complete index
+			 * Decoders sharing an index use this so that only one of them scans the stream at a time;
+			 * the others wait for the index to become complete, or claim the work if it is relinquished early.
+			 * @return \c true if the caller should build the index, \c false if it is complete or another caller holds the claim
+			 */
+			bool BeginBuilding();
+
+			/*! @brief Relinquish a claim obtained from \c BeginBuilding(), whether or not the index was completed */
+			void EndBuilding();
+
+			//@}
+
+
+			// ========================================
+			/*! @name Persistence */
+			//@{
+
+			/*!
+			 * @brief Write the index to the cache directory if it has changed
+			 * @return \c true on success or if persistence is disabled, \c false otherwise
+			 */
+			bool Save();
+
+			//@}
+
+		private:
+
+			explicit SeekIndex(std::string key);
+
+			bool Load(const std::string& path);
+
+			// Data members
+			mutable std::mutex		mMutex;
+			const std::string		mKey;
+			std::vector<Point>		mPoints;
+			SInt64					mMinimumSpacing;
+			SInt64					mTotalFrames;
+			bool					mComplete;
+			bool					mDirty;
+			bool					mBuilding;
+		};
+
+	}
+}
@@ -102,6 +102,14 @@ bool SFB::Audio::TrueAudioDecoder::HandlesMIMEType(CFStringRef mimeType)
 	return false;
 }
 
+bool SFB::Audio::TrueAudioDecoder::HandlesSignature(const void *header, size_t length)
+{
+	if(nullptr == header || 4 > length)
+		return false;
+
+	return !memcmp(header, "TTA1", 4);
+}
+
 SFB::Audio::Decoder::unique_ptr SFB::Audio::TrueAudioDecoder::CreateDecoder(InputSource::unique_ptr inputSource)
 {
 	return unique_ptr(new TrueAudioDecoder(std::move(inputSource)));
@@ -33,6 +33,7 @@
 #include "WavPackDecoder.h"
 #include "CFWrapper.h"
 #include "CFErrorUtilities.h"
+#include "SampleConversion.h"
 #include "Logger.h"
 
 #define BUFFER_SIZE_FRAMES 2048
@@ -172,6 +173,14 @@ bool SFB::Audio::WavPackDecoder::HandlesMIMEType(CFStringRef mimeType)
 	return false;
 }
 
+bool SFB::Audio::WavPackDecoder::HandlesSignature(const void *header, size_t length)
+{
+	if(nullptr == header || 4 > length)
+		return false;
+
+	return !memcmp(header, "wvpk", 4);
+}
+
 SFB::Audio::Decoder::unique_ptr SFB::Audio::WavPackDecoder::CreateDecoder(InputSource::unique_ptr inputSource)
 {
 	return unique_ptr(new WavPackDecoder(std::move(inputSource)));
@@ -213,9 +222,9 @@ bool SFB::Audio::WavPackDecoder::_Open(CFErrorRef *error)
 		return false;
 	}
 	
-	// Floating-point and lossy files will be handed off in the canonical Core Audio format
+	// Floating-point and lossy files, and lossless files if float output was requested, will be handed off in the canonical Core Audio format
 	int mode = WavpackGetMode(mWPC.get());
-	if(MODE_FLOAT & mode || !(MODE_LOSSLESS & mode)) {
+	if(MODE_FLOAT & mode || !(MODE_LOSSLESS & mode) || mPrefersFloatOutput) {
 		// Canonical Core Audio format
 		mFormat.mFormatID			= kAudioFormatLinearPCM;
 		mFormat.mFormatFlags		= kAudioFormatFlagsNativeFloatPacked | kAudioFormatFlagIsNonInterleaved;
@@ -321,56 +330,32 @@ UInt32 SFB::Audio::WavPackDecoder::_ReadAudio(AudioBufferList *bufferList, UInt3
 		int mode = WavpackGetMode(mWPC.get());
 		
 		// Floating point files require no special handling other than deinterleaving
-		if(MODE_FLOAT & mode) {
-			float *inputBuffer = (float *)mBuffer.get();
-			
-			// Deinterleave the samples
-			for(UInt32 channel = 0; channel < mFormat.mChannelsPerFrame; ++channel) {
-				float *floatBuffer = (float *)bufferList->mBuffers[channel].mData;
-				
-				for(UInt32 sample = channel; sample < samplesRead * mFormat.mChannelsPerFrame; sample += mFormat.mChannelsPerFrame)
-					*floatBuffer++ = inputBuffer[sample];
-				
-				bufferList->mBuffers[channel].mNumberChannels	= 1;
-				bufferList->mBuffers[channel].mDataByteSize		= samplesRead * sizeof(float);
-			}
-		}
-		// Lossless files will be handed off as integers
-		else if(MODE_LOSSLESS & mode) {
+		if(MODE_FLOAT & mode)
+			SampleConversion::DeinterleaveFloat((const float *)mBuffer.get(), bufferList, mFormat.mChannelsPerFrame, samplesRead, totalFramesRead);
+		// Lossless files will be handed off as integers unless float output was requested
+		else if(MODE_LOSSLESS & mode && !mPrefersFloatOutput) {
 			// WavPack hands us 32-bit signed ints with the samples low-aligned; shift them to high alignment
 			UInt32 shift = (UInt32)(8 * (sizeof(int32_t) - (size_t)WavpackGetBytesPerSample(mWPC.get())));
-			
-			// Deinterleave the 32-bit samples and shift to high-alignment
-			for(UInt32 channel = 0; channel < mFormat.mChannelsPerFrame; ++channel) {
-				int32_t *shiftedBuffer = (int32_t *)bufferList->mBuffers[channel].mData;
-				
-				for(UInt32 sample = channel; sample < samplesRead * mFormat.mChannelsPerFrame; sample += mFormat.mChannelsPerFrame)
-					*shiftedBuffer++ = mBuffer[sample] << shift;
-				
-				bufferList->mBuffers[channel].mNumberChannels	= 1;
-				bufferList->mBuffers[channel].mDataByteSize		= samplesRead * sizeof(int32_t);
-			}		
+			SampleConversion::DeinterleaveInt32(mBuffer.get(), bufferList, mFormat.mChannelsPerFrame, samplesRead, shift, totalFramesRead);
 		}
-		// Convert lossy files to float
+		// Convert lossy files, and lossless files if float output was requested, to float
+		// The scale is computed unsigned since 1 << 31 overflows for 32-bit samples
 		else {
-			float scaleFactor = (1 << ((WavpackGetBytesPerSample(mWPC.get()) * 8) - 1));
-			
-			// Deinterleave the 32-bit samples and convert to float
-			for(UInt32 channel = 0; channel < mFormat.mChannelsPerFrame; ++channel) {
-				float *floatBuffer = (float *)bufferList->mBuffers[channel].mData;
-				
-				for(UInt32 sample = channel; sample < samplesRead * mFormat.mChannelsPerFrame; sample += mFormat.mChannelsPerFrame)
-					*floatBuffer++ = mBuffer[sample] / scaleFactor;
-				
-				bufferList->mBuffers[channel].mNumberChannels	= 1;
-				bufferList->mBuffers[channel].mDataByteSize		= samplesRead * sizeof(float);
-			}
+			unsigned bitsPerSample = 8 * (unsigned)WavpackGetBytesPerSample(mWPC.get());
+			float scale = 1.f / (float)(1u << (bitsPerSample - 1));
+			SampleConversion::DeinterleaveInt32ToFloat(mBuffer.get(), bufferList, mFormat.mChannelsPerFrame, samplesRead, scale, totalFramesRead);
 		}
-		
+
 		totalFramesRead += samplesRead;
 		framesRemaining -= samplesRead;
 	}
 	
+	// Float and 32-bit integer samples are the same size
+	for(UInt32 channel = 0; channel < mFormat.mChannelsPerFrame; ++channel) {
+		bufferList->mBuffers[channel].mNumberChannels	= 1;
+		bufferList->mBuffers[channel].mDataByteSize		= totalFramesRead * sizeof(float);
+	}
+
 	mCurrentFrame += totalFramesRead;
 	
 	return totalFramesRead;
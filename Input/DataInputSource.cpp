@@ -0,0 +1,77 @@
+/*
+ *  Copyright (C) 2013 Stephen F. Booth <me@sbooth.org>
+ *  All Rights Reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    - Neither the name of Stephen F. Booth nor the names of its 
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "DataInputSource.h"
+
+#pragma mark Creation and Destruction
+
+SFB::DataInputSource::DataInputSource(const void *bytes, SInt64 byteCount, Deleter deleter, CFURLRef url)
+	: InputSource(url), mBytes(static_cast<const UInt8 *>(bytes), [deleter](const UInt8 *b) { if(deleter) deleter(b); }), mByteCount(byteCount), mOffset(0)
+{
+	assert(nullptr != bytes);
+	assert(0 <= byteCount);
+}
+
+SFB::DataInputSource::DataInputSource(std::shared_ptr<const UInt8> bytes, SInt64 byteCount, CFURLRef url)
+	: InputSource(url), mBytes(bytes), mByteCount(byteCount), mOffset(0)
+{}
+
+bool SFB::DataInputSource::_Open(CFErrorRef */*error*/)
+{
+	mOffset = 0;
+	return true;
+}
+
+bool SFB::DataInputSource::_Close(CFErrorRef */*error*/)
+{
+	mOffset = 0;
+	return true;
+}
+
+SInt64 SFB::DataInputSource::_Read(void *buffer, SInt64 byteCount)
+{
+	SInt64 remaining = mByteCount - mOffset;
+
+	if(byteCount > remaining)
+		byteCount = remaining;
+
+	memcpy(buffer, mBytes.get() + mOffset, (size_t)byteCount);
+	mOffset += byteCount;
+	return byteCount;
+}
+
+bool SFB::DataInputSource::_SeekToOffset(SInt64 offset)
+{
+	if(offset > mByteCount)
+		return false;
+
+	mOffset = offset;
+	return true;
+}
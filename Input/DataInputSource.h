@@ -0,0 +1,86 @@
+/*
+ *  Copyright (C) 2013 Stephen F. Booth <me@sbooth.org>
+ *  All Rights Reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    - Neither the name of Stephen F. Booth nor the names of its 
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <functional>
+#include <memory>
+
+#include "InputSource.h"
+
+namespace SFB {
+
+	// ========================================
+	// InputSource serving bytes from a caller-owned buffer without copying
+	// ========================================
+	class DataInputSource : public InputSource
+	{
+
+	public:
+
+		// Invoked with the buffer when the input source is destroyed
+		typedef std::function<void(const void *)> Deleter;
+
+		// Creation
+		DataInputSource(const void *bytes, SInt64 byteCount, Deleter deleter = nullptr, CFURLRef url = nullptr);
+
+	private:
+
+		// Creates a clone sharing bytes
+		DataInputSource(std::shared_ptr<const UInt8> bytes, SInt64 byteCount, CFURLRef url);
+
+		// Bytestream access
+		virtual bool _Open(CFErrorRef *error);
+		virtual bool _Close(CFErrorRef *error);
+
+		// Functionality
+		virtual SInt64 _Read(void *buffer, SInt64 byteCount);
+		inline virtual bool _AtEOF() const						{ return mOffset == mByteCount; }
+
+		inline virtual SInt64 _GetOffset() const				{ return mOffset; }
+		inline virtual SInt64 _GetLength() const				{ return mByteCount; }
+
+		// Seeking support
+		inline virtual bool _SupportsSeeking() const			{ return true; }
+		virtual bool _SeekToOffset(SInt64 offset);
+
+		// In-memory access
+		inline virtual const void * _GetBytes() const			{ return mBytes.get(); }
+
+		// Cloning support; clones share the buffer, which is deleted when the last of them is destroyed
+		inline virtual unique_ptr _Clone() const				{ return unique_ptr(new DataInputSource(mBytes, mByteCount, GetURL())); }
+
+		// Data members
+		std::shared_ptr<const UInt8>	mBytes;
+		SInt64							mByteCount;
+		SInt64							mOffset;
+	};
+
+}
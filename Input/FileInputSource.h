@@ -63,6 +63,9 @@ namespace SFB {
 		inline virtual bool _SupportsSeeking() const			{ return true; }
 		virtual bool _SeekToOffset(SInt64 offset)				{ return (0 == ::fseeko(mFile.get(), offset, SEEK_SET)); }
 
+		// Cloning support
+		inline virtual unique_ptr _Clone() const				{ return unique_ptr(new FileInputSource(GetURL())); }
+
 		typedef std::unique_ptr<std::FILE, std::function<int(std::FILE *)>> unique_FILE_ptr;
 
 		// Data members
@@ -0,0 +1,681 @@
+/*
+ *  Copyright (C) 2013 Stephen F. Booth <me@sbooth.org>
+ *  All Rights Reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    - Neither the name of Stephen F. Booth nor the names of its 
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+#include "HTTPConnectionPool.h"
+#include "Logger.h"
+
+#define CONNECTION_BUFFER_SIZE_BYTES	16384
+#define MAXIMUM_LINE_LENGTH_BYTES		8192
+
+namespace {
+
+	// Returns the UTF-8 representation of string
+	std::string CreateUTF8String(CFStringRef string)
+	{
+		if(nullptr == string)
+			return std::string();
+
+		CFRange range = CFRangeMake(0, CFStringGetLength(string));
+		CFIndex count = 0;
+		CFStringGetBytes(string, range, kCFStringEncodingUTF8, 0, false, nullptr, 0, &count);
+
+		std::string result(static_cast<size_t>(count), '\0');
+		CFStringGetBytes(string, range, kCFStringEncodingUTF8, 0, false, reinterpret_cast<UInt8 *>(&result[0]), count, nullptr);
+
+		return result;
+	}
+
+	// Host names are case-insensitive, so connections are keyed using the lowercased host name
+	std::string CreateConnectionKey(CFStringRef host, SInt32 port, bool secure)
+	{
+		std::string key = CreateUTF8String(host);
+		std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+
+		return std::string(secure ? "https://" : "http://") + key + ":" + std::to_string(port);
+	}
+
+	bool StringContainsToken(CFStringRef string, CFStringRef token)
+	{
+		if(nullptr == string)
+			return false;
+
+		return kCFNotFound != CFStringFind(string, token, kCFCompareCaseInsensitive).location;
+	}
+
+	SInt64 ParseContentLength(CFStringRef string)
+	{
+		std::string value = CreateUTF8String(string);
+		if(value.empty())
+			return -1;
+
+		char *end = nullptr;
+		long long contentLength = strtoll(value.c_str(), &end, 10);
+		if(end == value.c_str() || 0 > contentLength)
+			return -1;
+
+		return contentLength;
+	}
+
+	// Parses the scheme, host and port of url
+	bool GetConnectionParameters(CFURLRef url, SFB::CFString& host, SInt32& port, bool& secure)
+	{
+		if(nullptr == url)
+			return false;
+
+		SFB::CFString scheme = CFURLCopyScheme(url);
+		if(!scheme)
+			return false;
+
+		secure = kCFCompareEqualTo == CFStringCompare(CFSTR("https"), scheme, kCFCompareCaseInsensitive);
+
+		host = CFURLCopyHostName(url);
+		if(!host)
+			return false;
+
+		port = CFURLGetPortNumber(url);
+		if(-1 == port)
+			port = secure ? 443 : 80;
+
+		return true;
+	}
+
+	CFErrorRef CreateErrorForStream(CFErrorRef streamError)
+	{
+		if(streamError)
+			return streamError;
+		return CFErrorCreate(kCFAllocatorDefault, kCFErrorDomainPOSIX, EIO, nullptr);
+	}
+
+}
+
+#pragma mark HTTPConnection
+
+SFB::HTTPConnection::HTTPConnection(CFStringRef host, SInt32 port, bool secure)
+	: mHost((CFStringRef)CFRetain(host)), mPort(port), mSecure(secure), mKey(CreateConnectionKey(host, port, secure)), mReadStream(nullptr), mWriteStream(nullptr), mBuffer(CONNECTION_BUFFER_SIZE_BYTES), mBufferStart(0), mBufferEnd(0), mBodyFraming(BodyFraming::None), mBodyBytesRemaining(0), mPendingResponseCount(0), mRequestCount(0), mCloseRequested(false), mErrorOccurred(false), mLastUseTime(0)
+{
+	assert(nullptr != host);
+}
+
+SFB::HTTPConnection::~HTTPConnection()
+{
+	Close();
+}
+
+bool SFB::HTTPConnection::Open(CFErrorRef *error)
+{
+	if(IsOpen())
+		return true;
+
+	CFReadStreamRef readStream = nullptr;
+	CFWriteStreamRef writeStream = nullptr;
+	CFStreamCreatePairWithSocketToHost(kCFAllocatorDefault, mHost, (UInt32)mPort, &readStream, &writeStream);
+
+	mReadStream = readStream;
+	mWriteStream = writeStream;
+
+	if(!mReadStream || !mWriteStream) {
+		Close();
+		if(error)
+			*error = CFErrorCreate(kCFAllocatorDefault, kCFErrorDomainPOSIX, ENOMEM, nullptr);
+		return false;
+	}
+
+	if(mSecure) {
+		CFReadStreamSetProperty(mReadStream, kCFStreamPropertySocketSecurityLevel, kCFStreamSocketSecurityLevelNegotiatedSSL);
+		CFWriteStreamSetProperty(mWriteStream, kCFStreamPropertySocketSecurityLevel, kCFStreamSocketSecurityLevelNegotiatedSSL);
+	}
+
+	// Both streams share the same socket, and reads and writes block until the connection is established
+	if(!CFReadStreamOpen(mReadStream) || !CFWriteStreamOpen(mWriteStream)) {
+		if(error)
+			*error = CreateErrorForStream(CFReadStreamCopyError(mReadStream));
+		Close();
+		return false;
+	}
+
+	mBufferStart = mBufferEnd = 0;
+	mBodyFraming = BodyFraming::None;
+	mBodyBytesRemaining = 0;
+	mPendingResponseCount = 0;
+	mRequestCount = 0;
+	mCloseRequested = false;
+	mErrorOccurred = false;
+	mLastUseTime = CFAbsoluteTimeGetCurrent();
+
+	return true;
+}
+
+void SFB::HTTPConnection::Close()
+{
+	if(mReadStream)
+		CFReadStreamClose(mReadStream);
+	if(mWriteStream)
+		CFWriteStreamClose(mWriteStream);
+
+	mReadStream = nullptr;
+	mWriteStream = nullptr;
+
+	mBufferStart = mBufferEnd = 0;
+	mBodyFraming = BodyFraming::None;
+	mPendingResponseCount = 0;
+}
+
+bool SFB::HTTPConnection::IsReusable() const
+{
+	if(!CanSendRequest() || 0 != mPendingResponseCount || IsReadingResponseBody())
+		return false;
+
+	// Any unsolicited data or an end of stream means the server has closed or abandoned the connection
+	if(mBufferStart != mBufferEnd)
+		return false;
+
+	return kCFStreamStatusOpen == CFReadStreamGetStatus(mReadStream) && kCFStreamStatusOpen == CFWriteStreamGetStatus(mWriteStream);
+}
+
+bool SFB::HTTPConnection::SendRequest(CFHTTPMessageRef request, CFErrorRef *error)
+{
+	if(nullptr == request || !CanSendRequest()) {
+		if(error)
+			*error = CFErrorCreate(kCFAllocatorDefault, kCFErrorDomainPOSIX, ENOTCONN, nullptr);
+		return false;
+	}
+
+	SFB::CFString hostField;
+	if((mSecure && 443 == mPort) || (!mSecure && 80 == mPort))
+		hostField = (CFStringRef)CFRetain(mHost);
+	else
+		hostField = CFStringCreateWithFormat(kCFAllocatorDefault, nullptr, CFSTR("%@:%d"), mHost.Object(), (int)mPort);
+
+	CFHTTPMessageSetHeaderFieldValue(request, CFSTR("Host"), hostField);
+	CFHTTPMessageSetHeaderFieldValue(request, CFSTR("Connection"), CFSTR("keep-alive"));
+
+	SFB::CFData message = CFHTTPMessageCopySerializedMessage(request);
+	if(!message) {
+		if(error)
+			*error = CFErrorCreate(kCFAllocatorDefault, kCFErrorDomainPOSIX, ENOMEM, nullptr);
+		return false;
+	}
+
+	const UInt8 *bytes = CFDataGetBytePtr(message);
+	CFIndex bytesRemaining = CFDataGetLength(message);
+
+	while(0 < bytesRemaining) {
+		CFIndex bytesWritten = CFWriteStreamWrite(mWriteStream, bytes, bytesRemaining);
+		if(0 >= bytesWritten) {
+			mErrorOccurred = true;
+			if(error)
+				*error = CreateErrorForStream(CFWriteStreamCopyError(mWriteStream));
+			return false;
+		}
+
+		bytes += bytesWritten;
+		bytesRemaining -= bytesWritten;
+	}
+
+	++mPendingResponseCount;
+	++mRequestCount;
+	mLastUseTime = CFAbsoluteTimeGetCurrent();
+
+	return true;
+}
+
+CFHTTPMessageRef SFB::HTTPConnection::CopyNextResponseHeader(CFErrorRef *error)
+{
+	if(0 == mPendingResponseCount || IsReadingResponseBody()) {
+		if(error)
+			*error = CFErrorCreate(kCFAllocatorDefault, kCFErrorDomainPOSIX, EINVAL, nullptr);
+		return nullptr;
+	}
+
+	for(;;) {
+		SFB::CFHTTPMessage response = CFHTTPMessageCreateEmpty(kCFAllocatorDefault, false);
+		if(!response) {
+			if(error)
+				*error = CFErrorCreate(kCFAllocatorDefault, kCFErrorDomainPOSIX, ENOMEM, nullptr);
+			return nullptr;
+		}
+
+		// Accumulate the status line and header fields
+		std::string line;
+		do {
+			if(!ReadLine(line)) {
+				mErrorOccurred = true;
+				if(error)
+					*error = CreateErrorForStream(CFReadStreamCopyError(mReadStream));
+				return nullptr;
+			}
+
+			line.append("\r\n");
+			CFHTTPMessageAppendBytes(response, reinterpret_cast<const UInt8 *>(line.data()), (CFIndex)line.size());
+		} while(2 < line.size());
+
+		if(!CFHTTPMessageIsHeaderComplete(response)) {
+			LOGGER_WARNING("org.sbooth.AudioEngine.HTTPConnection", "Malformed HTTP response header from " << mHost);
+			mErrorOccurred = true;
+			if(error)
+				*error = CFErrorCreate(kCFAllocatorDefault, kCFErrorDomainPOSIX, EBADMSG, nullptr);
+			return nullptr;
+		}
+
+		CFIndex statusCode = CFHTTPMessageGetResponseStatusCode(response);
+
+		// Interim responses precede the final response for the request
+		if(100 <= statusCode && 200 > statusCode)
+			continue;
+
+		SFB::CFString connectionField = CFHTTPMessageCopyHeaderFieldValue(response, CFSTR("Connection"));
+		SFB::CFString version = CFHTTPMessageCopyVersion(response);
+		if(StringContainsToken(connectionField, CFSTR("close")))
+			mCloseRequested = true;
+		else if(version && kCFCompareEqualTo == CFStringCompare(version, kCFHTTPVersion1_0, 0) && !StringContainsToken(connectionField, CFSTR("keep-alive")))
+			mCloseRequested = true;
+
+		// Determine the length of the message body as described in RFC 7230 section 3.3.3
+		SFB::CFString transferEncoding = CFHTTPMessageCopyHeaderFieldValue(response, CFSTR("Transfer-Encoding"));
+		SFB::CFString contentLength = CFHTTPMessageCopyHeaderFieldValue(response, CFSTR("Content-Length"));
+
+		mBodyBytesRemaining = 0;
+
+		if(204 == statusCode || 304 == statusCode)
+			mBodyFraming = BodyFraming::None;
+		else if(StringContainsToken(transferEncoding, CFSTR("chunked")))
+			mBodyFraming = BodyFraming::Chunked;
+		else if(contentLength && -1 != (mBodyBytesRemaining = ParseContentLength(contentLength)))
+			mBodyFraming = 0 < mBodyBytesRemaining ? BodyFraming::ContentLength : BodyFraming::None;
+		else {
+			// The body extends until the server closes the connection
+			mBodyFraming = BodyFraming::UntilClose;
+			mBodyBytesRemaining = 0;
+			mCloseRequested = true;
+		}
+
+		if(BodyFraming::None == mBodyFraming)
+			EndResponseBody();
+
+		mLastUseTime = CFAbsoluteTimeGetCurrent();
+
+		return response.Relinquish();
+	}
+}
+
+SInt64 SFB::HTTPConnection::ReadResponseBody(void *buffer, SInt64 byteCount)
+{
+	if(nullptr == buffer || 0 > byteCount)
+		return -1;
+
+	switch(mBodyFraming) {
+		case BodyFraming::None:
+			return 0;
+
+		case BodyFraming::ContentLength:
+		{
+			SInt64 bytesRead = ReadBuffered(buffer, std::min(byteCount, mBodyBytesRemaining));
+			if(0 >= bytesRead) {
+				// The connection was closed before the complete body was received
+				mErrorOccurred = true;
+				return -1;
+			}
+
+			mBodyBytesRemaining -= bytesRead;
+			if(0 == mBodyBytesRemaining)
+				EndResponseBody();
+
+			return bytesRead;
+		}
+
+		case BodyFraming::Chunked:
+		{
+			std::string line;
+
+			// Each chunk is preceded by its size in hexadecimal
+			if(0 == mBodyBytesRemaining) {
+				if(!ReadLine(line)) {
+					mErrorOccurred = true;
+					return -1;
+				}
+
+				char *end = nullptr;
+				long long chunkSize = strtoll(line.c_str(), &end, 16);
+				if(end == line.c_str() || 0 > chunkSize) {
+					mErrorOccurred = true;
+					return -1;
+				}
+
+				// The last chunk is followed by optional trailer fields and an empty line
+				if(0 == chunkSize) {
+					do {
+						if(!ReadLine(line)) {
+							mErrorOccurred = true;
+							return -1;
+						}
+					} while(!line.empty());
+
+					EndResponseBody();
+					return 0;
+				}
+
+				mBodyBytesRemaining = chunkSize;
+			}
+
+			SInt64 bytesRead = ReadBuffered(buffer, std::min(byteCount, mBodyBytesRemaining));
+			if(0 >= bytesRead) {
+				mErrorOccurred = true;
+				return -1;
+			}
+
+			mBodyBytesRemaining -= bytesRead;
+
+			// Chunk data is terminated by CRLF
+			if(0 == mBodyBytesRemaining && (!ReadLine(line) || !line.empty())) {
+				mErrorOccurred = true;
+				return -1;
+			}
+
+			return bytesRead;
+		}
+
+		case BodyFraming::UntilClose:
+		{
+			SInt64 bytesRead = ReadBuffered(buffer, byteCount);
+			if(0 == bytesRead)
+				EndResponseBody();
+			else if(0 > bytesRead)
+				mErrorOccurred = true;
+
+			return bytesRead;
+		}
+	}
+
+	return -1;
+}
+
+SInt64 SFB::HTTPConnection::GetResponseBodyBytesRemaining() const
+{
+	switch(mBodyFraming) {
+		case BodyFraming::None:				return 0;
+		case BodyFraming::ContentLength:	return mBodyBytesRemaining;
+		default:							return -1;
+	}
+}
+
+bool SFB::HTTPConnection::DiscardResponseBody(SInt64 byteLimit)
+{
+	UInt8 buffer [4096];
+	SInt64 bytesDiscarded = 0;
+
+	while(IsReadingResponseBody()) {
+		if(bytesDiscarded >= byteLimit)
+			return false;
+
+		SInt64 bytesRead = ReadResponseBody(buffer, std::min((SInt64)sizeof(buffer), byteLimit - bytesDiscarded));
+		if(0 > bytesRead)
+			return false;
+
+		bytesDiscarded += bytesRead;
+	}
+
+	return true;
+}
+
+bool SFB::HTTPConnection::FillBuffer()
+{
+	if(!IsOpen())
+		return false;
+
+	if(mBufferStart == mBufferEnd)
+		mBufferStart = mBufferEnd = 0;
+	else if(mBufferEnd == mBuffer.size() && 0 < mBufferStart) {
+		memmove(&mBuffer[0], &mBuffer[mBufferStart], mBufferEnd - mBufferStart);
+		mBufferEnd -= mBufferStart;
+		mBufferStart = 0;
+	}
+
+	if(mBufferEnd == mBuffer.size())
+		return false;
+
+	CFIndex bytesRead = CFReadStreamRead(mReadStream, &mBuffer[mBufferEnd], (CFIndex)(mBuffer.size() - mBufferEnd));
+	if(0 > bytesRead) {
+		mErrorOccurred = true;
+		return false;
+	}
+	// The server closed the connection
+	else if(0 == bytesRead) {
+		mCloseRequested = true;
+		return false;
+	}
+
+	mBufferEnd += (size_t)bytesRead;
+
+	return true;
+}
+
+bool SFB::HTTPConnection::ReadLine(std::string& line)
+{
+	line.clear();
+
+	for(;;) {
+		auto begin = mBuffer.begin() + (std::vector<UInt8>::difference_type)mBufferStart;
+		auto end = mBuffer.begin() + (std::vector<UInt8>::difference_type)mBufferEnd;
+		auto newline = std::find(begin, end, '\n');
+
+		if(newline != end) {
+			line.append(begin, newline);
+			mBufferStart += (size_t)(newline - begin) + 1;
+
+			if(!line.empty() && '\r' == line.back())
+				line.pop_back();
+
+			return true;
+		}
+
+		line.append(begin, end);
+		mBufferStart = mBufferEnd;
+
+		if(MAXIMUM_LINE_LENGTH_BYTES < line.size() || !FillBuffer())
+			return false;
+	}
+}
+
+SInt64 SFB::HTTPConnection::ReadBuffered(void *buffer, SInt64 byteCount)
+{
+	if(mBufferStart == mBufferEnd) {
+		// Large reads bypass the buffer
+		if(byteCount >= (SInt64)mBuffer.size()) {
+			if(!IsOpen())
+				return -1;
+
+			CFIndex bytesRead = CFReadStreamRead(mReadStream, static_cast<UInt8 *>(buffer), (CFIndex)byteCount);
+			if(0 > bytesRead)
+				mErrorOccurred = true;
+			else if(0 == bytesRead)
+				mCloseRequested = true;
+
+			return bytesRead;
+		}
+
+		if(!FillBuffer())
+			return mErrorOccurred ? -1 : 0;
+	}
+
+	SInt64 bytesToCopy = std::min(byteCount, (SInt64)(mBufferEnd - mBufferStart));
+	memcpy(buffer, &mBuffer[mBufferStart], (size_t)bytesToCopy);
+	mBufferStart += (size_t)bytesToCopy;
+
+	return bytesToCopy;
+}
+
+void SFB::HTTPConnection::EndResponseBody()
+{
+	mBodyFraming = BodyFraming::None;
+	mBodyBytesRemaining = 0;
+
+	if(0 < mPendingResponseCount)
+		--mPendingResponseCount;
+
+	mLastUseTime = CFAbsoluteTimeGetCurrent();
+}
+
+#pragma mark HTTPConnectionPool
+
+SFB::HTTPConnectionPool& SFB::HTTPConnectionPool::GetSharedPool()
+{
+	static HTTPConnectionPool sSharedPool;
+	return sSharedPool;
+}
+
+SFB::HTTPConnectionPool::HTTPConnectionPool()
+	: mMaximumIdleConnectionsPerHost(2), mMaximumPipelineDepth(2), mIdleTimeout(15)
+{}
+
+size_t SFB::HTTPConnectionPool::GetMaximumIdleConnectionsPerHost() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mMaximumIdleConnectionsPerHost;
+}
+
+void SFB::HTTPConnectionPool::SetMaximumIdleConnectionsPerHost(size_t maximumIdleConnections)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mMaximumIdleConnectionsPerHost = maximumIdleConnections;
+
+	for(auto& iter : mIdleConnections) {
+		while(iter.second.size() > mMaximumIdleConnectionsPerHost)
+			iter.second.pop_front();
+	}
+}
+
+size_t SFB::HTTPConnectionPool::GetMaximumPipelineDepth() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mMaximumPipelineDepth;
+}
+
+void SFB::HTTPConnectionPool::SetMaximumPipelineDepth(size_t maximumPipelineDepth)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mMaximumPipelineDepth = std::max(maximumPipelineDepth, (size_t)1);
+}
+
+CFTimeInterval SFB::HTTPConnectionPool::GetIdleTimeout() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mIdleTimeout;
+}
+
+void SFB::HTTPConnectionPool::SetIdleTimeout(CFTimeInterval idleTimeout)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mIdleTimeout = idleTimeout;
+}
+
+SFB::HTTPConnection::unique_ptr SFB::HTTPConnectionPool::AcquireConnection(CFURLRef url, CFErrorRef *error)
+{
+	SFB::CFString host;
+	SInt32 port;
+	bool secure;
+	if(!GetConnectionParameters(url, host, port, secure)) {
+		if(error)
+			*error = CFErrorCreate(kCFAllocatorDefault, kCFErrorDomainPOSIX, EINVAL, nullptr);
+		return nullptr;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		auto iter = mIdleConnections.find(CreateConnectionKey(host, port, secure));
+		if(iter != mIdleConnections.end()) {
+			CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+
+			// The most recently used connections are at the back
+			while(!iter->second.empty()) {
+				HTTPConnection::unique_ptr connection = std::move(iter->second.back());
+				iter->second.pop_back();
+
+				if(now - connection->GetLastUseTime() < mIdleTimeout && connection->IsReusable()) {
+					LOGGER_DEBUG("org.sbooth.AudioEngine.HTTPConnectionPool", "Reusing connection to " << connection->GetKey());
+					return connection;
+				}
+			}
+		}
+	}
+
+	HTTPConnection::unique_ptr connection(new HTTPConnection(host, port, secure));
+	if(!connection->Open(error))
+		return nullptr;
+
+	return connection;
+}
+
+SFB::HTTPConnection::unique_ptr SFB::HTTPConnectionPool::OpenConnection(CFURLRef url, CFErrorRef *error)
+{
+	SFB::CFString host;
+	SInt32 port;
+	bool secure;
+	if(!GetConnectionParameters(url, host, port, secure)) {
+		if(error)
+			*error = CFErrorCreate(kCFAllocatorDefault, kCFErrorDomainPOSIX, EINVAL, nullptr);
+		return nullptr;
+	}
+
+	HTTPConnection::unique_ptr connection(new HTTPConnection(host, port, secure));
+	if(!connection->Open(error))
+		return nullptr;
+
+	return connection;
+}
+
+void SFB::HTTPConnectionPool::RelinquishConnection(HTTPConnection::unique_ptr connection)
+{
+	if(!connection || !connection->IsReusable())
+		return;
+
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	if(0 == mMaximumIdleConnectionsPerHost)
+		return;
+
+	auto& idleConnections = mIdleConnections[connection->GetKey()];
+
+	// Discard the least recently used connections to stay within the limit
+	while(idleConnections.size() >= mMaximumIdleConnectionsPerHost)
+		idleConnections.pop_front();
+
+	idleConnections.push_back(std::move(connection));
+}
+
+void SFB::HTTPConnectionPool::RemoveIdleConnections()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mIdleConnections.clear();
+}
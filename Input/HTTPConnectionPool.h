@@ -0,0 +1,308 @@
+/*
+ *  Copyright (C) 2013 Stephen F. Booth <me@sbooth.org>
+ *  All Rights Reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    - Neither the name of Stephen F. Booth nor the names of its 
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+
+#include <CoreFoundation/CoreFoundation.h>
+
+#if TARGET_OS_IPHONE
+# include <CFNetwork/CFNetwork.h>
+#else
+# include <CoreServices/CoreServices.h>
+#endif
+
+#include "CFWrapper.h"
+
+/*! @file HTTPConnectionPool.h @brief Persistent HTTP/1.1 connections shared between \c HTTPInputSource instances */
+
+/*! @brief \c SFBAudioEngine's encompassing namespace */
+namespace SFB {
+
+	/*!
+	 * @brief A persistent HTTP/1.1 connection to a single host
+	 *
+	 * Requests may be pipelined: additional requests may be sent before earlier responses
+	 * have been read.  Responses are read in the order the requests were sent.
+	 * I/O is synchronous and a connection should only be used by one thread at a time.
+	 */
+	class HTTPConnection
+	{
+
+	public:
+
+		// ========================================
+		/*! @name Creation and Destruction */
+		//@{
+
+		/*! @brief A \c std::unique_ptr for \c HTTPConnection objects */
+		typedef std::unique_ptr<HTTPConnection> unique_ptr;
+
+		/*!
+		 * @brief Create a new \c HTTPConnection
+		 * @param host The host name
+		 * @param port The port number
+		 * @param secure Whether to use TLS
+		 */
+		HTTPConnection(CFStringRef host, SInt32 port, bool secure);
+
+		/*! @brief Destroy the \c HTTPConnection, closing the socket if open */
+		~HTTPConnection();
+
+		/*! @cond */
+
+		/*! @internal This class is non-copyable */
+		HTTPConnection(const HTTPConnection& rhs) = delete;
+
+		/*! @internal This class is non-assignable */
+		HTTPConnection& operator=(const HTTPConnection& rhs) = delete;
+
+		/*! @endcond */
+
+		//@}
+
+
+		// ========================================
+		/*! @name Connection management */
+		//@{
+
+		/*!
+		 * @brief Open the connection
+		 * @param error An optional pointer to a \c CFErrorRef to receive error information
+		 * @return \c true on success, \c false otherwise
+		 */
+		bool Open(CFErrorRef *error = nullptr);
+
+		/*! @brief Close the connection */
+		void Close();
+
+		/*! @brief Query whether the connection is open */
+		inline bool IsOpen() const								{ return mReadStream && mWriteStream; }
+
+		/*! @brief Get the key identifying the connection's host, port and scheme */
+		inline const std::string& GetKey() const				{ return mKey; }
+
+		/*! @brief Get the number of requests sent on this connection */
+		inline size_t GetRequestCount() const					{ return mRequestCount; }
+
+		/*! @brief Get the time this connection was last used */
+		inline CFAbsoluteTime GetLastUseTime() const			{ return mLastUseTime; }
+
+		/*!
+		 * @brief Query whether this connection may be used for another request
+		 * A connection is reusable if it is open, no I/O errors have occurred, all responses have been
+		 * completely read, and the server did not request that the connection be closed.
+		 */
+		bool IsReusable() const;
+
+		//@}
+
+
+		// ========================================
+		/*! @name Requests and responses */
+		//@{
+
+		/*!
+		 * @brief Send a request
+		 * @note The \c Host and \c Connection header fields are set automatically
+		 * @param request The request to send
+		 * @param error An optional pointer to a \c CFErrorRef to receive error information
+		 * @return \c true on success, \c false otherwise
+		 */
+		bool SendRequest(CFHTTPMessageRef request, CFErrorRef *error = nullptr);
+
+		/*! @brief Query whether another request may be sent, possibly before earlier responses have been read */
+		inline bool CanSendRequest() const						{ return IsOpen() && !mCloseRequested && !mErrorOccurred; }
+
+		/*! @brief Get the number of requests whose responses have not been completely read */
+		inline size_t GetPendingResponseCount() const			{ return mPendingResponseCount; }
+
+		/*!
+		 * @brief Read the header of the next response
+		 * @note Any unread body of the current response must be read or discarded first
+		 * @param error An optional pointer to a \c CFErrorRef to receive error information
+		 * @return A header-only \c CFHTTPMessageRef that must be released by the caller, or \c nullptr on error
+		 */
+		CFHTTPMessageRef CopyNextResponseHeader(CFErrorRef *error = nullptr);
+
+		/*! @brief Query whether the body of the current response is being read */
+		inline bool IsReadingResponseBody() const				{ return BodyFraming::None != mBodyFraming; }
+
+		/*!
+		 * @brief Read bytes from the body of the current response
+		 * @param buffer A buffer to receive the data
+		 * @param byteCount The maximum number of bytes to read
+		 * @return The number of bytes read, \c 0 at the end of the body, or \c -1 on error
+		 */
+		SInt64 ReadResponseBody(void *buffer, SInt64 byteCount);
+
+		/*! @brief Get the number of body bytes remaining in the current response, or \c -1 if unknown */
+		SInt64 GetResponseBodyBytesRemaining() const;
+
+		/*!
+		 * @brief Read and discard the rest of the current response body
+		 * @param byteLimit The maximum number of bytes to discard
+		 * @return \c true if the body was completely consumed, \c false otherwise
+		 */
+		bool DiscardResponseBody(SInt64 byteLimit);
+
+		//@}
+
+	private:
+
+		enum class BodyFraming {
+			None,
+			ContentLength,
+			Chunked,
+			UntilClose
+		};
+
+		bool FillBuffer();
+		bool ReadLine(std::string& line);
+		SInt64 ReadBuffered(void *buffer, SInt64 byteCount);
+		void EndResponseBody();
+
+		// Data members
+		SFB::CFString					mHost;
+		SInt32							mPort;
+		bool							mSecure;
+		std::string						mKey;
+
+		SFB::CFReadStream				mReadStream;
+		SFB::CFWriteStream				mWriteStream;
+
+		std::vector<UInt8>				mBuffer;
+		size_t							mBufferStart;
+		size_t							mBufferEnd;
+
+		BodyFraming						mBodyFraming;
+		SInt64							mBodyBytesRemaining;
+
+		size_t							mPendingResponseCount;
+		size_t							mRequestCount;
+		bool							mCloseRequested;
+		bool							mErrorOccurred;
+		CFAbsoluteTime					mLastUseTime;
+	};
+
+	/*!
+	 * @brief A pool of idle persistent HTTP/1.1 connections keyed by host
+	 *
+	 * Connections are acquired for exclusive use and relinquished when no longer needed.
+	 * Reusable connections are kept for a limited time so sequential tracks and range requests
+	 * to the same host avoid TCP and TLS setup.
+	 */
+	class HTTPConnectionPool
+	{
+
+	public:
+
+		/*! @brief Get the shared \c HTTPConnectionPool */
+		static HTTPConnectionPool& GetSharedPool();
+
+
+		// ========================================
+		/*! @name Limits */
+		//@{
+
+		/*! @brief Get the maximum number of idle connections kept per host */
+		size_t GetMaximumIdleConnectionsPerHost() const;
+
+		/*! @brief Set the maximum number of idle connections kept per host */
+		void SetMaximumIdleConnectionsPerHost(size_t maximumIdleConnections);
+
+		/*! @brief Get the maximum number of outstanding requests on a single connection */
+		size_t GetMaximumPipelineDepth() const;
+
+		/*! @brief Set the maximum number of outstanding requests on a single connection */
+		void SetMaximumPipelineDepth(size_t maximumPipelineDepth);
+
+		/*! @brief Get the time after which idle connections are discarded */
+		CFTimeInterval GetIdleTimeout() const;
+
+		/*! @brief Set the time after which idle connections are discarded */
+		void SetIdleTimeout(CFTimeInterval idleTimeout);
+
+		//@}
+
+
+		// ========================================
+		/*! @name Connection management */
+		//@{
+
+		/*!
+		 * @brief Acquire a connection to the host of \c url
+		 * An idle connection is returned if one is available, otherwise a new connection is opened
+		 * @param url The URL
+		 * @param error An optional pointer to a \c CFErrorRef to receive error information
+		 * @return An open \c HTTPConnection, or \c nullptr on failure
+		 */
+		HTTPConnection::unique_ptr AcquireConnection(CFURLRef url, CFErrorRef *error = nullptr);
+
+		/*!
+		 * @brief Open a new connection to the host of \c url, bypassing idle connections
+		 * This is useful when an idle connection turns out to have been closed by the server
+		 * @param url The URL
+		 * @param error An optional pointer to a \c CFErrorRef to receive error information
+		 * @return An open \c HTTPConnection, or \c nullptr on failure
+		 */
+		HTTPConnection::unique_ptr OpenConnection(CFURLRef url, CFErrorRef *error = nullptr);
+
+		/*!
+		 * @brief Return a connection to the pool
+		 * The connection is kept for reuse if it is reusable and the per-host idle limit has not been reached,
+		 * otherwise it is closed
+		 */
+		void RelinquishConnection(HTTPConnection::unique_ptr connection);
+
+		/*! @brief Close all idle connections */
+		void RemoveIdleConnections();
+
+		//@}
+
+	private:
+
+		HTTPConnectionPool();
+
+		// Data members
+		mutable std::mutex												mMutex;
+		std::unordered_map<std::string, std::deque<HTTPConnection::unique_ptr>>	mIdleConnections;
+		size_t															mMaximumIdleConnectionsPerHost;
+		size_t															mMaximumPipelineDepth;
+		CFTimeInterval													mIdleTimeout;
+	};
+
+}
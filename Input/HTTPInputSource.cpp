@@ -28,137 +28,156 @@
  *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <algorithm>
+#include <cstdio>
+
 #include "HTTPInputSource.h"
+#include "CFErrorUtilities.h"
 #include "Logger.h"
 
-// ========================================
-// CFNetwork callbacks
-// ========================================
-namespace {
-
-	void myCFReadStreamClientCallBack(CFReadStreamRef stream, CFStreamEventType type, void *clientCallBackInfo)
-	{
-		assert(nullptr != clientCallBackInfo);
-
-		SFB::HTTPInputSource *inputSource = static_cast<SFB::HTTPInputSource *>(clientCallBackInfo);
-		inputSource->HandleNetworkEvent(stream, type);
-	}
-
-}
+// The number of bytes requested in each range request
+#define RANGE_REQUEST_SIZE_BYTES		(256 * 1024)
 
+// Outstanding response data up to this size is read and discarded on a seek instead of closing the connection
+#define MAXIMUM_DISCARD_SIZE_BYTES		(512 * 1024)
 
 #pragma mark Creation and Destruction
 
 
 SFB::HTTPInputSource::HTTPInputSource(CFURLRef url)
-	: InputSource(url), mRequest(nullptr), mReadStream(nullptr), mResponseHeaders(nullptr), mEOSReached(false), mOffset(-1), mDesiredOffset(0)
+	: InputSource(url), mConnection(nullptr), mConnectionReused(false), mNextRequestOffset(0), mResponseInProgress(false), mResponseHeaders(nullptr), mRangeRequestsSupported(true), mEOSReached(false), mOffset(-1), mLength(-1)
 {}
 
 bool SFB::HTTPInputSource::_Open(CFErrorRef *error)
 {
-	// Set up the HTTP request
-	mRequest = CFHTTPMessageCreateRequest(kCFAllocatorDefault, CFSTR("GET"), GetURL(), kCFHTTPVersion1_1);
-	if(!mRequest) {
-		if(error)
-			*error = CFErrorCreate(kCFAllocatorDefault, kCFErrorDomainPOSIX, ENOMEM, nullptr);
-		return false;
-	}
+	mOffset = 0;
+	mLength = -1;
+	mNextRequestOffset = 0;
+	mRangeRequestsSupported = true;
+	mEOSReached = false;
 
-	CFHTTPMessageSetHeaderFieldValue(mRequest, CFSTR("User-Agent"), CFSTR("SFBAudioEngine"));
-
-	// Seek support
-	if(0 < mDesiredOffset) {
-		SFB::CFString byteRange = CFStringCreateWithFormat(kCFAllocatorDefault, nullptr, CFSTR("bytes=%lld-"), mDesiredOffset);
-		CFHTTPMessageSetHeaderFieldValue(mRequest, CFSTR("Range"), byteRange);
-	}
-
-	mReadStream = CFReadStreamCreateForStreamedHTTPRequest(kCFAllocatorDefault, mRequest, nullptr);
-	if(!mReadStream) {
-		if(error)
-			*error = CFErrorCreate(kCFAllocatorDefault, kCFErrorDomainPOSIX, ENOMEM, nullptr);
+	if(!FillPipeline(error))
 		return false;
-	}
 
-	// Start the HTTP connection
-	CFStreamClientContext myContext = {
-		.version = 0,
-		.info = this,
-		.retain = nullptr,
-		.release = nullptr,
-		.copyDescription = nullptr
-	};
-
-	CFOptionFlags clientFlags = kCFStreamEventOpenCompleted | kCFStreamEventHasBytesAvailable | kCFStreamEventErrorOccurred | kCFStreamEventEndEncountered;
-    if(!CFReadStreamSetClient(mReadStream, clientFlags, myCFReadStreamClientCallBack, &myContext)) {
-		if(error)
-			*error = CFErrorCreate(kCFAllocatorDefault, kCFErrorDomainPOSIX, ENOMEM, nullptr);
-		return false;
-	}
+	if(!BeginResponse(error)) {
+		// An idle connection from the pool may have been closed by the server, so retry once with a new connection
+		if(!mConnectionReused)
+			return false;
 
-	CFReadStreamScheduleWithRunLoop(mReadStream, CFRunLoopGetCurrent(), kCFRunLoopDefaultMode);
+		if(error && *error)
+			CFRelease(*error), *error = nullptr;
 
-	if(!CFReadStreamOpen(mReadStream)) {
-		if(error)
-			*error = CFErrorCreate(kCFAllocatorDefault, kCFErrorDomainPOSIX, ENOMEM, nullptr);
-		return false;
+		if(!ReopenConnection(error) || !BeginResponse(error))
+			return false;
 	}
 
-	while(nullptr == mResponseHeaders)
-		CFRunLoopRunInMode(kCFRunLoopDefaultMode, 0, true);
-
 	return true;
 }
 
 bool SFB::HTTPInputSource::_Close(CFErrorRef */*error*/)
 {
-	mRequest = nullptr;
-	mReadStream = nullptr;
+	if(mConnection) {
+		AbandonResponses();
+		HTTPConnectionPool::GetSharedPool().RelinquishConnection(std::move(mConnection));
+	}
+
+	mRequestedOffsets.clear();
+	mResponseInProgress = false;
 	mResponseHeaders = nullptr;
 
 	mOffset = -1;
-	mDesiredOffset = 0;
+	mLength = -1;
+	mNextRequestOffset = 0;
+	mEOSReached = false;
 
 	return true;
 }
 
 SInt64 SFB::HTTPInputSource::_Read(void *buffer, SInt64 byteCount)
 {
-	CFStreamStatus status = CFReadStreamGetStatus(mReadStream);
-		
-	if(kCFStreamStatusAtEnd == status)
-		return 0;
-	else if(kCFStreamStatusNotOpen == status || kCFStreamStatusClosed == status || kCFStreamStatusError == status)
-		return -1;
+	UInt8 *bytes = static_cast<UInt8 *>(buffer);
+	SInt64 totalBytesRead = 0;
+	bool reopened = false;
 
-	CFIndex bytesRead = CFReadStreamRead(mReadStream, (UInt8 *)buffer, (CFIndex)byteCount);
+	while(totalBytesRead < byteCount && !mEOSReached) {
+		bool success = true;
 
-	mOffset += bytesRead;
+		if(!mResponseInProgress) {
+			if(mRequestedOffsets.empty())
+				success = FillPipeline(nullptr);
 
-	return bytesRead;
-}
+			if(success && mRequestedOffsets.empty()) {
+				mEOSReached = true;
+				break;
+			}
 
-SInt64 SFB::HTTPInputSource::_GetLength() const
-{
-	if(!mResponseHeaders)
-		return -1;
+			if(success)
+				success = BeginResponse(nullptr);
+		}
+		else {
+			SInt64 bytesRead = mConnection->ReadResponseBody(bytes + totalBytesRead, byteCount - totalBytesRead);
+			if(0 > bytesRead)
+				success = false;
+			else {
+				totalBytesRead += bytesRead;
+				mOffset += bytesRead;
+
+				if(!mConnection->IsReadingResponseBody()) {
+					mResponseInProgress = false;
+					mRequestedOffsets.pop_front();
+
+					if(!mRangeRequestsSupported || (-1 != mLength && mOffset >= mLength))
+						mEOSReached = true;
+					// Keep the pipeline full; errors surface when the next response is read
+					else
+						FillPipeline(nullptr);
+				}
+			}
+		}
 
-	SInt64 contentLength = -1;
+		// Resume from the current offset on a new connection if the existing one failed
+		if(!success) {
+			if(reopened || !ReopenConnection(nullptr))
+				return 0 < totalBytesRead ? totalBytesRead : -1;
 
-	// FIXME: 64-bit lengths aren't handled correctly
-	CFStringRef contentLengthString = reinterpret_cast<CFStringRef>(CFDictionaryGetValue(mResponseHeaders, CFSTR("Content-Length")));
-	if(contentLengthString)
-		contentLength = CFStringGetIntValue(contentLengthString);
+			LOGGER_INFO("org.sbooth.AudioEngine.InputSource.HTTP", "Reopened connection for " << GetURL() << " at offset " << mOffset);
+			reopened = true;
+		}
+	}
 
-	return contentLength;
+	return totalBytesRead;
 }
 
 bool SFB::HTTPInputSource::_SeekToOffset(SInt64 offset)
 {
-	if(!_Close(nullptr))
+	if(offset == mOffset)
+		return true;
+
+	if(!mRangeRequestsSupported || 0 > offset || (-1 != mLength && offset > mLength))
 		return false;
 
-	mDesiredOffset = offset;
-	return _Open(nullptr);
+	// Short forward seeks read through data that has already been requested
+	if(offset > mOffset && MAXIMUM_DISCARD_SIZE_BYTES >= offset - mOffset && !mRequestedOffsets.empty() && offset < mNextRequestOffset) {
+		UInt8 buffer [4096];
+		while(mOffset < offset) {
+			if(0 >= _Read(buffer, std::min((SInt64)sizeof(buffer), offset - mOffset)))
+				break;
+		}
+
+		if(offset == mOffset)
+			return true;
+	}
+
+	AbandonResponses();
+
+	mOffset = offset;
+	mNextRequestOffset = offset;
+	mEOSReached = -1 != mLength && offset == mLength;
+
+	if(mEOSReached)
+		return true;
+
+	return FillPipeline(nullptr);
 }
 
 CFStringRef SFB::HTTPInputSource::CopyContentMIMEType() const
@@ -169,32 +188,186 @@ CFStringRef SFB::HTTPInputSource::CopyContentMIMEType() const
 	return reinterpret_cast<CFStringRef>(CFDictionaryGetValue(mResponseHeaders, CFSTR("Content-Type")));
 }
 
-void SFB::HTTPInputSource::HandleNetworkEvent(CFReadStreamRef stream, CFStreamEventType type)
+#pragma mark Range Requests
+
+bool SFB::HTTPInputSource::FillPipeline(CFErrorRef *error)
 {
-	switch(type) {
-		case kCFStreamEventOpenCompleted:
-			mOffset = mDesiredOffset;
-			break;
+	if(!mRangeRequestsSupported)
+		return true;
 
-		case kCFStreamEventHasBytesAvailable:
-			if(nullptr == mResponseHeaders) {
-				SFB::CFType responseHeader = CFReadStreamCopyProperty(stream, kCFStreamPropertyHTTPResponseHeader);
-				if(responseHeader) {
-					mResponseHeaders = CFHTTPMessageCopyAllHeaderFields((CFHTTPMessageRef)responseHeader.Object());
-				}
-			}
+	// A connection that won't accept more requests is replaced once its responses have been read
+	if(mConnection && mRequestedOffsets.empty() && !mConnection->IsReusable())
+		mConnection.reset();
+
+	if(!mConnection) {
+		mConnection = HTTPConnectionPool::GetSharedPool().AcquireConnection(GetURL(), error);
+		if(!mConnection)
+			return false;
+
+		mConnectionReused = 0 < mConnection->GetRequestCount();
+	}
+
+	size_t pipelineDepth = HTTPConnectionPool::GetSharedPool().GetMaximumPipelineDepth();
+
+	while(mRequestedOffsets.size() < pipelineDepth && mConnection->CanSendRequest()) {
+		// Only one request is outstanding until the length of the resource is known
+		if(-1 == mLength && !mRequestedOffsets.empty())
 			break;
-		
-		case kCFStreamEventErrorOccurred:
-		{
-			SFB::CFError error = CFReadStreamCopyError(stream);
-			if(error)
-				LOGGER_ERR("org.sbooth.AudioEngine.InputSource.HTTP", "Error: " << error);
+		else if(-1 != mLength && mNextRequestOffset >= mLength)
 			break;
+
+		if(!SendRangeRequest(mNextRequestOffset, error))
+			return false;
+
+		mRequestedOffsets.push_back(mNextRequestOffset);
+		mNextRequestOffset += RANGE_REQUEST_SIZE_BYTES;
+	}
+
+	return true;
+}
+
+bool SFB::HTTPInputSource::SendRangeRequest(SInt64 offset, CFErrorRef *error)
+{
+	SFB::CFHTTPMessage request = CFHTTPMessageCreateRequest(kCFAllocatorDefault, CFSTR("GET"), GetURL(), kCFHTTPVersion1_1);
+	if(!request) {
+		if(error)
+			*error = CFErrorCreate(kCFAllocatorDefault, kCFErrorDomainPOSIX, ENOMEM, nullptr);
+		return false;
+	}
+
+	CFHTTPMessageSetHeaderFieldValue(request, CFSTR("User-Agent"), CFSTR("SFBAudioEngine"));
+
+	SInt64 lastByte = offset + RANGE_REQUEST_SIZE_BYTES - 1;
+	if(-1 != mLength)
+		lastByte = std::min(lastByte, mLength - 1);
+
+	SFB::CFString byteRange = CFStringCreateWithFormat(kCFAllocatorDefault, nullptr, CFSTR("bytes=%lld-%lld"), offset, lastByte);
+	CFHTTPMessageSetHeaderFieldValue(request, CFSTR("Range"), byteRange);
+
+	return mConnection->SendRequest(request, error);
+}
+
+bool SFB::HTTPInputSource::BeginResponse(CFErrorRef *error)
+{
+	if(!mConnection || mRequestedOffsets.empty())
+		return false;
+
+	SFB::CFHTTPMessage response = mConnection->CopyNextResponseHeader(error);
+	if(!response)
+		return false;
+
+	SInt64 requestedOffset = mRequestedOffsets.front();
+	CFIndex statusCode = CFHTTPMessageGetResponseStatusCode(response);
+
+	mResponseHeaders = CFHTTPMessageCopyAllHeaderFields(response);
+
+	// Partial content: Content-Range is "bytes first-last/complete-length" with an optional unknown length
+	if(206 == statusCode) {
+		SFB::CFString contentRange = CFHTTPMessageCopyHeaderFieldValue(response, CFSTR("Content-Range"));
+
+		char buf [128];
+		long long first = -1, last = -1, completeLength = -1;
+		if(!contentRange || !CFStringGetCString(contentRange, buf, sizeof(buf), kCFStringEncodingASCII) || 2 > sscanf(buf, "bytes %lld-%lld/%lld", &first, &last, &completeLength) || first != requestedOffset) {
+			LOGGER_ERR("org.sbooth.AudioEngine.InputSource.HTTP", "Unexpected Content-Range for " << GetURL() << ": " << contentRange);
+			if(error)
+				*error = CFErrorCreate(kCFAllocatorDefault, kCFErrorDomainPOSIX, EBADMSG, nullptr);
+			return false;
 		}
 
-		case kCFStreamEventEndEncountered:
+		if(-1 != completeLength)
+			mLength = completeLength;
+	}
+	// The server ignored the range and returned the entire resource
+	else if(200 == statusCode) {
+		if(0 != requestedOffset || 1 != mRequestedOffsets.size()) {
+			LOGGER_ERR("org.sbooth.AudioEngine.InputSource.HTTP", "Server ignored range request for " << GetURL());
+			if(error)
+				*error = CFErrorCreate(kCFAllocatorDefault, kCFErrorDomainPOSIX, EBADMSG, nullptr);
+			return false;
+		}
+
+		mRangeRequestsSupported = false;
+		mLength = mConnection->GetResponseBodyBytesRemaining();
+	}
+	// The requested offset is at or beyond the end of the resource
+	else if(416 == statusCode) {
+		mConnection->DiscardResponseBody(MAXIMUM_DISCARD_SIZE_BYTES);
+		mRequestedOffsets.pop_front();
+		AbandonResponses();
+		mEOSReached = true;
+		return true;
+	}
+	else {
+		if(error) {
+			SFB::CFString description = CFCopyLocalizedString(CFSTR("The file “%@” could not be read from the server."), "");
+			SFB::CFString failureReason = CFStringCreateWithFormat(kCFAllocatorDefault, nullptr, CFSTR("HTTP status %ld"), (long)statusCode);
+			SFB::CFString recoverySuggestion = CFCopyLocalizedString(CFSTR("The file may have been moved or the server may be unavailable."), "");
+
+			*error = CreateErrorForURL(InputSource::ErrorDomain, InputSource::InputOutputError, description, GetURL(), failureReason, recoverySuggestion);
+		}
+
+		return false;
+	}
+
+	mResponseInProgress = mConnection->IsReadingResponseBody();
+
+	// An empty body completes the response immediately
+	if(!mResponseInProgress) {
+		mRequestedOffsets.pop_front();
+		if(-1 != mLength && mOffset >= mLength)
 			mEOSReached = true;
-			break;
 	}
+
+	// Request the following range while this one is read
+	return FillPipeline(error);
+}
+
+bool SFB::HTTPInputSource::ReopenConnection(CFErrorRef *error)
+{
+	if(!mRangeRequestsSupported && 0 != mOffset)
+		return false;
+
+	mConnection = HTTPConnectionPool::GetSharedPool().OpenConnection(GetURL(), error);
+	mConnectionReused = false;
+	mRequestedOffsets.clear();
+	mResponseInProgress = false;
+	mNextRequestOffset = mOffset;
+
+	if(!mConnection)
+		return false;
+
+	mRangeRequestsSupported = true;
+	return FillPipeline(error);
+}
+
+void SFB::HTTPInputSource::AbandonResponses()
+{
+	if(!mConnection || mRequestedOffsets.empty()) {
+		mRequestedOffsets.clear();
+		mResponseInProgress = false;
+		return;
+	}
+
+	// Reading the remaining responses is usually cheaper than establishing a new connection
+	SInt64 bytesOutstanding = (SInt64)(mRequestedOffsets.size() - (mResponseInProgress ? 1 : 0)) * RANGE_REQUEST_SIZE_BYTES;
+	if(mResponseInProgress) {
+		SInt64 bytesRemaining = mConnection->GetResponseBodyBytesRemaining();
+		bytesOutstanding = -1 == bytesRemaining ? MAXIMUM_DISCARD_SIZE_BYTES + 1 : bytesOutstanding + bytesRemaining;
+	}
+
+	bool drained = MAXIMUM_DISCARD_SIZE_BYTES >= bytesOutstanding;
+
+	if(drained && mResponseInProgress)
+		drained = mConnection->DiscardResponseBody(MAXIMUM_DISCARD_SIZE_BYTES);
+
+	while(drained && 0 < mConnection->GetPendingResponseCount()) {
+		SFB::CFHTTPMessage response = mConnection->CopyNextResponseHeader(nullptr);
+		drained = response && mConnection->DiscardResponseBody(MAXIMUM_DISCARD_SIZE_BYTES);
+	}
+
+	if(!drained)
+		mConnection.reset();
+
+	mRequestedOffsets.clear();
+	mResponseInProgress = false;
 }
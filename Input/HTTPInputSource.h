@@ -30,6 +30,8 @@
 
 #pragma once
 
+#include <deque>
+
 #include <CoreFoundation/CoreFoundation.h>
 
 #if TARGET_OS_IPHONE
@@ -39,9 +41,14 @@
 #endif
 
 #include "InputSource.h"
+#include "HTTPConnectionPool.h"
 
 namespace SFB {
 
+	// ========================================
+	// An InputSource that reads a URL using HTTP range requests
+	// Connections are obtained from the shared HTTPConnectionPool and successive ranges are pipelined,
+	// so sequential tracks and seeks on the same host reuse persistent connections
 	class HTTPInputSource : public InputSource
 	{
 
@@ -61,26 +68,38 @@ namespace SFB {
 		inline virtual bool _AtEOF()	const					{ return mEOSReached; }
 
 		inline virtual SInt64 _GetOffset() const				{ return mOffset; }
-		virtual SInt64 _GetLength() const;
+		inline virtual SInt64 _GetLength() const				{ return mLength; }
 
 		// Seeking support
-		inline virtual bool _SupportsSeeking() const			{ return true; }
+		inline virtual bool _SupportsSeeking() const			{ return mRangeRequestsSupported; }
 		virtual bool _SeekToOffset(SInt64 offset);
 
+		// Reads wait on the server
+		inline virtual bool _MayBlock() const					{ return true; }
+
+		// Cloning support; clones use their own connections from the pool
+		inline virtual unique_ptr _Clone() const				{ return unique_ptr(new HTTPInputSource(GetURL())); }
+
 		CFStringRef CopyContentMIMEType() const;
 
+		// Range request management
+		bool FillPipeline(CFErrorRef *error);
+		bool SendRangeRequest(SInt64 offset, CFErrorRef *error);
+		bool BeginResponse(CFErrorRef *error);
+		bool ReopenConnection(CFErrorRef *error);
+		void AbandonResponses();
+
 		// Data members
-		SFB::CFHTTPMessage				mRequest;
-		SFB::CFReadStream				mReadStream;
+		HTTPConnection::unique_ptr		mConnection;
+		bool							mConnectionReused;
+		std::deque<SInt64>				mRequestedOffsets;
+		SInt64							mNextRequestOffset;
+		bool							mResponseInProgress;
 		SFB::CFDictionary				mResponseHeaders;
+		bool							mRangeRequestsSupported;
 		bool							mEOSReached;
 		SInt64							mOffset;
-		SInt64							mDesiredOffset;
-
-	public:
-
-		// Callbacks- for internal use only
-		void HandleNetworkEvent(CFReadStreamRef stream, CFStreamEventType type);
+		SInt64							mLength;
 	};
 
-}
\ No newline at end of file
+}
@@ -42,6 +42,12 @@ SFB::InMemoryFileInputSource::InMemoryFileInputSource(CFURLRef url)
 
 bool SFB::InMemoryFileInputSource::_Open(CFErrorRef *error)
 {
+	// Clones of an open input source already have the file's contents
+	if(mMemory) {
+		mCurrentPosition = mMemory.get();
+		return true;
+	}
+
 	typedef std::unique_ptr<std::FILE, std::function<int(std::FILE *)>> unique_FILE_ptr;
 
 	UInt8 buf [PATH_MAX];
@@ -66,7 +72,7 @@ bool SFB::InMemoryFileInputSource::_Open(CFErrorRef *error)
 	}
 
 	// Perform the allocation
-	mMemory = std::unique_ptr<int8_t []>(new int8_t [mFilestats.st_size]);
+	mMemory = std::shared_ptr<int8_t>(new int8_t [mFilestats.st_size], std::default_delete<int8_t []>());
 	if(!mMemory) {
 		if(error)
 			*error = CFErrorCreate(kCFAllocatorDefault, kCFErrorDomainPOSIX, errno, nullptr);
@@ -95,6 +101,16 @@ bool SFB::InMemoryFileInputSource::_Close(CFErrorRef */*error*/)
 	return true;
 }
 
+SFB::InputSource::unique_ptr SFB::InMemoryFileInputSource::_Clone() const
+{
+	auto inputSource = new InMemoryFileInputSource(GetURL());
+
+	inputSource->mFilestats = mFilestats;
+	inputSource->mMemory = mMemory;
+
+	return unique_ptr(inputSource);
+}
+
 SInt64 SFB::InMemoryFileInputSource::_Read(void *buffer, SInt64 byteCount)
 {
 	ptrdiff_t remaining = (mMemory.get() + mFilestats.st_size) - mCurrentPosition;
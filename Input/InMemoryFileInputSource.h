@@ -67,9 +67,15 @@ namespace SFB {
 		inline virtual bool _SupportsSeeking() const			{ return true; }
 		virtual bool _SeekToOffset(SInt64 offset);
 
+		// In-memory access
+		inline virtual const void * _GetBytes() const			{ return mMemory.get(); }
+
+		// Cloning support; clones share the file's contents
+		virtual unique_ptr _Clone() const;
+
 		// Data members
 		struct stat						mFilestats;
-		std::unique_ptr<int8_t []>		mMemory;
+		std::shared_ptr<int8_t>			mMemory;
 		int8_t							*mCurrentPosition;
 	};
 
@@ -28,11 +28,14 @@
  *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <chrono>
+
 #include "InputSource.h"
 #include "FileInputSource.h"
 #include "MemoryMappedFileInputSource.h"
 #include "InMemoryFileInputSource.h"
 #include "HTTPInputSource.h"
+#include "DataInputSource.h"
 #include "CFWrapper.h"
 #include "Logger.h"
 
@@ -41,6 +44,15 @@
 // ========================================
 const CFStringRef SFB::InputSource::ErrorDomain = CFSTR("org.sbooth.AudioEngine.ErrorDomain.InputSource");
 
+namespace {
+
+	inline CFTimeInterval ConvertNanosecondsToSeconds(UInt64 nanoseconds)
+	{
+		return nanoseconds / 1000000000.0;
+	}
+
+}
+
 #pragma mark Static Methods
 
 SFB::InputSource::unique_ptr SFB::InputSource::CreateInputSourceForURL(CFURLRef url, int flags, CFErrorRef *error)
@@ -64,23 +76,53 @@ SFB::InputSource::unique_ptr SFB::InputSource::CreateInputSourceForURL(CFURLRef
 		else
 			return unique_ptr(new FileInputSource(url));
 	}
-	else if(kCFCompareEqualTo == CFStringCompare(CFSTR("http"), scheme, kCFCompareCaseInsensitive))
+	else if(kCFCompareEqualTo == CFStringCompare(CFSTR("http"), scheme, kCFCompareCaseInsensitive) || kCFCompareEqualTo == CFStringCompare(CFSTR("https"), scheme, kCFCompareCaseInsensitive))
 		return unique_ptr(new HTTPInputSource(url));
 
 	return nullptr;
 }
 
+SFB::InputSource::unique_ptr SFB::InputSource::CreateInputSourceForBytes(const void *bytes, SInt64 byteCount, std::function<void(const void *)> deleter, CFURLRef url)
+{
+	if(nullptr == bytes || 0 > byteCount)
+		return nullptr;
+
+	return unique_ptr(new DataInputSource(bytes, byteCount, deleter, url));
+}
+
+SFB::InputSource::unique_ptr SFB::InputSource::CreateInputSourceForData(CFDataRef data, CFURLRef url)
+{
+	if(nullptr == data)
+		return nullptr;
+
+	CFRetain(data);
+	return unique_ptr(new DataInputSource(CFDataGetBytePtr(data), CFDataGetLength(data), [data](const void *) { CFRelease(data); }, url));
+}
+
+SFB::InputSource::unique_ptr SFB::InputSource::Clone(CFErrorRef *error) const
+{
+	auto inputSource = _Clone();
+	if(!inputSource) {
+		if(error)
+			*error = CFErrorCreate(kCFAllocatorDefault, kCFErrorDomainPOSIX, ENOTSUP, nullptr);
+		return nullptr;
+	}
+
+	if(IsOpen() && !inputSource->Open(error))
+		return nullptr;
+
+	return inputSource;
+}
+
 #pragma mark Creation and Destruction
 
 SFB::InputSource::InputSource()
-	: mURL(nullptr), mIsOpen(false)
+	: mURL(nullptr), mIsOpen(false), mBytesRead(0), mReadCount(0), mSeekCount(0), mReadNanoseconds(0), mSeekNanoseconds(0), mTracingEnabled(false), mTraceCapacity(0)
 {}
 
 SFB::InputSource::InputSource(CFURLRef url)
-	: mURL((CFURLRef)CFRetain(url)), mIsOpen(false)
-{
-	assert(nullptr != url);
-}
+	: mURL(url ? (CFURLRef)CFRetain(url) : nullptr), mIsOpen(false), mBytesRead(0), mReadCount(0), mSeekCount(0), mReadNanoseconds(0), mSeekNanoseconds(0), mTracingEnabled(false), mTraceCapacity(0)
+{}
 
 bool SFB::InputSource::Open(CFErrorRef *error)
 {
@@ -103,8 +145,11 @@ bool SFB::InputSource::Close(CFErrorRef *error)
 	}
 
 	bool result = _Close(error);
-	if(result)
+	if(result) {
 		mIsOpen = false;
+
+		LOGGER_DEBUG("org.sbooth.AudioEngine.InputSource", "I/O statistics for " << mURL << ": " << mBytesRead << " bytes in " << mReadCount << " reads, " << mSeekCount << " seeks, " << ((mReadNanoseconds + mSeekNanoseconds) / 1000000) << " ms blocked");
+	}
 	return result;
 }
 
@@ -115,7 +160,22 @@ SInt64 SFB::InputSource::Read(void *buffer, SInt64 byteCount)
 		return -1;
 	}
 
-	return _Read(buffer, byteCount);
+	SInt64 offset = mTracingEnabled ? _GetOffset() : -1;
+	auto start = std::chrono::steady_clock::now();
+
+	SInt64 bytesRead = _Read(buffer, byteCount);
+
+	UInt64 nanoseconds = (UInt64)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+	++mReadCount;
+	mReadNanoseconds += nanoseconds;
+	if(0 < bytesRead)
+		mBytesRead += (UInt64)bytesRead;
+
+	if(mTracingEnabled)
+		AddTraceRecord({ TraceRecord::Operation::Read, offset, byteCount, bytesRead, ConvertNanosecondsToSeconds(nanoseconds) });
+
+	return bytesRead;
 }
 
 bool SFB::InputSource::AtEOF() const
@@ -148,6 +208,21 @@ SInt64 SFB::InputSource::GetLength() const
 	return _GetLength();
 }
 
+const void * SFB::InputSource::GetBytes() const
+{
+	if(!IsOpen()) {
+		LOGGER_WARNING("org.sbooth.AudioEngine.InputSource", "GetBytes() called on an InputSource that hasn't been opened");
+		return nullptr;
+	}
+
+	return _GetBytes();
+}
+
+bool SFB::InputSource::MayBlock() const
+{
+	return _MayBlock();
+}
+
 bool SFB::InputSource::SupportsSeeking() const
 {
 	if(!IsOpen()) {
@@ -165,5 +240,76 @@ bool SFB::InputSource::SeekToOffset(SInt64 offset)
 		return false;
 	}
 
-	return _SeekToOffset(offset);
+	SInt64 currentOffset = mTracingEnabled ? _GetOffset() : -1;
+	auto start = std::chrono::steady_clock::now();
+
+	bool result = _SeekToOffset(offset);
+
+	UInt64 nanoseconds = (UInt64)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+	++mSeekCount;
+	mSeekNanoseconds += nanoseconds;
+
+	if(mTracingEnabled)
+		AddTraceRecord({ TraceRecord::Operation::Seek, currentOffset, offset, result ? 1 : 0, ConvertNanosecondsToSeconds(nanoseconds) });
+
+	return result;
+}
+
+#pragma mark I/O Accounting
+
+SFB::InputSource::Statistics SFB::InputSource::GetStatistics() const
+{
+	Statistics statistics = {
+		.mBytesRead = mBytesRead,
+		.mReadCount = mReadCount,
+		.mSeekCount = mSeekCount,
+		.mTimeBlockedReading = ConvertNanosecondsToSeconds(mReadNanoseconds),
+		.mTimeBlockedSeeking = ConvertNanosecondsToSeconds(mSeekNanoseconds)
+	};
+
+	return statistics;
+}
+
+void SFB::InputSource::ResetStatistics()
+{
+	mBytesRead = 0;
+	mReadCount = 0;
+	mSeekCount = 0;
+	mReadNanoseconds = 0;
+	mSeekNanoseconds = 0;
+}
+
+void SFB::InputSource::SetTracingEnabled(bool enabled, size_t capacity)
+{
+	std::lock_guard<std::mutex> lock(mTraceMutex);
+
+	mTraceCapacity = capacity;
+	while(mTraceRecords.size() > mTraceCapacity)
+		mTraceRecords.pop_front();
+
+	mTracingEnabled = enabled && 0 < capacity;
+}
+
+std::vector<SFB::InputSource::TraceRecord> SFB::InputSource::GetTraceRecords() const
+{
+	std::lock_guard<std::mutex> lock(mTraceMutex);
+	return std::vector<TraceRecord>(mTraceRecords.begin(), mTraceRecords.end());
+}
+
+void SFB::InputSource::ClearTraceRecords()
+{
+	std::lock_guard<std::mutex> lock(mTraceMutex);
+	mTraceRecords.clear();
+}
+
+void SFB::InputSource::AddTraceRecord(const TraceRecord& record)
+{
+	std::lock_guard<std::mutex> lock(mTraceMutex);
+
+	if(mTraceRecords.size() >= mTraceCapacity && !mTraceRecords.empty())
+		mTraceRecords.pop_front();
+
+	if(0 < mTraceCapacity)
+		mTraceRecords.push_back(record);
 }
@@ -31,6 +31,11 @@
 #pragma once
 
 #include <memory>
+#include <functional>
+#include <atomic>
+#include <mutex>
+#include <deque>
+#include <vector>
 
 #include <CoreFoundation/CoreFoundation.h>
 
@@ -80,6 +85,38 @@ namespace SFB {
 		 */
 		static unique_ptr CreateInputSourceForURL(CFURLRef url, int flags = 0, CFErrorRef *error = nullptr);
 
+		/*!
+		 * Create a new \c InputSource reading directly from a buffer in memory
+		 *
+		 * The bytes are not copied, so the buffer must remain valid for the lifetime of the returned object.
+		 * Since the input has no inherent type, decoders for it are usually located by signature or with an explicit MIME type.
+		 * @param bytes The buffer
+		 * @param byteCount The size of \c bytes, in bytes
+		 * @param deleter An optional function invoked with \c bytes when the returned object is destroyed
+		 * @param url An optional URL identifying the data, used in error messages and to determine the file extension
+		 * @return An \c InputSource for the buffer, or \c nullptr on failure
+		 */
+		static unique_ptr CreateInputSourceForBytes(const void *bytes, SInt64 byteCount, std::function<void(const void *)> deleter = nullptr, CFURLRef url = nullptr);
+
+		/*!
+		 * Create a new \c InputSource reading directly from a \c CFDataRef
+		 * @note \c data is retained, not copied
+		 * @param data The data
+		 * @param url An optional URL identifying the data, used in error messages and to determine the file extension
+		 * @return An \c InputSource for the data, or \c nullptr on failure
+		 */
+		static unique_ptr CreateInputSourceForData(CFDataRef data, CFURLRef url = nullptr);
+
+		/*!
+		 * Create a new \c InputSource reading the same bytes as this one with an independent offset
+		 *
+		 * Contents resident in memory are shared with the clone instead of being loaded again.
+		 * If this input source is open the clone is opened as well.
+		 * @param error An optional pointer to a \c CFErrorRef to receive error information
+		 * @return A new \c InputSource, or \c nullptr if this input source can't be cloned or on failure
+		 */
+		unique_ptr Clone(CFErrorRef *error = nullptr) const;
+
 		//@}
 
 
@@ -170,6 +207,90 @@ namespace SFB {
 		 */
 		bool SeekToOffset(SInt64 offset);
 
+		/*!
+		 * @brief Get a pointer to the input's contents if they are resident in memory
+		 *
+		 * Inputs backed by memory-mapped files, files loaded in memory and in-memory buffers expose their bytes
+		 * so readers can use them in place instead of copying them with \c Read().
+		 * @note The bytes remain valid while the input is open
+		 * @return A pointer to \c GetLength() bytes, or \c nullptr if the contents are not in memory
+		 */
+		const void * GetBytes() const;
+
+		/*!
+		 * @brief Query whether Read() may block waiting on a remote peer
+		 *
+		 * Reads from local files and memory complete promptly, but reads from network inputs can stall for
+		 * arbitrarily long.  Schedulers use this to keep stalled inputs from delaying other work.
+		 * @see Audio::DecoderScheduler
+		 */
+		bool MayBlock() const;
+
+		//@}
+
+
+		// ========================================
+		/*!
+		 * @name I/O accounting
+		 * Every call to Read() and SeekToOffset() is counted and timed, which helps determine whether
+		 * decoding is limited by the CPU or by I/O.  Per-call trace records are optional since they consume memory.
+		 */
+		//@{
+
+		/*! @brief Cumulative I/O statistics for an \c InputSource */
+		struct Statistics
+		{
+			UInt64 mBytesRead;					/*!< @brief The total number of bytes read */
+			UInt64 mReadCount;					/*!< @brief The number of calls to Read() */
+			UInt64 mSeekCount;					/*!< @brief The number of calls to SeekToOffset() */
+			CFTimeInterval mTimeBlockedReading;	/*!< @brief The time spent in Read(), in seconds */
+			CFTimeInterval mTimeBlockedSeeking;	/*!< @brief The time spent in SeekToOffset(), in seconds */
+
+			/*! @brief Get the average number of bytes returned per call to Read() */
+			inline double GetAverageReadSize() const		{ return 0 < mReadCount ? (double)mBytesRead / mReadCount : 0; }
+
+			/*! @brief Get the total time spent blocked in I/O, in seconds */
+			inline CFTimeInterval GetTimeBlocked() const	{ return mTimeBlockedReading + mTimeBlockedSeeking; }
+		};
+
+		/*! @brief A record of a single call to Read() or SeekToOffset() */
+		struct TraceRecord
+		{
+			/*! @brief The traced operation */
+			enum class Operation {
+				Read,							/*!< Read() */
+				Seek							/*!< SeekToOffset() */
+			};
+
+			Operation mOperation;				/*!< @brief The operation */
+			SInt64 mOffset;						/*!< @brief The offset before the operation */
+			SInt64 mArgument;					/*!< @brief The requested byte count for reads, or the desired offset for seeks */
+			SInt64 mResult;						/*!< @brief The number of bytes read for reads, or \c 1 or \c 0 indicating success for seeks */
+			CFTimeInterval mDuration;			/*!< @brief The time spent in the operation, in seconds */
+		};
+
+		/*! @brief Get a snapshot of the I/O statistics */
+		Statistics GetStatistics() const;
+
+		/*! @brief Reset the I/O statistics */
+		void ResetStatistics();
+
+		/*! @brief Query whether per-call trace records are collected */
+		inline bool IsTracingEnabled() const						{ return mTracingEnabled; }
+
+		/*!
+		 * @brief Enable or disable collection of per-call trace records
+		 * @param enabled Whether to collect trace records
+		 * @param capacity The maximum number of records retained; older records are discarded first
+		 */
+		void SetTracingEnabled(bool enabled, size_t capacity = 4096);
+
+		/*! @brief Get a copy of the collected trace records, oldest first */
+		std::vector<TraceRecord> GetTraceRecords() const;
+
+		/*! @brief Discard the collected trace records */
+		void ClearTraceRecords();
+
 		//@}
 
 	protected:
@@ -177,7 +298,7 @@ namespace SFB {
 		/*! @brief Create a new \c InputSource and initialize \c InputSource::mURL to \c nullptr */
 		InputSource();
 		
-		/*! @brief Create a new \c InputSource and initialize \c InputSource::mURL to \c url */
+		/*! @brief Create a new \c InputSource and initialize \c InputSource::mURL to \c url, which may be \c nullptr */
 		InputSource(CFURLRef url);
 
 	private:
@@ -194,10 +315,33 @@ namespace SFB {
 		virtual bool _SupportsSeeking() const					{ return false; }
 		virtual bool _SeekToOffset(SInt64 offset)				{ return false; }
 
+		// Optional in-memory access
+		virtual const void * _GetBytes() const					{ return nullptr; }
+
+		// Optional indication that reads may stall on the network
+		virtual bool _MayBlock() const							{ return false; }
+
+		// Optional cloning support; returns an unopened input source for the same bytes
+		virtual unique_ptr _Clone() const						{ return nullptr; }
+
+		void AddTraceRecord(const TraceRecord& record);
+
 		// Data members
 		SFB::CFURL mURL;	/*!< @brief The location of the bytes to be read */
 		bool mIsOpen;		/*!< @brief Indicates if input is open */
 
+		// I/O accounting; durations are in nanoseconds
+		std::atomic<UInt64>			mBytesRead;
+		std::atomic<UInt64>			mReadCount;
+		std::atomic<UInt64>			mSeekCount;
+		std::atomic<UInt64>			mReadNanoseconds;
+		std::atomic<UInt64>			mSeekNanoseconds;
+
+		std::atomic_bool			mTracingEnabled;
+		size_t						mTraceCapacity;
+		std::deque<TraceRecord>		mTraceRecords;
+		mutable std::mutex			mTraceMutex;
+
 	};
 
 }
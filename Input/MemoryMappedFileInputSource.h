@@ -65,6 +65,12 @@ namespace SFB {
 		inline virtual bool _SupportsSeeking() const			{ return true; }
 		virtual bool _SeekToOffset(SInt64 offset);
 
+		// In-memory access
+		inline virtual const void * _GetBytes() const			{ return mMemory.get(); }
+
+		// Cloning support; mapping the file again shares its pages
+		inline virtual unique_ptr _Clone() const				{ return unique_ptr(new MemoryMappedFileInputSource(GetURL())); }
+
 		typedef std::unique_ptr<int8_t, std::function<int(int8_t *)>> unique_mappedmem_ptr;
 
 		// Data members
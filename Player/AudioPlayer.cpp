@@ -228,10 +228,23 @@ namespace {
 			ioData->mBuffers[bufferIndex] = decoderStateData->mBufferList->mBuffers[bufferIndex];
 
 		*ioNumberDataPackets = framesRead;
-		
+
 		return noErr;
 	}
 
+	// ========================================
+	// Returns true if audio in sourceFormat may be written to the ring buffer without conversion
+	bool formatsAreIdentical(const AudioStreamBasicDescription& sourceFormat, const AudioStreamBasicDescription& destinationFormat)
+	{
+		return sourceFormat.mFormatID == destinationFormat.mFormatID
+			&& sourceFormat.mFormatFlags == destinationFormat.mFormatFlags
+			&& sourceFormat.mSampleRate == destinationFormat.mSampleRate
+			&& sourceFormat.mChannelsPerFrame == destinationFormat.mChannelsPerFrame
+			&& sourceFormat.mBitsPerChannel == destinationFormat.mBitsPerChannel
+			&& sourceFormat.mBytesPerFrame == destinationFormat.mBytesPerFrame
+			&& sourceFormat.mFramesPerPacket == destinationFormat.mFramesPerPacket;
+	}
+
 }
 
 #pragma mark Creation/Destruction
@@ -1606,6 +1619,8 @@ bool SFB::Audio::Player::Enqueue(Decoder::unique_ptr& decoder)
 	// Take ownership of the decoder and add it to the queue
 	mDecoderQueue.push_back(std::move(decoder));
 
+	WarmUpcomingDecoders();
+
 	mDecoderSemaphore.Signal();
 	
 	return true;
@@ -1667,6 +1682,8 @@ bool SFB::Audio::Player::ClearQueuedDecoders()
 
 	mDecoderQueue.clear();
 
+	WarmUpcomingDecoders();
+
 	return true;
 }
 
@@ -1885,12 +1902,18 @@ void * SFB::Audio::Player::DecoderThreadEntry()
 					auto iter = std::begin(mDecoderQueue);
 					decoder = std::move(*iter);
 					mDecoderQueue.erase(iter);
+
+					WarmUpcomingDecoders();
 				}
 			}
 
 			// ========================================
 			// Open the decoder if necessary
 			if(decoder && !decoder->IsOpen()) {
+				// Decoders able to produce float output can then bypass the AudioConverter
+				if(kAudioFormatFlagIsFloat & mRingBufferFormat.mFormatFlags)
+					decoder->SetPrefersFloatOutput(true);
+
 				CFErrorRef error = nullptr;
 				if(!decoder->Open(&error))  {
 					if(error) {
@@ -1994,8 +2017,14 @@ void * SFB::Audio::Player::DecoderThreadEntry()
 
 			// ========================================
 			// Create the AudioConverter which will convert from the decoder's format to the graph's format
+			// If the decoder already produces audio in the graph's format no conversion is necessary
 			AudioConverterRef audioConverter = nullptr;
-			OSStatus result = AudioConverterNew(&decoderFormat, &mRingBufferFormat, &audioConverter);
+			OSStatus result = noErr;
+			if(!formatsAreIdentical(decoderFormat, mRingBufferFormat))
+				result = AudioConverterNew(&decoderFormat, &mRingBufferFormat, &audioConverter);
+			else
+				LOGGER_INFO("org.sbooth.AudioEngine.Player", "Decoder format matches ring buffer format; bypassing AudioConverter");
+
 			if(noErr != result) {
 				LOGGER_ERR("org.sbooth.AudioEngine.Player", "AudioConverterNew failed: " << result);
 
@@ -2012,14 +2041,16 @@ void * SFB::Audio::Player::DecoderThreadEntry()
 			// ========================================
 			// Allocate the buffer lists which will serve as the transport between the decoder and the ring buffer
 			UInt32 inputBufferSize = mRingBufferWriteChunkSize * mRingBufferFormat.mBytesPerFrame;
-			UInt32 dataSize = sizeof(inputBufferSize);
-			result = AudioConverterGetProperty(audioConverter, kAudioConverterPropertyCalculateInputBufferSize, &dataSize, &inputBufferSize);
-			if(noErr != result)
-				LOGGER_ERR("org.sbooth.AudioEngine.Player", "AudioConverterGetProperty (kAudioConverterPropertyCalculateInputBufferSize) failed: " << result);
-			
-			// ========================================
-			// Allocate the buffer lists which will serve as the transport between the decoder and the ring buffer			
-			decoderState->AllocateBufferList(inputBufferSize / decoderFormat.mBytesPerFrame);
+			if(audioConverter) {
+				UInt32 dataSize = sizeof(inputBufferSize);
+				result = AudioConverterGetProperty(audioConverter, kAudioConverterPropertyCalculateInputBufferSize, &dataSize, &inputBufferSize);
+				if(noErr != result)
+					LOGGER_ERR("org.sbooth.AudioEngine.Player", "AudioConverterGetProperty (kAudioConverterPropertyCalculateInputBufferSize) failed: " << result);
+
+				// ========================================
+				// Allocate the buffer lists which will serve as the transport between the decoder and the ring buffer
+				decoderState->AllocateBufferList(inputBufferSize / decoderFormat.mBytesPerFrame);
+			}
 
 			BufferList bufferList(mRingBufferFormat, mRingBufferWriteChunkSize);
 
@@ -2052,9 +2083,11 @@ void * SFB::Audio::Player::DecoderThreadEntry()
 							mFlags.fetch_or(eAudioPlayerFlagMuteOutput, std::memory_order_relaxed);
 
 						// Reset the converter to flush any buffers
-						result = AudioConverterReset(audioConverter);
-						if(noErr != result)
-							LOGGER_ERR("org.sbooth.AudioEngine.Player", "AudioConverterReset failed: " << result);
+						if(audioConverter) {
+							result = AudioConverterReset(audioConverter);
+							if(noErr != result)
+								LOGGER_ERR("org.sbooth.AudioEngine.Player", "AudioConverterReset failed: " << result);
+						}
 
 						// Reset() is not thread safe but the rendering thread is outputting silence
 						mRingBuffer->Reset();
@@ -2106,9 +2139,11 @@ void * SFB::Audio::Player::DecoderThreadEntry()
 								mFramesRendered.store(newFrame, std::memory_order_relaxed);
 
 								// Reset the converter to flush any buffers
-								result = AudioConverterReset(audioConverter);
-								if(noErr != result)
-									LOGGER_ERR("org.sbooth.AudioEngine.Player", "AudioConverterReset failed: " << result);
+								if(audioConverter) {
+									result = AudioConverterReset(audioConverter);
+									if(noErr != result)
+										LOGGER_ERR("org.sbooth.AudioEngine.Player", "AudioConverterReset failed: " << result);
+								}
 
 								// Reset the ring buffer
 								mRingBuffer->Reset();
@@ -2135,10 +2170,17 @@ void * SFB::Audio::Player::DecoderThreadEntry()
 
 						// Read the input chunk, converting from the decoder's format to the AUGraph's format
 						UInt32 framesDecoded = mRingBufferWriteChunkSize;
-						
-						result = AudioConverterFillComplexBuffer(audioConverter, myAudioConverterComplexInputDataProc, decoderState, &framesDecoded, bufferList, nullptr);
-						if(noErr != result)
-							LOGGER_ERR("org.sbooth.AudioEngine.Player", "AudioConverterFillComplexBuffer failed: " << result);
+
+						if(audioConverter) {
+							result = AudioConverterFillComplexBuffer(audioConverter, myAudioConverterComplexInputDataProc, decoderState, &framesDecoded, bufferList, nullptr);
+							if(noErr != result)
+								LOGGER_ERR("org.sbooth.AudioEngine.Player", "AudioConverterFillComplexBuffer failed: " << result);
+						}
+						// Or read directly into the buffer list when no conversion is required
+						else {
+							bufferList.Reset();
+							framesDecoded = decoderState->mDecoder->ReadAudio(bufferList, framesDecoded);
+						}
 
 						// Store the decoded audio
 						if(0 != framesDecoded) {
@@ -3179,6 +3221,9 @@ void SFB::Audio::Player::StopActiveDecoders()
 bool SFB::Audio::Player::SetupAUGraphAndRingBufferForDecoder(Decoder& decoder)
 {
 	// Open the decoder if necessary
+	if(!decoder.IsOpen() && (kAudioFormatFlagIsFloat & mRingBufferFormat.mFormatFlags))
+		decoder.SetPrefersFloatOutput(true);
+
 	CFErrorRef error = nullptr;
 	if(!decoder.IsOpen() && !decoder.Open(&error)) {
 		if(error) {
@@ -3209,3 +3254,19 @@ bool SFB::Audio::Player::SetupAUGraphAndRingBufferForDecoder(Decoder& decoder)
 
 	return true;
 }
+
+void SFB::Audio::Player::WarmUpcomingDecoders()
+{
+	if(!mPageCacheWarmer.IsEnabled())
+		return;
+
+	std::vector<SFB::CFURL> urls;
+	size_t fileCount = std::min(mDecoderQueue.size(), mPageCacheWarmer.GetFileCount());
+	for(size_t i = 0; i < fileCount; ++i) {
+		CFURLRef url = mDecoderQueue[i]->GetURL();
+		if(url)
+			urls.push_back(SFB::CFURL((CFURLRef)CFRetain(url)));
+	}
+
+	mPageCacheWarmer.WarmURLs(std::move(urls));
+}
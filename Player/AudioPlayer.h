@@ -44,6 +44,7 @@
 #include "RingBuffer.h"
 #include "AudioChannelLayout.h"
 #include "Semaphore.h"
+#include "PageCacheWarmer.h"
 
 /*! @file AudioPlayer.h @brief Core playback functionality */
 
@@ -696,6 +697,19 @@ namespace SFB {
 			//@}
 
 
+			// ========================================
+			/*! @name Page Cache Warming */
+			//@{
+
+			/*!
+			 * @brief Get the object that warms the file system cache for upcoming decoders
+			 * @note The warmer is enabled by default and is updated whenever the decoder queue changes
+			 */
+			inline PageCacheWarmer& GetPageCacheWarmer()		{ return mPageCacheWarmer; }
+
+			//@}
+
+
 			/*! @cond */
 
 			/*! @internal This class is exposed so it can be used inside C callbacks */
@@ -741,6 +755,9 @@ namespace SFB {
 
 			bool SetupAUGraphAndRingBufferForDecoder(Decoder& decoder);
 
+			// Must be called with mMutex held
+			void WarmUpcomingDecoders();
+
 			// ========================================
 			// Data Members
 			AUGraph									mAUGraph;
@@ -768,6 +785,8 @@ namespace SFB {
 			std::thread								mCollectorThread;
 			Semaphore								mCollectorSemaphore;
 
+			PageCacheWarmer							mPageCacheWarmer;
+
 			std::atomic_llong						mFramesDecoded;
 			std::atomic_llong						mFramesRendered;
 			int64_t									mFramesRenderedLastPass;
@@ -0,0 +1,280 @@
+/*
+ *  Copyright (C) 2013 Stephen F. Booth <me@sbooth.org>
+ *  All Rights Reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    - Neither the name of Stephen F. Booth nor the names of its 
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <mach/clock_types.h>
+#include <cstring>
+#include <algorithm>
+
+#include "PageCacheWarmer.h"
+#include "Logger.h"
+
+// ========================================
+// Default parameters
+#define DEFAULT_FILE_COUNT					2
+#define DEFAULT_HEAD_BYTE_COUNT				(1024 * 1024)
+#define DEFAULT_TAIL_BYTE_COUNT				(256 * 1024)
+#define DEFAULT_BUDGET_BYTES_PER_SECOND		(8 * 1024 * 1024)
+
+// ========================================
+// Files are warmed in chunks of this size so cancellation and the budget are checked regularly
+#define CHUNK_SIZE_BYTES					(256 * 1024)
+
+// ========================================
+// The number of warmed paths to remember before starting over
+#define MAXIMUM_WARMED_PATHS				256
+
+#pragma mark Creation/Destruction
+
+SFB::Audio::PageCacheWarmer::PageCacheWarmer()
+	: mGeneration(ATOMIC_VAR_INIT(0)), mStop(ATOMIC_VAR_INIT(false)), mEnabled(ATOMIC_VAR_INIT(true)), mFileCount(ATOMIC_VAR_INIT(DEFAULT_FILE_COUNT)), mHeadByteCount(ATOMIC_VAR_INIT(DEFAULT_HEAD_BYTE_COUNT)), mTailByteCount(ATOMIC_VAR_INIT(DEFAULT_TAIL_BYTE_COUNT)), mBudget(ATOMIC_VAR_INIT(DEFAULT_BUDGET_BYTES_PER_SECOND)), mBudgetPeriodStart(0), mBudgetPeriodBytes(0)
+{
+	try {
+		mThread = std::thread(&PageCacheWarmer::ThreadEntry, this);
+	}
+
+	catch(const std::exception& e) {
+		LOGGER_CRIT("org.sbooth.AudioEngine.PageCacheWarmer", "Unable to create warming thread: " << e.what());
+
+		throw;
+	}
+}
+
+SFB::Audio::PageCacheWarmer::~PageCacheWarmer()
+{
+	mStop = true;
+	++mGeneration;
+	mSemaphore.Signal();
+
+	try {
+		mThread.join();
+	}
+
+	catch(const std::exception& e) {
+		LOGGER_ERR("org.sbooth.AudioEngine.PageCacheWarmer", "Unable to join warming thread: " << e.what());
+	}
+}
+
+#pragma mark Parameters
+
+void SFB::Audio::PageCacheWarmer::SetEnabled(bool enabled)
+{
+	mEnabled = enabled;
+	if(!enabled)
+		Cancel();
+}
+
+#pragma mark Warming
+
+void SFB::Audio::PageCacheWarmer::WarmURLs(std::vector<SFB::CFURL> urls)
+{
+	if(!mEnabled)
+		urls.clear();
+
+	size_t fileCount = mFileCount;
+	if(urls.size() > fileCount)
+		urls.resize(fileCount);
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mURLs = std::move(urls);
+		++mGeneration;
+	}
+
+	mSemaphore.Signal();
+}
+
+#pragma mark Thread Entry Point
+
+void * SFB::Audio::PageCacheWarmer::ThreadEntry()
+{
+	pthread_setname_np("org.sbooth.AudioEngine.PageCacheWarmer");
+
+	// ========================================
+	// Warming is speculative, so stay out of the way of I/O that matters
+	if(-1 == setiopolicy_np(IOPOL_TYPE_DISK, IOPOL_SCOPE_THREAD, IOPOL_THROTTLE))
+		LOGGER_WARNING("org.sbooth.AudioEngine.PageCacheWarmer", "Couldn't set warming thread I/O policy: " << strerror(errno));
+
+	uint64_t generation = 0;
+
+	while(!mStop) {
+
+		// ========================================
+		// Wait for a new list if nothing changed since the last pass
+		if(generation == mGeneration)
+			mSemaphore.Wait();
+
+		if(mStop)
+			break;
+
+		std::vector<SFB::CFURL> urls;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			generation = mGeneration;
+			urls = mURLs;
+		}
+
+		for(auto& url : urls) {
+			if(IsCancelled(generation) || !WarmFile(url, generation))
+				break;
+		}
+	}
+
+	mBuffer.reset();
+
+	return nullptr;
+}
+
+#pragma mark Internals
+
+bool SFB::Audio::PageCacheWarmer::WarmFile(CFURLRef url, uint64_t generation)
+{
+	if(nullptr == url)
+		return true;
+
+	SFB::CFString scheme(CFURLCopyScheme(url));
+	if(!scheme || kCFCompareEqualTo != CFStringCompare(CFSTR("file"), scheme, kCFCompareCaseInsensitive))
+		return true;
+
+	UInt8 buf [PATH_MAX];
+	if(!CFURLGetFileSystemRepresentation(url, FALSE, buf, PATH_MAX))
+		return true;
+
+	std::string path(reinterpret_cast<const char *>(buf));
+	if(mWarmedPaths.count(path))
+		return true;
+
+	int fd = open(path.c_str(), O_RDONLY);
+	if(-1 == fd) {
+		LOGGER_INFO("org.sbooth.AudioEngine.PageCacheWarmer", "open failed for \"" << path << "\": " << strerror(errno));
+		return true;
+	}
+
+	bool result = true;
+
+	struct stat s;
+	if(-1 == fstat(fd, &s))
+		LOGGER_INFO("org.sbooth.AudioEngine.PageCacheWarmer", "fstat failed for \"" << path << "\": " << strerror(errno));
+	else if(S_ISREG(s.st_mode)) {
+		off_t fileSize = s.st_size;
+		off_t headLength = std::min(fileSize, static_cast<off_t>(mHeadByteCount));
+		off_t tailOffset = std::max(headLength, fileSize - static_cast<off_t>(mTailByteCount));
+
+		// Headers first, since that is what the decoder will read when it is opened
+		result = WarmRange(fd, 0, headLength, generation) && WarmRange(fd, tailOffset, fileSize - tailOffset, generation);
+
+		if(result) {
+			if(mWarmedPaths.size() >= MAXIMUM_WARMED_PATHS)
+				mWarmedPaths.clear();
+			mWarmedPaths.insert(path);
+
+			LOGGER_DEBUG("org.sbooth.AudioEngine.PageCacheWarmer", "Warmed \"" << path << "\"");
+		}
+	}
+
+	close(fd);
+
+	return result;
+}
+
+bool SFB::Audio::PageCacheWarmer::WarmRange(int fd, off_t offset, off_t length, uint64_t generation)
+{
+	while(0 < length) {
+		if(IsCancelled(generation))
+			return false;
+
+		size_t chunkSize = static_cast<size_t>(std::min(length, static_cast<off_t>(CHUNK_SIZE_BYTES)));
+		if(!ConsumeBudget(chunkSize, generation))
+			return false;
+
+		// Prefer asynchronous read-ahead; some file systems (network volumes, for example) don't support it
+		struct radvisory advisory = {
+			.ra_offset = offset,
+			.ra_count = static_cast<int>(chunkSize)
+		};
+
+		if(-1 == fcntl(fd, F_RDADVISE, &advisory)) {
+			if(!mBuffer)
+				mBuffer = std::unique_ptr<char []>(new char [CHUNK_SIZE_BYTES]);
+
+			ssize_t bytesRead = pread(fd, mBuffer.get(), chunkSize, offset);
+			if(0 >= bytesRead) {
+				if(-1 == bytesRead)
+					LOGGER_INFO("org.sbooth.AudioEngine.PageCacheWarmer", "pread failed: " << strerror(errno));
+				return true;
+			}
+
+			chunkSize = static_cast<size_t>(bytesRead);
+		}
+
+		offset += chunkSize;
+		length -= chunkSize;
+	}
+
+	return true;
+}
+
+bool SFB::Audio::PageCacheWarmer::ConsumeBudget(size_t byteCount, uint64_t generation)
+{
+	size_t budget = mBudget;
+	if(0 == budget)
+		return true;
+
+	for(;;) {
+		if(IsCancelled(generation))
+			return false;
+
+		CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+		if(1 <= now - mBudgetPeriodStart) {
+			mBudgetPeriodStart = now;
+			mBudgetPeriodBytes = 0;
+		}
+
+		// Always allow at least one chunk per period so large chunks make progress under small budgets
+		if(0 == mBudgetPeriodBytes || mBudgetPeriodBytes + byteCount <= budget) {
+			mBudgetPeriodBytes += byteCount;
+			return true;
+		}
+
+		// Sleep until the next period; a queue change signals the semaphore and ends the wait early
+		CFTimeInterval remaining = std::max(0.0, 1 - (now - mBudgetPeriodStart));
+		mach_timespec_t timeout = {
+			.tv_sec = static_cast<unsigned int>(remaining),
+			.tv_nsec = static_cast<clock_res_t>((remaining - static_cast<unsigned int>(remaining)) * NSEC_PER_SEC)
+		};
+
+		mSemaphore.TimedWait(timeout);
+	}
+}
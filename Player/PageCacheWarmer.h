@@ -0,0 +1,181 @@
+/*
+ *  Copyright (C) 2013 Stephen F. Booth <me@sbooth.org>
+ *  All Rights Reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    - Neither the name of Stephen F. Booth nor the names of its 
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <CoreFoundation/CoreFoundation.h>
+
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <string>
+#include <unordered_set>
+
+#include "CFWrapper.h"
+#include "Semaphore.h"
+
+/*! @file PageCacheWarmer.h @brief Background read-ahead for files that will be played soon */
+
+/*! @brief \c SFBAudioEngine's encompassing namespace */
+namespace SFB {
+
+	/*! @brief %Audio functionality */
+	namespace Audio {
+
+		/*!
+		 * @brief A class that warms the file system cache for files that will be read soon
+		 *
+		 * A low-priority background thread asks the kernel to read ahead the beginning and end of each file,
+		 * which is where decoders read headers and trailers (tags, seek tables, \c moov atoms).
+		 * \c F_RDADVISE is used where the file system supports it; otherwise the data is read and discarded.
+		 * The amount of I/O issued per second is limited by a configurable budget, and pending work is
+		 * cancelled whenever a new list of URLs is provided.
+		 * Only \c file URLs are warmed.
+		 */
+		class PageCacheWarmer
+		{
+
+		public:
+
+			// ========================================
+			/*! @name Creation and Destruction */
+			//@{
+
+			/*!
+			 * @brief Create a new \c PageCacheWarmer
+			 * @throws std::system_error
+			 */
+			PageCacheWarmer();
+
+			/*! @brief Destroy this \c PageCacheWarmer, cancelling any pending work */
+			~PageCacheWarmer();
+
+			/*! @cond */
+
+			/*! @internal This class is non-copyable */
+			PageCacheWarmer(const PageCacheWarmer& rhs) = delete;
+
+			/*! @internal This class is non-assignable */
+			PageCacheWarmer& operator=(const PageCacheWarmer& rhs) = delete;
+
+			/*! @endcond */
+
+			//@}
+
+
+			// ========================================
+			/*! @name Parameters */
+			//@{
+
+			/*! @brief Query whether warming is enabled */
+			inline bool IsEnabled() const								{ return mEnabled; }
+
+			/*! @brief Enable or disable warming */
+			void SetEnabled(bool enabled);
+
+			/*! @brief Get the maximum number of upcoming files to warm */
+			inline size_t GetFileCount() const							{ return mFileCount; }
+
+			/*! @brief Set the maximum number of upcoming files to warm */
+			inline void SetFileCount(size_t fileCount)					{ mFileCount = fileCount; }
+
+			/*! @brief Get the number of bytes warmed at the beginning of each file */
+			inline size_t GetHeadByteCount() const						{ return mHeadByteCount; }
+
+			/*! @brief Set the number of bytes warmed at the beginning of each file */
+			inline void SetHeadByteCount(size_t byteCount)				{ mHeadByteCount = byteCount; }
+
+			/*! @brief Get the number of bytes warmed at the end of each file */
+			inline size_t GetTailByteCount() const						{ return mTailByteCount; }
+
+			/*! @brief Set the number of bytes warmed at the end of each file */
+			inline void SetTailByteCount(size_t byteCount)				{ mTailByteCount = byteCount; }
+
+			/*! @brief Get the maximum number of bytes requested per second, or \c 0 if unlimited */
+			inline size_t GetBudget() const								{ return mBudget; }
+
+			/*! @brief Set the maximum number of bytes requested per second, or \c 0 for no limit */
+			inline void SetBudget(size_t bytesPerSecond)				{ mBudget = bytesPerSecond; }
+
+			//@}
+
+
+			// ========================================
+			/*! @name Warming */
+			//@{
+
+			/*!
+			 * @brief Replace the list of files to warm
+			 * Any warming in progress is cancelled.  Only the first \c GetFileCount() URLs are warmed.
+			 * @param urls The URLs of the upcoming files, in the order they will be read
+			 */
+			void WarmURLs(std::vector<SFB::CFURL> urls);
+
+			/*! @brief Cancel any warming in progress */
+			inline void Cancel()										{ WarmURLs(std::vector<SFB::CFURL>()); }
+
+			//@}
+
+		private:
+
+			void * ThreadEntry();
+
+			bool WarmFile(CFURLRef url, uint64_t generation);
+			bool WarmRange(int fd, off_t offset, off_t length, uint64_t generation);
+			bool ConsumeBudget(size_t byteCount, uint64_t generation);
+
+			inline bool IsCancelled(uint64_t generation) const			{ return mStop || generation != mGeneration; }
+
+			// Data members
+			std::thread							mThread;
+			Semaphore							mSemaphore;
+
+			std::mutex							mMutex;
+			std::vector<SFB::CFURL>				mURLs;
+			std::atomic<uint64_t>				mGeneration;
+			std::atomic_bool					mStop;
+
+			std::atomic_bool					mEnabled;
+			std::atomic_size_t					mFileCount;
+			std::atomic_size_t					mHeadByteCount;
+			std::atomic_size_t					mTailByteCount;
+			std::atomic_size_t					mBudget;
+
+			// Accessed only from the warming thread
+			std::unique_ptr<char []>			mBuffer;
+			CFAbsoluteTime						mBudgetPeriodStart;
+			size_t								mBudgetPeriodBytes;
+			std::unordered_set<std::string>		mWarmedPaths;
+		};
+
+	}
+}
@@ -0,0 +1,1017 @@
+/*
+ *  Copyright (C) 2013 Stephen F. Booth <me@sbooth.org>
+ *  All Rights Reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    - Neither the name of Stephen F. Booth nor the names of its 
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cmath>
+#include <cstring>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+# include <immintrin.h>
+# define SAMPLE_CONVERSION_X86 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+# include <arm_neon.h>
+# define SAMPLE_CONVERSION_NEON 1
+#endif
+
+#if defined(__APPLE__)
+# include <sys/sysctl.h>
+#endif
+
+#include "SampleConversion.h"
+
+// ========================================
+// The largest float less than 2^31; larger values overflow when converted to int32_t
+#define MAXIMUM_INT32_FLOAT 2147483520.f
+
+// ========================================
+// AudioBufferLists with more channels than this use a heap-allocated pointer array
+#define STACK_CHANNEL_POINTERS 16
+
+#if SAMPLE_CONVERSION_X86
+# define AVX2_FUNCTION __attribute__((target("avx2")))
+#endif
+
+namespace {
+
+	// ========================================
+	// The kernels for one implementation
+	struct KernelTable
+	{
+		SFB::Audio::SampleConversion::Implementation mImplementation;
+
+		void (*mDeinterleaveFloat)(const float *, float * const *, unsigned, size_t);
+		void (*mDeinterleaveInt32)(const int32_t *, int32_t * const *, unsigned, size_t, unsigned);
+		void (*mDeinterleaveInt32ToFloat)(const int32_t *, float * const *, unsigned, size_t, float);
+		void (*mInterleaveFloat)(const float * const *, float *, unsigned, size_t);
+		void (*mInterleaveInt32)(const int32_t * const *, int32_t *, unsigned, size_t);
+		void (*mShiftInt32)(const int32_t *, int32_t *, size_t, unsigned);
+		void (*mConvertInt32ToInt16)(const int32_t *, int16_t *, size_t, unsigned);
+		void (*mConvertInt32ToInt8)(const int32_t *, int8_t *, size_t, unsigned);
+		void (*mConvertInt32ToPackedInt24)(const int32_t *, uint8_t *, size_t, unsigned);
+		void (*mConvertInt32ToFloat)(const int32_t *, float *, size_t, float);
+		void (*mConvertFloatToInt32)(const float *, int32_t *, size_t, float);
+		void (*mClipFloat)(const float *, float *, size_t, float, float);
+	};
+
+#pragma mark Scalar
+
+	namespace scalar {
+
+		void DeinterleaveFloat(const float *src, float * const *dst, unsigned channels, size_t frames)
+		{
+			for(unsigned channel = 0; channel < channels; ++channel) {
+				const float *input = src + channel;
+				float *output = dst[channel];
+				for(size_t frame = 0; frame < frames; ++frame, input += channels)
+					*output++ = *input;
+			}
+		}
+
+		void DeinterleaveInt32(const int32_t *src, int32_t * const *dst, unsigned channels, size_t frames, unsigned shift)
+		{
+			for(unsigned channel = 0; channel < channels; ++channel) {
+				const int32_t *input = src + channel;
+				int32_t *output = dst[channel];
+				for(size_t frame = 0; frame < frames; ++frame, input += channels)
+					*output++ = (int32_t)((uint32_t)*input << shift);
+			}
+		}
+
+		void DeinterleaveInt32ToFloat(const int32_t *src, float * const *dst, unsigned channels, size_t frames, float scale)
+		{
+			for(unsigned channel = 0; channel < channels; ++channel) {
+				const int32_t *input = src + channel;
+				float *output = dst[channel];
+				for(size_t frame = 0; frame < frames; ++frame, input += channels)
+					*output++ = (float)*input * scale;
+			}
+		}
+
+		void InterleaveFloat(const float * const *src, float *dst, unsigned channels, size_t frames)
+		{
+			for(unsigned channel = 0; channel < channels; ++channel) {
+				const float *input = src[channel];
+				float *output = dst + channel;
+				for(size_t frame = 0; frame < frames; ++frame, output += channels)
+					*output = *input++;
+			}
+		}
+
+		void InterleaveInt32(const int32_t * const *src, int32_t *dst, unsigned channels, size_t frames)
+		{
+			for(unsigned channel = 0; channel < channels; ++channel) {
+				const int32_t *input = src[channel];
+				int32_t *output = dst + channel;
+				for(size_t frame = 0; frame < frames; ++frame, output += channels)
+					*output = *input++;
+			}
+		}
+
+		void ShiftInt32(const int32_t *src, int32_t *dst, size_t count, unsigned shift)
+		{
+			for(size_t i = 0; i < count; ++i)
+				dst[i] = (int32_t)((uint32_t)src[i] << shift);
+		}
+
+		void ConvertInt32ToInt16(const int32_t *src, int16_t *dst, size_t count, unsigned shift)
+		{
+			for(size_t i = 0; i < count; ++i)
+				dst[i] = (int16_t)((uint32_t)src[i] << shift);
+		}
+
+		void ConvertInt32ToInt8(const int32_t *src, int8_t *dst, size_t count, unsigned shift)
+		{
+			for(size_t i = 0; i < count; ++i)
+				dst[i] = (int8_t)((uint32_t)src[i] << shift);
+		}
+
+		void ConvertInt32ToPackedInt24(const int32_t *src, uint8_t *dst, size_t count, unsigned shift)
+		{
+			for(size_t i = 0; i < count; ++i) {
+				int32_t value = (int32_t)((uint32_t)src[i] << shift);
+#if __BIG_ENDIAN__
+				*dst++ = (uint8_t)((value >> 16) & 0xff);
+				*dst++ = (uint8_t)((value >> 8) & 0xff);
+				*dst++ = (uint8_t)(value & 0xff);
+#else
+				*dst++ = (uint8_t)(value & 0xff);
+				*dst++ = (uint8_t)((value >> 8) & 0xff);
+				*dst++ = (uint8_t)((value >> 16) & 0xff);
+#endif
+			}
+		}
+
+		void ConvertInt32ToFloat(const int32_t *src, float *dst, size_t count, float scale)
+		{
+			for(size_t i = 0; i < count; ++i)
+				dst[i] = (float)src[i] * scale;
+		}
+
+		void ConvertFloatToInt32(const float *src, int32_t *dst, size_t count, float scale)
+		{
+			float minValue = -scale;
+			float maxValue = std::min(scale - 1.f, MAXIMUM_INT32_FLOAT);
+			for(size_t i = 0; i < count; ++i)
+				dst[i] = (int32_t)lrintf(std::min(std::max(src[i] * scale, minValue), maxValue));
+		}
+
+		void ClipFloat(const float *src, float *dst, size_t count, float minValue, float maxValue)
+		{
+			for(size_t i = 0; i < count; ++i)
+				dst[i] = std::min(std::max(src[i], minValue), maxValue);
+		}
+
+		const KernelTable sKernels = {
+			SFB::Audio::SampleConversion::Implementation::Scalar,
+			DeinterleaveFloat,
+			DeinterleaveInt32,
+			DeinterleaveInt32ToFloat,
+			InterleaveFloat,
+			InterleaveInt32,
+			ShiftInt32,
+			ConvertInt32ToInt16,
+			ConvertInt32ToInt8,
+			ConvertInt32ToPackedInt24,
+			ConvertInt32ToFloat,
+			ConvertFloatToInt32,
+			ClipFloat
+		};
+
+	}
+
+#if SAMPLE_CONVERSION_X86
+
+#pragma mark SSE2
+
+	// Stereo is by far the most common layout, so it is the only interleaved layout with vectorized paths;
+	// other channel counts use the scalar kernels
+
+	namespace sse2 {
+
+		void DeinterleaveFloat(const float *src, float * const *dst, unsigned channels, size_t frames)
+		{
+			if(2 != channels)
+				return scalar::DeinterleaveFloat(src, dst, channels, frames);
+
+			float *left = dst[0], *right = dst[1];
+			size_t frame = 0;
+			for(; frame + 4 <= frames; frame += 4, src += 8) {
+				__m128 a = _mm_loadu_ps(src);
+				__m128 b = _mm_loadu_ps(src + 4);
+				_mm_storeu_ps(left + frame, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+				_mm_storeu_ps(right + frame, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+			}
+
+			for(; frame < frames; ++frame, src += 2) {
+				left[frame] = src[0];
+				right[frame] = src[1];
+			}
+		}
+
+		void DeinterleaveInt32(const int32_t *src, int32_t * const *dst, unsigned channels, size_t frames, unsigned shift)
+		{
+			if(2 != channels)
+				return scalar::DeinterleaveInt32(src, dst, channels, frames, shift);
+
+			int32_t *left = dst[0], *right = dst[1];
+			__m128i count = _mm_cvtsi32_si128((int)shift);
+			size_t frame = 0;
+			for(; frame + 4 <= frames; frame += 4, src += 8) {
+				__m128 a = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)src));
+				__m128 b = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)(src + 4)));
+				__m128i l = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+				__m128i r = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+				_mm_storeu_si128((__m128i *)(left + frame), _mm_sll_epi32(l, count));
+				_mm_storeu_si128((__m128i *)(right + frame), _mm_sll_epi32(r, count));
+			}
+
+			for(; frame < frames; ++frame, src += 2) {
+				left[frame] = (int32_t)((uint32_t)src[0] << shift);
+				right[frame] = (int32_t)((uint32_t)src[1] << shift);
+			}
+		}
+
+		void DeinterleaveInt32ToFloat(const int32_t *src, float * const *dst, unsigned channels, size_t frames, float scale)
+		{
+			if(2 != channels)
+				return scalar::DeinterleaveInt32ToFloat(src, dst, channels, frames, scale);
+
+			float *left = dst[0], *right = dst[1];
+			__m128 factor = _mm_set1_ps(scale);
+			size_t frame = 0;
+			for(; frame + 4 <= frames; frame += 4, src += 8) {
+				__m128 a = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)src));
+				__m128 b = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(src + 4)));
+				_mm_storeu_ps(left + frame, _mm_mul_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), factor));
+				_mm_storeu_ps(right + frame, _mm_mul_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)), factor));
+			}
+
+			for(; frame < frames; ++frame, src += 2) {
+				left[frame] = (float)src[0] * scale;
+				right[frame] = (float)src[1] * scale;
+			}
+		}
+
+		void InterleaveFloat(const float * const *src, float *dst, unsigned channels, size_t frames)
+		{
+			if(2 != channels)
+				return scalar::InterleaveFloat(src, dst, channels, frames);
+
+			const float *left = src[0], *right = src[1];
+			size_t frame = 0;
+			for(; frame + 4 <= frames; frame += 4, dst += 8) {
+				__m128 l = _mm_loadu_ps(left + frame);
+				__m128 r = _mm_loadu_ps(right + frame);
+				_mm_storeu_ps(dst, _mm_unpacklo_ps(l, r));
+				_mm_storeu_ps(dst + 4, _mm_unpackhi_ps(l, r));
+			}
+
+			for(; frame < frames; ++frame, dst += 2) {
+				dst[0] = left[frame];
+				dst[1] = right[frame];
+			}
+		}
+
+		void InterleaveInt32(const int32_t * const *src, int32_t *dst, unsigned channels, size_t frames)
+		{
+			if(2 != channels)
+				return scalar::InterleaveInt32(src, dst, channels, frames);
+
+			const int32_t *left = src[0], *right = src[1];
+			size_t frame = 0;
+			for(; frame + 4 <= frames; frame += 4, dst += 8) {
+				__m128i l = _mm_loadu_si128((const __m128i *)(left + frame));
+				__m128i r = _mm_loadu_si128((const __m128i *)(right + frame));
+				_mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi32(l, r));
+				_mm_storeu_si128((__m128i *)(dst + 4), _mm_unpackhi_epi32(l, r));
+			}
+
+			for(; frame < frames; ++frame, dst += 2) {
+				dst[0] = left[frame];
+				dst[1] = right[frame];
+			}
+		}
+
+		void ShiftInt32(const int32_t *src, int32_t *dst, size_t count, unsigned shift)
+		{
+			__m128i bits = _mm_cvtsi32_si128((int)shift);
+			size_t i = 0;
+			for(; i + 4 <= count; i += 4)
+				_mm_storeu_si128((__m128i *)(dst + i), _mm_sll_epi32(_mm_loadu_si128((const __m128i *)(src + i)), bits));
+
+			scalar::ShiftInt32(src + i, dst + i, count - i, shift);
+		}
+
+		void ConvertInt32ToInt16(const int32_t *src, int16_t *dst, size_t count, unsigned shift)
+		{
+			__m128i bits = _mm_cvtsi32_si128((int)shift);
+			size_t i = 0;
+			for(; i + 8 <= count; i += 8) {
+				__m128i a = _mm_sll_epi32(_mm_loadu_si128((const __m128i *)(src + i)), bits);
+				__m128i b = _mm_sll_epi32(_mm_loadu_si128((const __m128i *)(src + i + 4)), bits);
+				_mm_storeu_si128((__m128i *)(dst + i), _mm_packs_epi32(a, b));
+			}
+
+			scalar::ConvertInt32ToInt16(src + i, dst + i, count - i, shift);
+		}
+
+		void ConvertInt32ToInt8(const int32_t *src, int8_t *dst, size_t count, unsigned shift)
+		{
+			__m128i bits = _mm_cvtsi32_si128((int)shift);
+			size_t i = 0;
+			for(; i + 16 <= count; i += 16) {
+				__m128i a = _mm_sll_epi32(_mm_loadu_si128((const __m128i *)(src + i)), bits);
+				__m128i b = _mm_sll_epi32(_mm_loadu_si128((const __m128i *)(src + i + 4)), bits);
+				__m128i c = _mm_sll_epi32(_mm_loadu_si128((const __m128i *)(src + i + 8)), bits);
+				__m128i d = _mm_sll_epi32(_mm_loadu_si128((const __m128i *)(src + i + 12)), bits);
+				_mm_storeu_si128((__m128i *)(dst + i), _mm_packs_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+			}
+
+			scalar::ConvertInt32ToInt8(src + i, dst + i, count - i, shift);
+		}
+
+		void ConvertInt32ToFloat(const int32_t *src, float *dst, size_t count, float scale)
+		{
+			__m128 factor = _mm_set1_ps(scale);
+			size_t i = 0;
+			for(; i + 4 <= count; i += 4)
+				_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(src + i))), factor));
+
+			scalar::ConvertInt32ToFloat(src + i, dst + i, count - i, scale);
+		}
+
+		void ConvertFloatToInt32(const float *src, int32_t *dst, size_t count, float scale)
+		{
+			__m128 factor = _mm_set1_ps(scale);
+			__m128 minValue = _mm_set1_ps(-scale);
+			__m128 maxValue = _mm_set1_ps(std::min(scale - 1.f, MAXIMUM_INT32_FLOAT));
+			size_t i = 0;
+			for(; i + 4 <= count; i += 4) {
+				__m128 value = _mm_mul_ps(_mm_loadu_ps(src + i), factor);
+				value = _mm_min_ps(_mm_max_ps(value, minValue), maxValue);
+				_mm_storeu_si128((__m128i *)(dst + i), _mm_cvtps_epi32(value));
+			}
+
+			scalar::ConvertFloatToInt32(src + i, dst + i, count - i, scale);
+		}
+
+		void ClipFloat(const float *src, float *dst, size_t count, float minValue, float maxValue)
+		{
+			__m128 lower = _mm_set1_ps(minValue);
+			__m128 upper = _mm_set1_ps(maxValue);
+			size_t i = 0;
+			for(; i + 4 <= count; i += 4)
+				_mm_storeu_ps(dst + i, _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), lower), upper));
+
+			scalar::ClipFloat(src + i, dst + i, count - i, minValue, maxValue);
+		}
+
+		// Packing 24-bit samples efficiently requires SSSE3's pshufb, so the scalar kernel is used
+		const KernelTable sKernels = {
+			SFB::Audio::SampleConversion::Implementation::SSE2,
+			DeinterleaveFloat,
+			DeinterleaveInt32,
+			DeinterleaveInt32ToFloat,
+			InterleaveFloat,
+			InterleaveInt32,
+			ShiftInt32,
+			ConvertInt32ToInt16,
+			ConvertInt32ToInt8,
+			scalar::ConvertInt32ToPackedInt24,
+			ConvertInt32ToFloat,
+			ConvertFloatToInt32,
+			ClipFloat
+		};
+
+	}
+
+#pragma mark AVX2
+
+	namespace avx2 {
+
+		// Interleaved L0 R0 ... L3 R3 and L4 R4 ... L7 R7 to L0 ... L7 and R0 ... R7
+		// _mm256_shuffle_ps works within 128-bit lanes, so the 64-bit halves must be reordered afterwards
+		AVX2_FUNCTION inline void Deinterleave2(__m256 a, __m256 b, __m256& left, __m256& right)
+		{
+			left = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))), _MM_SHUFFLE(3, 1, 2, 0)));
+			right = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))), _MM_SHUFFLE(3, 1, 2, 0)));
+		}
+
+		AVX2_FUNCTION void DeinterleaveFloat(const float *src, float * const *dst, unsigned channels, size_t frames)
+		{
+			if(2 != channels)
+				return scalar::DeinterleaveFloat(src, dst, channels, frames);
+
+			float *left = dst[0], *right = dst[1];
+			size_t frame = 0;
+			for(; frame + 8 <= frames; frame += 8, src += 16) {
+				__m256 l, r;
+				Deinterleave2(_mm256_loadu_ps(src), _mm256_loadu_ps(src + 8), l, r);
+				_mm256_storeu_ps(left + frame, l);
+				_mm256_storeu_ps(right + frame, r);
+			}
+
+			float * const tail [2] = { left + frame, right + frame };
+			sse2::DeinterleaveFloat(src, tail, 2, frames - frame);
+		}
+
+		AVX2_FUNCTION void DeinterleaveInt32(const int32_t *src, int32_t * const *dst, unsigned channels, size_t frames, unsigned shift)
+		{
+			if(2 != channels)
+				return scalar::DeinterleaveInt32(src, dst, channels, frames, shift);
+
+			int32_t *left = dst[0], *right = dst[1];
+			__m128i count = _mm_cvtsi32_si128((int)shift);
+			size_t frame = 0;
+			for(; frame + 8 <= frames; frame += 8, src += 16) {
+				__m256 l, r;
+				Deinterleave2(_mm256_castsi256_ps(_mm256_loadu_si256((const __m256i *)src)), _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i *)(src + 8))), l, r);
+				_mm256_storeu_si256((__m256i *)(left + frame), _mm256_sll_epi32(_mm256_castps_si256(l), count));
+				_mm256_storeu_si256((__m256i *)(right + frame), _mm256_sll_epi32(_mm256_castps_si256(r), count));
+			}
+
+			int32_t * const tail [2] = { left + frame, right + frame };
+			sse2::DeinterleaveInt32(src, tail, 2, frames - frame, shift);
+		}
+
+		AVX2_FUNCTION void DeinterleaveInt32ToFloat(const int32_t *src, float * const *dst, unsigned channels, size_t frames, float scale)
+		{
+			if(2 != channels)
+				return scalar::DeinterleaveInt32ToFloat(src, dst, channels, frames, scale);
+
+			float *left = dst[0], *right = dst[1];
+			__m256 factor = _mm256_set1_ps(scale);
+			size_t frame = 0;
+			for(; frame + 8 <= frames; frame += 8, src += 16) {
+				__m256 l, r;
+				Deinterleave2(_mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *)src)), _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *)(src + 8))), l, r);
+				_mm256_storeu_ps(left + frame, _mm256_mul_ps(l, factor));
+				_mm256_storeu_ps(right + frame, _mm256_mul_ps(r, factor));
+			}
+
+			float * const tail [2] = { left + frame, right + frame };
+			sse2::DeinterleaveInt32ToFloat(src, tail, 2, frames - frame, scale);
+		}
+
+		AVX2_FUNCTION void ShiftInt32(const int32_t *src, int32_t *dst, size_t count, unsigned shift)
+		{
+			__m128i bits = _mm_cvtsi32_si128((int)shift);
+			size_t i = 0;
+			for(; i + 8 <= count; i += 8)
+				_mm256_storeu_si256((__m256i *)(dst + i), _mm256_sll_epi32(_mm256_loadu_si256((const __m256i *)(src + i)), bits));
+
+			scalar::ShiftInt32(src + i, dst + i, count - i, shift);
+		}
+
+		AVX2_FUNCTION void ConvertInt32ToInt16(const int32_t *src, int16_t *dst, size_t count, unsigned shift)
+		{
+			__m128i bits = _mm_cvtsi32_si128((int)shift);
+			size_t i = 0;
+			for(; i + 16 <= count; i += 16) {
+				__m256i a = _mm256_sll_epi32(_mm256_loadu_si256((const __m256i *)(src + i)), bits);
+				__m256i b = _mm256_sll_epi32(_mm256_loadu_si256((const __m256i *)(src + i + 8)), bits);
+				// _mm256_packs_epi32 interleaves the 128-bit lanes of its arguments
+				_mm256_storeu_si256((__m256i *)(dst + i), _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), _MM_SHUFFLE(3, 1, 2, 0)));
+			}
+
+			sse2::ConvertInt32ToInt16(src + i, dst + i, count - i, shift);
+		}
+
+		AVX2_FUNCTION void ConvertInt32ToPackedInt24(const int32_t *src, uint8_t *dst, size_t count, unsigned shift)
+		{
+			// Gather the low three bytes of each sample into the low 12 bytes of the register
+			const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+			__m128i bits = _mm_cvtsi32_si128((int)shift);
+			size_t i = 0;
+			// Each store writes 16 bytes but advances 12, so stop while there is room for the overrun
+			for(; i + 6 <= count; i += 4, dst += 12) {
+				__m128i value = _mm_sll_epi32(_mm_loadu_si128((const __m128i *)(src + i)), bits);
+				_mm_storeu_si128((__m128i *)dst, _mm_shuffle_epi8(value, pack));
+			}
+
+			scalar::ConvertInt32ToPackedInt24(src + i, dst, count - i, shift);
+		}
+
+		AVX2_FUNCTION void ConvertInt32ToFloat(const int32_t *src, float *dst, size_t count, float scale)
+		{
+			__m256 factor = _mm256_set1_ps(scale);
+			size_t i = 0;
+			for(; i + 8 <= count; i += 8)
+				_mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *)(src + i))), factor));
+
+			scalar::ConvertInt32ToFloat(src + i, dst + i, count - i, scale);
+		}
+
+		AVX2_FUNCTION void ConvertFloatToInt32(const float *src, int32_t *dst, size_t count, float scale)
+		{
+			__m256 factor = _mm256_set1_ps(scale);
+			__m256 minValue = _mm256_set1_ps(-scale);
+			__m256 maxValue = _mm256_set1_ps(std::min(scale - 1.f, MAXIMUM_INT32_FLOAT));
+			size_t i = 0;
+			for(; i + 8 <= count; i += 8) {
+				__m256 value = _mm256_mul_ps(_mm256_loadu_ps(src + i), factor);
+				value = _mm256_min_ps(_mm256_max_ps(value, minValue), maxValue);
+				_mm256_storeu_si256((__m256i *)(dst + i), _mm256_cvtps_epi32(value));
+			}
+
+			scalar::ConvertFloatToInt32(src + i, dst + i, count - i, scale);
+		}
+
+		AVX2_FUNCTION void ClipFloat(const float *src, float *dst, size_t count, float minValue, float maxValue)
+		{
+			__m256 lower = _mm256_set1_ps(minValue);
+			__m256 upper = _mm256_set1_ps(maxValue);
+			size_t i = 0;
+			for(; i + 8 <= count; i += 8)
+				_mm256_storeu_ps(dst + i, _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src + i), lower), upper));
+
+			scalar::ClipFloat(src + i, dst + i, count - i, minValue, maxValue);
+		}
+
+		// Interleaving and 8-bit narrowing are store-bound, and the SSE2 kernels keep up with them
+		const KernelTable sKernels = {
+			SFB::Audio::SampleConversion::Implementation::AVX2,
+			DeinterleaveFloat,
+			DeinterleaveInt32,
+			DeinterleaveInt32ToFloat,
+			sse2::InterleaveFloat,
+			sse2::InterleaveInt32,
+			ShiftInt32,
+			ConvertInt32ToInt16,
+			sse2::ConvertInt32ToInt8,
+			ConvertInt32ToPackedInt24,
+			ConvertInt32ToFloat,
+			ConvertFloatToInt32,
+			ClipFloat
+		};
+
+		bool IsSupported()
+		{
+#if defined(__APPLE__)
+			int supported = 0;
+			size_t size = sizeof(supported);
+			if(sysctlbyname("hw.optional.avx2_0", &supported, &size, nullptr, 0))
+				return false;
+			return 0 != supported;
+#else
+			return __builtin_cpu_supports("avx2");
+#endif
+		}
+
+	}
+
+#endif /* SAMPLE_CONVERSION_X86 */
+
+#if SAMPLE_CONVERSION_NEON
+
+#pragma mark NEON
+
+	namespace neon {
+
+		void DeinterleaveFloat(const float *src, float * const *dst, unsigned channels, size_t frames)
+		{
+			if(2 != channels)
+				return scalar::DeinterleaveFloat(src, dst, channels, frames);
+
+			float *left = dst[0], *right = dst[1];
+			size_t frame = 0;
+			for(; frame + 4 <= frames; frame += 4, src += 8) {
+				float32x4x2_t value = vld2q_f32(src);
+				vst1q_f32(left + frame, value.val[0]);
+				vst1q_f32(right + frame, value.val[1]);
+			}
+
+			for(; frame < frames; ++frame, src += 2) {
+				left[frame] = src[0];
+				right[frame] = src[1];
+			}
+		}
+
+		void DeinterleaveInt32(const int32_t *src, int32_t * const *dst, unsigned channels, size_t frames, unsigned shift)
+		{
+			if(2 != channels)
+				return scalar::DeinterleaveInt32(src, dst, channels, frames, shift);
+
+			int32_t *left = dst[0], *right = dst[1];
+			int32x4_t bits = vdupq_n_s32((int32_t)shift);
+			size_t frame = 0;
+			for(; frame + 4 <= frames; frame += 4, src += 8) {
+				int32x4x2_t value = vld2q_s32(src);
+				vst1q_s32(left + frame, vshlq_s32(value.val[0], bits));
+				vst1q_s32(right + frame, vshlq_s32(value.val[1], bits));
+			}
+
+			for(; frame < frames; ++frame, src += 2) {
+				left[frame] = (int32_t)((uint32_t)src[0] << shift);
+				right[frame] = (int32_t)((uint32_t)src[1] << shift);
+			}
+		}
+
+		void DeinterleaveInt32ToFloat(const int32_t *src, float * const *dst, unsigned channels, size_t frames, float scale)
+		{
+			if(2 != channels)
+				return scalar::DeinterleaveInt32ToFloat(src, dst, channels, frames, scale);
+
+			float *left = dst[0], *right = dst[1];
+			size_t frame = 0;
+			for(; frame + 4 <= frames; frame += 4, src += 8) {
+				int32x4x2_t value = vld2q_s32(src);
+				vst1q_f32(left + frame, vmulq_n_f32(vcvtq_f32_s32(value.val[0]), scale));
+				vst1q_f32(right + frame, vmulq_n_f32(vcvtq_f32_s32(value.val[1]), scale));
+			}
+
+			for(; frame < frames; ++frame, src += 2) {
+				left[frame] = (float)src[0] * scale;
+				right[frame] = (float)src[1] * scale;
+			}
+		}
+
+		void InterleaveFloat(const float * const *src, float *dst, unsigned channels, size_t frames)
+		{
+			if(2 != channels)
+				return scalar::InterleaveFloat(src, dst, channels, frames);
+
+			const float *left = src[0], *right = src[1];
+			size_t frame = 0;
+			for(; frame + 4 <= frames; frame += 4, dst += 8) {
+				float32x4x2_t value = { { vld1q_f32(left + frame), vld1q_f32(right + frame) } };
+				vst2q_f32(dst, value);
+			}
+
+			for(; frame < frames; ++frame, dst += 2) {
+				dst[0] = left[frame];
+				dst[1] = right[frame];
+			}
+		}
+
+		void InterleaveInt32(const int32_t * const *src, int32_t *dst, unsigned channels, size_t frames)
+		{
+			if(2 != channels)
+				return scalar::InterleaveInt32(src, dst, channels, frames);
+
+			const int32_t *left = src[0], *right = src[1];
+			size_t frame = 0;
+			for(; frame + 4 <= frames; frame += 4, dst += 8) {
+				int32x4x2_t value = { { vld1q_s32(left + frame), vld1q_s32(right + frame) } };
+				vst2q_s32(dst, value);
+			}
+
+			for(; frame < frames; ++frame, dst += 2) {
+				dst[0] = left[frame];
+				dst[1] = right[frame];
+			}
+		}
+
+		void ShiftInt32(const int32_t *src, int32_t *dst, size_t count, unsigned shift)
+		{
+			int32x4_t bits = vdupq_n_s32((int32_t)shift);
+			size_t i = 0;
+			for(; i + 4 <= count; i += 4)
+				vst1q_s32(dst + i, vshlq_s32(vld1q_s32(src + i), bits));
+
+			scalar::ShiftInt32(src + i, dst + i, count - i, shift);
+		}
+
+		void ConvertInt32ToInt16(const int32_t *src, int16_t *dst, size_t count, unsigned shift)
+		{
+			int32x4_t bits = vdupq_n_s32((int32_t)shift);
+			size_t i = 0;
+			for(; i + 8 <= count; i += 8) {
+				int16x4_t a = vmovn_s32(vshlq_s32(vld1q_s32(src + i), bits));
+				int16x4_t b = vmovn_s32(vshlq_s32(vld1q_s32(src + i + 4), bits));
+				vst1q_s16(dst + i, vcombine_s16(a, b));
+			}
+
+			scalar::ConvertInt32ToInt16(src + i, dst + i, count - i, shift);
+		}
+
+		void ConvertInt32ToInt8(const int32_t *src, int8_t *dst, size_t count, unsigned shift)
+		{
+			int32x4_t bits = vdupq_n_s32((int32_t)shift);
+			size_t i = 0;
+			for(; i + 8 <= count; i += 8) {
+				int16x4_t a = vmovn_s32(vshlq_s32(vld1q_s32(src + i), bits));
+				int16x4_t b = vmovn_s32(vshlq_s32(vld1q_s32(src + i + 4), bits));
+				vst1_s8(dst + i, vmovn_s16(vcombine_s16(a, b)));
+			}
+
+			scalar::ConvertInt32ToInt8(src + i, dst + i, count - i, shift);
+		}
+
+		void ConvertInt32ToPackedInt24(const int32_t *src, uint8_t *dst, size_t count, unsigned shift)
+		{
+			int32x4_t bits = vdupq_n_s32((int32_t)shift);
+			size_t i = 0;
+			for(; i + 16 <= count; i += 16, dst += 48) {
+				// Shift in place, then split the little-endian samples into byte planes and store the low three
+				int32_t shifted [16];
+				for(size_t j = 0; j < 16; j += 4)
+					vst1q_s32(shifted + j, vshlq_s32(vld1q_s32(src + i + j), bits));
+
+				uint8x16x4_t bytes = vld4q_u8((const uint8_t *)shifted);
+				uint8x16x3_t packed = { { bytes.val[0], bytes.val[1], bytes.val[2] } };
+				vst3q_u8(dst, packed);
+			}
+
+			scalar::ConvertInt32ToPackedInt24(src + i, dst, count - i, shift);
+		}
+
+		void ConvertInt32ToFloat(const int32_t *src, float *dst, size_t count, float scale)
+		{
+			size_t i = 0;
+			for(; i + 4 <= count; i += 4)
+				vst1q_f32(dst + i, vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(src + i)), scale));
+
+			scalar::ConvertInt32ToFloat(src + i, dst + i, count - i, scale);
+		}
+
+#if defined(__aarch64__)
+		void ConvertFloatToInt32(const float *src, int32_t *dst, size_t count, float scale)
+		{
+			float32x4_t minValue = vdupq_n_f32(-scale);
+			float32x4_t maxValue = vdupq_n_f32(std::min(scale - 1.f, MAXIMUM_INT32_FLOAT));
+			size_t i = 0;
+			for(; i + 4 <= count; i += 4) {
+				float32x4_t value = vmulq_n_f32(vld1q_f32(src + i), scale);
+				value = vminq_f32(vmaxq_f32(value, minValue), maxValue);
+				vst1q_s32(dst + i, vcvtnq_s32_f32(value));
+			}
+
+			scalar::ConvertFloatToInt32(src + i, dst + i, count - i, scale);
+		}
+#endif
+
+		void ClipFloat(const float *src, float *dst, size_t count, float minValue, float maxValue)
+		{
+			float32x4_t lower = vdupq_n_f32(minValue);
+			float32x4_t upper = vdupq_n_f32(maxValue);
+			size_t i = 0;
+			for(; i + 4 <= count; i += 4)
+				vst1q_f32(dst + i, vminq_f32(vmaxq_f32(vld1q_f32(src + i), lower), upper));
+
+			scalar::ClipFloat(src + i, dst + i, count - i, minValue, maxValue);
+		}
+
+		// ARMv7 NEON lacks a round-to-nearest float conversion, so the scalar kernel is used there
+		const KernelTable sKernels = {
+			SFB::Audio::SampleConversion::Implementation::NEON,
+			DeinterleaveFloat,
+			DeinterleaveInt32,
+			DeinterleaveInt32ToFloat,
+			InterleaveFloat,
+			InterleaveInt32,
+			ShiftInt32,
+			ConvertInt32ToInt16,
+			ConvertInt32ToInt8,
+			ConvertInt32ToPackedInt24,
+			ConvertInt32ToFloat,
+#if defined(__aarch64__)
+			ConvertFloatToInt32,
+#else
+			scalar::ConvertFloatToInt32,
+#endif
+			ClipFloat
+		};
+
+	}
+
+#endif /* SAMPLE_CONVERSION_NEON */
+
+#pragma mark Dispatch
+
+	const KernelTable * GetKernelTable(SFB::Audio::SampleConversion::Implementation implementation)
+	{
+		switch(implementation) {
+			case SFB::Audio::SampleConversion::Implementation::Scalar:
+				return &scalar::sKernels;
+
+#if SAMPLE_CONVERSION_X86
+			case SFB::Audio::SampleConversion::Implementation::SSE2:
+				return &sse2::sKernels;
+
+			case SFB::Audio::SampleConversion::Implementation::AVX2:
+				return avx2::IsSupported() ? &avx2::sKernels : nullptr;
+#endif
+
+#if SAMPLE_CONVERSION_NEON
+			case SFB::Audio::SampleConversion::Implementation::NEON:
+				return &neon::sKernels;
+#endif
+
+			default:
+				return nullptr;
+		}
+	}
+
+	const KernelTable * GetBestKernelTable()
+	{
+#if SAMPLE_CONVERSION_X86
+		if(avx2::IsSupported())
+			return &avx2::sKernels;
+		return &sse2::sKernels;
+#elif SAMPLE_CONVERSION_NEON
+		return &neon::sKernels;
+#else
+		return &scalar::sKernels;
+#endif
+	}
+
+	std::atomic<const KernelTable *>& GetKernels()
+	{
+		static std::atomic<const KernelTable *> sKernels(GetBestKernelTable());
+		return sKernels;
+	}
+
+	inline const KernelTable& Kernels()
+	{
+		return *GetKernels().load(std::memory_order_relaxed);
+	}
+
+	// Collects the channel pointers of an AudioBufferList
+	template <typename T>
+	class ChannelPointers
+	{
+	public:
+		ChannelPointers(const AudioBufferList *bufferList, unsigned channels, size_t frameOffset)
+		{
+			mPointers = mStackPointers;
+			if(STACK_CHANNEL_POINTERS < channels) {
+				mHeapPointers = std::unique_ptr<T *[]>(new T * [channels]);
+				mPointers = mHeapPointers.get();
+			}
+
+			for(unsigned channel = 0; channel < channels; ++channel)
+				mPointers[channel] = static_cast<T *>(bufferList->mBuffers[channel].mData) + frameOffset;
+		}
+
+		inline operator T * const *() const		{ return mPointers; }
+
+	private:
+		T							*mStackPointers [STACK_CHANNEL_POINTERS];
+		std::unique_ptr<T *[]>		mHeapPointers;
+		T							**mPointers;
+	};
+
+}
+
+#pragma mark Implementation Selection
+
+SFB::Audio::SampleConversion::Implementation SFB::Audio::SampleConversion::GetImplementation()
+{
+	return Kernels().mImplementation;
+}
+
+bool SFB::Audio::SampleConversion::IsImplementationAvailable(Implementation implementation)
+{
+	return nullptr != GetKernelTable(implementation);
+}
+
+bool SFB::Audio::SampleConversion::SetImplementation(Implementation implementation)
+{
+	const KernelTable *kernels = GetKernelTable(implementation);
+	if(nullptr == kernels)
+		return false;
+
+	GetKernels().store(kernels, std::memory_order_relaxed);
+	return true;
+}
+
+const char * SFB::Audio::SampleConversion::GetImplementationName(Implementation implementation)
+{
+	switch(implementation) {
+		case Implementation::Scalar:	return "Scalar";
+		case Implementation::SSE2:		return "SSE2";
+		case Implementation::AVX2:		return "AVX2";
+		case Implementation::NEON:		return "NEON";
+	}
+
+	return "Unknown";
+}
+
+#pragma mark Interleaving and Deinterleaving
+
+void SFB::Audio::SampleConversion::DeinterleaveFloat(const float *src, float * const *dst, unsigned channels, size_t frames)
+{
+	if(1 == channels)
+		memcpy(dst[0], src, frames * sizeof(float));
+	else
+		Kernels().mDeinterleaveFloat(src, dst, channels, frames);
+}
+
+void SFB::Audio::SampleConversion::DeinterleaveInt32(const int32_t *src, int32_t * const *dst, unsigned channels, size_t frames, unsigned shift)
+{
+	if(1 == channels)
+		ShiftInt32(src, dst[0], frames, shift);
+	else
+		Kernels().mDeinterleaveInt32(src, dst, channels, frames, shift);
+}
+
+void SFB::Audio::SampleConversion::DeinterleaveInt32ToFloat(const int32_t *src, float * const *dst, unsigned channels, size_t frames, float scale)
+{
+	if(1 == channels)
+		ConvertInt32ToFloat(src, dst[0], frames, scale);
+	else
+		Kernels().mDeinterleaveInt32ToFloat(src, dst, channels, frames, scale);
+}
+
+void SFB::Audio::SampleConversion::InterleaveFloat(const float * const *src, float *dst, unsigned channels, size_t frames)
+{
+	if(1 == channels)
+		memcpy(dst, src[0], frames * sizeof(float));
+	else
+		Kernels().mInterleaveFloat(src, dst, channels, frames);
+}
+
+void SFB::Audio::SampleConversion::InterleaveInt32(const int32_t * const *src, int32_t *dst, unsigned channels, size_t frames)
+{
+	if(1 == channels)
+		memcpy(dst, src[0], frames * sizeof(int32_t));
+	else
+		Kernels().mInterleaveInt32(src, dst, channels, frames);
+}
+
+void SFB::Audio::SampleConversion::DeinterleaveFloat(const float *src, AudioBufferList *dst, unsigned channels, size_t frames, size_t dstOffset)
+{
+	DeinterleaveFloat(src, ChannelPointers<float>(dst, channels, dstOffset), channels, frames);
+}
+
+void SFB::Audio::SampleConversion::DeinterleaveInt32(const int32_t *src, AudioBufferList *dst, unsigned channels, size_t frames, unsigned shift, size_t dstOffset)
+{
+	DeinterleaveInt32(src, ChannelPointers<int32_t>(dst, channels, dstOffset), channels, frames, shift);
+}
+
+void SFB::Audio::SampleConversion::DeinterleaveInt32ToFloat(const int32_t *src, AudioBufferList *dst, unsigned channels, size_t frames, float scale, size_t dstOffset)
+{
+	DeinterleaveInt32ToFloat(src, ChannelPointers<float>(dst, channels, dstOffset), channels, frames, scale);
+}
+
+#pragma mark Format Conversion
+
+void SFB::Audio::SampleConversion::ShiftInt32(const int32_t *src, int32_t *dst, size_t count, unsigned shift)
+{
+	if(0 == shift) {
+		if(src != dst)
+			memcpy(dst, src, count * sizeof(int32_t));
+	}
+	else
+		Kernels().mShiftInt32(src, dst, count, shift);
+}
+
+void SFB::Audio::SampleConversion::ConvertInt32ToInt16(const int32_t *src, int16_t *dst, size_t count, unsigned shift)
+{
+	Kernels().mConvertInt32ToInt16(src, dst, count, shift);
+}
+
+void SFB::Audio::SampleConversion::ConvertInt32ToInt8(const int32_t *src, int8_t *dst, size_t count, unsigned shift)
+{
+	Kernels().mConvertInt32ToInt8(src, dst, count, shift);
+}
+
+void SFB::Audio::SampleConversion::ConvertInt32ToPackedInt24(const int32_t *src, uint8_t *dst, size_t count, unsigned shift)
+{
+	Kernels().mConvertInt32ToPackedInt24(src, dst, count, shift);
+}
+
+void SFB::Audio::SampleConversion::ConvertInt32ToFloat(const int32_t *src, float *dst, size_t count, float scale)
+{
+	Kernels().mConvertInt32ToFloat(src, dst, count, scale);
+}
+
+void SFB::Audio::SampleConversion::ConvertFloatToInt32(const float *src, int32_t *dst, size_t count, float scale)
+{
+	Kernels().mConvertFloatToInt32(src, dst, count, scale);
+}
+
+void SFB::Audio::SampleConversion::ClipFloat(const float *src, float *dst, size_t count, float minValue, float maxValue)
+{
+	Kernels().mClipFloat(src, dst, count, minValue, maxValue);
+}
@@ -0,0 +1,216 @@
+/*
+ *  Copyright (C) 2013 Stephen F. Booth <me@sbooth.org>
+ *  All Rights Reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    - Neither the name of Stephen F. Booth nor the names of its 
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <CoreAudio/CoreAudioTypes.h>
+#include <cstddef>
+#include <cstdint>
+
+/*! @file SampleConversion.h @brief Vectorized sample format conversion, interleaving and deinterleaving */
+
+/*! @brief \c SFBAudioEngine's encompassing namespace */
+namespace SFB {
+
+	/*! @brief %Audio functionality */
+	namespace Audio {
+
+		/*!
+		 * @brief Sample conversion kernels shared by the decoders
+		 *
+		 * Each kernel has a portable scalar implementation and, where it pays off, SSE2, AVX2 and NEON implementations.
+		 * The fastest implementation supported by the processor is selected the first time a kernel is used.
+		 * Source and destination buffers need not be aligned.  Unless noted otherwise, source and destination
+		 * must not overlap.
+		 */
+		namespace SampleConversion {
+
+			/*! @brief Kernel implementations */
+			enum class Implementation {
+				Scalar,		/*!< Portable C++ */
+				SSE2,		/*!< x86 SSE2 */
+				AVX2,		/*!< x86 AVX2 */
+				NEON		/*!< ARM NEON */
+			};
+
+
+			// ========================================
+			/*! @name Implementation Selection */
+			//@{
+
+			/*! @brief Get the implementation currently in use */
+			Implementation GetImplementation();
+
+			/*! @brief Query whether \c implementation is supported by this processor and build */
+			bool IsImplementationAvailable(Implementation implementation);
+
+			/*!
+			 * @brief Select the implementation to use
+			 * @note This is intended for benchmarking and verification; by default the fastest available implementation is used
+			 * @param implementation The desired implementation
+			 * @return \c true on success, \c false if \c implementation is not available
+			 */
+			bool SetImplementation(Implementation implementation);
+
+			/*! @brief Get a human-readable name for \c implementation */
+			const char * GetImplementationName(Implementation implementation);
+
+			//@}
+
+
+			// ========================================
+			/*! @name Interleaving and Deinterleaving */
+			//@{
+
+			/*!
+			 * @brief Deinterleave \c float samples
+			 * @param src The interleaved samples
+			 * @param dst An array of \c channels destination buffers, each with space for \c frames samples
+			 * @param channels The number of channels
+			 * @param frames The number of frames
+			 */
+			void DeinterleaveFloat(const float *src, float * const *dst, unsigned channels, size_t frames);
+
+			/*!
+			 * @brief Deinterleave 32-bit integer samples, shifting each one left by \c shift bits
+			 * @param src The interleaved samples
+			 * @param dst An array of \c channels destination buffers, each with space for \c frames samples
+			 * @param channels The number of channels
+			 * @param frames The number of frames
+			 * @param shift The number of bits to shift left, typically to convert low-aligned samples to high alignment
+			 */
+			void DeinterleaveInt32(const int32_t *src, int32_t * const *dst, unsigned channels, size_t frames, unsigned shift = 0);
+
+			/*!
+			 * @brief Deinterleave 32-bit integer samples and convert them to \c float
+			 * @param src The interleaved samples
+			 * @param dst An array of \c channels destination buffers, each with space for \c frames samples
+			 * @param channels The number of channels
+			 * @param frames The number of frames
+			 * @param scale The factor each sample is multiplied by after conversion, for example \c 1/32768 for 16-bit samples
+			 */
+			void DeinterleaveInt32ToFloat(const int32_t *src, float * const *dst, unsigned channels, size_t frames, float scale);
+
+			/*!
+			 * @brief Interleave \c float samples
+			 * @param src An array of \c channels source buffers, each containing \c frames samples
+			 * @param dst The destination buffer, with space for \c channels * \c frames samples
+			 * @param channels The number of channels
+			 * @param frames The number of frames
+			 */
+			void InterleaveFloat(const float * const *src, float *dst, unsigned channels, size_t frames);
+
+			/*!
+			 * @brief Interleave 32-bit integer samples
+			 * @param src An array of \c channels source buffers, each containing \c frames samples
+			 * @param dst The destination buffer, with space for \c channels * \c frames samples
+			 * @param channels The number of channels
+			 * @param frames The number of frames
+			 */
+			void InterleaveInt32(const int32_t * const *src, int32_t *dst, unsigned channels, size_t frames);
+
+			/*!
+			 * @brief Deinterleave \c float samples into the buffers of an \c AudioBufferList
+			 * @note \c dst must contain at least \c channels buffers, and their \c mDataByteSize fields are not modified
+			 * @param dstOffset The frame offset in each destination buffer at which to begin writing
+			 */
+			void DeinterleaveFloat(const float *src, AudioBufferList *dst, unsigned channels, size_t frames, size_t dstOffset = 0);
+
+			/*!
+			 * @brief Deinterleave 32-bit integer samples into the buffers of an \c AudioBufferList
+			 * @note \c dst must contain at least \c channels buffers, and their \c mDataByteSize fields are not modified
+			 * @param dstOffset The frame offset in each destination buffer at which to begin writing
+			 */
+			void DeinterleaveInt32(const int32_t *src, AudioBufferList *dst, unsigned channels, size_t frames, unsigned shift = 0, size_t dstOffset = 0);
+
+			/*!
+			 * @brief Deinterleave 32-bit integer samples into the \c float buffers of an \c AudioBufferList
+			 * @note \c dst must contain at least \c channels buffers, and their \c mDataByteSize fields are not modified
+			 * @param dstOffset The frame offset in each destination buffer at which to begin writing
+			 */
+			void DeinterleaveInt32ToFloat(const int32_t *src, AudioBufferList *dst, unsigned channels, size_t frames, float scale, size_t dstOffset = 0);
+
+			//@}
+
+
+			// ========================================
+			/*! @name Format Conversion */
+			//@{
+
+			/*!
+			 * @brief Shift 32-bit integer samples left by \c shift bits
+			 * @note \c src and \c dst may be the same buffer
+			 */
+			void ShiftInt32(const int32_t *src, int32_t *dst, size_t count, unsigned shift);
+
+			/*!
+			 * @brief Shift 32-bit integer samples left by \c shift bits and narrow them to 16 bits
+			 * @note The shifted samples must fit in 16 bits
+			 */
+			void ConvertInt32ToInt16(const int32_t *src, int16_t *dst, size_t count, unsigned shift = 0);
+
+			/*!
+			 * @brief Shift 32-bit integer samples left by \c shift bits and narrow them to 8 bits
+			 * @note The shifted samples must fit in 8 bits
+			 */
+			void ConvertInt32ToInt8(const int32_t *src, int8_t *dst, size_t count, unsigned shift = 0);
+
+			/*!
+			 * @brief Shift 32-bit integer samples left by \c shift bits and pack them as native-endian 24-bit samples
+			 * @note The shifted samples must fit in 24 bits, and \c dst must have space for \c 3 * \c count bytes
+			 */
+			void ConvertInt32ToPackedInt24(const int32_t *src, uint8_t *dst, size_t count, unsigned shift = 0);
+
+			/*!
+			 * @brief Convert 32-bit integer samples to \c float, multiplying each by \c scale
+			 * @note \c src and \c dst may be the same buffer
+			 */
+			void ConvertInt32ToFloat(const int32_t *src, float *dst, size_t count, float scale);
+
+			/*!
+			 * @brief Convert \c float samples to 32-bit integers, multiplying each by \c scale
+			 *
+			 * The scaled samples are rounded to the nearest integer and clipped to [-\c scale, \c scale - 1],
+			 * so a \c scale of \c 32768 produces 16-bit values
+			 * @note \c src and \c dst may be the same buffer
+			 */
+			void ConvertFloatToInt32(const float *src, int32_t *dst, size_t count, float scale);
+
+			/*!
+			 * @brief Clip \c float samples to [\c minValue, \c maxValue]
+			 * @note \c src and \c dst may be the same buffer
+			 */
+			void ClipFloat(const float *src, float *dst, size_t count, float minValue, float maxValue);
+
+			//@}
+
+		}
+	}
+}
@@ -0,0 +1,468 @@
+/*
+ *  Copyright (C) 2013 Stephen F. Booth <me@sbooth.org>
+ *  All Rights Reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    - Neither the name of Stephen F. Booth nor the names of its 
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <algorithm>
+#include <cerrno>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#include <Accelerate/Accelerate.h>
+
+#include "Waveform.h"
+#include "AudioDecoder.h"
+#include "AudioConverter.h"
+#include "AudioBufferList.h"
+#include "CacheKey.h"
+#include "CFWrapper.h"
+#include "Logger.h"
+
+// Each level has this many times as many frames per bucket as the preceding level
+#define LEVEL_FACTOR 4
+
+// The number of frames converted at once
+#define BUFFER_SIZE_FRAMES 4096
+
+// Files shorter than this many frames per thread are analyzed serially
+#define MIN_REGION_SIZE_FRAMES (4 * SFB::Audio::Waveform::MaximumFramesPerBucket)
+
+// Identifies waveform files; the trailing digit is the format version
+#define WAVEFORM_FILE_MAGIC "SFBWAVE1"
+
+const UInt32 SFB::Audio::Waveform::MinimumFramesPerBucket;
+const UInt32 SFB::Audio::Waveform::MaximumFramesPerBucket;
+
+namespace {
+
+	std::mutex sCacheMutex;
+	std::string sCacheDirectoryPath;
+
+	// A bucket being computed
+	struct Accumulator
+	{
+		Accumulator()
+			: mMinimum(FLT_MAX), mMaximum(-FLT_MAX), mSumOfSquares(0), mFrameCount(0)
+		{}
+
+		float	mMinimum;
+		float	mMaximum;
+		double	mSumOfSquares;
+		UInt32	mFrameCount;
+	};
+
+	// One vector of buckets per channel
+	typedef std::vector<std::vector<Accumulator>> Accumulators;
+
+	// Adds frameCount frames of non-interleaved float audio starting at firstFrame to the finest level's buckets
+	void Accumulate(const AudioBufferList *bufferList, UInt32 frameCount, SInt64 firstFrame, Accumulators& accumulators)
+	{
+		const UInt32 framesPerBucket = SFB::Audio::Waveform::MinimumFramesPerBucket;
+
+		for(UInt32 channel = 0; channel < bufferList->mNumberBuffers; ++channel) {
+			const float *samples = (const float *)bufferList->mBuffers[channel].mData;
+			auto& buckets = accumulators[channel];
+
+			UInt32 offset = 0;
+			while(offset < frameCount) {
+				SInt64 frame = firstFrame + offset;
+				size_t index = (size_t)(frame / framesPerBucket);
+				UInt32 count = std::min(frameCount - offset, framesPerBucket - (UInt32)(frame % framesPerBucket));
+
+				if(index >= buckets.size())
+					buckets.resize(index + 1);
+
+				float minimum, maximum, sumOfSquares;
+				vDSP_minv(samples + offset, 1, &minimum, count);
+				vDSP_maxv(samples + offset, 1, &maximum, count);
+				vDSP_svesq(samples + offset, 1, &sumOfSquares, count);
+
+				auto& bucket = buckets[index];
+				bucket.mMinimum			= std::min(bucket.mMinimum, minimum);
+				bucket.mMaximum			= std::max(bucket.mMaximum, maximum);
+				bucket.mSumOfSquares	+= sumOfSquares;
+				bucket.mFrameCount		+= count;
+
+				offset += count;
+			}
+		}
+	}
+
+	// Converts and accumulates up to frameLimit frames (all frames if -1), returning the number of frames analyzed
+	SInt64 AnalyzeFrames(SFB::Audio::Converter& converter, SInt64 frameLimit, Accumulators& accumulators)
+	{
+		SFB::Audio::BufferList bufferList(converter.GetFormat(), BUFFER_SIZE_FRAMES);
+		if(!bufferList)
+			return -1;
+
+		SInt64 framesAnalyzed = 0;
+		while(-1 == frameLimit || framesAnalyzed < frameLimit) {
+			bufferList.Reset();
+
+			UInt32 frameCount = converter.ConvertAudio(bufferList, BUFFER_SIZE_FRAMES);
+			if(0 == frameCount)
+				break;
+
+			if(-1 != frameLimit)
+				frameCount = (UInt32)std::min((SInt64)frameCount, frameLimit - framesAnalyzed);
+
+			Accumulate(bufferList, frameCount, framesAnalyzed, accumulators);
+			framesAnalyzed += frameCount;
+		}
+
+		return framesAnalyzed;
+	}
+
+	SFB::Audio::Waveform::Bucket BucketForAccumulator(const Accumulator& accumulator)
+	{
+		if(0 == accumulator.mFrameCount)
+			return { 0, 0, 0 };
+		return { accumulator.mMinimum, accumulator.mMaximum, (float)std::sqrt(accumulator.mSumOfSquares / accumulator.mFrameCount) };
+	}
+
+}
+
+#pragma mark Creation
+
+SFB::Audio::Waveform::unique_ptr SFB::Audio::Waveform::CreateWaveformForURL(CFURLRef url, unsigned threadCount, CFErrorRef *error)
+{
+	if(nullptr == url)
+		return nullptr;
+
+	auto inputSource = InputSource::CreateInputSourceForURL(url, 0, error);
+	if(!inputSource || !inputSource->Open(error))
+		return nullptr;
+
+	std::string directory;
+	{
+		std::lock_guard<std::mutex> lock(sCacheMutex);
+		directory = sCacheDirectoryPath;
+	}
+
+	std::string key, path;
+	if(!directory.empty() && SFB::CreateCacheKeyForInputSource(*inputSource, "Waveform", key))
+		path = SFB::GetCachePathForKey(directory, key, "waveform");
+
+	unique_ptr waveform(new Waveform);
+	if(!path.empty() && waveform->Load(path, key))
+		return waveform;
+
+	if(!waveform->Analyze(std::move(inputSource), threadCount, error))
+		return nullptr;
+
+	if(!path.empty())
+		waveform->Save(path, key);
+
+	return waveform;
+}
+
+void SFB::Audio::Waveform::SetCacheDirectory(CFURLRef url)
+{
+	std::string path;
+	if(url) {
+		UInt8 buf [PATH_MAX];
+		if(!CFURLGetFileSystemRepresentation(url, TRUE, buf, PATH_MAX)) {
+			LOGGER_WARNING("org.sbooth.AudioEngine.Waveform", "Invalid cache directory: " << url);
+			return;
+		}
+		path = (const char *)buf;
+	}
+
+	std::lock_guard<std::mutex> lock(sCacheMutex);
+	sCacheDirectoryPath = path;
+}
+
+SFB::Audio::Waveform::Waveform()
+	: mSampleRate(0), mChannelCount(0), mTotalFrames(0)
+{}
+
+#pragma mark Levels
+
+const SFB::Audio::Waveform::Bucket * SFB::Audio::Waveform::GetBuckets(size_t level, UInt32 channel) const
+{
+	if(level >= mLevels.size() || channel >= mChannelCount)
+		return nullptr;
+	return mLevels[level].mBuckets.data() + (channel * mLevels[level].mBucketCount);
+}
+
+size_t SFB::Audio::Waveform::GetLevelForFramesPerPixel(double framesPerPixel) const
+{
+	size_t level = 0;
+	while(level + 1 < mLevels.size() && mLevels[level + 1].mFramesPerBucket <= framesPerPixel)
+		++level;
+	return level;
+}
+
+#pragma mark Analysis
+
+bool SFB::Audio::Waveform::Analyze(InputSource::unique_ptr inputSource, unsigned threadCount, CFErrorRef *error)
+{
+	SFB::CFURL url = (CFURLRef)CFRetain(inputSource->GetURL());
+
+	auto decoder = Decoder::CreateDecoderForInputSource(std::move(inputSource), error);
+	if(!decoder || (!decoder->IsOpen() && !decoder->Open(error)))
+		return false;
+
+	AudioStreamBasicDescription decoderFormat = decoder->GetFormat();
+
+	mSampleRate		= decoderFormat.mSampleRate;
+	mChannelCount	= decoderFormat.mChannelsPerFrame;
+
+	AudioStreamBasicDescription format;
+
+	format.mFormatID			= kAudioFormatLinearPCM;
+	format.mFormatFlags			= kAudioFormatFlagsNativeFloatPacked | kAudioFormatFlagIsNonInterleaved;
+
+	format.mSampleRate			= decoderFormat.mSampleRate;
+	format.mChannelsPerFrame	= decoderFormat.mChannelsPerFrame;
+	format.mBitsPerChannel		= 32;
+
+	format.mBytesPerPacket		= 4;
+	format.mFramesPerPacket		= 1;
+	format.mBytesPerFrame		= 4;
+
+	format.mReserved			= 0;
+
+	if(0 == threadCount)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	// Regions are sized from the file's length, so an estimated length would truncate or misalign them;
+	// such files are analyzed serially to the end so the result (and the cached copy) is complete
+	SInt64 totalFrames = decoder->GetTotalFrames();
+	if(decoder->SupportsSeeking() && 0 < totalFrames && decoder->TotalFramesAreExact())
+		threadCount = (unsigned)std::min((SInt64)threadCount, totalFrames / MIN_REGION_SIZE_FRAMES);
+	else
+		threadCount = 1;
+
+	Accumulators accumulators(mChannelCount);
+	bool analyzed = false;
+
+	// Divide the file into regions aligned to the coarsest level's buckets and analyze them concurrently
+	if(1 < threadCount) {
+		decoder.reset();
+
+		SInt64 regionSize = (totalFrames + threadCount - 1) / threadCount;
+		regionSize = ((regionSize + MaximumFramesPerBucket - 1) / MaximumFramesPerBucket) * MaximumFramesPerBucket;
+
+		std::vector<Accumulators> regionAccumulators(threadCount, Accumulators(mChannelCount));
+		std::vector<SInt64> regionFrames(threadCount, -1);
+		std::vector<std::thread> threads;
+
+		for(unsigned i = 0; i < threadCount; ++i) {
+			SInt64 startingFrame = i * regionSize;
+			UInt32 frameCount = (UInt32)std::min(regionSize, totalFrames - startingFrame);
+
+			threads.push_back(std::thread([&, i, startingFrame, frameCount]() {
+				pthread_setname_np("org.sbooth.AudioEngine.Waveform");
+
+				auto regionDecoder = Decoder::CreateDecoderForURLRegion(url, startingFrame, frameCount);
+				if(!regionDecoder)
+					return;
+
+				Converter converter(std::move(regionDecoder), format);
+				if(converter.Open())
+					regionFrames[i] = AnalyzeFrames(converter, frameCount, regionAccumulators[i]);
+			}));
+		}
+
+		for(auto& thread : threads)
+			thread.join();
+
+		// Every region except the last must be complete for the buckets to line up
+		analyzed = true;
+		for(unsigned i = 0; i < threadCount && analyzed; ++i) {
+			SInt64 expectedFrames = std::min(regionSize, totalFrames - i * regionSize);
+			analyzed = (regionFrames[i] == expectedFrames) || (i == threadCount - 1 && 0 < regionFrames[i]);
+		}
+
+		if(analyzed) {
+			mTotalFrames = 0;
+			for(unsigned i = 0; i < threadCount; ++i) {
+				for(UInt32 channel = 0; channel < mChannelCount; ++channel)
+					accumulators[channel].insert(accumulators[channel].end(), regionAccumulators[i][channel].begin(), regionAccumulators[i][channel].end());
+				mTotalFrames += regionFrames[i];
+			}
+		}
+		else {
+			LOGGER_NOTICE("org.sbooth.AudioEngine.Waveform", "Concurrent analysis failed for " << (CFURLRef)url << "; analyzing serially");
+
+			accumulators = Accumulators(mChannelCount);
+			decoder = Decoder::CreateDecoderForURL(url, error);
+			if(!decoder)
+				return false;
+		}
+	}
+
+	if(!analyzed) {
+		Converter converter(std::move(decoder), format);
+		if(!converter.Open(error))
+			return false;
+
+		mTotalFrames = AnalyzeFrames(converter, -1, accumulators);
+		if(-1 == mTotalFrames)
+			return false;
+	}
+
+	// Build each level from the preceding one
+	mLevels.clear();
+	for(UInt32 framesPerBucket = MinimumFramesPerBucket; framesPerBucket <= MaximumFramesPerBucket; framesPerBucket *= LEVEL_FACTOR) {
+		if(MinimumFramesPerBucket != framesPerBucket) {
+			for(auto& buckets : accumulators) {
+				Accumulators::value_type combined((buckets.size() + LEVEL_FACTOR - 1) / LEVEL_FACTOR);
+				for(size_t i = 0; i < buckets.size(); ++i) {
+					auto& bucket = combined[i / LEVEL_FACTOR];
+					bucket.mMinimum			= std::min(bucket.mMinimum, buckets[i].mMinimum);
+					bucket.mMaximum			= std::max(bucket.mMaximum, buckets[i].mMaximum);
+					bucket.mSumOfSquares	+= buckets[i].mSumOfSquares;
+					bucket.mFrameCount		+= buckets[i].mFrameCount;
+				}
+				buckets = std::move(combined);
+			}
+		}
+
+		Level level;
+		level.mFramesPerBucket	= framesPerBucket;
+		level.mBucketCount		= (size_t)((mTotalFrames + framesPerBucket - 1) / framesPerBucket);
+		level.mBuckets.resize(level.mBucketCount * mChannelCount, { 0, 0, 0 });
+
+		for(UInt32 channel = 0; channel < mChannelCount; ++channel) {
+			const auto& buckets = accumulators[channel];
+			for(size_t i = 0; i < std::min(buckets.size(), level.mBucketCount); ++i)
+				level.mBuckets[(channel * level.mBucketCount) + i] = BucketForAccumulator(buckets[i]);
+		}
+
+		mLevels.push_back(std::move(level));
+	}
+
+	return true;
+}
+
+#pragma mark Persistence
+
+bool SFB::Audio::Waveform::Save(const std::string& path, const std::string& key) const
+{
+	std::string temporaryPath = path + ".tmp";
+
+	FILE *file = fopen(temporaryPath.c_str(), "wb");
+	if(nullptr == file) {
+		LOGGER_WARNING("org.sbooth.AudioEngine.Waveform", "Unable to create \"" << temporaryPath << "\": " << strerror(errno));
+		return false;
+	}
+
+	uint32_t keyLength = (uint32_t)key.size();
+	uint32_t levelCount = (uint32_t)mLevels.size();
+
+	bool success = 1 == fwrite(WAVEFORM_FILE_MAGIC, 8, 1, file)
+		&& 1 == fwrite(&keyLength, sizeof(keyLength), 1, file)
+		&& keyLength == fwrite(key.data(), 1, keyLength, file)
+		&& 1 == fwrite(&mSampleRate, sizeof(mSampleRate), 1, file)
+		&& 1 == fwrite(&mChannelCount, sizeof(mChannelCount), 1, file)
+		&& 1 == fwrite(&mTotalFrames, sizeof(mTotalFrames), 1, file)
+		&& 1 == fwrite(&levelCount, sizeof(levelCount), 1, file);
+
+	for(auto& level : mLevels) {
+		if(!success)
+			break;
+
+		uint64_t bucketCount = level.mBucketCount;
+		success = 1 == fwrite(&level.mFramesPerBucket, sizeof(level.mFramesPerBucket), 1, file)
+			&& 1 == fwrite(&bucketCount, sizeof(bucketCount), 1, file)
+			&& (level.mBuckets.empty() || level.mBuckets.size() == fwrite(level.mBuckets.data(), sizeof(Bucket), level.mBuckets.size(), file));
+	}
+
+	if(0 != fclose(file))
+		success = false;
+
+	if(!success || 0 != rename(temporaryPath.c_str(), path.c_str())) {
+		LOGGER_WARNING("org.sbooth.AudioEngine.Waveform", "Unable to write \"" << path << "\": " << strerror(errno));
+		unlink(temporaryPath.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+bool SFB::Audio::Waveform::Load(const std::string& path, const std::string& key)
+{
+	FILE *file = fopen(path.c_str(), "rb");
+	if(nullptr == file)
+		return false;
+
+	char magic [8];
+	uint32_t keyLength = 0;
+	std::string fileKey;
+	uint32_t levelCount = 0;
+	std::vector<Level> levels;
+
+	// Guard against corrupt files requesting huge allocations
+	struct stat s;
+	bool success = 0 == fstat(fileno(file), &s)
+		&& 1 == fread(magic, sizeof(magic), 1, file) && !memcmp(magic, WAVEFORM_FILE_MAGIC, 8)
+		&& 1 == fread(&keyLength, sizeof(keyLength), 1, file) && keyLength == key.size();
+
+	if(success) {
+		fileKey.resize(keyLength);
+		success = keyLength == fread(&fileKey[0], 1, keyLength, file) && fileKey == key
+			&& 1 == fread(&mSampleRate, sizeof(mSampleRate), 1, file)
+			&& 1 == fread(&mChannelCount, sizeof(mChannelCount), 1, file)
+			&& 1 == fread(&mTotalFrames, sizeof(mTotalFrames), 1, file)
+			&& 1 == fread(&levelCount, sizeof(levelCount), 1, file) && 0 < levelCount && 32 >= levelCount;
+	}
+
+	for(uint32_t i = 0; success && i < levelCount; ++i) {
+		Level level;
+		uint64_t bucketCount = 0;
+		success = 1 == fread(&level.mFramesPerBucket, sizeof(level.mFramesPerBucket), 1, file)
+			&& 1 == fread(&bucketCount, sizeof(bucketCount), 1, file)
+			&& 0 != mChannelCount && bucketCount <= (uint64_t)s.st_size / (sizeof(Bucket) * mChannelCount);
+
+		if(success) {
+			level.mBucketCount = (size_t)bucketCount;
+			level.mBuckets.resize(level.mBucketCount * mChannelCount);
+			success = level.mBuckets.empty() || level.mBuckets.size() == fread(level.mBuckets.data(), sizeof(Bucket), level.mBuckets.size(), file);
+			levels.push_back(std::move(level));
+		}
+	}
+
+	fclose(file);
+
+	// A different file with the same hash is simply replaced on the next save
+	if(!success)
+		return false;
+
+	mLevels = std::move(levels);
+
+	return true;
+}
@@ -0,0 +1,185 @@
+/*
+ *  Copyright (C) 2013 Stephen F. Booth <me@sbooth.org>
+ *  All Rights Reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    - Neither the name of Stephen F. Booth nor the names of its 
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <CoreFoundation/CoreFoundation.h>
+#include <CoreAudio/CoreAudioTypes.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "InputSource.h"
+
+/*! @file Waveform.h @brief Multi-resolution waveform overviews */
+
+/*! @brief \c SFBAudioEngine's encompassing namespace */
+namespace SFB {
+
+	/*! @brief %Audio functionality */
+	namespace Audio {
+
+		/*!
+		 * @brief A multi-resolution summary of a file's audio, suitable for drawing waveform overviews
+		 *
+		 * A \c Waveform contains a pyramid of levels.  Each level divides the audio into buckets of equal length and
+		 * records the minimum, maximum and RMS sample values of each channel in each bucket.  The finest level has
+		 * \c Waveform::MinimumFramesPerBucket frames per bucket and each following level has four times as many,
+		 * up to \c Waveform::MaximumFramesPerBucket.  All levels are computed in a single decoding pass.
+		 *
+		 * When a cache directory is set, waveforms are saved there and loaded instead of being computed again.
+		 * Files are identified by URL and, for \c file URLs, size and modification date.
+		 */
+		class Waveform
+		{
+
+		public:
+
+			/*! @brief A \c std::unique_ptr for \c Waveform objects */
+			typedef std::unique_ptr<Waveform> unique_ptr;
+
+			/*! @brief The sample values of one channel in one bucket */
+			struct Bucket
+			{
+				float mMinimum;		/*!< @brief The minimum sample value */
+				float mMaximum;		/*!< @brief The maximum sample value */
+				float mRMS;			/*!< @brief The root mean square of the sample values */
+			};
+
+			/*! @brief The number of frames in each bucket of the finest level */
+			static const UInt32 MinimumFramesPerBucket = 256;
+
+			/*! @brief The number of frames in each bucket of the coarsest level */
+			static const UInt32 MaximumFramesPerBucket = 65536;
+
+
+			// ========================================
+			/*! @name Creation */
+			//@{
+
+			/*!
+			 * @brief Create a \c Waveform for the specified URL
+			 *
+			 * If a cached waveform for the URL exists it is returned immediately.  Otherwise the file is decoded,
+			 * on several threads if it supports seeking, and the waveform is cached.
+			 * @param url The URL
+			 * @param threadCount The number of threads to use, or \c 0 for one per processor
+			 * @param error An optional pointer to a \c CFErrorRef to receive error information
+			 * @return A \c Waveform object, or \c nullptr on failure
+			 */
+			static unique_ptr CreateWaveformForURL(CFURLRef url, unsigned threadCount = 0, CFErrorRef *error = nullptr);
+
+			/*!
+			 * @brief Set the directory used to cache waveforms
+			 * @param url The directory URL, or \c nullptr to disable caching (the default)
+			 */
+			static void SetCacheDirectory(CFURLRef url);
+
+			/*! @cond */
+
+			/*! @internal This class is non-copyable */
+			Waveform(const Waveform& rhs) = delete;
+
+			/*! @internal This class is non-assignable */
+			Waveform& operator=(const Waveform& rhs) = delete;
+
+			/*! @endcond */
+
+			//@}
+
+
+			// ========================================
+			/*! @name Audio information */
+			//@{
+
+			/*! @brief Get the sample rate of the audio */
+			inline Float64 GetSampleRate() const						{ return mSampleRate; }
+
+			/*! @brief Get the number of channels */
+			inline UInt32 GetChannelCount() const						{ return mChannelCount; }
+
+			/*! @brief Get the number of frames of audio */
+			inline SInt64 GetTotalFrames() const						{ return mTotalFrames; }
+
+			//@}
+
+
+			// ========================================
+			/*! @name Levels */
+			//@{
+
+			/*! @brief Get the number of levels */
+			inline size_t GetLevelCount() const							{ return mLevels.size(); }
+
+			/*! @brief Get the number of frames in each bucket of \c level */
+			inline UInt32 GetFramesPerBucket(size_t level) const		{ return mLevels[level].mFramesPerBucket; }
+
+			/*! @brief Get the number of buckets in \c level */
+			inline size_t GetBucketCount(size_t level) const			{ return mLevels[level].mBucketCount; }
+
+			/*!
+			 * @brief Get the buckets of one channel in \c level
+			 * @return An array of \c GetBucketCount() buckets
+			 */
+			const Bucket * GetBuckets(size_t level, UInt32 channel) const;
+
+			/*! @brief Get the coarsest level with no more than \c framesPerPixel frames per bucket */
+			size_t GetLevelForFramesPerPixel(double framesPerPixel) const;
+
+			//@}
+
+		private:
+
+			Waveform();
+
+			// Computes the waveform by decoding inputSource
+			bool Analyze(InputSource::unique_ptr inputSource, unsigned threadCount, CFErrorRef *error);
+
+			// Persistence
+			bool Load(const std::string& path, const std::string& key);
+			bool Save(const std::string& path, const std::string& key) const;
+
+			struct Level
+			{
+				UInt32					mFramesPerBucket;
+				size_t					mBucketCount;
+				std::vector<Bucket>		mBuckets;			// Each channel's buckets are contiguous
+			};
+
+			// Data members
+			Float64					mSampleRate;
+			UInt32					mChannelCount;
+			SInt64					mTotalFrames;
+			std::vector<Level>		mLevels;
+		};
+
+	}
+}